@@ -0,0 +1,147 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/mixed.h"
+
+// Measures how the CPU time of the space mixer grows with the number of
+// sources, both for plain speaker panning and for binaural rendering.
+// Without an HRTF table argument a synthetic one is generated.
+
+#define SAMPLERATE 48000
+#define SAMPLES 512
+#define BLOCKS 200
+#define MAX_SOURCES 1024
+#define SYNTHETIC_FILE "space-bench-hrtf.raw"
+#define DEG2RAD (3.14159265f/180.0f)
+
+double mtime(){
+  struct timespec spec;
+  if(clock_gettime(CLOCK_MONOTONIC, &spec) == 0){
+    return spec.tv_sec + ((double)spec.tv_nsec) / ((double)1E9);
+  }
+  return 0.0;
+}
+
+// Ten degree steps in azimuth on five elevation rings, with a simple
+// interaural level and time difference and a short decay.
+int write_synthetic_hrtf(const char *path){
+  uint32_t length = 256;
+  uint32_t header[5] = {0x5452484D, 1, SAMPLERATE, 36*5, length};
+  float *ir = calloc(2*length, sizeof(float));
+  FILE *file = fopen(path, "wb");
+  if(!file || !ir){
+    free(ir);
+    if(file) fclose(file);
+    return 0;
+  }
+  fwrite(header, sizeof(uint32_t), 5, file);
+  for(int e=-2; e<=2; ++e){
+    for(int a=0; a<36; ++a){
+      float angles[2] = {a*10.0f, e*30.0f};
+      float side = sinf(angles[0]*DEG2RAD) * cosf(angles[1]*DEG2RAD);
+      uint32_t delay = (uint32_t)(fabsf(side) * 30.0f);
+      memset(ir, 0, 2*length*sizeof(float));
+      for(uint32_t i=0; i+delay<length; ++i){
+        float decay = expf(-(float)i / 24.0f);
+        // Positive azimuths are to the left.
+        ir[0*length + i + (side < 0.0f? delay : 0)] = decay * (1.0f + side) * 0.5f;
+        ir[1*length + i + (side < 0.0f? 0 : delay)] = decay * (1.0f - side) * 0.5f;
+      }
+      fwrite(angles, sizeof(float), 2, file);
+      fwrite(ir, sizeof(float), 2*length, file);
+    }
+  }
+  fclose(file);
+  free(ir);
+  return 1;
+}
+
+// Mix the given number of sources scattered around the listener and
+// return the average time per block in seconds.
+double run(uint32_t sources, const char *hrtf){
+  double time = -1.0;
+  struct mixed_segment space = {0};
+  struct mixed_buffer *in = calloc(sources, sizeof(struct mixed_buffer));
+  struct mixed_buffer out[2] = {0};
+  if(!in) return -1.0;
+
+  if(!mixed_make_segment_space_mixer(SAMPLERATE, &space)
+     || !mixed_make_buffer(SAMPLES, &out[0])
+     || !mixed_make_buffer(SAMPLES, &out[1])
+     || !mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out[0], &space)
+     || !mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &out[1], &space)){
+    fprintf(stderr, "Failed to create space mixer: %s\n", mixed_error_string(-1));
+    goto cleanup;
+  }
+  if(hrtf && !mixed_segment_set(MIXED_SPACE_HRTF, (void *)hrtf, &space)){
+    fprintf(stderr, "Failed to load HRTF table: %s\n", mixed_error_string(-1));
+    goto cleanup;
+  }
+  srand(sources);
+  for(uint32_t s=0; s<sources; ++s){
+    float location[3] = {rand()%2000-1000.0f, rand()%400-200.0f, rand()%2000-1000.0f};
+    if(!mixed_make_buffer(SAMPLES, &in[s])
+       || !mixed_segment_set_in(MIXED_BUFFER, s, &in[s], &space)
+       || !mixed_segment_set_in(MIXED_SPACE_LOCATION, s, location, &space)){
+      fprintf(stderr, "Failed to add source: %s\n", mixed_error_string(-1));
+      goto cleanup;
+    }
+  }
+  if(!mixed_segment_start(&space)) goto cleanup;
+
+  double total = 0.0;
+  for(uint32_t b=0; b<BLOCKS; ++b){
+    for(uint32_t s=0; s<sources; ++s){
+      float *data;
+      uint32_t samples = SAMPLES;
+      mixed_buffer_request_write(&data, &samples, &in[s]);
+      for(uint32_t i=0; i<samples; ++i)
+        data[i] = (rand() / (float)RAND_MAX - 0.5f) * 0.01f;
+      mixed_buffer_finish_write(samples, &in[s]);
+    }
+    double start = mtime();
+    if(!mixed_segment_mix(&space)) goto cleanup;
+    total += mtime() - start;
+    mixed_buffer_clear(&out[0]);
+    mixed_buffer_clear(&out[1]);
+  }
+  mixed_segment_end(&space);
+  time = total / BLOCKS;
+
+ cleanup:
+  mixed_free_segment(&space);
+  for(uint32_t s=0; s<sources; ++s)
+    mixed_free_buffer(&in[s]);
+  free(in);
+  mixed_free_buffer(&out[0]);
+  mixed_free_buffer(&out[1]);
+  return time;
+}
+
+int main(int argc, char **argv){
+  const char *hrtf = SYNTHETIC_FILE;
+  double block = (double)SAMPLES / SAMPLERATE;
+
+  if(1 < argc){
+    hrtf = argv[1];
+  }else if(!write_synthetic_hrtf(SYNTHETIC_FILE)){
+    fprintf(stderr, "Failed to write the synthetic HRTF table.\n");
+    return 1;
+  }
+
+  printf("Sources   Panning ms  %%RT     Binaural ms  %%RT\n");
+  for(uint32_t sources=1; sources<=MAX_SOURCES; sources*=2){
+    double panning = run(sources, 0);
+    double binaural = run(sources, hrtf);
+    if(panning < 0.0 || binaural < 0.0) break;
+    printf("%7u   %10.3f  %6.2f  %11.3f  %6.2f\n", sources,
+           panning*1000.0, panning/block*100.0,
+           binaural*1000.0, binaural/block*100.0);
+  }
+
+  if(argc < 2) remove(SYNTHETIC_FILE);
+  return 0;
+}
@@ -0,0 +1,63 @@
+#include "internal.h"
+
+// Air absorbs high frequencies more the further sound travels. We model
+// this with a one-pole low-pass per source, whose cutoff falls from the
+// samplerate at the min distance to the configured cutoff at the max
+// distance. The coefficients are looked up from a table over the
+// normalised distance, and the filters of many sources are run together
+// as a bank, with the sources of the bank in the lanes of a vector.
+
+// Samples per source that are transposed into the bank at once.
+#define AIR_BANK_CHUNK 64
+
+void air_absorption_table(float cutoff, uint32_t samplerate, struct air_absorption_data *data){
+  data->cutoff = cutoff;
+  if(cutoff <= 0.0f) return;
+  float ratio = cutoff / samplerate;
+  for(uint32_t i=0; i<=AIR_TABLE_SIZE; ++i){
+    float t = (float)i / AIR_TABLE_SIZE;
+    float frequency = samplerate * powf(ratio, t);
+    data->table[i] = 1.0f - expf(-2.0f*M_PI*frequency/samplerate);
+  }
+}
+
+float air_absorption_coefficient(float min, float max, float distance, struct air_absorption_data *data){
+  if(max <= min) return data->table[0];
+  float t = CLAMP(0.0f, (distance - min) / (max - min), 1.0f) * AIR_TABLE_SIZE;
+  uint32_t i = MIN((uint32_t)t, AIR_TABLE_SIZE-1);
+  float f = t - i;
+  return data->table[i] + (data->table[i+1] - data->table[i]) * f;
+}
+
+// Filter the inputs of up to AIR_BANK_LANES sources in place.
+VECTORIZE void air_absorption_bank(uint32_t n, float *restrict ins[], uint32_t samples, const float *restrict coefficients, float *states[]){
+  float block[AIR_BANK_CHUNK][AIR_BANK_LANES] = {{0}};
+  float a[AIR_BANK_LANES] = {0};
+  float y[AIR_BANK_LANES] = {0};
+  for(uint32_t k=0; k<n; ++k){
+    a[k] = coefficients[k];
+    y[k] = *states[k];
+  }
+  for(uint32_t offset=0; offset<samples; offset+=AIR_BANK_CHUNK){
+    uint32_t chunk = MIN(AIR_BANK_CHUNK, samples-offset);
+    for(uint32_t k=0; k<n; ++k){
+      float *restrict in = ins[k]+offset;
+      for(uint32_t i=0; i<chunk; ++i)
+        block[i][k] = in[i];
+    }
+    // Every lane only depends on itself, so this runs across the vector.
+    for(uint32_t i=0; i<chunk; ++i){
+      for(uint32_t k=0; k<AIR_BANK_LANES; ++k){
+        y[k] += a[k] * (block[i][k] - y[k]);
+        block[i][k] = y[k];
+      }
+    }
+    for(uint32_t k=0; k<n; ++k){
+      float *restrict in = ins[k]+offset;
+      for(uint32_t i=0; i<chunk; ++i)
+        in[i] = block[i][k];
+    }
+  }
+  for(uint32_t k=0; k<n; ++k)
+    *states[k] = y[k];
+}
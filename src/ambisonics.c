@@ -0,0 +1,45 @@
+#include "internal.h"
+
+// Real spherical harmonics in ACN channel order with SN3D normalisation,
+// as used by the AmbiX format. The direction is given in our usual frame
+// of X+ right, Y+ up, Z+ forward, and has to be normalised. Ambisonics
+// uses X+ forward, Y+ left, Z+ up instead, so we swizzle first.
+void ambisonic_encode(const float direction[3], uint32_t order, float *restrict gains){
+  float x = direction[2];
+  float y = -direction[0];
+  float z = direction[1];
+
+  gains[0] = 1.0f;
+  if(order < 1) return;
+  gains[1] = y;
+  gains[2] = z;
+  gains[3] = x;
+  if(order < 2) return;
+  float x2 = x*x, y2 = y*y, z2 = z*z;
+  gains[4] = 1.7320508f * x*y;
+  gains[5] = 1.7320508f * y*z;
+  gains[6] = 0.5f * (3.0f*z2 - 1.0f);
+  gains[7] = 1.7320508f * x*z;
+  gains[8] = 0.8660254f * (x2 - y2);
+  if(order < 3) return;
+  gains[9] = 0.7905694f * y*(3.0f*x2 - y2);
+  gains[10] = 3.8729833f * x*y*z;
+  gains[11] = 0.6123724f * y*(5.0f*z2 - 1.0f);
+  gains[12] = 0.5f * z*(5.0f*z2 - 3.0f);
+  gains[13] = 0.6123724f * x*(5.0f*z2 - 1.0f);
+  gains[14] = 1.9364917f * z*(x2 - y2);
+  gains[15] = 0.7905694f * x*(x2 - 3.0f*y2);
+}
+
+// The weight of each order for a max-rE decoder, which trades some
+// localisation precision for a tighter energy spread and fewer side lobes.
+void ambisonic_max_re_weights(uint32_t order, float weights[AMBISONIC_MAX_ORDER+1]){
+  float c = cosf(2.40681f / (order + 1.51f)); // 137.9° in radians
+  weights[0] = 1.0f;
+  weights[1] = c;
+  weights[2] = 0.5f * (3.0f*c*c - 1.0f);
+  weights[3] = 0.5f * c*(5.0f*c*c - 3.0f);
+  for(uint32_t l=order+1; l<=AMBISONIC_MAX_ORDER; ++l){
+    weights[l] = 0.0f;
+  }
+}
@@ -116,6 +116,31 @@ static inline int bip_finish_read(uint32_t size, struct bip *buffer){
   return 1;
 }
 
+// Move the read position over to the second region, if the first one
+// has been read completely and the writer has moved on. Returns whether
+// the read position wrapped.
+static inline int bip_wrap_read(struct bip *buffer){
+  read_buffer_state(read, write, full_r2, buffer);
+  if(!full_r2 || read < buffer->size || write == 0) return 0;
+ retry:
+  if(!atomic_cas(buffer->write, write_, write)){
+    write_ = atomic_read(buffer->write);
+    write = write_ & 0x7FFFFFFF;
+    goto retry;
+  }
+  atomic_write(buffer->read, 0);
+  return 1;
+}
+
+// The end of the region the reader is currently in. This is the end of
+// the buffer while the second region is pending, and the write position
+// otherwise.
+static inline uint32_t bip_read_end(struct bip *buffer){
+  read_buffer_state(read, write, full_r2, buffer);
+  IGNORE(read);
+  return full_r2? buffer->size : write;
+}
+
 static inline void bip_discard(struct bip *buffer){
   atomic_write(buffer->read, 0);
   atomic_write(buffer->write, 0);
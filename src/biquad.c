@@ -5,19 +5,21 @@
 
 extern inline float biquad_sample(float sample, struct biquad_data *state);
 
-VECTORIZE void biquad_process(struct mixed_buffer *input, struct mixed_buffer *output, struct biquad_data *state){
-  float b0 = state->b[0];
-  float b1 = state->b[1];
-  float b2 = state->b[2];
-  float a1 = state->a[0];
-  float a2 = state->a[1];
-  float xn1 = state->x[0];
-  float xn2 = state->x[1];
-  float yn1 = state->y[0];
-  float yn2 = state->y[1];
-
-  with_mixed_buffer_transfer(i, samples, inv, input, outv, output, {
-      float xn0 = inv[i];
+// The recursion is serial, so only the fused multiply-adds of the wider
+// tiers shorten it.
+DEF_KERNEL(biquad_kernel, (const float *in, float *out, uint32_t samples, struct biquad_data *state), {
+    float b0 = state->b[0];
+    float b1 = state->b[1];
+    float b2 = state->b[2];
+    float a1 = state->a[0];
+    float a2 = state->a[1];
+    float xn1 = state->x[0];
+    float xn2 = state->x[1];
+    float yn1 = state->y[0];
+    float yn2 = state->y[1];
+
+    for(uint32_t i=0; i<samples; ++i){
+      float xn0 = in[i];
       float L =
         b0 * xn0 +
         b1 * xn1 +
@@ -29,13 +31,33 @@ VECTORIZE void biquad_process(struct mixed_buffer *input, struct mixed_buffer *o
       xn1 = xn0;
       yn2 = yn1;
       yn1 = L;
-      outv[i] = L;
-    });
+      out[i] = L;
+    }
 
-  state->x[0] = xn1;
-  state->x[1] = xn2;
-  state->y[0] = yn1;
-  state->y[1] = yn2;
+    state->x[0] = xn1;
+    state->x[1] = xn2;
+    state->y[0] = yn1;
+    state->y[1] = yn2;
+  })
+
+void biquad_kernels(uint32_t features, struct kernel_table *table){
+  table->biquad = KERNEL_TIER(biquad_kernel, features);
+}
+
+void biquad_process(struct mixed_buffer *input, struct mixed_buffer *output, struct biquad_data *state){
+  biquad_kernel process = kernels()->biquad;
+  uint32_t samples = UINT32_MAX;
+  float *in, *out;
+  if(input == output){
+    mixed_buffer_request_read(&in, &samples, input);
+    process(in, in, samples, state);
+  }else{
+    mixed_buffer_request_read(&in, &samples, input);
+    mixed_buffer_request_write(&out, &samples, output);
+    process(in, out, samples, state);
+    mixed_buffer_finish_read(samples, input);
+    mixed_buffer_finish_write(samples, output);
+  }
 }
 
 extern inline void biquad_reset(struct biquad_data *state);
@@ -21,6 +21,8 @@ MIXED_EXPORT uint8_t mixed_samplesize(enum mixed_encoding encoding){
   case MIXED_UINT32: return 4;
   case MIXED_FLOAT: return 4;
   case MIXED_DOUBLE: return 8;
+  case MIXED_FLOAT16: return 2;
+  case MIXED_BFLOAT16: return 2;
   default: return -1;
   }
 }
@@ -34,7 +36,7 @@ int mix_noop(struct mixed_segment *segment){
   return 1;
 }
 
-PFFFT_Setup *ffts[16] = {0};
+static PFFFT_Setup *ffts[16] = {0};
 #define LOG2(X) ((unsigned) (8*sizeof (unsigned long long) - __builtin_clzll((X)) - 1))
 
 PFFFT_Setup *ensure_ffts(uint32_t framesize){
@@ -45,30 +47,49 @@ PFFFT_Setup *ensure_ffts(uint32_t framesize){
   }
   pow -= 3;
 
-  if(ffts[pow] == 0){
-    ffts[pow] = pffft_new_setup(framesize, PFFFT_COMPLEX);
-    if(ffts[pow] == 0){
+  PFFFT_Setup *setup = atomic_read(ffts[pow]);
+  if(setup == 0){
+    // Setups are read-only once made, so if we race another thread to
+    // create one we can simply discard ours and use theirs instead.
+    setup = pffft_new_setup(framesize, PFFFT_REAL);
+    if(setup == 0){
       mixed_err(MIXED_OUT_OF_MEMORY);
       return 0;
     }
+    if(!atomic_cas(ffts[pow], (PFFFT_Setup *)0, setup)){
+      pffft_destroy_setup(setup);
+      setup = atomic_read(ffts[pow]);
+    }
   }
-  return ffts[pow];
+  return setup;
 }
 
-MIXED_EXPORT int mixed_fwd_fft(uint32_t framesize, float *in, float *out){
+int fft_fwd(uint32_t framesize, float *in, float *out, float *work){
   PFFFT_Setup *f = ensure_ffts(framesize);
   if(!f) return 0;
-  pffft_transform_ordered(f, in, out, 0, PFFFT_FORWARD);
+  pffft_transform_ordered(f, in, out, work, PFFFT_FORWARD);
   return 1;
 }
 
-MIXED_EXPORT int mixed_inv_fft(uint32_t framesize, float *in, float *out){
+int fft_inv(uint32_t framesize, float *in, float *out, float *work){
   PFFFT_Setup *f = ensure_ffts(framesize);
   if(!f) return 0;
-  pffft_transform_ordered(f, in, out, 0, PFFFT_BACKWARD);
+  pffft_transform_ordered(f, in, out, work, PFFFT_BACKWARD);
   return 1;
 }
 
+MIXED_EXPORT int mixed_prepare_fft(uint32_t framesize){
+  return ensure_ffts(framesize) != 0;
+}
+
+MIXED_EXPORT int mixed_fwd_fft(uint32_t framesize, float *in, float *out){
+  return fft_fwd(framesize, in, out, 0);
+}
+
+MIXED_EXPORT int mixed_inv_fft(uint32_t framesize, float *in, float *out){
+  return fft_inv(framesize, in, out, 0);
+}
+
 MIXED_EXPORT extern inline float mixed_from_db(mixed_decibel_t volume);
 MIXED_EXPORT extern inline  mixed_decibel_t mixed_to_db(float volume);
 
@@ -224,6 +245,12 @@ MIXED_EXPORT const char *mixed_type_string(int code){
     return "duration (s)";
   case MIXED_CHANNEL_CONFIGURATION_POINTER:
     return "channel configuration pointer";
+  case MIXED_FFT_WINDOW_ENUM:
+    return "fft window";
+  case MIXED_CONVOLUTION_MODE_ENUM:
+    return "convolution mode";
+  case MIXED_VOLUME_MODE_ENUM:
+    return "volume mode";
   default:
     return "unknown";
   }
@@ -359,6 +386,42 @@ MIXED_EXPORT const char *mixed_segment_field_string(int code){
     return "equalizer bands";
   case MIXED_SPACE_SPATIAL:
     return "spatial";
+  case MIXED_FFT_WINDOW:
+    return "fft window";
+  case MIXED_CONVOLUTION_MODE:
+    return "convolution mode";
+  case MIXED_PARTITION_SIZE:
+    return "partition size";
+  case MIXED_BACKGROUND_PROCESSING:
+    return "background processing";
+  case MIXED_SPACE_MAX_VOICES:
+    return "max voices";
+  case MIXED_SPACE_AUDIBILITY_THRESHOLD:
+    return "audibility threshold";
+  case MIXED_SPACE_PRIORITY:
+    return "priority";
+  case MIXED_SPACE_ACTIVE_VOICES:
+    return "active voices";
+  case MIXED_SPACE_VIRTUAL_VOICES:
+    return "virtual voices";
+  case MIXED_THREAD_COUNT:
+    return "thread count";
+  case MIXED_AMBISONIC_ORDER:
+    return "ambisonic order";
+  case MIXED_SPACE_HRTF:
+    return "hrtf";
+  case MIXED_SOURCE_UPDATE:
+    return "source update";
+  case MIXED_SPACE_AIR_ABSORPTION:
+    return "air absorption";
+  case MIXED_VOLUME_MODE:
+    return "volume mode";
+  case MIXED_BACKGROUND_OVERRUNS:
+    return "background overruns";
+  case MIXED_DIRECT_CROSSOVER:
+    return "direct crossover";
+  case MIXED_SPACE_PROPAGATION_DELAY:
+    return "propagation delay";
   default:
     return "unknown";
   }
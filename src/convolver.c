@@ -0,0 +1,477 @@
+#include "internal.h"
+#include "pffft.h"
+
+// Non-uniformly partitioned overlap-save convolution.
+//
+// Any number of FIRs may share the same input, in which case the input
+// spectra are computed only once and each FIR only adds its own
+// multiply-accumulate and inverse transform.
+//
+// The FIR is cut into stages of growing block sizes. Each stage runs a
+// uniformly partitioned convolution over its part of the FIR, with a
+// frequency domain delay line of past input spectra. A stage with block
+// size B only needs to produce output once every B samples, and it may
+// do so late by up to its offset into the FIR minus the head block size.
+// Choosing the stage offsets accordingly means that only the head stage
+// dictates the latency, while the long tail is handled by few, large
+// partitions.
+//
+// In background mode every stage after the head is instead computed by a
+// worker thread. The audio thread hands a stage's input block over when
+// it becomes due and collects the result once the stage is due again,
+// giving the worker a deadline of one full block of that stage. To make
+// room for that extra block of delay, the stages are planned such that
+// each offset also covers twice its block size. The handoff only goes
+// through the stage's atomic state and a semaphore post, so the audio
+// thread never blocks on a lock the worker holds.
+//
+// The audio thread polls for at most CONVOLVER_MAX_WAIT on a late result.
+// After that it counts an overrun and drops the stage's output for the
+// block instead. As the stage missed an input block as well, its delay
+// line is cleared once the worker is done with it, so that the stage's
+// part of the tail is silent until the delay line has refilled, rather
+// than playing misaligned.
+
+#define CONVOLVER_GROWTH 4
+#define CONVOLVER_MAX_BLOCK 8192
+// In nanoseconds.
+#define CONVOLVER_MAX_WAIT 500000
+#define CONVOLVER_POLL 20000
+// The quit value that also hands the convolver over to its worker.
+#define CONVOLVER_RETIRED 2
+
+static uint32_t ring_size(uint32_t size){
+  uint32_t v = 1;
+  while(v < size) v <<= 1;
+  return v;
+}
+
+static int plan_stages(uint32_t head, uint32_t fir_size, bool background, struct convolver_data *data){
+  uint32_t delay = (background)? 2 : 1;
+  uint32_t offset = 0;
+  uint32_t block = head;
+  data->stage_count = 0;
+  while(offset < fir_size){
+    if(CONVOLVER_MAX_STAGES <= data->stage_count){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    struct convolver_stage *stage = &data->stages[data->stage_count++];
+    uint32_t remaining = 1 + (fir_size - offset - 1) / block;
+    uint32_t next = block * CONVOLVER_GROWTH;
+    uint32_t count = remaining;
+    if(next <= CONVOLVER_MAX_BLOCK){
+      // Cover enough of the FIR that the next stage's offset hides its block latency.
+      count = MAX(1, (delay*next - head - offset + block - 1) / block);
+      count = MIN(count, remaining);
+    }
+    stage->block_size = block;
+    stage->offset = offset;
+    stage->partition_count = count;
+    stage->background = background && 0 < offset;
+    offset += count * block;
+    if(next <= CONVOLVER_MAX_BLOCK) block = next;
+  }
+  return 1;
+}
+
+static void convolver_stage_transform(struct convolver_stage *stage, uint32_t outputs, float *restrict work, float *restrict scratch);
+
+#ifdef MIXED_THREADS
+static void *convolver_worker(void *arg){
+  struct convolver_data *data = (struct convolver_data *)arg;
+  for(;;){
+    semaphore_wait(&data->signal);
+    int quit = atomic_read(data->quit);
+    if(quit == CONVOLVER_RETIRED){
+      // Nobody is going to join us, so clean up after ourselves.
+      pthread_detach(pthread_self());
+      semaphore_destroy(&data->signal);
+      data->threaded = 0;
+      free_convolver_data(data);
+      mixed_free(data);
+      break;
+    }
+    if(quit) break;
+    // Stages are ordered by block size, so the earliest deadline comes first.
+    for(uint32_t s=0; s<data->stage_count; ++s){
+      struct convolver_stage *stage = &data->stages[s];
+      if(atomic_read(stage->state) == CONVOLVER_JOB_PENDING){
+        convolver_stage_transform(stage, data->outputs, stage->job, stage->job_scratch);
+        atomic_write(stage->state, CONVOLVER_JOB_DONE);
+      }
+    }
+  }
+  return 0;
+}
+
+// Poll the stage's job until the deadline, or without one if it is null.
+// Returns 0 if the job is still running. Each round sleeps briefly, which
+// leaves the core to the worker should it share one with us, without
+// overshooting the deadline by more than a round.
+static int convolver_wait(struct convolver_stage *stage, const struct timespec *deadline){
+  const struct timespec poll = {0, CONVOLVER_POLL};
+  while(atomic_read(stage->state) == CONVOLVER_JOB_PENDING){
+    if(deadline){
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if(deadline->tv_sec < now.tv_sec || (deadline->tv_sec == now.tv_sec && deadline->tv_nsec <= now.tv_nsec))
+        return (atomic_read(stage->state) != CONVOLVER_JOB_PENDING);
+    }
+    nanosleep(&poll, 0);
+  }
+  return 1;
+}
+
+static void convolver_deadline(struct timespec *deadline){
+  clock_gettime(CLOCK_MONOTONIC, deadline);
+  deadline->tv_nsec += CONVOLVER_MAX_WAIT;
+  if(1000000000 <= deadline->tv_nsec){
+    deadline->tv_sec += 1;
+    deadline->tv_nsec -= 1000000000;
+  }
+}
+#endif
+
+void free_convolver_data(struct convolver_data *data){
+#ifdef MIXED_THREADS
+  if(data->threaded){
+    atomic_write(data->quit, 1);
+    semaphore_post(&data->signal);
+    pthread_join(data->thread, 0);
+    semaphore_destroy(&data->signal);
+    data->threaded = 0;
+  }
+#endif
+  for(uint32_t s=0; s<data->stage_count; ++s){
+    FREE(data->stages[s].fir);
+  }
+  FREE(data->in_ring);
+  data->out_ring = 0;
+  data->work = 0;
+  data->scratch = 0;
+  data->stage_count = 0;
+}
+
+void retire_convolver_data(struct convolver_data *data){
+#ifdef MIXED_THREADS
+  if(data->threaded){
+    atomic_write(data->quit, CONVOLVER_RETIRED);
+    semaphore_post(&data->signal);
+    return;
+  }
+#endif
+  free_convolver_data(data);
+  mixed_free(data);
+}
+
+int make_convolver_data(float *fir, uint32_t fir_size, uint32_t outputs, uint32_t head, bool background, struct convolver_data *data){
+  uint32_t max_block = head, max_reach = head, size_used = 0;
+
+#ifndef MIXED_THREADS
+  if(background){
+    mixed_err(MIXED_NOT_IMPLEMENTED);
+    return 0;
+  }
+#endif
+  if(head < 16 || CONVOLVER_MAX_BLOCK < head || (head & (head-1)) != 0 || outputs == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
+  // Trim the common silent tail of all FIRs.
+  for(uint32_t o=0; o<outputs; ++o){
+    uint32_t size = fir_size;
+    while(size_used < size && fabs(fir[o*fir_size+size-1]) < 0.000001f){
+      --size;
+    }
+    size_used = MAX(size_used, size);
+  }
+
+  memset(data, 0, sizeof(struct convolver_data));
+  data->outputs = outputs;
+  if(!plan_stages(head, size_used, background, data))
+    return 0;
+
+  for(uint32_t s=0; s<data->stage_count; ++s){
+    struct convolver_stage *stage = &data->stages[s];
+    uint32_t block = stage->block_size;
+    uint32_t size = block*2;
+    uint32_t count = stage->partition_count;
+    stage->setup = ensure_ffts(size);
+    if(!stage->setup) goto cleanup;
+    // Spectra of the FIR partitions of each output followed by the input delay line.
+    uint32_t job_size = (stage->background)? size*(outputs+1) : 0;
+    stage->fir = aligned_calloc(64, count*size*(outputs+1) + job_size, sizeof(float));
+    if(!stage->fir){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      goto cleanup;
+    }
+    stage->delay_line = stage->fir + count*size*outputs;
+    if(stage->background){
+      stage->job = stage->delay_line + count*size;
+      stage->job_scratch = stage->job + size*outputs;
+    }
+    max_block = MAX(max_block, block);
+    max_reach = MAX(max_reach, stage->offset + head);
+  }
+
+  data->head = head;
+  data->in_size = ring_size(max_block*2);
+  data->out_size = ring_size(max_reach + max_block);
+  data->in_ring = aligned_calloc(64, data->in_size + data->out_size*outputs + max_block*2*(outputs+1), sizeof(float));
+  if(!data->in_ring){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    goto cleanup;
+  }
+  data->out_ring = data->in_ring + data->in_size;
+  data->work = data->out_ring + data->out_size*outputs;
+  data->scratch = data->work + max_block*2*outputs;
+
+  // Transform the partitions, pre-scaled to undo the unscaled inverse transform.
+  for(uint32_t s=0; s<data->stage_count; ++s){
+    struct convolver_stage *stage = &data->stages[s];
+    uint32_t block = stage->block_size;
+    uint32_t size = block*2;
+    for(uint32_t o=0; o<outputs; ++o){
+      for(uint32_t p=0; p<stage->partition_count; ++p){
+        uint32_t start = stage->offset + p*block;
+        uint32_t count = MIN(block, size_used - start);
+        float *source = fir + o*fir_size + start;
+        float *spectrum = stage->fir + (o*stage->partition_count + p)*size;
+        for(uint32_t k=0; k<count; ++k)
+          data->work[k] = source[k] / size;
+        memset(data->work+count, 0, (size-count)*sizeof(float));
+        pffft_transform(stage->setup, data->work, spectrum, data->scratch, PFFFT_FORWARD);
+      }
+    }
+  }
+
+#ifdef MIXED_THREADS
+  if(background && 1 < data->stage_count){
+    if(!semaphore_init(&data->signal)){
+      mixed_err(MIXED_INTERNAL_ERROR);
+      goto cleanup;
+    }
+    if(pthread_create(&data->thread, 0, convolver_worker, data) != 0){
+      semaphore_destroy(&data->signal);
+      mixed_err(MIXED_INTERNAL_ERROR);
+      goto cleanup;
+    }
+    data->threaded = 1;
+  }
+#endif
+  return 1;
+
+ cleanup:
+  free_convolver_data(data);
+  return 0;
+}
+
+void convolver_reset(struct convolver_data *data){
+  for(uint32_t s=0; s<data->stage_count; ++s){
+    struct convolver_stage *stage = &data->stages[s];
+#ifdef MIXED_THREADS
+    if(data->threaded)
+      convolver_wait(stage, 0);
+    atomic_write(stage->state, CONVOLVER_JOB_IDLE);
+#endif
+    memset(stage->delay_line, 0, stage->partition_count*stage->block_size*2*sizeof(float));
+    stage->index = 0;
+    stage->late = 0;
+  }
+  if(data->in_ring)
+    memset(data->in_ring, 0, (data->in_size + data->out_size*data->outputs)*sizeof(float));
+  data->time = 0;
+  data->fill = 0;
+}
+
+// Push the spectrum of the input at the start of work, and replace work by
+// the convolved output of each FIR, whose second halves are free of
+// circular aliasing.
+static void convolver_stage_transform(struct convolver_stage *stage, uint32_t outputs, float *restrict work, float *restrict scratch){
+  uint32_t size = stage->block_size*2;
+  uint32_t count = stage->partition_count;
+
+  float *current = stage->delay_line + stage->index*size;
+  pffft_transform(stage->setup, work, current, scratch, PFFFT_FORWARD);
+
+  for(uint32_t o=0; o<outputs; ++o){
+    float *result = work + o*size;
+    float *fir = stage->fir + o*count*size;
+    // Multiply-accumulate against the FIR partitions along the delay line.
+    memset(result, 0, size*sizeof(float));
+    uint32_t index = stage->index;
+    for(uint32_t p=0; p<count; ++p){
+      pffft_zconvolve_accumulate(stage->setup, stage->delay_line + index*size, fir + p*size, result, 1.0f);
+      index = (index == 0)? count-1 : index-1;
+    }
+    pffft_transform(stage->setup, result, result, scratch, PFFFT_BACKWARD);
+  }
+  stage->index = (stage->index+1) % count;
+}
+
+static void convolver_stage_collect(struct convolver_stage *stage, uint32_t target, float *restrict work, struct convolver_data *data){
+  uint32_t block = stage->block_size;
+  uint32_t size = block*2;
+  uint32_t out_mask = data->out_size-1;
+  for(uint32_t o=0; o<data->outputs; ++o){
+    float *restrict out_ring = data->out_ring + o*data->out_size;
+    float *restrict result = work + o*size + block;
+    for(uint32_t k=0; k<block; ++k)
+      out_ring[(target+k) & out_mask] += result[k];
+  }
+}
+
+static void convolver_stage_process(struct convolver_stage *stage, struct convolver_data *data){
+  uint32_t block = stage->block_size;
+  uint32_t size = block*2;
+  uint32_t in_mask = data->in_size-1;
+  uint32_t time = data->time;
+  float *restrict work = data->work;
+  float *restrict in_ring = data->in_ring;
+
+#ifdef MIXED_THREADS
+  if(stage->background){
+    // Collect the previous result, which is due now at the latest.
+    struct timespec deadline;
+    work = stage->job;
+    convolver_deadline(&deadline);
+    if(!convolver_wait(stage, &deadline)){
+      atomic_write(data->overruns, data->overruns+1);
+      stage->late = 1;
+      debug_log("%p Convolver stage %u overrun", (void*)data, stage->block_size);
+      return;
+    }
+    if(stage->late){
+      // The result is for a block that was already played.
+      memset(stage->delay_line, 0, stage->partition_count*stage->block_size*2*sizeof(float));
+      stage->index = 0;
+      stage->late = 0;
+    }else if(atomic_read(stage->state) == CONVOLVER_JOB_DONE){
+      convolver_stage_collect(stage, stage->target, work, data);
+    }
+  }
+#endif
+
+  // Gather the last two blocks of input.
+  uint32_t start = time - size;
+  for(uint32_t k=0; k<size; ++k)
+    work[k] = in_ring[(start+k) & in_mask];
+  // The output belongs to the input block that just finished, shifted by
+  // the stage's offset.
+  uint32_t target = time - block + stage->offset;
+
+#ifdef MIXED_THREADS
+  if(stage->background){
+    stage->target = target;
+    atomic_write(stage->state, CONVOLVER_JOB_PENDING);
+    semaphore_post(&data->signal);
+    return;
+  }
+#endif
+
+  convolver_stage_transform(stage, data->outputs, work, data->scratch);
+  convolver_stage_collect(stage, target, work, data);
+}
+
+VECTORIZE void convolver(float *in, float **out, uint32_t samples, struct convolver_data *data){
+  uint32_t head = data->head;
+  uint32_t outputs = data->outputs;
+  uint32_t in_mask = data->in_size-1;
+  uint32_t out_mask = data->out_size-1;
+  float *restrict in_ring = data->in_ring;
+
+  if(data->stage_count == 0){
+    for(uint32_t o=0; o<outputs; ++o)
+      memset(out[o], 0, samples*sizeof(float));
+    return;
+  }
+
+  for(uint32_t i=0; i<samples; ){
+    uint32_t block = MIN(samples - i, head - data->fill);
+    uint32_t in_pos = data->time + data->fill;
+    // The previous head block's output lags behind its input by one block.
+    uint32_t out_pos = data->time - head + data->fill;
+    for(uint32_t k=0; k<block; ++k){
+      in_ring[(in_pos+k) & in_mask] = in[i+k];
+    }
+    for(uint32_t o=0; o<outputs; ++o){
+      float *restrict out_ring = data->out_ring + o*data->out_size;
+      float *restrict target = out[o] + i;
+      for(uint32_t k=0; k<block; ++k){
+        uint32_t idx = (out_pos+k) & out_mask;
+        target[k] = out_ring[idx];
+        out_ring[idx] = 0.0f;
+      }
+    }
+    data->fill += block;
+    i += block;
+
+    if(data->fill == head){
+      data->fill = 0;
+      data->time += head;
+      for(uint32_t s=0; s<data->stage_count; ++s){
+        struct convolver_stage *stage = &data->stages[s];
+        if((data->time & (stage->block_size-1)) == 0)
+          convolver_stage_process(stage, data);
+      }
+    }
+  }
+}
+
+// Direct form convolution for short FIRs, without any latency. The FIR
+// is stored reversed, so that each tap scales a contiguous run of the
+// input history and the inner loop vectorises well.
+#define DIRECT_CHUNK 256
+
+void free_direct_convolver_data(struct direct_convolver_data *data){
+  FREE(data->fir);
+  data->history = 0;
+  data->size = 0;
+}
+
+int make_direct_convolver_data(float *fir, uint32_t fir_size, struct direct_convolver_data *data){
+  while(1 < fir_size && fabs(fir[fir_size-1]) < 0.000001f){
+    --fir_size;
+  }
+  uint32_t size = MAX(1, fir_size);
+
+  data->fir = aligned_calloc(64, size + size-1 + DIRECT_CHUNK, sizeof(float));
+  if(!data->fir){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->history = data->fir + size;
+  data->size = size;
+  for(uint32_t k=0; k<fir_size; ++k)
+    data->fir[size-1-k] = fir[k];
+  return 1;
+}
+
+void direct_convolver_reset(struct direct_convolver_data *data){
+  memset(data->history, 0, (data->size-1)*sizeof(float));
+}
+
+VECTORIZE void direct_convolver(float *in, float *out, uint32_t samples, struct direct_convolver_data *data){
+  uint32_t size = data->size;
+  uint32_t past = size-1;
+  const float *restrict fir = data->fir;
+  float *restrict history = data->history;
+
+  for(uint32_t i=0; i<samples; ){
+    uint32_t chunk = MIN(DIRECT_CHUNK, samples-i);
+    float *restrict target = out+i;
+    // Copy the input first, as we may be running in place.
+    memcpy(history+past, in+i, chunk*sizeof(float));
+    memset(target, 0, chunk*sizeof(float));
+    for(uint32_t k=0; k<size; ++k){
+      float h = fir[k];
+      const float *restrict x = history+k;
+      for(uint32_t n=0; n<chunk; ++n)
+        target[n] += h * x[n];
+    }
+    memmove(history, history+chunk, past*sizeof(float));
+    i += chunk;
+  }
+}
@@ -0,0 +1,94 @@
+#include "internal.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define CPU_X86
+#endif
+
+// The CPU features are detected once, and the kernel table is filled for
+// them by every module that has kernels. Since the features cannot change
+// while the process runs, callers only need to look up the kernel once
+// per block rather than going through an indirection on every call.
+
+enum table_state{
+  TABLE_EMPTY,
+  TABLE_FILLING,
+  TABLE_READY
+};
+
+static struct kernel_table table = {0};
+static int state = TABLE_EMPTY;
+static uint32_t detected = 0;
+
+#ifdef CPU_X86
+static uint64_t xgetbv(uint32_t index){
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+  return ((uint64_t)edx << 32) | eax;
+}
+#endif
+
+static uint32_t detect_features(void){
+  uint32_t features = 0;
+#if defined(CPU_X86)
+  unsigned int eax, ebx, ecx, edx;
+  if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+  if(edx & bit_SSE2)
+    features |= MIXED_CPU_SSE2;
+  // The OS also has to preserve the upper halves of the YMM registers.
+  if((ecx & bit_OSXSAVE) && (ecx & bit_AVX) && (xgetbv(0) & 0x6) == 0x6){
+    if(ecx & bit_FMA)
+      features |= MIXED_CPU_FMA;
+    if(ecx & bit_F16C)
+      features |= MIXED_CPU_F16C;
+    if(7 <= __get_cpuid_max(0, 0)){
+      __cpuid_count(7, 0, eax, ebx, ecx, edx);
+      if(ebx & bit_AVX2)
+        features |= MIXED_CPU_AVX2;
+    }
+  }
+#elif defined(__ARM_NEON)
+  // The NEON kernels are only compiled in when NEON is part of the
+  // target, in which case every CPU running the code has it.
+  features |= MIXED_CPU_NEON;
+#endif
+  return features;
+}
+
+DEF_KERNEL(mix_add_kernel, (float *restrict out, const float *restrict in, uint32_t samples, float volume), {
+    for(uint32_t i=0; i<samples; ++i)
+      out[i] += in[i] * volume;
+  })
+
+static void fill_table(uint32_t features){
+  table.features = features;
+  table.mix_add = KERNEL_TIER(mix_add_kernel, features);
+  interleave_kernels(features, &table);
+  biquad_kernels(features, &table);
+  convolution_kernels(features, &table);
+  fft_window_kernels(features, &table);
+}
+
+const struct kernel_table *kernels(void){
+  if(atomic_read(state) != TABLE_READY){
+    if(atomic_cas(state, TABLE_EMPTY, TABLE_FILLING)){
+      detected = detect_features();
+      fill_table(detected);
+      atomic_write(state, TABLE_READY);
+    }else{
+      // Filling only takes a moment.
+      while(atomic_read(state) != TABLE_READY);
+    }
+  }
+  return &table;
+}
+
+MIXED_EXPORT uint32_t mixed_cpu_features(void){
+  return kernels()->features;
+}
+
+MIXED_EXPORT int mixed_force_cpu_features(uint32_t features){
+  kernels();
+  fill_table(detected & features);
+  return 1;
+}
@@ -0,0 +1,119 @@
+#include "internal.h"
+
+// Doppler shifting through a variable fractional delay line.
+//
+// A source approaching or receding at a constant velocity is heard at a
+// constant pitch, which in a real room comes from the propagation delay
+// shrinking or growing over time. We model exactly that: the read head
+// trails the write head by a delay that changes by (1 - pitch) samples
+// every sample. Whenever the source stops moving relative to the
+// listener, the delay is slowly steered back to its target, which
+// undoes any drift between the velocity and the location.
+//
+// With the propagation delay the target is the time the sound takes
+// to reach the listener, and the line is long enough to hold that up
+// to the max distance, so a source that keeps moving away does not run
+// out of line before it falls silent. That costs a long line and the
+// full latency per source, so by default the target only follows the
+// change of the propagation delay since the source started, around a
+// base delay in the middle of a short line. Once the change exceeds
+// the line, the reference distance is dragged along, so the delay
+// clamps at the end and returns as soon as the source turns around.
+
+#define DOPPLER_MIN_DELAY 2.0f
+#define DOPPLER_MIN_SIZE 64
+// A bit over five seconds at 48kHz.
+#define DOPPLER_MAX_SIZE (1<<18)
+// The change of the delay in seconds the line holds either way when
+// the propagation delay is not simulated.
+#define DOPPLER_RANGE 0.05f
+
+int make_doppler_data(uint32_t samplerate, bool propagation, float max_delay, struct doppler_data *data){
+  uint32_t size = DOPPLER_MIN_SIZE;
+  if(!propagation) max_delay = 2.0f * DOPPLER_RANGE * samplerate;
+  while(size < DOPPLER_MAX_SIZE && size < max_delay + 4.0f) size *= 2;
+  if(data->buffer && size <= data->size && propagation == data->propagation) return 1;
+  float *buffer = mixed_calloc(size, sizeof(float));
+  if(!buffer){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  FREE(data->buffer);
+  data->buffer = buffer;
+  data->size = size;
+  data->propagation = propagation;
+  // Return to the propagation delay with a time constant of four
+  // seconds, which keeps the pitch deviation while doing so below one
+  // percent.
+  data->relax = 1.0f / (4.0f * samplerate);
+  doppler_reset(data);
+  return 1;
+}
+
+void free_doppler_data(struct doppler_data *data){
+  FREE(data->buffer);
+  data->size = 0;
+}
+
+void doppler_reset(struct doppler_data *data){
+  if(data->buffer)
+    memset(data->buffer, 0, data->size*sizeof(float));
+  // Picked up from the target on the next run.
+  data->delay = -1.0f;
+  data->index = 0;
+}
+
+static inline float hermite(float x0, float x1, float x2, float x3, float t){
+  float c1 = 0.5f * (x2 - x0);
+  float c2 = x0 - 2.5f * x1 + 2.0f * x2 - 0.5f * x3;
+  float c3 = 0.5f * (x3 - x0) + 1.5f * (x1 - x2);
+  return ((c3 * t + c2) * t + c1) * t + x1;
+}
+
+void doppler(float *in, float *out, uint32_t samples, float pitch, struct doppler_data *data){
+  float *restrict buffer = data->buffer;
+  uint32_t mask = data->size-1;
+  float max_delay = data->size-4.0f;
+  float target = data->target;
+  if(!data->propagation){
+    if(data->delay < 0.0f) data->origin = target - data->size/2;
+    target -= data->origin;
+    // Drag the reference along once the change no longer fits.
+    float excess = target - CLAMP(DOPPLER_MIN_DELAY, target, max_delay);
+    data->origin += excess;
+    target -= excess;
+  }
+  target = CLAMP(DOPPLER_MIN_DELAY, target, max_delay);
+  float delay = (data->delay < 0.0f)? target : data->delay;
+  uint32_t index = data->index;
+  float step = 1.0f - pitch;
+  float relax = (pitch == 1.0f)? data->relax : 0.0f;
+
+  for(uint32_t i=0; i<samples; ++i){
+    buffer[index & mask] = in[i];
+    delay += step + (target - delay) * relax;
+    delay = CLAMP(DOPPLER_MIN_DELAY, delay, max_delay);
+    float position = index - delay;
+    float whole = floorf(position);
+    uint32_t p = (uint32_t)(int32_t)whole;
+    out[i] = hermite(buffer[(p-1) & mask],
+                     buffer[(p+0) & mask],
+                     buffer[(p+1) & mask],
+                     buffer[(p+2) & mask],
+                     position - whole);
+    ++index;
+  }
+  data->delay = delay;
+  data->index = index & mask;
+}
+
+// Only feed the delay line, for when the output is not needed.
+void doppler_skip(float *in, uint32_t samples, struct doppler_data *data){
+  float *restrict buffer = data->buffer;
+  uint32_t mask = data->size-1;
+  uint32_t index = data->index;
+  for(uint32_t i=0; i<samples; ++i){
+    buffer[(index+i) & mask] = in[i];
+  }
+  data->index = (index+samples) & mask;
+}
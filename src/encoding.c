@@ -10,6 +10,10 @@ MIXED_EXPORT extern inline float mixed_from_int24(int24_t sample);
 MIXED_EXPORT extern inline float mixed_from_uint24(uint24_t sample);
 MIXED_EXPORT extern inline float mixed_from_int32(int32_t sample);
 MIXED_EXPORT extern inline float mixed_from_uint32(uint32_t sample);
+MIXED_EXPORT extern inline float mixed_float16_to_float(uint16_t half);
+MIXED_EXPORT extern inline uint16_t mixed_float_to_float16(float sample);
+MIXED_EXPORT extern inline float mixed_from_float16(uint16_t sample);
+MIXED_EXPORT extern inline float mixed_from_bfloat16(uint16_t sample);
 MIXED_EXPORT extern inline float mixed_to_float(float sample);
 MIXED_EXPORT extern inline double mixed_to_double(float sample);
 MIXED_EXPORT extern inline int8_t mixed_to_int8(float sample);
@@ -20,3 +24,5 @@ MIXED_EXPORT extern inline int24_t mixed_to_int24(float sample);
 MIXED_EXPORT extern inline uint24_t mixed_to_uint24(float sample);
 MIXED_EXPORT extern inline int32_t mixed_to_int32(float sample);
 MIXED_EXPORT extern inline uint32_t mixed_to_uint32(float sample);
+MIXED_EXPORT extern inline uint16_t mixed_to_float16(float sample);
+MIXED_EXPORT extern inline uint16_t mixed_to_bfloat16(float sample);
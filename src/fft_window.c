@@ -4,23 +4,98 @@
 
 #include "internal.h"
 
+static float *windows[4][16] = {0};
+
+static void compute_window(enum mixed_fft_window type, uint32_t framesize, float *window){
+  for(uint32_t k = 0; k < framesize; k++){
+    double x = 2.*M_PI*(double)k/(double)framesize;
+    switch(type){
+    case MIXED_HAMMING_WINDOW:
+      window[k] = 0.54 - 0.46*cos(x);
+      break;
+    case MIXED_BLACKMAN_HARRIS_WINDOW:
+      window[k] = 0.35875 - 0.48829*cos(x) + 0.14128*cos(2.*x) - 0.01168*cos(3.*x);
+      break;
+    case MIXED_SQRT_HANN_WINDOW:
+      window[k] = sqrt(-.5*cos(x)+.5);
+      break;
+    case MIXED_HANN_WINDOW:
+    default:
+      window[k] = -.5*cos(x)+.5;
+      break;
+    }
+  }
+}
+
+const float *fft_window_table(enum mixed_fft_window type, uint32_t framesize){
+  uint32_t pow = 0;
+  while((1u << pow) < framesize) ++pow;
+  if(type < MIXED_HANN_WINDOW || MIXED_SQRT_HANN_WINDOW < type
+     || pow < 3 || 16 <= (pow-3) || (1u << pow) != framesize){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  pow -= 3;
+
+  float *window = atomic_read(windows[type-1][pow]);
+  if(window == 0){
+    // Same as the FFT setups, the tables are immutable once computed so
+    // losing a race just means we throw ours away.
+    window = aligned_calloc(64, framesize, sizeof(float));
+    if(!window){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    compute_window(type, framesize, window);
+    if(!atomic_cas(windows[type-1][pow], (float *)0, window)){
+      mixed_free(window);
+      window = atomic_read(windows[type-1][pow]);
+    }
+  }
+  return window;
+}
+
+int fft_window_set_type(enum mixed_fft_window type, struct fft_window_data *data){
+  const float *window = fft_window_table(type, data->framesize);
+  if(!window) return 0;
+
+  // Normalise the overlap-add so that an unaltered spectrum passes
+  // through at unity gain. The inverse transform is unscaled, and each
+  // output sample receives the analysis and synthesis window product
+  // from oversampling frames.
+  double sum = 0.0;
+  for(long k = 0; k < data->framesize; k++)
+    sum += window[k]*window[k];
+  data->window_type = type;
+  data->window = window;
+  data->window_scale = 1.0/(sum*data->oversampling);
+  return 1;
+}
+
 void free_fft_window_data(struct fft_window_data *data){
   if(data->in_fifo)
     mixed_free(data->in_fifo);
   data->in_fifo = 0;
   data->out_fifo = 0;
   data->fft_workspace = 0;
+  data->fft_scratch = 0;
   data->output_accumulator = 0;
   data->last_phase = 0;
   data->phase_sum = 0;
+  data->window = 0;
 }
 
 int make_fft_window_data(uint32_t framesize, uint32_t oversampling, uint32_t samplerate, struct fft_window_data *data){
+  // Make sure the transform setup exists before we ever mix.
+  if(!mixed_prepare_fft(framesize))
+    return 0;
+  
   size_t size =
     framesize+
     framesize+
-    framesize*2+
-    framesize*2+
+    framesize+
+    framesize+
+    framesize+
     framesize/2+1+
     framesize/2+1;
   float *mem = aligned_calloc(64, size, sizeof(float));
@@ -32,61 +107,107 @@ int make_fft_window_data(uint32_t framesize, uint32_t oversampling, uint32_t sam
 
   data->in_fifo = mem; mem += framesize;
   data->out_fifo = mem; mem += framesize;
-  data->fft_workspace = mem; mem += framesize*2;
-  data->output_accumulator = mem; mem += framesize*2;
+  data->fft_workspace = mem; mem += framesize;
+  data->fft_scratch = mem; mem += framesize;
+  data->output_accumulator = mem; mem += framesize;
   data->last_phase = mem; mem += framesize/2+1;
   data->phase_sum = mem; mem += framesize/2+1;
 
   data->framesize = framesize;
   data->oversampling = oversampling;
   data->samplerate = samplerate;
+  data->overlap = 0;
+  data->in_index = 0;
+  data->out_index = 0;
+  // Keep the window across re-creation, such as on samplerate changes.
+  if(!fft_window_set_type(data->window_type? data->window_type : MIXED_HANN_WINDOW, data)){
+    free_fft_window_data(data);
+    return 0;
+  }
   return 1;
 }
 
-VECTORIZE void fft_window(float *restrict in, float *restrict out, uint32_t samples, struct fft_window_data *data, fft_window_process process, void *user){
-  uint32_t framesize = data->framesize;
-  uint32_t oversampling = data->oversampling;
+static inline void ring_write(float *restrict ring, long size, long *index, const float *restrict in, long samples){
+  long first = MIN(samples, size - *index);
+  memcpy(ring + *index, in, first*sizeof(float));
+  memcpy(ring, in + first, (samples - first)*sizeof(float));
+  *index = (*index + samples) % size;
+}
+
+static inline void ring_read_clear(float *restrict ring, long size, long *index, float *restrict out, long samples){
+  long first = MIN(samples, size - *index);
+  memcpy(out, ring + *index, first*sizeof(float));
+  memcpy(out + first, ring, (samples - first)*sizeof(float));
+  memset(ring + *index, 0, first*sizeof(float));
+  memset(ring, 0, (samples - first)*sizeof(float));
+  *index = (*index + samples) % size;
+}
+
+DEF_KERNEL(window_kernel, (float *restrict out, const float *restrict in, const float *restrict window, uint32_t samples), {
+    for(uint32_t k=0; k<samples; ++k)
+      out[k] = in[k] * window[k];
+  })
+
+DEF_KERNEL(window_add_kernel, (float *restrict out, const float *restrict in, const float *restrict window, float scale, uint32_t samples), {
+    for(uint32_t k=0; k<samples; ++k)
+      out[k] += window[k] * in[k] * scale;
+  })
+
+void fft_window_kernels(uint32_t features, struct kernel_table *table){
+  table->window = KERNEL_TIER(window_kernel, features);
+  table->window_add = KERNEL_TIER(window_add_kernel, features);
+}
+
+// Both the input FIFO and the output accumulator are rings of framesize
+// samples, so a hop only ever touches the step new samples rather than
+// shifting the entire frame down.
+void fft_window(float *in, float *out, uint32_t samples, struct fft_window_data *data, fft_window_process process, void *user){
+  const struct kernel_table *table = kernels();
+  long framesize = data->framesize;
+  long oversampling = data->oversampling;
   float *restrict in_fifo = data->in_fifo;
   float *restrict out_fifo = data->out_fifo;
   float *restrict fft_workspace = data->fft_workspace;
-  float *output_accumulator = data->output_accumulator;
+  float *restrict fft_scratch = data->fft_scratch;
+  float *restrict output_accumulator = data->output_accumulator;
+  const float *restrict window = data->window;
+  float window_scale = data->window_scale;
 
-  long framesize2 = framesize/2;
   long step = framesize/oversampling;
   long fifo_latency = framesize-step;
   if(data->overlap == 0)
     data->overlap = fifo_latency;
 
-  for(uint32_t i = 0; i < samples; i++){
-    in_fifo[data->overlap] = in[i];
-    out[i] = out_fifo[data->overlap-fifo_latency];
-    data->overlap++;
+  for(uint32_t i = 0; i < samples; ){
+    long block = MIN((long)(samples - i), framesize - data->overlap);
+    // The input must be consumed before the output is written, as the
+    // two may be the same buffer.
+    ring_write(in_fifo, framesize, &data->in_index, in+i, block);
+    memcpy(out+i, out_fifo+(data->overlap-fifo_latency), block*sizeof(float));
+    data->overlap += block;
+    i += block;
+    
     if(data->overlap >= framesize){
       data->overlap = fifo_latency;
 
-      /* do windowing and re,im interleave */
-      for(uint32_t k = 0; k < framesize; k++) {
-        double window = -.5*cos(2.*M_PI*(double)k/(double)framesize)+.5;
-        fft_workspace[2*k] = in_fifo[k] * window;
-        fft_workspace[2*k+1] = 0.;
-      }
+      /* do windowing, starting from the oldest sample in the ring */
+      long start = data->in_index;
+      long first = framesize - start;
+      table->window(fft_workspace, in_fifo+start, window, first);
+      table->window(fft_workspace+first, in_fifo, window+first, framesize-first);
 
-      mixed_fwd_fft(framesize, fft_workspace, fft_workspace);
+      fft_fwd(framesize, fft_workspace, fft_workspace, fft_scratch);
       process(data, user);
-      mixed_inv_fft(framesize, fft_workspace, fft_workspace);
+      fft_inv(framesize, fft_workspace, fft_workspace, fft_scratch);
 
       /* do windowing and add to output accumulator */
-      for(uint32_t k = 0; k < framesize; k++) {
-        double window = -.5*cos(2.*M_PI*(double)k/(double)framesize)+.5;
-        output_accumulator[k] += 2.*window*fft_workspace[2*k]/(framesize2*oversampling);
-      }
-      for(uint32_t k = 0; k < step; k++)
-        out_fifo[k] = output_accumulator[k];
+      start = data->out_index;
+      first = framesize - start;
+      table->window_add(output_accumulator+start, fft_workspace, window, window_scale, first);
+      table->window_add(output_accumulator, fft_workspace+first, window+first, window_scale, framesize-first);
 
-      memmove(output_accumulator, output_accumulator+step, framesize*sizeof(float));
-
-      for(uint32_t k = 0; k < fifo_latency; k++)
-        in_fifo[k] = in_fifo[k+step];
+      /* the oldest step samples are complete, hand them to the output */
+      ring_read_clear(output_accumulator, framesize, &data->out_index, out_fifo, step);
     }
   }
 }
@@ -98,10 +219,10 @@ VECTORIZE void fft_pitch_shift(struct fft_window_data *data, void *user){
   float *restrict fft_workspace = data->fft_workspace;
   float *restrict last_phase = data->last_phase;
   float *restrict phase_sum = data->phase_sum;
-  float analyzed_frequency[framesize];
-  float analyzed_magnitude[framesize];
-  float synthesized_frequency[framesize];
-  float synthesized_magnitude[framesize];
+  float analyzed_frequency[framesize2+1];
+  float analyzed_magnitude[framesize2+1];
+  float synthesized_frequency[framesize2+1];
+  float synthesized_magnitude[framesize2+1];
 
   uint32_t step = framesize/oversampling;
   double bin_frequencies = (double)data->samplerate/(double)framesize;
@@ -109,10 +230,20 @@ VECTORIZE void fft_pitch_shift(struct fft_window_data *data, void *user){
   float pitch_shift = *((float*)user);
 
   for(uint32_t k = 0; k <= framesize2; k++){
-    float real = fft_workspace[2*k];
-    float imag = fft_workspace[2*k+1];
+    // The DC and nyquist bins are both real and packed into the first pair.
+    float real, imag;
+    if(k == 0){
+      real = fft_workspace[0];
+      imag = 0.;
+    }else if(k == framesize2){
+      real = fft_workspace[1];
+      imag = 0.;
+    }else{
+      real = fft_workspace[2*k];
+      imag = fft_workspace[2*k+1];
+    }
 
-    float magnitude = 2.*sqrt(real*real + imag*imag);
+    float magnitude = sqrt(real*real + imag*imag);
     float phase = atan2(imag,real);
     float tmp = phase - last_phase[k];
     last_phase[k] = phase;
@@ -128,8 +259,8 @@ VECTORIZE void fft_pitch_shift(struct fft_window_data *data, void *user){
     analyzed_frequency[k] = tmp;
   }
 
-  memset(synthesized_magnitude, 0, framesize*sizeof(float));
-  memset(synthesized_frequency, 0, framesize*sizeof(float));
+  memset(synthesized_magnitude, 0, (framesize2+1)*sizeof(float));
+  memset(synthesized_frequency, 0, (framesize2+1)*sizeof(float));
   for(uint32_t k = 0; k <= framesize2; k++){
     uint32_t index = k*pitch_shift;
     if(index <= framesize2){
@@ -149,10 +280,13 @@ VECTORIZE void fft_pitch_shift(struct fft_window_data *data, void *user){
     phase_sum[k] += tmp;
 
     float phase = phase_sum[k];
-    fft_workspace[2*k] = magnitude*cos(phase);
-    fft_workspace[2*k+1] = magnitude*sin(phase);
+    if(k == 0){
+      fft_workspace[0] = magnitude*cos(phase);
+    }else if(k == framesize2){
+      fft_workspace[1] = magnitude*cos(phase);
+    }else{
+      fft_workspace[2*k] = magnitude*cos(phase);
+      fft_workspace[2*k+1] = magnitude*sin(phase);
+    }
   }
-
-  for(uint32_t k = framesize+2; k < 2*framesize; k++)
-    fft_workspace[k] = 0.;
 }
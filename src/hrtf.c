@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include "internal.h"
+
+// Binaural rendering through a table of measured head related impulse
+// responses (HRIRs).
+//
+// Every measured direction acts like a virtual speaker: sources are
+// panned between the three measurements closest to them, and each
+// direction that receives any signal is then convolved once with its
+// pair of HRIRs. Since convolution is linear, panning between the
+// measurements is the same as convolving with the interpolated HRIR,
+// while sources close to each other share the same convolutions.
+// The convolvers of all directions are built up front by
+// hrtf_make_convolvers, so that mixing only has to track which of them
+// are in use.
+//
+// A fixed panning matrix, like an ambisonic decoder, can instead be
+// folded into the HRIRs with hrtf_fold, which leaves one pair of HRIRs
+// per input channel of the matrix rather than one per direction.
+
+// The head block of the partitioned convolution, and thus its latency.
+#define HRTF_HEAD 64
+#define DEG2RAD (M_PI/180.0f)
+
+void free_hrtf_data(struct hrtf_data *data){
+  if(data->convolvers){
+    for(uint32_t d=0; d<data->count; ++d)
+      free_convolver_data(&data->convolvers[d]);
+  }
+  if(data->input){
+    for(uint32_t d=0; d<data->count; ++d)
+      FREE(data->input[d]);
+  }
+  FREE(data->convolvers);
+  FREE(data->input);
+  FREE(data->idle);
+  FREE(data->used);
+  FREE(data->direction[0]);
+  FREE(data->direction[1]);
+  FREE(data->direction[2]);
+  FREE(data->irs);
+  FREE(data->scratch[0]);
+  data->scratch[1] = 0;
+  data->count = 0;
+  data->capacity = 0;
+}
+
+static int read_uint32(FILE *file, uint32_t *value){
+  unsigned char bytes[4];
+  if(fread(bytes, 1, 4, file) != 4) return 0;
+  *value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+  return 1;
+}
+
+static int read_floats(FILE *file, float *values, uint32_t count){
+  for(uint32_t i=0; i<count; ++i){
+    union { uint32_t u; float f; } value;
+    if(!read_uint32(file, &value.u)) return 0;
+    values[i] = value.f;
+  }
+  return 1;
+}
+
+int load_hrtf_data(const char *path, uint32_t samplerate, struct hrtf_data *data){
+  uint32_t magic, version, rate, count, length;
+  FILE *file = fopen(path, "rb");
+  memset(data, 0, sizeof(struct hrtf_data));
+  if(!file){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  if(!read_uint32(file, &magic) || magic != HRTF_MAGIC
+     || !read_uint32(file, &version) || version != 1
+     || !read_uint32(file, &rate)
+     || !read_uint32(file, &count)
+     || !read_uint32(file, &length)
+     || count == 0 || length == 0 || length > HRTF_MAX_LENGTH){
+    mixed_err(MIXED_INVALID_VALUE);
+    goto cleanup;
+  }
+  // We do not resample the responses. A samplerate of 0 accepts any.
+  if(samplerate && rate != samplerate){
+    mixed_err(MIXED_INVALID_VALUE);
+    goto cleanup;
+  }
+
+  data->count = count;
+  data->length = length;
+  data->irs = mixed_calloc(count*2*length, sizeof(float));
+  for(int i=0; i<3; ++i)
+    data->direction[i] = mixed_calloc(count, sizeof(float));
+  if(!data->irs || !data->direction[0] || !data->direction[1] || !data->direction[2]){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    goto cleanup;
+  }
+
+  for(uint32_t d=0; d<count; ++d){
+    float angles[2];
+    if(!read_floats(file, angles, 2)
+       || !read_floats(file, data->irs + d*2*length, 2*length)){
+      mixed_err(MIXED_INVALID_VALUE);
+      goto cleanup;
+    }
+    // Azimuth counter-clockwise from the front, elevation upwards, in degrees.
+    float azimuth = angles[0] * DEG2RAD;
+    float elevation = angles[1] * DEG2RAD;
+    data->direction[0][d] = -sinf(azimuth) * cosf(elevation);
+    data->direction[1][d] = sinf(elevation);
+    data->direction[2][d] = cosf(azimuth) * cosf(elevation);
+  }
+  fclose(file);
+  return 1;
+
+ cleanup:
+  if(file) fclose(file);
+  free_hrtf_data(data);
+  return 0;
+}
+
+int hrtf_make_convolvers(struct hrtf_data *data){
+  uint32_t count = data->count, length = data->length;
+  data->convolvers = mixed_calloc(count, sizeof(struct convolver_data));
+  data->input = mixed_calloc(count, sizeof(float *));
+  data->idle = mixed_calloc(count, sizeof(uint32_t));
+  data->used = mixed_calloc(count, sizeof(bool));
+  if(!data->convolvers || !data->input || !data->idle || !data->used){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  for(uint32_t d=0; d<count; ++d){
+    struct convolver_data *filter = &data->convolvers[d];
+    if(!make_convolver_data(data->irs + d*2*length, length, 2, HRTF_HEAD, 0, filter))
+      return 0;
+    // Start out silent, as if the tail had already played out.
+    data->idle[d] = filter->in_size + filter->out_size;
+  }
+  return 1;
+}
+
+// Build a stereo convolver for each of the channels, whose HRIRs are the
+// sum of all measured ones, weighed by the channel's column of the
+// matrix. The matrix holds a row of stride gains for each direction.
+int hrtf_fold(const float *matrix, uint32_t stride, uint32_t channels, struct convolver_data *convolvers, struct hrtf_data *data){
+  uint32_t length = data->length;
+  float *irs = mixed_calloc(2*length, sizeof(float));
+  if(!irs){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  for(uint32_t c=0; c<channels; ++c){
+    memset(irs, 0, 2*length*sizeof(float));
+    for(uint32_t d=0; d<data->count; ++d){
+      float gain = matrix[d*stride + c];
+      const float *source = data->irs + d*2*length;
+      if(gain == 0.0f) continue;
+      for(uint32_t i=0; i<2*length; ++i)
+        irs[i] += gain * source[i];
+    }
+    if(!make_convolver_data(irs, length, 2, HRTF_HEAD, 0, &convolvers[c])){
+      for(uint32_t p=0; p<c; ++p)
+        free_convolver_data(&convolvers[p]);
+      mixed_free(irs);
+      return 0;
+    }
+  }
+  mixed_free(irs);
+  return 1;
+}
+
+int hrtf_ensure_capacity(uint32_t samples, struct hrtf_data *data){
+  if(samples <= data->capacity) return 1;
+  float *scratch = mixed_calloc(2*samples, sizeof(float));
+  if(!scratch){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  for(uint32_t d=0; d<data->count; ++d){
+    float *input = mixed_calloc(samples, sizeof(float));
+    if(!input){
+      mixed_free(scratch);
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    mixed_free(data->input[d]);
+    data->input[d] = input;
+  }
+  FREE(data->scratch[0]);
+  data->scratch[0] = scratch;
+  data->scratch[1] = scratch + samples;
+  data->capacity = samples;
+  return 1;
+}
+
+// Mark the direction as used in this block.
+void hrtf_use(uint32_t direction, uint32_t samples, struct hrtf_data *data){
+  if(data->used[direction]) return;
+  memset(data->input[direction], 0, samples*sizeof(float));
+  data->used[direction] = 1;
+  data->idle[direction] = 0;
+}
+
+// Convolve every direction that was used, or that still has a tail to
+// play out, and add the result to the two outputs.
+VECTORIZE void hrtf_render(float *restrict left, float *restrict right, uint32_t samples, struct hrtf_data *data){
+  float *restrict l = data->scratch[0];
+  float *restrict r = data->scratch[1];
+  for(uint32_t d=0; d<data->count; ++d){
+    if(!data->input[d]) continue;
+    struct convolver_data *filter = &data->convolvers[d];
+    // The whole ring buffer has to run empty before the tail is silent.
+    uint32_t flush = filter->in_size + filter->out_size;
+    if(!data->used[d]){
+      if(flush <= data->idle[d]) continue;
+      memset(data->input[d], 0, samples*sizeof(float));
+      data->idle[d] += samples;
+    }
+    data->used[d] = 0;
+    convolver(data->input[d], data->scratch, samples, filter);
+    for(uint32_t i=0; i<samples; ++i){
+      left[i] += l[i];
+      right[i] += r[i];
+    }
+  }
+}
+
+// Find the three measurements closest to each direction, and weigh them
+// by their inverse angular distance.
+VECTORIZE void hrtf_compute_gains_batch(uint32_t count, const float *restrict x, const float *restrict y, const float *restrict z, float *restrict gains[3], uint32_t *restrict targets[3], struct hrtf_data *data){
+  const float *restrict dx = data->direction[0];
+  const float *restrict dy = data->direction[1];
+  const float *restrict dz = data->direction[2];
+  for(uint32_t i=0; i<count; ++i){
+    float px = x[i], py = y[i], pz = z[i];
+    // Sources without a direction are placed in front.
+    if(px == 0.0f && py == 0.0f && pz == 0.0f) pz = 1.0f;
+    float length = sqrtf(px*px + py*py + pz*pz);
+    px /= length; py /= length; pz /= length;
+    float best[3] = {-2.0f, -2.0f, -2.0f};
+    uint32_t index[3] = {0, 0, 0};
+    for(uint32_t d=0; d<data->count; ++d){
+      float dot = px*dx[d] + py*dy[d] + pz*dz[d];
+      if(dot <= best[2]) continue;
+      if(best[1] < dot){
+        best[2] = best[1]; index[2] = index[1];
+        if(best[0] < dot){
+          best[1] = best[0]; index[1] = index[0];
+          best[0] = dot; index[0] = d;
+        }else{
+          best[1] = dot; index[1] = d;
+        }
+      }else{
+        best[2] = dot; index[2] = d;
+      }
+    }
+    float weight[3], total = 0.0f;
+    uint32_t n = MIN(3, data->count);
+    for(uint32_t k=0; k<n; ++k){
+      weight[k] = 1.0f / (acosf(CLAMP(-1.0f, best[k], 1.0f)) + 0.0001f);
+      total += weight[k];
+    }
+    for(uint32_t k=0; k<3; ++k){
+      gains[k][i] = (k < n)? weight[k] / total : 0.0f;
+      targets[k][i] = index[k];
+    }
+  }
+}
@@ -0,0 +1,850 @@
+#include "internal.h"
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define INTERLEAVE_X86
+#endif
+
+// Conversion between interleaved packs and channel buffers in one pass
+// over the pack. The frames are converted in chunks: first all samples
+// of the chunk are converted in sequence with SIMD kernels into a small
+// scratch block that stays in cache, which is then split up into the
+// channels with a shuffle kernel for the channel count. Both steps are
+// branch-free, and every byte of the pack is only read or written once.
+//
+// The conversions compute exactly what the per-sample functions in
+// mixed_encoding.h compute, so which path is taken does not matter.
+// The kernels for the CPU are picked through the kernel table.
+
+// Floats in the scratch block, a multiple of every channel count's chunk.
+#define SCRATCH_SIZE 2048
+
+//// Generic conversions
+static void from_int16_generic(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const int16_t *restrict data = (const int16_t *)in;
+  for(uint32_t i=0; i<samples; ++i)
+    out[i] = mixed_from_int16(data[i]) * volume;
+}
+
+static void from_int24_generic(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const uint8_t *restrict data = (const uint8_t *)in;
+  for(uint32_t i=0; i<samples; ++i){
+    int32_t sample = ((int8_t)data[3*i+2] << 16) + (data[3*i+1] << 8) + data[3*i];
+    out[i] = mixed_from_int24(sample) * volume;
+  }
+}
+
+static void from_int32_generic(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const int32_t *restrict data = (const int32_t *)in;
+  for(uint32_t i=0; i<samples; ++i)
+    out[i] = mixed_from_int32(data[i]) * volume;
+}
+
+static void from_float_generic(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const float *restrict data = (const float *)in;
+  for(uint32_t i=0; i<samples; ++i)
+    out[i] = mixed_from_float(data[i]) * volume;
+}
+
+static void to_int16_generic(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  int16_t *restrict data = (int16_t *)out;
+  for(uint32_t i=0; i<samples; ++i)
+    data[i] = mixed_to_int16(in[i]) * volume;
+}
+
+static void to_int24_generic(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  uint8_t *restrict data = (uint8_t *)out;
+  for(uint32_t i=0; i<samples; ++i){
+    int24_t sample = mixed_to_int24(in[i] * volume);
+    data[3*i+2] = (sample >> 16) & 0xFF;
+    data[3*i+1] = (sample >>  8) & 0xFF;
+    data[3*i+0] = (sample >>  0) & 0xFF;
+  }
+}
+
+static void to_int32_generic(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  int32_t *restrict data = (int32_t *)out;
+  for(uint32_t i=0; i<samples; ++i){
+    // INT32_MAX rounds up to 2^31 as a float, which must not wrap around.
+    float value = mixed_to_int32(in[i]) * volume;
+    data[i] = (INT32_MAX <= value)? INT32_MAX
+      : (INT32_MIN < value)? (int32_t)value
+      : INT32_MIN;
+  }
+}
+
+static void to_float_generic(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  float *restrict data = (float *)out;
+  for(uint32_t i=0; i<samples; ++i)
+    data[i] = mixed_to_float(in[i]) * volume;
+}
+
+static void from_float16_generic(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const uint16_t *restrict data = (const uint16_t *)in;
+  for(uint32_t i=0; i<samples; ++i)
+    out[i] = mixed_from_float16(data[i]) * volume;
+}
+
+static void from_bfloat16_generic(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const uint16_t *restrict data = (const uint16_t *)in;
+  for(uint32_t i=0; i<samples; ++i)
+    out[i] = mixed_from_bfloat16(data[i]) * volume;
+}
+
+static void to_float16_generic(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  uint16_t *restrict data = (uint16_t *)out;
+  for(uint32_t i=0; i<samples; ++i)
+    data[i] = mixed_to_float16(in[i] * volume);
+}
+
+static void to_bfloat16_generic(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  uint16_t *restrict data = (uint16_t *)out;
+  for(uint32_t i=0; i<samples; ++i)
+    data[i] = mixed_to_bfloat16(in[i] * volume);
+}
+
+//// SSE2 conversions
+#ifdef INTERLEAVE_X86
+// Signed samples are divided by the magnitude of the extreme on their side.
+__attribute__((target("sse2")))
+static inline __m128 sse2_scale_signed(__m128i sample, float negative, float positive){
+  __m128 value = _mm_cvtepi32_ps(sample);
+  __m128 sign = _mm_castsi128_ps(_mm_cmplt_epi32(sample, _mm_setzero_si128()));
+  __m128 divisor = _mm_or_ps(_mm_and_ps(sign, _mm_set1_ps(negative)), _mm_andnot_ps(sign, _mm_set1_ps(positive)));
+  return _mm_div_ps(value, divisor);
+}
+
+// Clamp to [lo, hi], with NaN turning into lo like the scalar version.
+__attribute__((target("sse2")))
+static inline __m128 sse2_clamp(__m128 value, float lo, float hi){
+  return _mm_max_ps(_mm_min_ps(_mm_set1_ps(hi), value), _mm_set1_ps(lo));
+}
+
+__attribute__((target("sse2")))
+static void from_int16_sse2(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const int16_t *restrict data = (const int16_t *)in;
+  __m128 vol = _mm_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m128i raw = _mm_loadu_si128((const __m128i *)(data+i));
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(raw, raw), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(raw, raw), 16);
+    _mm_storeu_ps(out+i+0, _mm_mul_ps(sse2_scale_signed(lo, -(float)INT16_MIN, INT16_MAX), vol));
+    _mm_storeu_ps(out+i+4, _mm_mul_ps(sse2_scale_signed(hi, -(float)INT16_MIN, INT16_MAX), vol));
+  }
+  from_int16_generic(data+i, out+i, samples-i, volume);
+}
+
+__attribute__((target("sse2")))
+static void from_int32_sse2(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const int32_t *restrict data = (const int32_t *)in;
+  __m128 vol = _mm_set1_ps(volume);
+  __m128d negative = _mm_set1_pd(-(double)INT32_MIN);
+  __m128d positive = _mm_set1_pd(INT32_MAX);
+  uint32_t i = 0;
+  for(; i+4 <= samples; i+=4){
+    __m128i raw = _mm_loadu_si128((const __m128i *)(data+i));
+    __m128d sign = _mm_castsi128_pd(_mm_shuffle_epi32(_mm_cmplt_epi32(raw, _mm_setzero_si128()), _MM_SHUFFLE(1,1,0,0)));
+    __m128d lo = _mm_div_pd(_mm_cvtepi32_pd(raw), _mm_or_pd(_mm_and_pd(sign, negative), _mm_andnot_pd(sign, positive)));
+    raw = _mm_shuffle_epi32(raw, _MM_SHUFFLE(1,0,3,2));
+    sign = _mm_castsi128_pd(_mm_shuffle_epi32(_mm_cmplt_epi32(raw, _mm_setzero_si128()), _MM_SHUFFLE(1,1,0,0)));
+    __m128d hi = _mm_div_pd(_mm_cvtepi32_pd(raw), _mm_or_pd(_mm_and_pd(sign, negative), _mm_andnot_pd(sign, positive)));
+    __m128 value = _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+    _mm_storeu_ps(out+i, _mm_mul_ps(value, vol));
+  }
+  from_int32_generic(data+i, out+i, samples-i, volume);
+}
+
+__attribute__((target("sse2")))
+static void from_float_sse2(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const float *restrict data = (const float *)in;
+  __m128 vol = _mm_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+4 <= samples; i+=4){
+    __m128 value = sse2_clamp(_mm_loadu_ps(data+i), -1.0f, 1.0f);
+    _mm_storeu_ps(out+i, _mm_mul_ps(value, vol));
+  }
+  from_float_generic(data+i, out+i, samples-i, volume);
+}
+
+__attribute__((target("sse2")))
+static void to_int16_sse2(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  int16_t *restrict data = (int16_t *)out;
+  __m128 scale = _mm_set1_ps(0x8000);
+  __m128 vol = _mm_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m128i lo = _mm_cvttps_epi32(sse2_clamp(_mm_mul_ps(_mm_loadu_ps(in+i+0), scale), INT16_MIN, INT16_MAX));
+    __m128i hi = _mm_cvttps_epi32(sse2_clamp(_mm_mul_ps(_mm_loadu_ps(in+i+4), scale), INT16_MIN, INT16_MAX));
+    if(volume != 1.0f){
+      lo = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo), vol));
+      hi = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi), vol));
+    }
+    _mm_storeu_si128((__m128i *)(data+i), _mm_packs_epi32(lo, hi));
+  }
+  to_int16_generic(in+i, data+i, samples-i, volume);
+}
+
+__attribute__((target("sse2")))
+static void to_int32_sse2(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  int32_t *restrict data = (int32_t *)out;
+  __m128 scale = _mm_set1_ps(2147483648.0f);
+  __m128 vol = _mm_set1_ps(volume);
+  __m128i max = _mm_set1_epi32(INT32_MAX);
+  uint32_t i = 0;
+  for(; i+4 <= samples; i+=4){
+    __m128 value = _mm_loadu_ps(in+i);
+    // Out of range and NaN convert to INT32_MIN, so only the top needs fixing.
+    __m128i top = _mm_castps_si128(_mm_cmpge_ps(value, _mm_set1_ps(1.0f)));
+    __m128i sample = _mm_cvttps_epi32(_mm_mul_ps(value, scale));
+    sample = _mm_or_si128(_mm_and_si128(top, max), _mm_andnot_si128(top, sample));
+    if(volume != 1.0f){
+      value = _mm_mul_ps(_mm_cvtepi32_ps(sample), vol);
+      top = _mm_castps_si128(_mm_cmpge_ps(value, scale));
+      sample = _mm_cvttps_epi32(value);
+      sample = _mm_or_si128(_mm_and_si128(top, max), _mm_andnot_si128(top, sample));
+    }
+    _mm_storeu_si128((__m128i *)(data+i), sample);
+  }
+  to_int32_generic(in+i, data+i, samples-i, volume);
+}
+
+__attribute__((target("sse2")))
+static void to_float_sse2(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  float *restrict data = (float *)out;
+  __m128 vol = _mm_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+4 <= samples; i+=4){
+    __m128 value = sse2_clamp(_mm_loadu_ps(in+i), -1.0f, 1.0f);
+    _mm_storeu_ps(data+i, _mm_mul_ps(value, vol));
+  }
+  to_float_generic(in+i, data+i, samples-i, volume);
+}
+
+// A bfloat16 is the upper half of a float, so only shifts are needed.
+__attribute__((target("sse2")))
+static void from_bfloat16_sse2(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const uint16_t *restrict data = (const uint16_t *)in;
+  __m128 vol = _mm_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m128i raw = _mm_loadu_si128((const __m128i *)(data+i));
+    __m128 lo = _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), raw));
+    __m128 hi = _mm_castsi128_ps(_mm_unpackhi_epi16(_mm_setzero_si128(), raw));
+    _mm_storeu_ps(out+i+0, _mm_mul_ps(sse2_clamp(lo, -1.0f, 1.0f), vol));
+    _mm_storeu_ps(out+i+4, _mm_mul_ps(sse2_clamp(hi, -1.0f, 1.0f), vol));
+  }
+  from_bfloat16_generic(data+i, out+i, samples-i, volume);
+}
+
+// Round to nearest even by adding just under half of the dropped part,
+// plus the lowest kept bit. The arithmetic shift leaves the halves as
+// sign-extended integers, which pack down without saturating.
+__attribute__((target("sse2")))
+static inline __m128i sse2_round_bfloat16(__m128 value){
+  __m128i bits = _mm_castps_si128(value);
+  __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1));
+  bits = _mm_add_epi32(bits, _mm_add_epi32(odd, _mm_set1_epi32(0x7FFF)));
+  return _mm_srai_epi32(bits, 16);
+}
+
+__attribute__((target("sse2")))
+static void to_bfloat16_sse2(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  uint16_t *restrict data = (uint16_t *)out;
+  __m128 vol = _mm_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m128i lo = sse2_round_bfloat16(sse2_clamp(_mm_mul_ps(_mm_loadu_ps(in+i+0), vol), -1.0f, 1.0f));
+    __m128i hi = sse2_round_bfloat16(sse2_clamp(_mm_mul_ps(_mm_loadu_ps(in+i+4), vol), -1.0f, 1.0f));
+    _mm_storeu_si128((__m128i *)(data+i), _mm_packs_epi32(lo, hi));
+  }
+  to_bfloat16_generic(in+i, data+i, samples-i, volume);
+}
+
+//// AVX2 conversions
+__attribute__((target("avx2")))
+static inline __m256 avx2_scale_signed(__m256i sample, float negative, float positive){
+  __m256 value = _mm256_cvtepi32_ps(sample);
+  __m256 sign = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_setzero_si256(), sample));
+  __m256 divisor = _mm256_blendv_ps(_mm256_set1_ps(positive), _mm256_set1_ps(negative), sign);
+  return _mm256_div_ps(value, divisor);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 avx2_clamp(__m256 value, float lo, float hi){
+  return _mm256_max_ps(_mm256_min_ps(_mm256_set1_ps(hi), value), _mm256_set1_ps(lo));
+}
+
+__attribute__((target("avx2")))
+static void from_int16_avx2(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const int16_t *restrict data = (const int16_t *)in;
+  __m256 vol = _mm256_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m256i sample = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(data+i)));
+    _mm256_storeu_ps(out+i, _mm256_mul_ps(avx2_scale_signed(sample, -(float)INT16_MIN, INT16_MAX), vol));
+  }
+  from_int16_generic(data+i, out+i, samples-i, volume);
+}
+
+__attribute__((target("avx2")))
+static void from_int24_avx2(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const uint8_t *restrict data = (const uint8_t *)in;
+  __m256 vol = _mm256_set1_ps(volume);
+  // Move the three bytes of each sample to the top of a lane, then shift
+  // them back down to sign extend.
+  __m128i spread = _mm_setr_epi8(-1,0,1,2, -1,3,4,5, -1,6,7,8, -1,9,10,11);
+  uint32_t i = 0;
+  // Each load reads 16 bytes of which 12 are used, so stop early.
+  for(; i+12 <= samples; i+=8){
+    __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data+3*i+0)), spread);
+    __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data+3*i+12)), spread);
+    __m256i sample = _mm256_srai_epi32(_mm256_set_m128i(hi, lo), 8);
+    _mm256_storeu_ps(out+i, _mm256_mul_ps(avx2_scale_signed(sample, -(float)INT24_MIN, INT24_MAX), vol));
+  }
+  from_int24_generic(data+3*i, out+i, samples-i, volume);
+}
+
+__attribute__((target("avx2")))
+static void from_int32_avx2(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const int32_t *restrict data = (const int32_t *)in;
+  __m256 vol = _mm256_set1_ps(volume);
+  __m256d negative = _mm256_set1_pd(-(double)INT32_MIN);
+  __m256d positive = _mm256_set1_pd(INT32_MAX);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m128i raw[2] = {_mm_loadu_si128((const __m128i *)(data+i+0)),
+                      _mm_loadu_si128((const __m128i *)(data+i+4))};
+    __m128 half[2];
+    for(int h=0; h<2; ++h){
+      __m256d value = _mm256_cvtepi32_pd(raw[h]);
+      __m256d sign = _mm256_cmp_pd(value, _mm256_setzero_pd(), _CMP_LT_OQ);
+      half[h] = _mm256_cvtpd_ps(_mm256_div_pd(value, _mm256_blendv_pd(positive, negative, sign)));
+    }
+    __m256 value = _mm256_set_m128(half[1], half[0]);
+    _mm256_storeu_ps(out+i, _mm256_mul_ps(value, vol));
+  }
+  from_int32_generic(data+i, out+i, samples-i, volume);
+}
+
+__attribute__((target("avx2")))
+static void from_float_avx2(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const float *restrict data = (const float *)in;
+  __m256 vol = _mm256_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m256 value = avx2_clamp(_mm256_loadu_ps(data+i), -1.0f, 1.0f);
+    _mm256_storeu_ps(out+i, _mm256_mul_ps(value, vol));
+  }
+  from_float_generic(data+i, out+i, samples-i, volume);
+}
+
+__attribute__((target("avx2")))
+static void to_int16_avx2(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  int16_t *restrict data = (int16_t *)out;
+  __m256 scale = _mm256_set1_ps(0x8000);
+  __m256 vol = _mm256_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m256i sample = _mm256_cvttps_epi32(avx2_clamp(_mm256_mul_ps(_mm256_loadu_ps(in+i), scale), INT16_MIN, INT16_MAX));
+    if(volume != 1.0f)
+      sample = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(sample), vol));
+    __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(sample), _mm256_extracti128_si256(sample, 1));
+    _mm_storeu_si128((__m128i *)(data+i), packed);
+  }
+  to_int16_generic(in+i, data+i, samples-i, volume);
+}
+
+__attribute__((target("avx2")))
+static void to_int24_avx2(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  uint8_t *restrict data = (uint8_t *)out;
+  __m256 scale = _mm256_set1_ps(0x800000);
+  __m256 vol = _mm256_set1_ps(volume);
+  // Gather the low three bytes of each lane into the first twelve bytes.
+  __m128i gather = _mm_setr_epi8(0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m256 value = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(in+i), vol), scale);
+    __m256i sample = _mm256_cvttps_epi32(avx2_clamp(value, INT24_MIN, INT24_MAX));
+    __m128i lo = _mm_shuffle_epi8(_mm256_castsi256_si128(sample), gather);
+    __m128i hi = _mm_shuffle_epi8(_mm256_extracti128_si256(sample, 1), gather);
+    uint8_t *target = data+3*i;
+    int32_t rest[2] = {_mm_cvtsi128_si32(_mm_srli_si128(lo, 8)), _mm_cvtsi128_si32(_mm_srli_si128(hi, 8))};
+    _mm_storel_epi64((__m128i *)(target+0), lo);
+    memcpy(target+8, &rest[0], 4);
+    _mm_storel_epi64((__m128i *)(target+12), hi);
+    memcpy(target+20, &rest[1], 4);
+  }
+  to_int24_generic(in+i, data+3*i, samples-i, volume);
+}
+
+__attribute__((target("avx2")))
+static void to_int32_avx2(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  int32_t *restrict data = (int32_t *)out;
+  __m256 scale = _mm256_set1_ps(2147483648.0f);
+  __m256 vol = _mm256_set1_ps(volume);
+  __m256i max = _mm256_set1_epi32(INT32_MAX);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m256 value = _mm256_loadu_ps(in+i);
+    __m256 top = _mm256_cmp_ps(value, _mm256_set1_ps(1.0f), _CMP_GE_OQ);
+    __m256i sample = _mm256_cvttps_epi32(_mm256_mul_ps(value, scale));
+    sample = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(sample), _mm256_castsi256_ps(max), top));
+    if(volume != 1.0f){
+      value = _mm256_mul_ps(_mm256_cvtepi32_ps(sample), vol);
+      top = _mm256_cmp_ps(value, scale, _CMP_GE_OQ);
+      sample = _mm256_cvttps_epi32(value);
+      sample = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(sample), _mm256_castsi256_ps(max), top));
+    }
+    _mm256_storeu_si256((__m256i *)(data+i), sample);
+  }
+  to_int32_generic(in+i, data+i, samples-i, volume);
+}
+
+__attribute__((target("avx2")))
+static void to_float_avx2(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  float *restrict data = (float *)out;
+  __m256 vol = _mm256_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m256 value = avx2_clamp(_mm256_loadu_ps(in+i), -1.0f, 1.0f);
+    _mm256_storeu_ps(data+i, _mm256_mul_ps(value, vol));
+  }
+  to_float_generic(in+i, data+i, samples-i, volume);
+}
+
+//// F16C conversions
+// The conversion instructions round to nearest even, same as the
+// scalar conversion, and handle subnormals regardless of the MXCSR.
+__attribute__((target("avx,f16c")))
+static inline __m256 f16c_clamp(__m256 value){
+  return _mm256_max_ps(_mm256_min_ps(_mm256_set1_ps(1.0f), value), _mm256_set1_ps(-1.0f));
+}
+
+__attribute__((target("avx,f16c")))
+static void from_float16_f16c(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const uint16_t *restrict data = (const uint16_t *)in;
+  __m256 vol = _mm256_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m256 value = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(data+i)));
+    _mm256_storeu_ps(out+i, _mm256_mul_ps(f16c_clamp(value), vol));
+  }
+  from_float16_generic(data+i, out+i, samples-i, volume);
+}
+
+__attribute__((target("avx,f16c")))
+static void to_float16_f16c(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  uint16_t *restrict data = (uint16_t *)out;
+  __m256 vol = _mm256_set1_ps(volume);
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    __m256 value = f16c_clamp(_mm256_mul_ps(_mm256_loadu_ps(in+i), vol));
+    _mm_storeu_si128((__m128i *)(data+i), _mm256_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT));
+  }
+  to_float16_generic(in+i, data+i, samples-i, volume);
+}
+#endif
+
+//// NEON conversions
+#ifdef __ARM_NEON
+static inline float32x4_t neon_scale_signed(int32x4_t sample, float negative, float positive){
+  uint32x4_t sign = vcltq_s32(sample, vdupq_n_s32(0));
+  float32x4_t divisor = vbslq_f32(sign, vdupq_n_f32(negative), vdupq_n_f32(positive));
+#ifdef __aarch64__
+  return vdivq_f32(vcvtq_f32_s32(sample), divisor);
+#else
+  // Refine the reciprocal estimate, which is not quite exact.
+  float32x4_t inverse = vrecpeq_f32(divisor);
+  inverse = vmulq_f32(vrecpsq_f32(divisor, inverse), inverse);
+  inverse = vmulq_f32(vrecpsq_f32(divisor, inverse), inverse);
+  return vmulq_f32(vcvtq_f32_s32(sample), inverse);
+#endif
+}
+
+// NaN compares false against both bounds and ends up at lo.
+static inline float32x4_t neon_clamp(float32x4_t value, float lo, float hi){
+  float32x4_t low = vdupq_n_f32(lo);
+  float32x4_t high = vdupq_n_f32(hi);
+  value = vbslq_f32(vcgeq_f32(value, high), high, value);
+  return vbslq_f32(vcgeq_f32(value, low), value, low);
+}
+
+static void from_int16_neon(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const int16_t *restrict data = (const int16_t *)in;
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    int16x8_t raw = vld1q_s16(data+i);
+    float32x4_t lo = neon_scale_signed(vmovl_s16(vget_low_s16(raw)), -(float)INT16_MIN, INT16_MAX);
+    float32x4_t hi = neon_scale_signed(vmovl_s16(vget_high_s16(raw)), -(float)INT16_MIN, INT16_MAX);
+    vst1q_f32(out+i+0, vmulq_n_f32(lo, volume));
+    vst1q_f32(out+i+4, vmulq_n_f32(hi, volume));
+  }
+  from_int16_generic(data+i, out+i, samples-i, volume);
+}
+
+static void from_float_neon(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const float *restrict data = (const float *)in;
+  uint32_t i = 0;
+  for(; i+4 <= samples; i+=4){
+    float32x4_t value = neon_clamp(vld1q_f32(data+i), -1.0f, 1.0f);
+    vst1q_f32(out+i, vmulq_n_f32(value, volume));
+  }
+  from_float_generic(data+i, out+i, samples-i, volume);
+}
+
+static void to_int16_neon(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  int16_t *restrict data = (int16_t *)out;
+  uint32_t i = 0;
+  for(; i+8 <= samples; i+=8){
+    int32x4_t lo = vcvtq_s32_f32(neon_clamp(vmulq_n_f32(vld1q_f32(in+i+0), 0x8000), INT16_MIN, INT16_MAX));
+    int32x4_t hi = vcvtq_s32_f32(neon_clamp(vmulq_n_f32(vld1q_f32(in+i+4), 0x8000), INT16_MIN, INT16_MAX));
+    if(volume != 1.0f){
+      lo = vcvtq_s32_f32(vmulq_n_f32(vcvtq_f32_s32(lo), volume));
+      hi = vcvtq_s32_f32(vmulq_n_f32(vcvtq_f32_s32(hi), volume));
+    }
+    vst1q_s16(data+i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+  }
+  to_int16_generic(in+i, data+i, samples-i, volume);
+}
+
+static void to_float_neon(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  float *restrict data = (float *)out;
+  uint32_t i = 0;
+  for(; i+4 <= samples; i+=4){
+    float32x4_t value = neon_clamp(vld1q_f32(in+i), -1.0f, 1.0f);
+    vst1q_f32(data+i, vmulq_n_f32(value, volume));
+  }
+  to_float_generic(in+i, data+i, samples-i, volume);
+}
+
+static void from_bfloat16_neon(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const uint16_t *restrict data = (const uint16_t *)in;
+  uint32_t i = 0;
+  for(; i+4 <= samples; i+=4){
+    float32x4_t value = vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(data+i), 16));
+    vst1q_f32(out+i, vmulq_n_f32(neon_clamp(value, -1.0f, 1.0f), volume));
+  }
+  from_bfloat16_generic(data+i, out+i, samples-i, volume);
+}
+
+static void to_bfloat16_neon(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  uint16_t *restrict data = (uint16_t *)out;
+  uint32_t i = 0;
+  for(; i+4 <= samples; i+=4){
+    float32x4_t value = neon_clamp(vmulq_n_f32(vld1q_f32(in+i), volume), -1.0f, 1.0f);
+    uint32x4_t bits = vreinterpretq_u32_f32(value);
+    uint32x4_t odd = vandq_u32(vshrq_n_u32(bits, 16), vdupq_n_u32(1));
+    bits = vaddq_u32(bits, vaddq_u32(odd, vdupq_n_u32(0x7FFF)));
+    vst1_u16(data+i, vshrn_n_u32(bits, 16));
+  }
+  to_bfloat16_generic(in+i, data+i, samples-i, volume);
+}
+
+#ifdef __aarch64__
+// Half precision conversions are part of the base AArch64 ISA.
+static void from_float16_neon(const void *restrict in, float *restrict out, uint32_t samples, float volume){
+  const uint16_t *restrict data = (const uint16_t *)in;
+  uint32_t i = 0;
+  for(; i+4 <= samples; i+=4){
+    float32x4_t value = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(data+i)));
+    vst1q_f32(out+i, vmulq_n_f32(neon_clamp(value, -1.0f, 1.0f), volume));
+  }
+  from_float16_generic(data+i, out+i, samples-i, volume);
+}
+
+static void to_float16_neon(const float *restrict in, void *restrict out, uint32_t samples, float volume){
+  uint16_t *restrict data = (uint16_t *)out;
+  uint32_t i = 0;
+  for(; i+4 <= samples; i+=4){
+    float32x4_t value = neon_clamp(vmulq_n_f32(vld1q_f32(in+i), volume), -1.0f, 1.0f);
+    vst1_u16(data+i, vreinterpret_u16_f16(vcvt_f16_f32(value)));
+  }
+  to_float16_generic(in+i, data+i, samples-i, volume);
+}
+#endif
+#endif
+
+//// Channel shuffles
+static void deinterleave_generic(const float *restrict in, float **outs, mixed_channel_t channels, uint32_t frames){
+  for(mixed_channel_t c=0; c<channels; ++c){
+    float *restrict out = outs[c];
+    for(uint32_t f=0; f<frames; ++f)
+      out[f] = in[f*channels+c];
+  }
+}
+
+static void interleave_generic(float **ins, float *restrict out, mixed_channel_t channels, uint32_t frames){
+  for(mixed_channel_t c=0; c<channels; ++c){
+    const float *restrict in = ins[c];
+    for(uint32_t f=0; f<frames; ++f)
+      out[f*channels+c] = in[f];
+  }
+}
+
+#ifdef INTERLEAVE_X86
+__attribute__((target("sse2")))
+static void deinterleave_2_sse2(const float *restrict in, float *restrict left, float *restrict right, uint32_t frames){
+  uint32_t f = 0;
+  for(; f+4 <= frames; f+=4){
+    __m128 a = _mm_loadu_ps(in+2*f+0);
+    __m128 b = _mm_loadu_ps(in+2*f+4);
+    _mm_storeu_ps(left+f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)));
+    _mm_storeu_ps(right+f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+  }
+  for(; f<frames; ++f){
+    left[f] = in[2*f+0];
+    right[f] = in[2*f+1];
+  }
+}
+
+__attribute__((target("sse2")))
+static void interleave_2_sse2(const float *restrict left, const float *restrict right, float *restrict out, uint32_t frames){
+  uint32_t f = 0;
+  for(; f+4 <= frames; f+=4){
+    __m128 l = _mm_loadu_ps(left+f);
+    __m128 r = _mm_loadu_ps(right+f);
+    _mm_storeu_ps(out+2*f+0, _mm_unpacklo_ps(l, r));
+    _mm_storeu_ps(out+2*f+4, _mm_unpackhi_ps(l, r));
+  }
+  for(; f<frames; ++f){
+    out[2*f+0] = left[f];
+    out[2*f+1] = right[f];
+  }
+}
+
+// Four frames at a time, transposing blocks of four channels. With six
+// channels the second block overlaps the first by two channels.
+__attribute__((target("sse2")))
+static void deinterleave_wide_sse2(const float *restrict in, float **outs, mixed_channel_t channels, uint32_t frames){
+  uint32_t f = 0;
+  for(; f+4 <= frames; f+=4){
+    for(mixed_channel_t c=0; c<channels; c+=4){
+      mixed_channel_t base = MIN(c, channels-4);
+      const float *restrict row = in+f*channels+base;
+      __m128 r0 = _mm_loadu_ps(row+0*channels);
+      __m128 r1 = _mm_loadu_ps(row+1*channels);
+      __m128 r2 = _mm_loadu_ps(row+2*channels);
+      __m128 r3 = _mm_loadu_ps(row+3*channels);
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+      _mm_storeu_ps(outs[base+0]+f, r0);
+      _mm_storeu_ps(outs[base+1]+f, r1);
+      _mm_storeu_ps(outs[base+2]+f, r2);
+      _mm_storeu_ps(outs[base+3]+f, r3);
+    }
+  }
+  if(f < frames){
+    float *tails[channels];
+    for(mixed_channel_t c=0; c<channels; ++c) tails[c] = outs[c]+f;
+    deinterleave_generic(in+f*channels, tails, channels, frames-f);
+  }
+}
+
+__attribute__((target("sse2")))
+static void interleave_wide_sse2(float **ins, float *restrict out, mixed_channel_t channels, uint32_t frames){
+  uint32_t f = 0;
+  for(; f+4 <= frames; f+=4){
+    for(mixed_channel_t c=0; c<channels; c+=4){
+      mixed_channel_t base = MIN(c, channels-4);
+      float *restrict row = out+f*channels+base;
+      __m128 r0 = _mm_loadu_ps(ins[base+0]+f);
+      __m128 r1 = _mm_loadu_ps(ins[base+1]+f);
+      __m128 r2 = _mm_loadu_ps(ins[base+2]+f);
+      __m128 r3 = _mm_loadu_ps(ins[base+3]+f);
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+      _mm_storeu_ps(row+0*channels, r0);
+      _mm_storeu_ps(row+1*channels, r1);
+      _mm_storeu_ps(row+2*channels, r2);
+      _mm_storeu_ps(row+3*channels, r3);
+    }
+  }
+  if(f < frames){
+    float *tails[channels];
+    for(mixed_channel_t c=0; c<channels; ++c) tails[c] = ins[c]+f;
+    interleave_generic(tails, out+f*channels, channels, frames-f);
+  }
+}
+#endif
+
+#ifdef __ARM_NEON
+static void deinterleave_2_neon(const float *restrict in, float *restrict left, float *restrict right, uint32_t frames){
+  uint32_t f = 0;
+  for(; f+4 <= frames; f+=4){
+    float32x4x2_t frame = vld2q_f32(in+2*f);
+    vst1q_f32(left+f, frame.val[0]);
+    vst1q_f32(right+f, frame.val[1]);
+  }
+  for(; f<frames; ++f){
+    left[f] = in[2*f+0];
+    right[f] = in[2*f+1];
+  }
+}
+
+static void interleave_2_neon(const float *restrict left, const float *restrict right, float *restrict out, uint32_t frames){
+  uint32_t f = 0;
+  for(; f+4 <= frames; f+=4){
+    float32x4x2_t frame = {{vld1q_f32(left+f), vld1q_f32(right+f)}};
+    vst2q_f32(out+2*f, frame);
+  }
+  for(; f<frames; ++f){
+    out[2*f+0] = left[f];
+    out[2*f+1] = right[f];
+  }
+}
+#endif
+
+static void deinterleave(const float *restrict in, float **outs, mixed_channel_t channels, uint32_t frames, uint32_t features){
+#if defined(INTERLEAVE_X86)
+  if(features & MIXED_CPU_SSE2){
+    if(channels == 2){ deinterleave_2_sse2(in, outs[0], outs[1], frames); return; }
+    if(4 <= channels){ deinterleave_wide_sse2(in, outs, channels, frames); return; }
+  }
+#elif defined(__ARM_NEON)
+  if(features & MIXED_CPU_NEON){
+    if(channels == 2){ deinterleave_2_neon(in, outs[0], outs[1], frames); return; }
+  }
+#endif
+  IGNORE(features);
+  deinterleave_generic(in, outs, channels, frames);
+}
+
+static void interleave(float **ins, float *restrict out, mixed_channel_t channels, uint32_t frames, uint32_t features){
+#if defined(INTERLEAVE_X86)
+  if(features & MIXED_CPU_SSE2){
+    if(channels == 2){ interleave_2_sse2(ins[0], ins[1], out, frames); return; }
+    if(4 <= channels){ interleave_wide_sse2(ins, out, channels, frames); return; }
+  }
+#elif defined(__ARM_NEON)
+  if(features & MIXED_CPU_NEON){
+    if(channels == 2){ interleave_2_neon(ins[0], ins[1], out, frames); return; }
+  }
+#endif
+  IGNORE(features);
+  interleave_generic(ins, out, channels, frames);
+}
+
+//// Dispatch
+void interleave_kernels(uint32_t features, struct kernel_table *table){
+  convert_from_kernel from[6] = {from_int16_generic, from_int24_generic, from_int32_generic, from_float_generic,
+                                 from_float16_generic, from_bfloat16_generic};
+  convert_to_kernel to[6] = {to_int16_generic, to_int24_generic, to_int32_generic, to_float_generic,
+                             to_float16_generic, to_bfloat16_generic};
+#if defined(INTERLEAVE_X86)
+  if((features & CPU_TIER_AVX2) == CPU_TIER_AVX2){
+    convert_from_kernel avx2_from[4] = {from_int16_avx2, from_int24_avx2, from_int32_avx2, from_float_avx2};
+    convert_to_kernel avx2_to[4] = {to_int16_avx2, to_int24_avx2, to_int32_avx2, to_float_avx2};
+    memcpy(from, avx2_from, sizeof(avx2_from));
+    memcpy(to, avx2_to, sizeof(avx2_to));
+  }else if(features & MIXED_CPU_SSE2){
+    convert_from_kernel sse2_from[4] = {from_int16_sse2, from_int24_generic, from_int32_sse2, from_float_sse2};
+    convert_to_kernel sse2_to[4] = {to_int16_sse2, to_int24_generic, to_int32_sse2, to_float_sse2};
+    memcpy(from, sse2_from, sizeof(sse2_from));
+    memcpy(to, sse2_to, sizeof(sse2_to));
+  }
+  if(features & MIXED_CPU_F16C){
+    from[4] = from_float16_f16c;
+    to[4] = to_float16_f16c;
+  }
+  if(features & MIXED_CPU_SSE2){
+    from[5] = from_bfloat16_sse2;
+    to[5] = to_bfloat16_sse2;
+  }
+#elif defined(__ARM_NEON)
+  if(features & MIXED_CPU_NEON){
+    convert_from_kernel neon_from[6] = {from_int16_neon, from_int24_generic, from_int32_generic, from_float_neon,
+                                        from_float16_generic, from_bfloat16_neon};
+    convert_to_kernel neon_to[6] = {to_int16_neon, to_int24_generic, to_int32_generic, to_float_neon,
+                                    to_float16_generic, to_bfloat16_neon};
+#ifdef __aarch64__
+    neon_from[4] = from_float16_neon;
+    neon_to[4] = to_float16_neon;
+#endif
+    memcpy(from, neon_from, sizeof(from));
+    memcpy(to, neon_to, sizeof(to));
+  }
+#endif
+  memcpy(table->convert_from, from, sizeof(from));
+  memcpy(table->convert_to, to, sizeof(to));
+}
+
+static int kernel_index(enum mixed_encoding encoding){
+  switch(encoding){
+  case MIXED_INT16: return 0;
+  case MIXED_INT24: return 1;
+  case MIXED_INT32: return 2;
+  case MIXED_FLOAT: return 3;
+  case MIXED_FLOAT16: return 4;
+  case MIXED_BFLOAT16: return 5;
+  default: return -1;
+  }
+}
+
+int transfer_frames_from(enum mixed_encoding encoding, mixed_channel_t channels, const void *restrict in, float **outs, uint32_t frames, float volume){
+  int index = kernel_index(encoding);
+  if(index < 0 || channels == 0) return 0;
+  const struct kernel_table *table = kernels();
+  convert_from_kernel convert = table->convert_from[index];
+  uint8_t size = mixed_samplesize(encoding);
+  if(channels == 1){
+    convert(in, outs[0], frames, volume);
+    return 1;
+  }
+  float scratch[SCRATCH_SIZE];
+  float *chunk_outs[channels];
+  uint32_t chunk = SCRATCH_SIZE / channels;
+  const char *data = (const char *)in;
+  for(uint32_t f=0; f<frames; f+=chunk){
+    uint32_t count = MIN(chunk, frames-f);
+    convert(data + f*channels*size, scratch, count*channels, volume);
+    for(mixed_channel_t c=0; c<channels; ++c)
+      chunk_outs[c] = outs[c]+f;
+    deinterleave(scratch, chunk_outs, channels, count, table->features);
+  }
+  return 1;
+}
+
+int transfer_frames_to(enum mixed_encoding encoding, mixed_channel_t channels, float **ins, void *restrict out, uint32_t frames, float volume){
+  int index = kernel_index(encoding);
+  if(index < 0 || channels == 0) return 0;
+  const struct kernel_table *table = kernels();
+  convert_to_kernel convert = table->convert_to[index];
+  uint8_t size = mixed_samplesize(encoding);
+  if(channels == 1){
+    convert(ins[0], out, frames, volume);
+    return 1;
+  }
+  float scratch[SCRATCH_SIZE];
+  float *chunk_ins[channels];
+  uint32_t chunk = SCRATCH_SIZE / channels;
+  char *data = (char *)out;
+  for(uint32_t f=0; f<frames; f+=chunk){
+    uint32_t count = MIN(chunk, frames-f);
+    for(mixed_channel_t c=0; c<channels; ++c)
+      chunk_ins[c] = ins[c]+f;
+    interleave(chunk_ins, scratch, channels, count, table->features);
+    convert(scratch, data + f*channels*size, count*channels, volume);
+  }
+  return 1;
+}
+
+// Planes are already split up by channel, so they only need converting.
+int transfer_planes_from(enum mixed_encoding encoding, mixed_channel_t channels, uint32_t plane, const void *restrict in, float **outs, uint32_t frames, float volume){
+  int index = kernel_index(encoding);
+  if(index < 0) return 0;
+  convert_from_kernel convert = kernels()->convert_from[index];
+  for(mixed_channel_t c=0; c<channels; ++c)
+    convert((const char *)in + c*plane, outs[c], frames, volume);
+  return 1;
+}
+
+int transfer_planes_to(enum mixed_encoding encoding, mixed_channel_t channels, uint32_t plane, float **ins, void *restrict out, uint32_t frames, float volume){
+  int index = kernel_index(encoding);
+  if(index < 0) return 0;
+  convert_to_kernel convert = kernels()->convert_to[index];
+  for(mixed_channel_t c=0; c<channels; ++c)
+    convert(ins[c], (char *)out + c*plane, frames, volume);
+  return 1;
+}
@@ -5,6 +5,15 @@
 #include <stdbool.h>
 #include <time.h>
 #include "mixed.h"
+#ifdef MIXED_THREADS
+#include <pthread.h>
+#include <errno.h>
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+#else
+#include <semaphore.h>
+#endif
+#endif
 #ifdef __RDRND__
 #include <cpuid.h>
 #include <immintrin.h>
@@ -39,6 +48,55 @@ static inline void __ignore(char _, ...){(void)_;}
 #define debug_log(...)
 #endif
 
+#ifdef MIXED_THREADS
+// A counting semaphore whose post does not take a lock, so that the
+// mixing thread can wake a worker without risking a priority inversion.
+// Unnamed POSIX semaphores cannot be used on Darwin, as sem_init always
+// fails there, so we use dispatch semaphores instead.
+#ifdef __APPLE__
+struct semaphore{
+  dispatch_semaphore_t sem;
+};
+
+static inline int semaphore_init(struct semaphore *sem){
+  sem->sem = dispatch_semaphore_create(0);
+  return sem->sem != 0;
+}
+
+static inline void semaphore_destroy(struct semaphore *sem){
+  dispatch_release(sem->sem);
+}
+
+static inline void semaphore_post(struct semaphore *sem){
+  dispatch_semaphore_signal(sem->sem);
+}
+
+static inline void semaphore_wait(struct semaphore *sem){
+  dispatch_semaphore_wait(sem->sem, DISPATCH_TIME_FOREVER);
+}
+#else
+struct semaphore{
+  sem_t sem;
+};
+
+static inline int semaphore_init(struct semaphore *sem){
+  return sem_init(&sem->sem, 0, 0) == 0;
+}
+
+static inline void semaphore_destroy(struct semaphore *sem){
+  sem_destroy(&sem->sem);
+}
+
+static inline void semaphore_post(struct semaphore *sem){
+  sem_post(&sem->sem);
+}
+
+static inline void semaphore_wait(struct semaphore *sem){
+  while(sem_wait(&sem->sem) != 0 && errno == EINTR);
+}
+#endif
+#endif
+
 #if defined(__GNUC__) && !defined(__WIN32__)
 #if defined(__x86_64__)
 #define VECTORIZE __attribute__((target_clones("avx2","avx","sse4.1","default")))
@@ -51,6 +109,22 @@ static inline void __ignore(char _, ...){(void)_;}
 #define VECTORIZE
 #endif
 
+// Hot kernels are picked from the kernel table instead. For kernels that
+// are plain loops, DEF_KERNEL compiles the same body once per tier so
+// that the compiler vectorises it for the wider registers, and
+// KERNEL_TIER picks the variant for the given features.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DEF_KERNEL(name, params, ...)                                   \
+  static void name##_generic params __VA_ARGS__                         \
+  __attribute__((target("avx2,fma"))) static void name##_avx2 params __VA_ARGS__
+#define KERNEL_TIER(name, features)                                     \
+  ((((features) & CPU_TIER_AVX2) == CPU_TIER_AVX2)? name##_avx2 : name##_generic)
+#else
+#define DEF_KERNEL(name, params, ...)                   \
+  static void name##_generic params __VA_ARGS__
+#define KERNEL_TIER(name, features) ((void)(features), name##_generic)
+#endif
+
 struct bip{
   void *data;
   uint32_t size;
@@ -73,18 +147,28 @@ int vector_remove_pos(uint32_t i, struct vector *vector);
 int vector_remove_item(void *element, struct vector *vector);
 int vector_clear(struct vector *vector);
 
+int fft_fwd(uint32_t framesize, float *in, float *out, float *work);
+int fft_inv(uint32_t framesize, float *in, float *out, float *work);
+struct PFFFT_Setup *ensure_ffts(uint32_t framesize);
+
 struct fft_window_data{
   float *in_fifo;
   float *out_fifo;
   float *fft_workspace;
+  float *fft_scratch;
   float *output_accumulator;
   // Extra stuff used for pitch
   float *last_phase;
   float *phase_sum;
+  const float *window;
+  float window_scale;
+  enum mixed_fft_window window_type;
   long framesize;
   long oversampling;
   long overlap;
   long samplerate;
+  long in_index;
+  long out_index;
 };
 
 
@@ -92,10 +176,178 @@ typedef void (*fft_window_process)(struct fft_window_data *data, void *user);
 void fft_pitch_shift(struct fft_window_data *data, void *user);
 void fft_convolve(struct fft_window_data *data, void *user);
 
+const float *fft_window_table(enum mixed_fft_window type, uint32_t framesize);
+int fft_window_set_type(enum mixed_fft_window type, struct fft_window_data *data);
 void free_fft_window_data(struct fft_window_data *data);
 int make_fft_window_data(uint32_t framesize, uint32_t oversampling, uint32_t samplerate, struct fft_window_data *data);
 void fft_window(float *in, float *out, uint32_t samples, struct fft_window_data *data, fft_window_process process, void *user);
 
+#define CONVOLVER_MAX_STAGES 8
+
+enum convolver_job_state{
+  CONVOLVER_JOB_IDLE,
+  CONVOLVER_JOB_PENDING,
+  CONVOLVER_JOB_DONE
+};
+
+struct convolver_stage{
+  struct PFFFT_Setup *setup;
+  float *fir;
+  float *delay_line;
+  // Private input/result and scratch buffers for background stages
+  float *job;
+  float *job_scratch;
+  uint32_t block_size;
+  uint32_t offset;
+  uint32_t partition_count;
+  uint32_t index;
+  uint32_t target;
+  int state;
+  bool background;
+  bool late;
+};
+
+struct convolver_data{
+  struct convolver_stage stages[CONVOLVER_MAX_STAGES];
+  float *in_ring;
+  float *out_ring;
+  float *work;
+  float *scratch;
+  uint32_t stage_count;
+  uint32_t outputs;
+  uint32_t head;
+  uint32_t in_size;
+  uint32_t out_size;
+  uint32_t time;
+  uint32_t fill;
+  uint32_t overruns;
+#ifdef MIXED_THREADS
+  pthread_t thread;
+  struct semaphore signal;
+  int quit;
+  bool threaded;
+#endif
+};
+
+void free_convolver_data(struct convolver_data *data);
+// Frees a convolver allocated with mixed_calloc, without waiting on its
+// worker thread, which instead frees it once it is done.
+void retire_convolver_data(struct convolver_data *data);
+int make_convolver_data(float *fir, uint32_t fir_size, uint32_t outputs, uint32_t head, bool background, struct convolver_data *data);
+void convolver_reset(struct convolver_data *data);
+void convolver(float *in, float **out, uint32_t samples, struct convolver_data *data);
+
+struct direct_convolver_data{
+  float *fir;
+  float *history;
+  uint32_t size;
+};
+
+void free_direct_convolver_data(struct direct_convolver_data *data);
+int make_direct_convolver_data(float *fir, uint32_t fir_size, struct direct_convolver_data *data);
+void direct_convolver_reset(struct direct_convolver_data *data);
+void direct_convolver(float *in, float *out, uint32_t samples, struct direct_convolver_data *data);
+
+// The default FIR size up to which the convolution segment uses the
+// direct form rather than its windowed FFT mode. Per sample, the direct
+// form costs one multiply-add per tap, while the windowed mode at the
+// default frame size of 2048 costs about as much as 128 taps in FFTs
+// and spectrum products, before counting its frame of latency.
+#define DIRECT_CONVOLVER_CROSSOVER 128
+
+struct doppler_data{
+  float *buffer;
+  float delay;
+  // The propagation delay in samples, which the delay returns to.
+  float target;
+  // Without the propagation delay, the target is taken relative to this.
+  float origin;
+  float relax;
+  uint32_t index;
+  uint32_t size;
+  bool propagation;
+};
+
+// The propagation delay over the distance in samples. The doppler factor
+// scales it along with the pitch shift it causes.
+static inline float doppler_delay(float distance, float soundspeed, float doppler_factor, uint32_t samplerate){
+  return (0.0f < soundspeed)? doppler_factor * distance / soundspeed * samplerate : 0.0f;
+}
+
+void free_doppler_data(struct doppler_data *data);
+// Grows the line to hold at least max_delay samples, if needed. Without
+// the propagation delay the line has a short fixed size instead.
+int make_doppler_data(uint32_t samplerate, bool propagation, float max_delay, struct doppler_data *data);
+void doppler_reset(struct doppler_data *data);
+void doppler(float *in, float *out, uint32_t samples, float pitch, struct doppler_data *data);
+void doppler_skip(float *in, uint32_t samples, struct doppler_data *data);
+
+// "MHRT" in little endian
+#define HRTF_MAGIC 0x5452484D
+#define HRTF_MAX_LENGTH 65536
+
+struct hrtf_data{
+  // Unit vectors of the measured directions
+  float *direction[3];
+  // Left and right HRIR of each direction
+  float *irs;
+  // Convolver and input of each direction, made by hrtf_make_convolvers
+  // and sized by hrtf_ensure_capacity
+  struct convolver_data *convolvers;
+  float **input;
+  uint32_t *idle;
+  bool *used;
+  float *scratch[2];
+  uint32_t count;
+  uint32_t length;
+  uint32_t capacity;
+};
+
+void free_hrtf_data(struct hrtf_data *data);
+int load_hrtf_data(const char *path, uint32_t samplerate, struct hrtf_data *data);
+int hrtf_make_convolvers(struct hrtf_data *data);
+int hrtf_fold(const float *matrix, uint32_t stride, uint32_t channels, struct convolver_data *convolvers, struct hrtf_data *data);
+int hrtf_ensure_capacity(uint32_t samples, struct hrtf_data *data);
+void hrtf_use(uint32_t direction, uint32_t samples, struct hrtf_data *data);
+void hrtf_render(float *restrict left, float *restrict right, uint32_t samples, struct hrtf_data *data);
+void hrtf_compute_gains_batch(uint32_t count, const float *restrict x, const float *restrict y, const float *restrict z, float *restrict gains[3], uint32_t *restrict targets[3], struct hrtf_data *data);
+
+// The number of sources whose air absorption is filtered together.
+#define AIR_BANK_LANES 8
+#define AIR_TABLE_SIZE 256
+
+struct air_absorption_data{
+  // One-pole coefficients over the distance between min and max.
+  float table[AIR_TABLE_SIZE+1];
+  float cutoff;
+};
+
+void air_absorption_table(float cutoff, uint32_t samplerate, struct air_absorption_data *data);
+float air_absorption_coefficient(float min, float max, float distance, struct air_absorption_data *data);
+void air_absorption_bank(uint32_t n, float *restrict ins[], uint32_t samples, const float *restrict coefficients, float *states[]);
+
+// Convert between interleaved frames and channel buffers at a constant
+// volume. Returns 0 without touching anything if there is no kernel for
+// the encoding.
+int transfer_frames_from(enum mixed_encoding encoding, mixed_channel_t channels, const void *restrict in, float **outs, uint32_t frames, float volume);
+int transfer_frames_to(enum mixed_encoding encoding, mixed_channel_t channels, float **ins, void *restrict out, uint32_t frames, float volume);
+// The same for planar frames, with the planes plane bytes apart.
+int transfer_planes_from(enum mixed_encoding encoding, mixed_channel_t channels, uint32_t plane, const void *restrict in, float **outs, uint32_t frames, float volume);
+int transfer_planes_to(enum mixed_encoding encoding, mixed_channel_t channels, uint32_t plane, float **ins, void *restrict out, uint32_t frames, float volume);
+
+// Pick the array transfer function for the encoding and byte order of
+// the pack that applies the change from volume to target_volume per the
+// volume mode of the pack.
+mixed_transfer_function_from transfer_function_from(struct mixed_pack *pack, float volume, float target_volume);
+mixed_transfer_function_to transfer_function_to(struct mixed_pack *pack, float volume, float target_volume);
+
+#define AMBISONIC_MAX_ORDER 3
+#define AMBISONIC_CHANNELS(ORDER) (((ORDER)+1)*((ORDER)+1))
+#define AMBISONIC_MAX_CHANNELS AMBISONIC_CHANNELS(AMBISONIC_MAX_ORDER)
+
+void ambisonic_encode(const float direction[3], uint32_t order, float *restrict gains);
+void ambisonic_max_re_weights(uint32_t order, float weights[AMBISONIC_MAX_ORDER+1]);
+
 float attenuation_none(float min, float max, float dist, float roll);
 float attenuation_inverse(float min, float max, float dist, float roll);
 float attenuation_linear(float min, float max, float dist, float roll);
@@ -150,6 +402,36 @@ inline float biquad_sample(float sample, struct biquad_data *data){
   return L;
 }
 
+// The table of hot kernels, filled once for the features of the CPU.
+// Every module with kernels fills in its own entries.
+#define CPU_TIER_AVX2 (MIXED_CPU_AVX2 | MIXED_CPU_FMA)
+
+typedef void (*convert_from_kernel)(const void *restrict in, float *restrict out, uint32_t samples, float volume);
+typedef void (*convert_to_kernel)(const float *restrict in, void *restrict out, uint32_t samples, float volume);
+typedef void (*mix_add_kernel)(float *restrict out, const float *restrict in, uint32_t samples, float volume);
+typedef void (*biquad_kernel)(const float *in, float *out, uint32_t samples, struct biquad_data *state);
+typedef void (*split_multiply_add_kernel)(float *restrict dst_re, float *restrict dst_im, const float *restrict l_re, const float *restrict l_im, const float *restrict r_re, const float *restrict r_im, uint32_t size);
+typedef void (*window_kernel)(float *restrict out, const float *restrict in, const float *restrict window, uint32_t samples);
+typedef void (*window_add_kernel)(float *restrict out, const float *restrict in, const float *restrict window, float scale, uint32_t samples);
+
+struct kernel_table{
+  uint32_t features;
+  // Indexed by int16, int24, int32, float, float16, bfloat16.
+  convert_from_kernel convert_from[6];
+  convert_to_kernel convert_to[6];
+  mix_add_kernel mix_add;
+  biquad_kernel biquad;
+  split_multiply_add_kernel split_multiply_add;
+  window_kernel window;
+  window_add_kernel window_add;
+};
+
+const struct kernel_table *kernels(void);
+void interleave_kernels(uint32_t features, struct kernel_table *table);
+void biquad_kernels(uint32_t features, struct kernel_table *table);
+void convolution_kernels(uint32_t features, struct kernel_table *table);
+void fft_window_kernels(uint32_t features, struct kernel_table *table);
+
 float hilbert(float input, float *delay, uint32_t delay_size, uint32_t delay_i);
 
 int mix_noop(struct mixed_segment *segment);
@@ -183,6 +465,23 @@ unsigned int mixed_random_int(void);
 #define atomic_read(PLACE) __atomic_load_n(&PLACE, __ATOMIC_SEQ_CST)
 #define atomic_write(PLACE, VAL) __atomic_store_n(&PLACE, VAL, __ATOMIC_SEQ_CST)
 #define atomic_cas(PLACE, OLD, NEW) __sync_bool_compare_and_swap(&PLACE, OLD, NEW)
+#define atomic_swap(PLACE, VAL) __atomic_exchange_n(&PLACE, VAL, __ATOMIC_SEQ_CST)
+
+// The slot of an encoding in tables indexed by encoding. The 16 bit
+// floats follow right after MIXED_DOUBLE, rather than at their value.
+static inline uint32_t encoding_index(enum mixed_encoding encoding){
+  switch(encoding){
+  case MIXED_FLOAT16: return MIXED_DOUBLE;
+  case MIXED_BFLOAT16: return MIXED_DOUBLE+1;
+  default: return encoding-1;
+  }
+}
+
+static inline bool valid_encoding(enum mixed_encoding encoding){
+  return (MIXED_INT8 <= encoding && encoding <= MIXED_DOUBLE)
+    || encoding == MIXED_FLOAT16 || encoding == MIXED_BFLOAT16;
+}
+
 #define FREE(PLACE) if(PLACE){mixed_free(PLACE); PLACE=0;}
 
 static inline float vec_dot(const float a[3], const float b[3]){
@@ -254,15 +553,25 @@ struct vbap_set{
   float inv_mat[9];
 };
 
+// Layouts with at least this many sets get a direction lookup grid.
+#define VBAP_GRID_MIN_SETS 4
+#define VBAP_GRID_SIZE 64
+
 struct vbap_data{
   char dims;
   mixed_channel_t speaker_count;
   float speakers[MIXED_MAX_SPEAKER_COUNT][3];
   int set_count;
   struct vbap_set sets[MAX_VBAP_SETS];
+  // The best set for each vertex of a grid over the octahedral
+  // parameterisation of the sphere. Only valid if has_grid is set.
+  bool has_grid;
+  uint16_t grid[VBAP_GRID_SIZE+1][VBAP_GRID_SIZE+1];
 };
 
 int mixed_compute_gains(const float position[3], float gains[], mixed_channel_t speakers[], mixed_channel_t *count, struct vbap_data *data);
+#define VBAP_BATCH_SIZE 64
+void mixed_compute_gains_batch(uint32_t count, float *restrict x, float *restrict y, float *restrict z, float *restrict gains[3], uint32_t *restrict sets, struct vbap_data *data);
 int make_vbap(float speakers[][3], mixed_channel_t speaker_count, int dim, struct vbap_data *data);
 int make_vbap_from_configuration(struct mixed_channel_configuration const* configuration, struct vbap_data *data);
 int make_vbap_from_channel_count(mixed_channel_t speaker_count, struct vbap_data *data);
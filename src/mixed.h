@@ -139,8 +139,9 @@ extern "C" {
   };
 
   /// This enum describes the possible sample encodings.
-  /// All encodings are little-endian.
-  /// 
+  /// All encodings are little-endian unless the layout of the pack
+  /// says otherwise.
+  /// See mixed_layout
   MIXED_EXPORT enum mixed_encoding{
     /// Corresponds to int8_t (signed 8-bit integer)
     MIXED_INT8 = 1,
@@ -161,7 +162,42 @@ extern "C" {
     /// Corresponds to float (IEEE 754 single precision floating point)
     MIXED_FLOAT,
     /// Corresponds to double (IEEE 754 double precision floating point)
-    MIXED_DOUBLE
+    MIXED_DOUBLE,
+    /// IEEE 754 half precision floating point, stored as uint16_t
+    ///
+    /// Unlike the other encodings this is not also a field type, so
+    /// its value lies outside of the range of field types.
+    /// See mixed_from_float16
+    MIXED_FLOAT16 = 0x100,
+    /// bfloat16, the upper half of a float, stored as uint16_t
+    ///
+    /// Unlike the other encodings this is not also a field type, so
+    /// its value lies outside of the range of field types.
+    /// See mixed_from_bfloat16
+    MIXED_BFLOAT16
+  };
+
+  /// This enum describes how the samples are arranged in a pack.
+  ///
+  /// The values are flags, one for the arrangement of the channels
+  /// and one for the byte order, which are combined into a bitmask.
+  /// See mixed_pack
+  MIXED_EXPORT enum mixed_layout{
+    /// The samples of a frame follow each other.
+    MIXED_INTERLEAVED = 0x0,
+    /// Each channel has its own plane of consecutive samples.
+    ///
+    /// The pack is split into as many planes as there are channels,
+    /// each of size/channels bytes. The planes are filled and consumed
+    /// together in whole frames, so an area obtained from the pack
+    /// points into the first plane, and the same area of every other
+    /// plane follows at multiples of size/channels bytes. The size of
+    /// the area still counts the bytes of all planes.
+    MIXED_PLANAR = 0x1,
+    /// Samples are stored with the least significant byte first.
+    MIXED_LITTLE_ENDIAN = 0x0,
+    /// Samples are stored with the most significant byte first.
+    MIXED_BIG_ENDIAN = 0x2
   };
 
   /// This enum describes all possible flags of the
@@ -197,6 +233,9 @@ extern "C" {
     MIXED_FADE_TO,
     /// Access the time (in seconds) it takes to fade
     /// between the FROM and TO values as a float.
+    /// For the convolution segment this is the time it takes to
+    /// crossfade to a newly set FIR, which only happens in the
+    /// MIXED_CONVOLUTION_PARTITIONED mode. The default there is 0.05
     MIXED_FADE_TIME,
     /// Acccess the type of fading function that is used.
     /// See mixed_fade_type
@@ -232,8 +271,19 @@ extern "C" {
     MIXED_SPACE_SOUNDSPEED,
     /// Access the doppler factor value as a float.
     /// Changing this can exaggerate or dampen the doppler
-    /// effect's potency.
-    /// The default is 1
+    /// effect's potency. A value of 0 disables it.
+    /// The doppler shift is simulated per source by a delay
+    /// line whose length follows the relative velocity, and
+    /// which is allocated only while the factor is above 0.
+    /// Unless MIXED_SPACE_PROPAGATION_DELAY is set, the delay
+    /// starts in the middle of a line of at least a tenth of
+    /// a second, which delays every source by about 85ms at
+    /// 48kHz, and follows the change of the propagation delay
+    /// by at least 50ms either way. Beyond that the pitch
+    /// shift stops until the source turns around. Once the
+    /// relative velocity is zero the delay slowly drifts back
+    /// to the one of the source's current location.
+    /// The default is 0
     MIXED_SPACE_DOPPLER_FACTOR,
     /// Access the minimal distance as a float.
     /// Any distance lower than this will make the sound
@@ -386,7 +436,7 @@ extern "C" {
     /// Access the current position of the repeater buffer.
     /// 
     MIXED_REPEAT_POSITION,
-    /// The frame size of the FFT, must be a powerof two in [2^1, 2^13]
+    /// The frame size of the FFT, must be a powerof two in [2^5, 2^13]
     /// The default is 2048
     MIXED_FRAMESIZE,
     /// The oversampling rate between FFT frames.
@@ -403,6 +453,16 @@ extern "C" {
     /// used, but the read is *not* committed, meaning that after the FIR
     /// is set, the buffer will still have the same amount of available
     /// data to be read.
+    /// In MIXED_CONVOLUTION_PARTITIONED mode the new FIR is transformed
+    /// on the calling thread, which may differ from the mixing thread,
+    /// and the segment then crossfades to it over MIXED_FADE_TIME
+    /// without interrupting the output.
+    /// In the MIXED_CONVOLUTION_WINDOWED and MIXED_CONVOLUTION_DIRECT
+    /// modes the FIR is instead replaced right away, which must happen
+    /// on the mixing thread. The output then jumps to the new response
+    /// and the input held by the old one is dropped, which is audible
+    /// as a click. Use MIXED_CONVOLUTION_PARTITIONED to change FIRs
+    /// while the segment is playing.
     MIXED_FIR,
     /// The specific channel configuration of the segment.
     /// The field is a MIXED_CHANNEL_CONFIGURATION_POINTER.
@@ -414,6 +474,131 @@ extern "C" {
     /// Note that this is separate from receiving distance attenuation.
     /// The default is 1
     MIXED_SPACE_SPATIAL,
+    /// Access the window function applied to the FFT frames.
+    /// The value must be from the mixed_fft_window enum.
+    /// The default is MIXED_HANN_WINDOW
+    MIXED_FFT_WINDOW,
+    /// Access the processing method of the convolution segment.
+    /// The value must be from the mixed_convolution_mode enum.
+    /// The default is MIXED_CONVOLUTION_DIRECT for short FIRs, and
+    /// MIXED_CONVOLUTION_WINDOWED otherwise.
+    MIXED_CONVOLUTION_MODE,
+    /// Access the size of the first partition in samples when using
+    /// MIXED_CONVOLUTION_PARTITIONED. The value must be a power of two
+    /// in [16, 8192] and is also the latency of the convolution.
+    /// The default is 128
+    MIXED_PARTITION_SIZE,
+    /// Access whether the segment hands work off to a background thread
+    /// as a boolean. For the convolution segment in
+    /// MIXED_CONVOLUTION_PARTITIONED mode this moves all but the first
+    /// partitions to a worker thread, leaving only the short head on the
+    /// mixing thread. The worker must finish each block before the same
+    /// stage is due again. The mixing thread waits for it for at most
+    /// half a millisecond, after which the stage's output is dropped
+    /// and counted in MIXED_BACKGROUND_OVERRUNS.
+    /// Fails with MIXED_NOT_IMPLEMENTED if the library was built
+    /// without thread support.
+    /// The default is 0
+    MIXED_BACKGROUND_PROCESSING,
+    /// Access the maximal number of voices that are actually mixed
+    /// as a uint32_t. If more sources are audible, only the ones with
+    /// the highest loudness times priority are mixed, and the rest is
+    /// virtualised: their input is consumed, but not mixed.
+    /// The default is UINT32_MAX
+    MIXED_SPACE_MAX_VOICES,
+    /// Access the loudness below which a source is virtualised as a
+    /// float. The loudness is the highest gain the source has on any
+    /// speaker after attenuation, before the segment volume is applied.
+    /// The default is 0.0001, which is -80dB
+    MIXED_SPACE_AUDIBILITY_THRESHOLD,
+    /// Access the priority of the source as a float. Sources are picked
+    /// for mixing by their loudness multiplied with their priority.
+    /// The default is 1.0
+    MIXED_SPACE_PRIORITY,
+    /// Read the number of sources that were mixed in the last block
+    /// as a uint32_t.
+    MIXED_SPACE_ACTIVE_VOICES,
+    /// Read the number of sources that were virtualised in the last
+    /// block as a uint32_t.
+    MIXED_SPACE_VIRTUAL_VOICES,
+    /// Access the number of threads the segment mixes on as a uint32_t.
+    /// For the space mixer the sources are split up between the mixing
+    /// thread and count-1 worker threads, each of which mixes into its
+    /// own copy of the outputs that are summed up at the end of the
+    /// block. Blocks with few sources are still mixed on one thread.
+    /// Fails with MIXED_NOT_IMPLEMENTED for counts above one if the
+    /// library was built without thread support.
+    /// The default is 1
+    MIXED_THREAD_COUNT,
+    /// Read the ambisonic order of the bus as a uint32_t.
+    /// The bus has (order+1)² channels.
+    MIXED_AMBISONIC_ORDER,
+    /// Set the path to an HRTF table file to render binaurally with, as
+    /// a const char *. A null pointer switches back to speaker panning.
+    /// Sources, or the virtual speakers of the ambisonic decoder, are
+    /// panned between the three closest measured directions,
+    /// and each direction in use is convolved with its pair of impulse
+    /// responses once, no matter how many sources share it. The
+    /// ambisonic decoder instead folds its panning into one pair of
+    /// impulse responses per bus channel when the table is set, so its
+    /// cost does not depend on the size of the table. HRTFs are
+    /// only used while the output is stereo, and add 64 samples of
+    /// latency. The table has to be recorded at the segment's samplerate.
+    /// The file consists of little-endian 32 bit fields:
+    ///
+    /// * The magic number 0x5452484D ("MHRT")
+    /// * The version, which must be 1
+    /// * The samplerate of the responses
+    /// * The number of measured directions
+    /// * The number of samples per impulse response
+    ///
+    /// Followed for each direction by the azimuth and elevation in
+    /// degrees as floats, the azimuth going counter-clockwise from the
+    /// front, and the left and the right impulse response as floats.
+    MIXED_SPACE_HRTF,
+    /// Set the properties of a range of sources at once.
+    /// The value is a pointer to a struct mixed_source_update.
+    /// This is the same as setting every field on every source of the
+    /// range separately, but only dispatches once. If any location in
+    /// the range has no source, or a field is not supported by the
+    /// segment, nothing is changed.
+    /// Can only be set.
+    MIXED_SOURCE_UPDATE,
+    /// Access the cutoff frequency in Hz of the low-pass filter that
+    /// simulates air absorption for sources at their max distance, as
+    /// a float. The cutoff falls exponentially with the distance from
+    /// the samplerate at the min distance down to this value. Must be
+    /// below half the samplerate. 0 disables the filtering.
+    /// The default is 0
+    MIXED_SPACE_AIR_ABSORPTION,
+    /// Access how a change of the volume is applied.
+    /// The value must be from the mixed_volume_mode enum. On the
+    /// packer and unpacker this accesses the volume_mode of the pack.
+    /// The default is MIXED_VOLUME_ZERO_CROSSING
+    MIXED_VOLUME_MODE,
+    /// Read how often the background thread has not delivered a result
+    /// in time, as a uint32_t. Each overrun drops the output of the
+    /// late stage of the partitioned convolution, and as the stage
+    /// also misses an input block, it stays silent until it has
+    /// taken in as many new blocks as it has partitions. The count
+    /// restarts when the FIR is updated.
+    MIXED_BACKGROUND_OVERRUNS,
+    /// Access the FIR size in taps up to which the convolution segment
+    /// picks MIXED_CONVOLUTION_DIRECT over MIXED_CONVOLUTION_WINDOWED,
+    /// as a uint32_t. Setting it picks the mode anew, unless the mode
+    /// was set explicitly.
+    /// The default is 128
+    MIXED_DIRECT_CROSSOVER,
+    /// Access whether the doppler delay lines simulate the full
+    /// propagation delay, as a bool. If set, every source is delayed
+    /// by the time its sound takes to reach the listener, times the
+    /// doppler factor, and the pitch shift carries on up to
+    /// MIXED_SPACE_MAX_DISTANCE. Each line then holds the propagation
+    /// delay at the max distance, but at most about five seconds at
+    /// 48kHz, which at the default max distance is a megabyte of
+    /// memory and close to three seconds of delay per source.
+    /// The default is false
+    MIXED_SPACE_PROPAGATION_DELAY,
   };
 
   /// This enum descripbes the possible resampling quality options.
@@ -487,6 +672,84 @@ extern "C" {
     MIXED_CUBIC_IN_OUT
   };
 
+  /// This enum describes the possible FFT frame window functions.
+  ///
+  /// The same window is applied both before the forward and after the
+  /// inverse transform, and the overlapping frames are normalised to
+  /// unity gain.
+  MIXED_EXPORT enum mixed_fft_window{
+    /// The raised cosine window.
+    ///
+    ///   w = 0.5 - 0.5 cos(2πk/N)
+    MIXED_HANN_WINDOW = 1,
+    /// A raised cosine window with lower sidelobes, that does not
+    /// touch zero at its ends.
+    ///
+    ///   w = 0.54 - 0.46 cos(2πk/N)
+    MIXED_HAMMING_WINDOW,
+    /// A four term window with very low sidelobes, best used with an
+    /// oversampling factor of at least 4.
+    ///
+    ///   w = 0.35875 - 0.48829 cos(2πk/N) + 0.14128 cos(4πk/N) - 0.01168 cos(6πk/N)
+    MIXED_BLACKMAN_HARRIS_WINDOW,
+    /// The square root of the Hann window, which reconstructs perfectly
+    /// at any oversampling factor of 2 or more.
+    ///
+    ///   w = sqrt(0.5 - 0.5 cos(2πk/N))
+    MIXED_SQRT_HANN_WINDOW
+  };
+
+  /// This enum describes the processing methods of the convolution segment.
+  ///
+  MIXED_EXPORT enum mixed_convolution_mode{
+    /// Convolve with overlapping windowed FFT frames of the segment's
+    /// framesize. This has a latency of the framesize and only
+    /// approximates the true convolution.
+    MIXED_CONVOLUTION_WINDOWED = 1,
+    /// Convolve exactly with a non-uniformly partitioned FIR. The head
+    /// of the FIR is processed in small blocks of MIXED_PARTITION_SIZE
+    /// samples, which also determines the latency, while the tail is
+    /// processed in progressively larger blocks to keep the cost low
+    /// even for long FIRs.
+    MIXED_CONVOLUTION_PARTITIONED,
+    /// Convolve exactly in the time domain, without any latency. This
+    /// is the cheapest method for short FIRs only, and is picked
+    /// automatically for FIRs of up to MIXED_DIRECT_CROSSOVER taps.
+    MIXED_CONVOLUTION_DIRECT
+  };
+
+  /// This enum describes how a change of the volume is applied.
+  ///
+  /// Either way, while the volume does not change the samples are
+  /// scaled by a constant.
+  MIXED_EXPORT enum mixed_volume_mode{
+    /// Keep the old volume until the signal crosses zero, then jump to
+    /// the new volume. This avoids clicks without any smoothing, but
+    /// has to check every sample, and the change may be delayed
+    /// indefinitely for signals that do not cross zero.
+    MIXED_VOLUME_ZERO_CROSSING = 0,
+    /// Ramp linearly from the old to the new volume over the next
+    /// processed block.
+    MIXED_VOLUME_RAMP
+  };
+
+  /// This enum describes the CPU features the kernels make use of.
+  ///
+  /// The values are flags and are combined into a bitmask.
+  /// See mixed_cpu_features
+  MIXED_EXPORT enum mixed_cpu_feature{
+    /// SSE2 on x86.
+    MIXED_CPU_SSE2 = 0x1,
+    /// AVX2 on x86. The AVX2 kernels also need MIXED_CPU_FMA.
+    MIXED_CPU_AVX2 = 0x2,
+    /// Fused multiply-add on x86.
+    MIXED_CPU_FMA = 0x4,
+    /// NEON on ARM.
+    MIXED_CPU_NEON = 0x8,
+    /// Half precision conversions on x86.
+    MIXED_CPU_F16C = 0x10
+  };
+
   /// This enum describes the possible generator wave types.
   /// 
   MIXED_EXPORT enum mixed_generator_type{
@@ -728,6 +991,12 @@ extern "C" {
     MIXED_DURATION_T,
     /// A pointer to a mixed_channel_configuration
     MIXED_CHANNEL_CONFIGURATION_POINTER,
+    /// An enum mixed_fft_window
+    MIXED_FFT_WINDOW_ENUM,
+    /// An enum mixed_convolution_mode
+    MIXED_CONVOLUTION_MODE_ENUM,
+    /// An enum mixed_volume_mode
+    MIXED_VOLUME_MODE_ENUM,
   };
 
   /// Type used for channel count descriptions.
@@ -742,6 +1011,28 @@ extern "C" {
     mixed_channel_t positions[MIXED_MAX_SPEAKER_COUNT];
   };
 
+  /// Describes a bulk update of sources for MIXED_SOURCE_UPDATE.
+  /// Every array holds the values of count consecutive sources, starting
+  /// with the source at input location start. Vectors are interleaved,
+  /// with two floats per source for the plane mixer and three for the
+  /// others. A null array leaves that field of the sources unchanged.
+  MIXED_EXPORT struct mixed_source_update{
+    uint32_t start;
+    uint32_t count;
+    /// MIXED_SPACE_LOCATION or MIXED_PLANE_LOCATION
+    float *location;
+    /// MIXED_SPACE_VELOCITY or MIXED_PLANE_VELOCITY
+    float *velocity;
+    /// MIXED_SPACE_MIN_DISTANCE
+    float *min_distance;
+    /// MIXED_SPACE_MAX_DISTANCE
+    float *max_distance;
+    /// MIXED_SPACE_ROLLOFF
+    float *rolloff;
+    /// MIXED_SPACE_PRIORITY
+    float *priority;
+  };
+
   /// Type used for decibel descriptions.
   ///
   typedef float mixed_decibel_t;
@@ -794,6 +1085,12 @@ extern "C" {
     /// The sample rate at which data is encoded in Hz.
     /// 
     uint32_t samplerate;
+    /// How a change of the volume is applied when converting.
+    /// See mixed_volume_mode
+    enum mixed_volume_mode volume_mode;
+    /// How the samples are arranged in the byte array.
+    /// See mixed_layout
+    enum mixed_layout layout;
   };
 
   /// Metadata struct for a segment's field.
@@ -953,7 +1250,8 @@ extern "C" {
   /// You are responsible for passing in an array of buffers that is
   /// at least as long as the channel's channel count.
   /// The volume is a linear multiplier you can pass to adjust the
-  /// volume in the resulting buffers.
+  /// volume in the resulting buffers. A change from volume to
+  /// target_volume is applied according to the pack's volume_mode.
   /// pack.frames should be set to the number of frames in the input
   /// pack, and will be set to the number of frames that have actually
   /// been read from the packed buffer. This may be less if the
@@ -966,7 +1264,8 @@ extern "C" {
   /// You are responsible for passing in an array of buffers that is
   /// at least as long as the channel's channel count.
   /// The volume is a linear multiplier you can pass to adjust the
-  /// volume in the resulting channel.
+  /// volume in the resulting channel. A change from volume to
+  /// target_volume is applied according to the pack's volume_mode.
   /// pack.frames should be set to the number of frames in the output
   /// pack, and will be set to the number of frames that have actually
   /// been written to the pack. This may be less if the input buffers
@@ -1216,6 +1515,13 @@ extern "C" {
   /// The sample rate given denotes the target sample rate of the
   /// buffers connected to the outputs of this segment. The source
   /// sample rate is the sample rate stored in the channel.
+  ///
+  /// If the pack holds planar little-endian floats at the sample
+  /// rate of the buffers, and the buffers attached to the outputs
+  /// have no data array of their own, the buffers are turned into
+  /// views of the planes instead and no samples are copied. Unless
+  /// the volume is changed from 1.0, the samples are then passed on
+  /// as they are, without being clamped.
   MIXED_EXPORT int mixed_make_segment_unpacker(struct mixed_pack *packed, uint32_t samplerate, struct mixed_segment *segment);
 
   /// An audio packer.
@@ -1347,6 +1653,7 @@ extern "C" {
   ///
   /// * MIXED_SPACE_LOCATION
   /// * MIXED_SPACE_VELOCITY
+  /// * MIXED_SPACE_PRIORITY
   ///
   /// The position, velocity, and general properties of the space mixing
   /// are configured through the general field set/get functions. The
@@ -1358,14 +1665,25 @@ extern "C" {
   /// * MIXED_SPACE_UP
   /// * MIXED_SPACE_SOUNDSPEED
   /// * MIXED_SPACE_DOPPLER_FACTOR
+  /// * MIXED_SPACE_PROPAGATION_DELAY
   /// * MIXED_SPACE_MIN_DISTANCE
   /// * MIXED_SPACE_MAX_DISTANCE
   /// * MIXED_SPACE_ROLLOFF
   /// * MIXED_SPACE_ATTENUATION
+  /// * MIXED_SPACE_MAX_VOICES
+  /// * MIXED_SPACE_AUDIBILITY_THRESHOLD
+  /// * MIXED_SPACE_ACTIVE_VOICES
+  /// * MIXED_SPACE_VIRTUAL_VOICES
+  /// * MIXED_THREAD_COUNT
+  /// * MIXED_SPACE_HRTF
+  /// * MIXED_SPACE_AIR_ABSORPTION
+  /// * MIXED_SOURCE_UPDATE
   ///
   /// See the MIXED_FIELDS enum for the documentation of each field.
   /// This segment does allow you to change fields and buffers while the
-  /// mixing has already been started.
+  /// mixing has already been started. When a change alters the gains of
+  /// a source, the gains are interpolated across the next mixed block, so
+  /// positions can be updated at a lower rate than blocks are mixed.
   MIXED_EXPORT int mixed_make_segment_space_mixer(uint32_t samplerate, struct mixed_segment *segment);
 
   /// A planar (2D) processed mixer
@@ -1387,16 +1705,81 @@ extern "C" {
   /// * MIXED_PLANE_VELOCITY
   /// * MIXED_SPACE_SOUNDSPEED
   /// * MIXED_SPACE_DOPPLER_FACTOR
+  /// * MIXED_SPACE_PROPAGATION_DELAY
   /// * MIXED_SPACE_MIN_DISTANCE
   /// * MIXED_SPACE_MAX_DISTANCE
   /// * MIXED_SPACE_ROLLOFF
   /// * MIXED_SPACE_ATTENUATION
+  /// * MIXED_SPACE_AIR_ABSORPTION
+  /// * MIXED_SOURCE_UPDATE
   ///
   /// See the MIXED_FIELDS enum for the documentation of each field.
   /// This segment does allow you to change fields and buffers while the
-  /// mixing has already been started.
+  /// mixing has already been started. Volume changes are interpolated
+  /// across the next mixed block.
   MIXED_EXPORT int mixed_make_segment_plane_mixer(uint32_t samplerate, struct mixed_segment *segment);
 
+  /// An ambisonic encoder
+  ///
+  /// This segment mixes positioned sources into an ambisonic bus of the
+  /// given order, which must be within [1,3]. The bus has (order+1)²
+  /// outputs in ACN channel order with SN3D normalisation (AmbiX). Unlike
+  /// the space mixer the cost per source does not depend on the speaker
+  /// layout, and the bus can be decoded to any layout with an ambisonic
+  /// decoder segment. The segment takes an arbitrary number of mono
+  /// inputs, each of which has the following fields aside from the buffer:
+  ///
+  /// * MIXED_SPACE_LOCATION
+  /// * MIXED_SPACE_MIN_DISTANCE
+  /// * MIXED_SPACE_MAX_DISTANCE
+  /// * MIXED_SPACE_ROLLOFF
+  ///
+  /// The following fields are understood on the segment:
+  ///
+  /// * MIXED_VOLUME
+  /// * MIXED_SPACE_LOCATION
+  /// * MIXED_SPACE_MIN_DISTANCE
+  /// * MIXED_SPACE_MAX_DISTANCE
+  /// * MIXED_SPACE_ROLLOFF
+  /// * MIXED_SPACE_ATTENUATION
+  /// * MIXED_AMBISONIC_ORDER
+  /// * MIXED_OUT_COUNT
+  /// * MIXED_SOURCE_UPDATE
+  ///
+  /// The bus is not rotated with the listener. Instead, the orientation
+  /// is set on the decoder, which only needs to update its own matrix.
+  /// Gain changes are interpolated across the next mixed block.
+  MIXED_EXPORT int mixed_make_segment_ambisonic_encoder(uint32_t order, struct mixed_segment *segment);
+
+  /// An ambisonic decoder
+  ///
+  /// This segment takes an ambisonic bus of the given order, as produced
+  /// by the ambisonic encoder, and decodes it to a speaker layout. The
+  /// default layout is stereo. The decoder samples the sphere with a set
+  /// of virtual speakers and pans those onto the layout with VBAP, so
+  /// irregular layouts like 5.1 are handled as well. The following
+  /// fields are understood:
+  ///
+  /// * MIXED_VOLUME
+  /// * MIXED_SPACE_DIRECTION
+  /// * MIXED_SPACE_UP
+  /// * MIXED_AMBISONIC_ORDER
+  /// * MIXED_OUT_COUNT
+  /// * MIXED_CHANNEL_CONFIGURATION
+  /// * MIXED_SAMPLERATE
+  /// * MIXED_SPACE_HRTF
+  ///
+  /// Changing the listener orientation only recomputes the decoding
+  /// matrix, and is interpolated across the next mixed block.
+  ///
+  /// If an HRTF table is set and the output is stereo, the virtual
+  /// speakers are panned onto the measured HRTF directions instead and
+  /// rendered binaurally. That decoder is folded into one stereo pair of
+  /// impulse responses per bus channel, and the listener orientation
+  /// rotates the bus before it is convolved. The table must match
+  /// MIXED_SAMPLERATE unless that is 0, which is the default.
+  MIXED_EXPORT int mixed_make_segment_ambisonic_decoder(uint32_t order, struct mixed_segment *segment);
+
   /// A delay segment
   ///
   /// This segment will simply delay the incoming samples to the output by
@@ -1594,8 +1977,28 @@ extern "C" {
   /// the size of the FFT frames that are processed. Larger frames lead to
   /// better quality at the cost of greater latency. 2048 should be a good
   /// default.
+  ///
+  /// If the FIR is short enough that convolving it directly in the time
+  /// domain is cheaper, the segment starts in MIXED_CONVOLUTION_DIRECT
+  /// mode instead, which has no latency. See MIXED_CONVOLUTION_MODE.
   MIXED_EXPORT int mixed_make_segment_convolution(uint32_t framesize, float *fir, uint32_t fir_size, uint32_t samplerate, struct mixed_segment *segment);
 
+  /// A segment convolving one input with several FIRs at once.
+  ///
+  /// This is useful for stereo or binaural reverbs, where the same
+  /// signal is convolved with one impulse response per output. The input
+  /// is only transformed once and shared by all outputs.
+  ///
+  /// firs should hold outputs impulse responses of fir_size elements
+  /// each, one after the other. The firs array may be freed after the
+  /// call to this function.
+  ///
+  /// The convolution is exact and uses the same non-uniform partitions
+  /// as the MIXED_CONVOLUTION_PARTITIONED mode of the convolution
+  /// segment, with partition_size being the size of the first partition
+  /// as described for MIXED_PARTITION_SIZE.
+  MIXED_EXPORT int mixed_make_segment_multi_convolution(uint32_t partition_size, float *firs, uint32_t fir_size, uint32_t outputs, struct mixed_segment *segment);
+
   /// An 8-band equalizer used for frequency adaptation.
   ///
   /// Each band is a multiplicative factor, with 1.0 being no adjustment.
@@ -1749,12 +2152,26 @@ extern "C" {
   ///
   MIXED_EXPORT mixed_transfer_function_to mixed_translator_to(enum mixed_encoding encoding);
 
+  /// Prepare the fast fourier transform setup for the given framesize.
+  ///
+  /// framesize must be a valid size for mixed_fwd_fft. The setup for
+  /// a framesize is created once and then shared between all users of
+  /// the library. Segments prepare the setups they need when they are
+  /// created, but you may call this ahead of time to ensure that the
+  /// raw transform functions never allocate.
+  /// Unlike most of the API, this function and the transform functions
+  /// are safe to call from multiple threads at the same time.
+  MIXED_EXPORT int mixed_prepare_fft(uint32_t framesize);
+
   /// Perform a fast fourier forward transform on a buffer of samples.
   ///
-  /// framesize must be a power of two between [2^3, 2^18]
+  /// framesize must be a power of two between [2^5, 2^18]
   /// in and out may be the same buffers, both with framesize number of
   /// elements. The output buffer will contain framesize/2 frequency bins
   /// as interleaved real and imaginary parts: [real, imag, real, imag, ...]
+  /// Since the DC and nyquist bins are purely real, the first pair holds
+  /// the real part of the DC bin, followed by the real part of the
+  /// nyquist bin.
   /// The input and output buffers both must be *at least* aligned to 16-byte
   /// boundaries, ideally to 64 bytes. mixed_buffer sample arrays are already
   /// guaratneed to have this alignment and are thus safe to use.
@@ -1762,10 +2179,13 @@ extern "C" {
 
   /// Performa a fast fourier inverse transform on a buffer of samples.
   ///
-  /// framesize must be a power of two between [2^3, 2^18]
+  /// framesize must be a power of two between [2^5, 2^18]
   /// in and out may be the same buffers, both with framesize number of
   /// elements. The input buffer must contain framesize/2 frequency bins
   /// as interleaved real and imaginary parts: [real, imag, real, imag, ...]
+  /// with the DC and nyquist bins packed as described in mixed_fwd_fft.
+  /// The transform is not scaled, meaning an inverse transform following
+  /// a forward transform will yield the input multiplied by framesize.
   /// The input and output buffers both must be *at least* aligned to 16-byte
   /// boundaries, ideally to 64 bytes. mixed_buffer sample arrays are already
   /// guaratneed to have this alignment and are thus safe to use.
@@ -1819,6 +2239,22 @@ extern "C" {
   ///
   MIXED_EXPORT const char *mixed_version(void);
 
+  /// Returns the mixed_cpu_feature flags the kernels make use of.
+  ///
+  /// The features are detected once on first use, and every hot kernel
+  /// is then picked for them, so the same library runs the widest
+  /// kernels the CPU supports.
+  MIXED_EXPORT uint32_t mixed_cpu_features(void);
+
+  /// Restrict the kernels to the given mixed_cpu_feature flags.
+  ///
+  /// Features the CPU lacks are ignored, so passing 0 forces the
+  /// portable kernels, and passing UINT32_MAX restores everything that
+  /// was detected. This is meant for benchmarking and testing the
+  /// tiers against each other, and must not be called while anything
+  /// is being mixed.
+  MIXED_EXPORT int mixed_force_cpu_features(uint32_t features);
+
   //// Allow customising how libmixed allocates things.
 #ifdef MIXED_NO_CUSTOM_ALLOCATOR
 #define mixed_calloc calloc
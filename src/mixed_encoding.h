@@ -137,3 +137,74 @@ MIXED_EXPORT inline uint32_t mixed_to_uint32(float sample){
     : (-1.0f<=sample)? (sample+1)*0x80000000L
     : 0;
 }
+
+// Half precision samples are stored as their raw bits. The conversions
+// round to nearest even, same as the hardware conversion instructions.
+union mixed_float_bits{
+  uint32_t u;
+  float f;
+};
+
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_float16_to_float(uint16_t half){
+  union mixed_float_bits v;
+  uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1F;
+  uint32_t mantissa = half & 0x3FF;
+  if(exponent == 0){
+    v.f = mantissa * (1.0f / 16777216.0f);
+    v.u |= sign;
+  }else if(exponent == 0x1F){
+    v.u = sign | 0x7F800000 | (mantissa << 13);
+  }else{
+    v.u = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  return v.f;
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline uint16_t mixed_float_to_float16(float sample){
+  union mixed_float_bits v, magic;
+  uint16_t half;
+  v.f = sample;
+  // Adding this pushes subnormal halves into the low mantissa bits.
+  magic.u = 126 << 23;
+  uint32_t sign = v.u & 0x80000000;
+  v.u ^= sign;
+  if(0x47800000 <= v.u){
+    half = (0x7F800000 < v.u)? 0x7E00 : 0x7C00;
+  }else if(v.u < 0x38800000){
+    v.f += magic.f;
+    half = v.u - magic.u;
+  }else{
+    uint32_t odd = (v.u >> 13) & 1;
+    v.u += 0xC8000FFF + odd;
+    half = v.u >> 13;
+  }
+  return half | (sign >> 16);
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_from_float16(uint16_t sample){
+  return mixed_from_float(mixed_float16_to_float(sample));
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_from_bfloat16(uint16_t sample){
+  union mixed_float_bits v;
+  v.u = (uint32_t)sample << 16;
+  return mixed_from_float(v.f);
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline uint16_t mixed_to_float16(float sample){
+  return mixed_float_to_float16(mixed_to_float(sample));
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline uint16_t mixed_to_bfloat16(float sample){
+  union mixed_float_bits v;
+  v.f = mixed_to_float(sample);
+  v.u += 0x7FFF + ((v.u >> 16) & 1);
+  return v.u >> 16;
+}
@@ -25,11 +25,18 @@ MIXED_EXPORT int mixed_pack_clear(struct mixed_pack *pack){
   return 1;
 }
 
+// The positions count the bytes of all planes, and whole frames are
+// always transferred, so a position in a planar pack maps to the same
+// fraction of every plane.
+static inline uint32_t pack_offset(uint32_t off, struct mixed_pack *pack){
+  return (pack->layout & MIXED_PLANAR)? off / pack->channels : off;
+}
+
 MIXED_EXPORT int mixed_pack_request_write(void *restrict *area, uint32_t *size, struct mixed_pack *pack){
   uint32_t off = 0;
   if(!bip_request_write(&off, size, (struct bip*)pack))
      return 0;
-  *area = pack->_data+off;
+  *area = pack->_data+pack_offset(off, pack);
   return 1;
 }
 
@@ -41,7 +48,7 @@ MIXED_EXPORT int mixed_pack_request_read(void *restrict *area, uint32_t *size, s
   uint32_t off = 0;
   if(!bip_request_read(&off, size, (struct bip*)pack))
     return 0;
-  *area = pack->_data+off;
+  *area = pack->_data+pack_offset(off, pack);
   return 1;
 }
 
@@ -0,0 +1,659 @@
+#include "../internal.h"
+
+// The number of directions we sample the sphere at to build the decoder.
+#define VIRTUAL_SPEAKERS 240
+// The most harmonics of a single order.
+#define ORDER_CHANNELS (2*AMBISONIC_MAX_ORDER+1)
+
+struct ambisonic_decoder_data{
+  struct mixed_buffer *in[AMBISONIC_MAX_CHANNELS];
+  struct mixed_buffer *out[MIXED_MAX_SPEAKER_COUNT];
+  struct mixed_channel_configuration channels;
+  struct vbap_data vbap;
+  uint32_t order;
+  float direction[3];
+  float up[3];
+  float volume;
+  // Speaker gain of each bus channel, with the listener rotation included.
+  // When decoding binaurally, this instead holds a row per bus channel
+  // that rotates the bus into the listener's frame.
+  float matrix[MIXED_MAX_SPEAKER_COUNT][AMBISONIC_MAX_CHANNELS];
+  float last_matrix[MIXED_MAX_SPEAKER_COUNT][AMBISONIC_MAX_CHANNELS];
+  // The stereo convolver of each bus channel, with the decoder to the
+  // HRTF directions folded into its HRIRs.
+  struct convolver_data binaural[AMBISONIC_MAX_CHANNELS];
+  float *rotated;
+  float *scratch[2];
+  uint32_t capacity;
+  uint32_t samplerate;
+  bool hrtf;
+  bool ramp;
+  bool started;
+};
+
+static inline bool is_binaural(struct ambisonic_decoder_data *data){
+  return data->hrtf && data->channels.count == 2;
+}
+
+// The number of rows of the matrix in use.
+static uint32_t decoder_rows(struct ambisonic_decoder_data *data){
+  if(is_binaural(data))
+    return AMBISONIC_CHANNELS(data->order);
+  return data->channels.count;
+}
+
+static void free_decoder_hrtf(struct ambisonic_decoder_data *data){
+  if(data->hrtf){
+    for(uint32_t c=0; c<AMBISONIC_CHANNELS(data->order); ++c)
+      free_convolver_data(&data->binaural[c]);
+  }
+  FREE(data->rotated);
+  data->scratch[0] = 0;
+  data->scratch[1] = 0;
+  data->capacity = 0;
+  data->hrtf = 0;
+}
+
+int ambisonic_decoder_free(struct mixed_segment *segment){
+  struct ambisonic_decoder_data *data = (struct ambisonic_decoder_data *)segment->data;
+  if(data){
+    free_decoder_hrtf(data);
+    mixed_free(data);
+  }
+  segment->data = 0;
+  return 1;
+}
+
+// Size the binaural scratch buffers to hold a full output buffer.
+static int ensure_hrtf_capacity(struct ambisonic_decoder_data *data){
+  if(!data->hrtf) return 1;
+  uint32_t samples = 0;
+  for(mixed_channel_t c=0; c<data->channels.count; ++c){
+    if(!data->out[c]) return 1;
+    samples = MAX(samples, data->out[c]->size);
+  }
+  if(samples <= data->capacity) return 1;
+  float *rotated = mixed_calloc(3*samples, sizeof(float));
+  if(!rotated){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  FREE(data->rotated);
+  data->rotated = rotated;
+  data->scratch[0] = rotated + samples;
+  data->scratch[1] = rotated + 2*samples;
+  data->capacity = samples;
+  return 1;
+}
+
+int ambisonic_decoder_start(struct mixed_segment *segment){
+  struct ambisonic_decoder_data *data = (struct ambisonic_decoder_data *)segment->data;
+  for(uint32_t c=0; c<AMBISONIC_CHANNELS(data->order); ++c){
+    if(!data->in[c]){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  for(mixed_channel_t c=0; c<data->channels.count; ++c){
+    if(!data->out[c]){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  return ensure_hrtf_capacity(data);
+}
+
+// Spread the virtual speakers evenly along a Fibonacci spiral, and mirror
+// every other one so that left and right are treated alike. Returns the
+// distance of the speaker from the vertical axis.
+static float virtual_speaker(uint32_t v, float local[3]){
+  uint32_t p = v/2;
+  float height = 1.0f - (2.0f*p + 1.0f) / (VIRTUAL_SPEAKERS/2);
+  float radius = sqrtf(1.0f - height*height);
+  float angle = p * 2.3999632f; // The golden angle in radians
+  local[0] = (v % 2)? -radius*cosf(angle) : radius*cosf(angle);
+  local[1] = height;
+  local[2] = radius*sinf(angle);
+  return radius;
+}
+
+static void listener_frame(struct ambisonic_decoder_data *data, float x[3], float y[3], float z[3]){
+  vec_normalize(z, data->direction);
+  vec_normalize(y, data->up);
+  vec_cross(x, y, z);
+  vec_cross(y, z, x);
+}
+
+// We use an All-Round Ambisonic Decoder: the bus is decoded to a dense,
+// even set of virtual speakers, each of which is then panned onto the
+// actual layout with VBAP, or onto the measured HRTF directions if an
+// HRTF is given. This behaves well on irregular layouts like 5.1, where
+// decoding to the speakers directly falls apart.
+// The listener's frame is folded into the resulting matrix, so turning
+// the listener does not touch the sources at all.
+static void build_decoder(uint32_t order, const float x[3], const float y[3], const float z[3], float (*matrix)[AMBISONIC_MAX_CHANNELS], uint32_t speakers, struct vbap_data *vbap, struct hrtf_data *hrtf){
+  uint32_t channels = AMBISONIC_CHANNELS(order);
+  float weights[AMBISONIC_MAX_ORDER+1];
+  float harmonics[VIRTUAL_SPEAKERS][AMBISONIC_MAX_CHANNELS];
+
+  ambisonic_max_re_weights(order, weights);
+  memset(matrix, 0, speakers*sizeof(*matrix));
+
+  for(uint32_t v=0; v<VIRTUAL_SPEAKERS; ++v){
+    float local[3];
+    float radius = virtual_speaker(v, local);
+    // Bring the direction from the listener's frame into the bus' frame.
+    float world[3];
+    for(int i=0; i<3; ++i){
+      world[i] = x[i]*local[0] + y[i]*local[1] + z[i]*local[2];
+    }
+    ambisonic_encode(world, order, harmonics[v]);
+
+    float gains[3];
+    uint32_t targets[3], count = 0;
+    if(hrtf){
+      float *gain_rows[3] = {&gains[0], &gains[1], &gains[2]};
+      uint32_t *target_rows[3] = {&targets[0], &targets[1], &targets[2]};
+      hrtf_compute_gains_batch(1, &local[0], &local[1], &local[2], gain_rows, target_rows, hrtf);
+      count = 3;
+    }else{
+      mixed_channel_t speaker[3], n;
+      mixed_compute_gains(local, gains, speaker, &n, vbap);
+      // A flat layout has no speakers to place steep directions on, so we
+      // let them fade out rather than snap to an arbitrary azimuth.
+      for(mixed_channel_t i=0; i<n; ++i){
+        if(vbap->dims == 2) gains[i] *= radius;
+        targets[count++] = speaker[i];
+      }
+    }
+    for(uint32_t c=0; c<channels; ++c){
+      uint32_t l = (uint32_t)sqrtf(c);
+      float weight = (2*l + 1) * weights[l] * harmonics[v][c] / VIRTUAL_SPEAKERS;
+      for(uint32_t i=0; i<count; ++i){
+        matrix[targets[i]][c] += gains[i] * weight;
+      }
+    }
+  }
+
+  // Normalise to unit energy on average over all directions.
+  float energy = 0.0f;
+  for(uint32_t v=0; v<VIRTUAL_SPEAKERS; ++v){
+    for(uint32_t s=0; s<speakers; ++s){
+      float gain = 0.0f;
+      for(uint32_t c=0; c<channels; ++c){
+        gain += matrix[s][c] * harmonics[v][c];
+      }
+      energy += gain*gain;
+    }
+  }
+  float scale = (0.0f < energy)? 1.0f / sqrtf(energy / VIRTUAL_SPEAKERS) : 0.0f;
+  for(uint32_t s=0; s<speakers; ++s){
+    for(uint32_t c=0; c<channels; ++c){
+      matrix[s][c] *= scale;
+    }
+  }
+}
+
+// Solve a x = b in place of b, for n unknowns and n right hand sides.
+static void solve(uint32_t n, double a[ORDER_CHANNELS][ORDER_CHANNELS], double b[ORDER_CHANNELS][ORDER_CHANNELS]){
+  for(uint32_t k=0; k<n; ++k){
+    uint32_t pivot = k;
+    for(uint32_t i=k+1; i<n; ++i){
+      if(fabs(a[pivot][k]) < fabs(a[i][k])) pivot = i;
+    }
+    for(uint32_t j=0; j<n; ++j){
+      double t = a[k][j]; a[k][j] = a[pivot][j]; a[pivot][j] = t;
+      t = b[k][j]; b[k][j] = b[pivot][j]; b[pivot][j] = t;
+    }
+    for(uint32_t i=0; i<n; ++i){
+      if(i == k || a[k][k] == 0.0) continue;
+      double f = a[i][k] / a[k][k];
+      for(uint32_t j=0; j<n; ++j){
+        a[i][j] -= f * a[k][j];
+        b[i][j] -= f * b[k][j];
+      }
+    }
+  }
+  for(uint32_t k=0; k<n; ++k){
+    for(uint32_t j=0; j<n; ++j){
+      b[k][j] = (a[k][k] == 0.0)? 0.0 : b[k][j] / a[k][k];
+    }
+  }
+}
+
+// The binaural decoder works in the listener's frame, so that its HRIRs
+// stay fixed. Instead we rotate the bus into that frame first. Rotations
+// only mix harmonics of the same order, so each order's block is fit
+// separately, by least squares over the virtual speakers.
+static void compute_rotation(struct ambisonic_decoder_data *data){
+  uint32_t order = data->order;
+  uint32_t channels = AMBISONIC_CHANNELS(order);
+  float x[3], y[3], z[3];
+  float local_harmonics[VIRTUAL_SPEAKERS][AMBISONIC_MAX_CHANNELS];
+  float world_harmonics[VIRTUAL_SPEAKERS][AMBISONIC_MAX_CHANNELS];
+
+  listener_frame(data, x, y, z);
+  for(uint32_t v=0; v<VIRTUAL_SPEAKERS; ++v){
+    float local[3], world[3];
+    virtual_speaker(v, local);
+    for(int i=0; i<3; ++i){
+      world[i] = x[i]*local[0] + y[i]*local[1] + z[i]*local[2];
+    }
+    ambisonic_encode(local, order, local_harmonics[v]);
+    ambisonic_encode(world, order, world_harmonics[v]);
+  }
+
+  memset(data->matrix, 0, channels*sizeof(*data->matrix));
+  for(uint32_t l=0; l<=order; ++l){
+    uint32_t base = l*l, n = 2*l + 1;
+    // With R the rotation, R g = a for the sums below, so g R^T = a^T.
+    double g[ORDER_CHANNELS][ORDER_CHANNELS] = {{0}};
+    double a[ORDER_CHANNELS][ORDER_CHANNELS] = {{0}};
+    for(uint32_t v=0; v<VIRTUAL_SPEAKERS; ++v){
+      const float *w = world_harmonics[v] + base;
+      const float *u = local_harmonics[v] + base;
+      for(uint32_t i=0; i<n; ++i){
+        for(uint32_t j=0; j<n; ++j){
+          g[i][j] += w[i] * w[j];
+          a[i][j] += w[i] * u[j];
+        }
+      }
+    }
+    solve(n, g, a);
+    for(uint32_t i=0; i<n; ++i){
+      for(uint32_t j=0; j<n; ++j){
+        data->matrix[base+i][base+j] = a[j][i];
+      }
+    }
+  }
+}
+
+static void compute_decoder(struct ambisonic_decoder_data *data){
+  if(is_binaural(data)){
+    compute_rotation(data);
+  }else{
+    float x[3], y[3], z[3];
+    listener_frame(data, x, y, z);
+    build_decoder(data->order, x, y, z, data->matrix, data->channels.count, &data->vbap, 0);
+  }
+  data->ramp = data->started;
+}
+
+// Add the bus channels to the output by the row's gains, interpolating
+// from the last block's row to avoid steps.
+VECTORIZE static void decode_row(float *restrict out, float *restrict ins[], uint32_t channels, const float *row, const float *last_row, float volume, bool ramp, uint32_t samples){
+  for(uint32_t c=0; c<channels; ++c){
+    float *restrict in = ins[c];
+    float gain = volume * row[c];
+    if(ramp){
+      float start = volume * last_row[c], step = (gain - start) / samples;
+      for(uint32_t i=0; i<samples; ++i){
+        out[i] += in[i] * (start + step*(i+1));
+      }
+    }else if(gain != 0.0f){
+      for(uint32_t i=0; i<samples; ++i){
+        out[i] += in[i] * gain;
+      }
+    }
+  }
+}
+
+VECTORIZE int ambisonic_decoder_mix(struct mixed_segment *segment){
+  struct ambisonic_decoder_data *data = (struct ambisonic_decoder_data *)segment->data;
+  uint32_t channels = AMBISONIC_CHANNELS(data->order);
+  mixed_channel_t speakers = data->channels.count;
+  uint32_t samples = UINT32_MAX;
+  float *restrict ins[AMBISONIC_MAX_CHANNELS];
+  float *restrict outs[MIXED_MAX_SPEAKER_COUNT];
+  uint32_t rows = decoder_rows(data);
+  bool binaural = is_binaural(data);
+
+  for(uint32_t c=0; c<channels; ++c){
+    mixed_buffer_request_read(&ins[c], &samples, data->in[c]);
+  }
+  for(mixed_channel_t s=0; s<speakers; ++s){
+    mixed_buffer_request_write(&outs[s], &samples, data->out[s]);
+  }
+  if(binaural) samples = MIN(samples, data->capacity);
+
+  if(0 < samples){
+    float volume = data->volume;
+    if(!data->started){
+      memcpy(data->last_matrix, data->matrix, rows*sizeof(*data->matrix));
+      data->started = 1;
+      data->ramp = 0;
+    }
+    if(binaural){
+      // Rotate each bus channel into the listener's frame, and convolve
+      // it with its HRIRs, into which the decoder is folded.
+      float *restrict rotated = data->rotated;
+      float *restrict l = data->scratch[0];
+      float *restrict r = data->scratch[1];
+      memset(outs[0], 0, samples*sizeof(float));
+      memset(outs[1], 0, samples*sizeof(float));
+      for(uint32_t c=0; c<channels; ++c){
+        memset(rotated, 0, samples*sizeof(float));
+        decode_row(rotated, ins, channels, data->matrix[c], data->last_matrix[c], volume, data->ramp, samples);
+        convolver(rotated, data->scratch, samples, &data->binaural[c]);
+        for(uint32_t i=0; i<samples; ++i){
+          outs[0][i] += l[i];
+          outs[1][i] += r[i];
+        }
+      }
+    }else{
+      for(mixed_channel_t s=0; s<speakers; ++s){
+        memset(outs[s], 0, samples*sizeof(float));
+        decode_row(outs[s], ins, channels, data->matrix[s], data->last_matrix[s], volume, data->ramp, samples);
+      }
+    }
+    if(data->ramp){
+      memcpy(data->last_matrix, data->matrix, rows*sizeof(*data->matrix));
+      data->ramp = 0;
+    }
+  }
+  for(uint32_t c=0; c<channels; ++c){
+    mixed_buffer_finish_read(samples, data->in[c]);
+  }
+  for(mixed_channel_t s=0; s<speakers; ++s){
+    mixed_buffer_finish_write(samples, data->out[s]);
+  }
+  return 1;
+}
+
+int ambisonic_decoder_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct ambisonic_decoder_data *data = (struct ambisonic_decoder_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(AMBISONIC_CHANNELS(data->order) <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->in[location] = (struct mixed_buffer *)buffer;
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int ambisonic_decoder_get_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct ambisonic_decoder_data *data = (struct ambisonic_decoder_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(AMBISONIC_CHANNELS(data->order) <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    *(struct mixed_buffer **)buffer = data->in[location];
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int ambisonic_decoder_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct ambisonic_decoder_data *data = (struct ambisonic_decoder_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->channels.count <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->out[location] = (struct mixed_buffer *)buffer;
+    return ensure_hrtf_capacity(data);
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int ambisonic_decoder_get_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct ambisonic_decoder_data *data = (struct ambisonic_decoder_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->channels.count <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    *(struct mixed_buffer **)buffer = data->out[location];
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int ambisonic_decoder_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct ambisonic_decoder_data *data = (struct ambisonic_decoder_data *)segment->data;
+  float *parts = (float *)value;
+  switch(field){
+  case MIXED_VOLUME:
+    *((float *)value) = data->volume;
+    break;
+  case MIXED_SPACE_DIRECTION:
+    parts[0] = data->direction[0];
+    parts[1] = data->direction[1];
+    parts[2] = data->direction[2];
+    break;
+  case MIXED_SPACE_UP:
+    parts[0] = data->up[0];
+    parts[1] = data->up[1];
+    parts[2] = data->up[2];
+    break;
+  case MIXED_AMBISONIC_ORDER:
+    *(uint32_t *)value = data->order;
+    break;
+  case MIXED_OUT_COUNT:
+    *(uint32_t *)value = data->channels.count;
+    break;
+  case MIXED_CHANNEL_CONFIGURATION:
+    *(struct mixed_channel_configuration *)value = data->channels;
+    break;
+  case MIXED_SAMPLERATE:
+    *(uint32_t *)value = data->samplerate;
+    break;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+static int set_configuration(struct mixed_channel_configuration const *channels, struct ambisonic_decoder_data *data){
+  struct vbap_data *vbap = mixed_calloc(1, sizeof(struct vbap_data));
+  if(!vbap){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  if(!make_vbap_from_configuration(channels, vbap)){
+    mixed_free(vbap);
+    return 0;
+  }
+  memcpy(&data->vbap, vbap, sizeof(struct vbap_data));
+  mixed_free(vbap);
+  memcpy(&data->channels, channels, sizeof(struct mixed_channel_configuration));
+  // The outputs are different now, so there is nothing to ramp from.
+  data->started = 0;
+  compute_decoder(data);
+  return 1;
+}
+
+static int set_hrtf(const char *path, struct ambisonic_decoder_data *data){
+  uint32_t channels = AMBISONIC_CHANNELS(data->order);
+  struct hrtf_data hrtf = {0};
+  struct convolver_data *binaural = 0;
+  float (*matrix)[AMBISONIC_MAX_CHANNELS] = 0;
+  if(path){
+    // Decode in the listener's own frame, and fold that into the HRIRs.
+    float x[3] = {1, 0, 0}, y[3] = {0, 1, 0}, z[3] = {0, 0, 1};
+    if(!load_hrtf_data(path, data->samplerate, &hrtf))
+      return 0;
+    matrix = mixed_calloc(hrtf.count, sizeof(*matrix));
+    binaural = mixed_calloc(channels, sizeof(struct convolver_data));
+    if(!matrix || !binaural){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      goto cleanup;
+    }
+    build_decoder(data->order, x, y, z, matrix, hrtf.count, 0, &hrtf);
+    if(!hrtf_fold(matrix[0], AMBISONIC_MAX_CHANNELS, channels, binaural, &hrtf))
+      goto cleanup;
+  }
+  free_decoder_hrtf(data);
+  if(path){
+    memcpy(data->binaural, binaural, channels*sizeof(struct convolver_data));
+    data->hrtf = 1;
+  }
+  // The rows of the matrix change meaning between the modes.
+  data->started = 0;
+  compute_decoder(data);
+  if(!ensure_hrtf_capacity(data)){
+    free_decoder_hrtf(data);
+    compute_decoder(data);
+    goto cleanup;
+  }
+  FREE(matrix);
+  FREE(binaural);
+  free_hrtf_data(&hrtf);
+  return 1;
+
+ cleanup:
+  FREE(matrix);
+  FREE(binaural);
+  free_hrtf_data(&hrtf);
+  return 0;
+}
+
+int ambisonic_decoder_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct ambisonic_decoder_data *data = (struct ambisonic_decoder_data *)segment->data;
+  float *parts = (float *)value;
+  switch(field){
+  case MIXED_VOLUME:
+    data->volume = *((float *)value);
+    break;
+  case MIXED_SPACE_DIRECTION:
+    data->direction[0] = parts[0];
+    data->direction[1] = parts[1];
+    data->direction[2] = parts[2];
+    compute_decoder(data);
+    break;
+  case MIXED_SPACE_UP:
+    data->up[0] = parts[0];
+    data->up[1] = parts[1];
+    data->up[2] = parts[2];
+    compute_decoder(data);
+    break;
+  case MIXED_OUT_COUNT:{
+    struct mixed_channel_configuration const *channels = mixed_default_channel_configuration(*(uint32_t *)value);
+    if(!channels) return 0;
+    return set_configuration(channels, data);}
+  case MIXED_CHANNEL_CONFIGURATION:
+    return set_configuration((struct mixed_channel_configuration *)value, data);
+  case MIXED_SAMPLERATE:
+    data->samplerate = *(uint32_t *)value;
+    break;
+  case MIXED_SPACE_HRTF:
+    return set_hrtf((const char *)value, data);
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+int ambisonic_decoder_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  struct ambisonic_decoder_data *data = (struct ambisonic_decoder_data *)segment->data;
+
+  info->name = "ambisonic_decoder";
+  info->description = "Decodes an ambisonic B-format bus to a speaker layout.";
+  info->flags = 0;
+  info->min_inputs = AMBISONIC_CHANNELS(data->order);
+  info->max_inputs = AMBISONIC_CHANNELS(data->order);
+  info->outputs = data->channels.count;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_VOLUME,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The volume scaling factor for the output.");
+
+  set_info_field(field++, MIXED_SPACE_DIRECTION,
+                 MIXED_FLOAT, 3, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The direction the listener is facing in.");
+
+  set_info_field(field++, MIXED_SPACE_UP,
+                 MIXED_FLOAT, 3, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The upwards direction of the listener.");
+
+  set_info_field(field++, MIXED_AMBISONIC_ORDER,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The ambisonic order of the bus.");
+
+  set_info_field(field++, MIXED_OUT_COUNT,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of output channels. When set, the output buffers need to be set anew.");
+
+  set_info_field(field++, MIXED_CHANNEL_CONFIGURATION,
+                 MIXED_CHANNEL_CONFIGURATION_POINTER, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The specific channel configuration and their positions. When set, the output buffers must be set anew.");
+
+  set_info_field(field++, MIXED_SAMPLERATE,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The samplerate an HRTF table must be recorded at, or 0 to accept any.");
+
+  set_info_field(field++, MIXED_SPACE_HRTF,
+                 MIXED_STRING, 1, MIXED_SEGMENT | MIXED_SET,
+                 "The path to an HRTF table to render binaurally with on stereo outputs.");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_ambisonic_decoder(uint32_t order, struct mixed_segment *segment){
+  if(order < 1 || AMBISONIC_MAX_ORDER < order){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
+  struct ambisonic_decoder_data *data = mixed_calloc(1, sizeof(struct ambisonic_decoder_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  data->order = order;
+  data->direction[2] = 1.0;      // Facing in Z+ direction
+  data->up[1] = 1.0;             // OpenGL-like. Y+ is up.
+  data->volume = 1.0;
+  if(!set_configuration(mixed_default_channel_configuration(2), data)){
+    mixed_free(data);
+    return 0;
+  }
+
+  segment->free = ambisonic_decoder_free;
+  segment->info = ambisonic_decoder_info;
+  segment->start = ambisonic_decoder_start;
+  segment->mix = ambisonic_decoder_mix;
+  segment->set_in = ambisonic_decoder_set_in;
+  segment->get_in = ambisonic_decoder_get_in;
+  segment->set_out = ambisonic_decoder_set_out;
+  segment->get_out = ambisonic_decoder_get_out;
+  segment->set = ambisonic_decoder_set;
+  segment->get = ambisonic_decoder_get;
+  segment->data = data;
+  return 1;
+}
+
+int __make_ambisonic_decoder(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_ambisonic_decoder(ARG(uint32_t, 0), segment);
+}
+
+REGISTER_SEGMENT(ambisonic_decoder, __make_ambisonic_decoder, 1, {
+      {.description = "order", .type = MIXED_UINT32}})
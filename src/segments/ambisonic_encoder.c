@@ -0,0 +1,491 @@
+#include "../internal.h"
+
+struct ambisonic_source{
+  struct mixed_buffer *buffer;
+  float location[3];
+  float min_distance;
+  float max_distance;
+  float rolloff;
+  // The gains used in the last block, to ramp from
+  float last_gains[AMBISONIC_MAX_CHANNELS];
+  bool started;
+};
+
+struct ambisonic_encoder_data{
+  struct ambisonic_source **sources;
+  uint32_t count;
+  uint32_t size;
+  struct mixed_buffer *out[AMBISONIC_MAX_CHANNELS];
+  uint32_t order;
+  uint32_t channels;
+  float location[3];
+  float min_distance;
+  float max_distance;
+  float rolloff;
+  float volume;
+  float (*attenuation)(float min, float max, float dist, float roll);
+};
+
+int ambisonic_encoder_free(struct mixed_segment *segment){
+  struct ambisonic_encoder_data *data = (struct ambisonic_encoder_data *)segment->data;
+  if(data){
+    for(uint32_t s=0; s<data->count; ++s){
+      if(data->sources[s]) mixed_free(data->sources[s]);
+    }
+    mixed_free(data->sources);
+    mixed_free(data);
+  }
+  segment->data = 0;
+  return 1;
+}
+
+int ambisonic_encoder_start(struct mixed_segment *segment){
+  struct ambisonic_encoder_data *data = (struct ambisonic_encoder_data *)segment->data;
+  for(uint32_t c=0; c<data->channels; ++c){
+    if(!data->out[c]){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void calculate_gains(float *gains, struct ambisonic_source *source, struct ambisonic_encoder_data *data){
+  float direction[3] = {source->location[0] - data->location[0],
+                        source->location[1] - data->location[1],
+                        source->location[2] - data->location[2]};
+  float min_dist = source->min_distance;
+  float max_dist = source->max_distance;
+  float distance = sqrtf(direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2]);
+  float volume = data->volume * data->attenuation(min_dist, max_dist, CLAMP(min_dist, distance, max_dist), source->rolloff);
+  vec_normalized(direction);
+  ambisonic_encode(direction, data->order, gains);
+  // Within the min distance the source has no clear direction, so fade
+  // it towards the omnidirectional component only.
+  float directivity = (distance < min_dist)? distance / min_dist : 1.0f;
+  gains[0] *= volume;
+  for(uint32_t c=1; c<data->channels; ++c){
+    gains[c] *= volume * directivity;
+  }
+}
+
+VECTORIZE int ambisonic_encoder_mix(struct mixed_segment *segment){
+  struct ambisonic_encoder_data *data = (struct ambisonic_encoder_data *)segment->data;
+  uint32_t channels = data->channels;
+  uint32_t samples = UINT32_MAX;
+  float *restrict outs[AMBISONIC_MAX_CHANNELS], *restrict in;
+
+  // Compute sample counts
+  for(uint32_t c=0; c<channels; ++c){
+    mixed_buffer_request_write(&outs[c], &samples, data->out[c]);
+  }
+  for(uint32_t s=0; s<data->count; ++s){
+    struct ambisonic_source *source = data->sources[s];
+    if(!source) continue;
+
+    mixed_buffer_request_read(&in, &samples, source->buffer);
+    if(samples == 0) break;
+  }
+
+  if(0 < samples){
+    for(uint32_t c=0; c<channels; ++c){
+      memset(outs[c], 0, samples*sizeof(float));
+    }
+    for(uint32_t s=0; s<data->count; ++s){
+      struct ambisonic_source *source = data->sources[s];
+      if(!source) continue;
+
+      float gains[AMBISONIC_MAX_CHANNELS];
+      mixed_buffer_request_read(&in, &samples, source->buffer);
+      calculate_gains(gains, source, data);
+      if(!source->started){
+        memcpy(source->last_gains, gains, sizeof(gains));
+        source->started = 1;
+      }
+      // Interpolate from the last block's gains to avoid steps.
+      for(uint32_t c=0; c<channels; ++c){
+        float *restrict out = outs[c];
+        float start = source->last_gains[c], step = (gains[c] - start) / samples;
+        for(uint32_t i=0; i<samples; ++i){
+          out[i] += in[i] * (start + step*(i+1));
+        }
+        source->last_gains[c] = gains[c];
+      }
+      mixed_buffer_finish_read(samples, source->buffer);
+    }
+  }
+  for(uint32_t c=0; c<channels; ++c){
+    mixed_buffer_finish_write(samples, data->out[c]);
+  }
+  return 1;
+}
+
+int ambisonic_encoder_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct ambisonic_encoder_data *data = (struct ambisonic_encoder_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->channels <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->out[location] = (struct mixed_buffer *)buffer;
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int ambisonic_encoder_get_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct ambisonic_encoder_data *data = (struct ambisonic_encoder_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->channels <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    *(struct mixed_buffer **)buffer = data->out[location];
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int ambisonic_encoder_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct ambisonic_encoder_data *data = (struct ambisonic_encoder_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(buffer){ // Add or set an element
+      struct ambisonic_source *source = 0;
+      if(location < data->count)
+        source = data->sources[location];
+      if(!source){
+        source = mixed_calloc(1, sizeof(struct ambisonic_source));
+        if(!source){
+          mixed_err(MIXED_OUT_OF_MEMORY);
+          return 0;
+        }
+        source->min_distance = data->min_distance;
+        source->max_distance = data->max_distance;
+        source->rolloff = data->rolloff;
+        source->location[0] = data->location[0];
+        source->location[1] = data->location[1];
+        source->location[2] = data->location[2];
+      }
+      source->buffer = (struct mixed_buffer *)buffer;
+      if(location < data->count) data->sources[location] = source;
+      else return vector_add_pos(location, source, (struct vector *)data);
+    }else{ // Remove an element
+      if(data->count <= location){
+        mixed_err(MIXED_INVALID_LOCATION);
+        return 0;
+      }
+      if(data->sources[location]){
+        mixed_free(data->sources[location]);
+      }
+      data->sources[location] = 0;
+    }
+    return 1;
+  case MIXED_SPACE_MIN_DISTANCE:
+  case MIXED_SPACE_MAX_DISTANCE:
+  case MIXED_SPACE_ROLLOFF:
+  case MIXED_SPACE_LOCATION:
+    if(data->count <= location || !data->sources[location]){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    struct ambisonic_source *source = data->sources[location];
+    float *value = (float *)buffer;
+    switch(field){
+    case MIXED_SPACE_MIN_DISTANCE:
+      source->min_distance = *(float *)buffer;
+      break;
+    case MIXED_SPACE_MAX_DISTANCE:
+      source->max_distance = *(float *)buffer;
+      break;
+    case MIXED_SPACE_ROLLOFF:
+      source->rolloff = *(float *)buffer;
+      break;
+    case MIXED_SPACE_LOCATION:
+      source->location[0] = value[0];
+      source->location[1] = value[1];
+      source->location[2] = value[2];
+      break;
+    }
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int ambisonic_encoder_get_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct ambisonic_encoder_data *data = (struct ambisonic_encoder_data *)segment->data;
+
+  if(data->count <= location){
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+
+  struct ambisonic_source *source = data->sources[location];
+  if(source == 0){
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+
+  switch(field){
+  case MIXED_BUFFER:
+    *(struct mixed_buffer **)buffer = source->buffer;
+    return 1;
+  case MIXED_SPACE_MIN_DISTANCE:
+    *(float *)buffer = source->min_distance;
+    return 1;
+  case MIXED_SPACE_MAX_DISTANCE:
+    *(float *)buffer = source->max_distance;
+    return 1;
+  case MIXED_SPACE_ROLLOFF:
+    *(float *)buffer = source->rolloff;
+    return 1;
+  case MIXED_SPACE_LOCATION:{
+    float *value = (float *)buffer;
+    value[0] = source->location[0];
+    value[1] = source->location[1];
+    value[2] = source->location[2];
+    return 1;}
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int ambisonic_encoder_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct ambisonic_encoder_data *data = (struct ambisonic_encoder_data *)segment->data;
+  float *parts = (float *)value;
+  switch(field){
+  case MIXED_VOLUME:
+    *((float *)value) = data->volume;
+    break;
+  case MIXED_SPACE_LOCATION:
+    parts[0] = data->location[0];
+    parts[1] = data->location[1];
+    parts[2] = data->location[2];
+    break;
+  case MIXED_SPACE_MIN_DISTANCE:
+    *(float *)value = data->min_distance;
+    break;
+  case MIXED_SPACE_MAX_DISTANCE:
+    *(float *)value = data->max_distance;
+    break;
+  case MIXED_SPACE_ROLLOFF:
+    *(float *)value = data->rolloff;
+    break;
+  case MIXED_SPACE_ATTENUATION:
+    if(data->attenuation == attenuation_none){
+      *(int *)value = MIXED_NO_ATTENUATION;
+    }else if(data->attenuation == attenuation_inverse){
+      *(int *)value = MIXED_INVERSE_ATTENUATION;
+    }else if(data->attenuation == attenuation_linear){
+      *(int *)value = MIXED_LINEAR_ATTENUATION;
+    }else if(data->attenuation == attenuation_exponential){
+      *(int *)value = MIXED_EXPONENTIAL_ATTENUATION;
+    }else{
+      *(float (**)(float min, float max, float dist, float roll))value = data->attenuation;
+    }
+    break;
+  case MIXED_AMBISONIC_ORDER:
+    *(uint32_t *)value = data->order;
+    break;
+  case MIXED_OUT_COUNT:
+    *(uint32_t *)value = data->channels;
+    break;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+static int update_sources(struct mixed_source_update *update, struct ambisonic_encoder_data *data){
+  uint32_t start = update->start;
+  if(update->velocity || update->priority){
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  if(data->count < start || data->count - start < update->count){
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+  for(uint32_t i=0; i<update->count; ++i){
+    if(!data->sources[start+i]){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+  }
+  for(uint32_t i=0; i<update->count; ++i){
+    struct ambisonic_source *source = data->sources[start+i];
+    if(update->location){
+      source->location[0] = update->location[i*3+0];
+      source->location[1] = update->location[i*3+1];
+      source->location[2] = update->location[i*3+2];
+    }
+    if(update->min_distance) source->min_distance = update->min_distance[i];
+    if(update->max_distance) source->max_distance = update->max_distance[i];
+    if(update->rolloff) source->rolloff = update->rolloff[i];
+  }
+  return 1;
+}
+
+int ambisonic_encoder_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct ambisonic_encoder_data *data = (struct ambisonic_encoder_data *)segment->data;
+  float *parts = (float *)value;
+  switch(field){
+  case MIXED_VOLUME:
+    data->volume = *((float *)value);
+    break;
+  case MIXED_SPACE_LOCATION:
+    data->location[0] = parts[0];
+    data->location[1] = parts[1];
+    data->location[2] = parts[2];
+    break;
+  case MIXED_SPACE_MIN_DISTANCE:
+    data->min_distance = *(float *)value;
+    break;
+  case MIXED_SPACE_MAX_DISTANCE:
+    data->max_distance = *(float *)value;
+    break;
+  case MIXED_SPACE_ROLLOFF:
+    data->rolloff = *(float *)value;
+    break;
+  case MIXED_SPACE_ATTENUATION:
+    switch(*(uint32_t *)value){
+    case MIXED_NO_ATTENUATION:
+      data->attenuation = attenuation_none;
+      break;
+    case MIXED_INVERSE_ATTENUATION:
+      data->attenuation = attenuation_inverse;
+      break;
+    case MIXED_LINEAR_ATTENUATION:
+      data->attenuation = attenuation_linear;
+      break;
+    case MIXED_EXPONENTIAL_ATTENUATION:
+      data->attenuation = attenuation_exponential;
+      break;
+    default: {
+      // The value is the function itself. Going through a union avoids
+      // casting an object pointer to a function pointer.
+      union{
+        void *value;
+        float (*function)(float min, float max, float dist, float roll);
+      } attenuation = {value};
+      data->attenuation = attenuation.function;
+      break;}
+    }
+    break;
+  case MIXED_SOURCE_UPDATE:
+    return update_sources((struct mixed_source_update *)value, data);
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+int ambisonic_encoder_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  struct ambisonic_encoder_data *data = (struct ambisonic_encoder_data *)segment->data;
+
+  info->name = "ambisonic_encoder";
+  info->description = "Encodes positioned sources into an ambisonic B-format bus.";
+  info->flags = 0;
+  info->min_inputs = 0;
+  info->max_inputs = -1;
+  info->outputs = data->channels;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_VOLUME,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The volume scaling factor for the output.");
+
+  set_info_field(field++, MIXED_SPACE_LOCATION,
+                 MIXED_FLOAT, 3, MIXED_IN | MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The location of the source or segment (listener) in space.");
+
+  set_info_field(field++, MIXED_SPACE_MIN_DISTANCE,
+                 MIXED_FLOAT, 1, MIXED_IN | MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Any distance lower than this will make the sound appear at its maximal volume.");
+
+  set_info_field(field++, MIXED_SPACE_MAX_DISTANCE,
+                 MIXED_FLOAT, 1, MIXED_IN | MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Any distance greater than this will make the sound appear at its minimal volume.");
+
+  set_info_field(field++, MIXED_SPACE_ROLLOFF,
+                 MIXED_FLOAT, 1, MIXED_IN | MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "This factor influences the curve of the attenuation function.");
+
+  set_info_field(field++, MIXED_SPACE_ATTENUATION,
+                 MIXED_FUNCTION, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The function that calculates the attenuation curve that defines the volume of a source by its distance.");
+
+  set_info_field(field++, MIXED_SOURCE_UPDATE,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_SET,
+                 "Update the properties of a range of sources at once.");
+
+  set_info_field(field++, MIXED_AMBISONIC_ORDER,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The ambisonic order of the bus.");
+
+  set_info_field(field++, MIXED_OUT_COUNT,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The number of bus channels, which is (order+1)².");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_ambisonic_encoder(uint32_t order, struct mixed_segment *segment){
+  if(order < 1 || AMBISONIC_MAX_ORDER < order){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
+  struct ambisonic_encoder_data *data = mixed_calloc(1, sizeof(struct ambisonic_encoder_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  data->order = order;
+  data->channels = AMBISONIC_CHANNELS(order);
+  data->min_distance = 10.0;      // That's 10 centimetres.
+  data->max_distance = 100000.0;  // That's a kilometre.
+  data->rolloff = 0.5;
+  data->attenuation = attenuation_exponential;
+  data->volume = 1.0;
+
+  segment->free = ambisonic_encoder_free;
+  segment->info = ambisonic_encoder_info;
+  segment->start = ambisonic_encoder_start;
+  segment->mix = ambisonic_encoder_mix;
+  segment->set_in = ambisonic_encoder_set_in;
+  segment->get_in = ambisonic_encoder_get_in;
+  segment->set_out = ambisonic_encoder_set_out;
+  segment->get_out = ambisonic_encoder_get_out;
+  segment->set = ambisonic_encoder_set;
+  segment->get = ambisonic_encoder_get;
+  segment->data = data;
+  return 1;
+}
+
+int __make_ambisonic_encoder(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_ambisonic_encoder(ARG(uint32_t, 0), segment);
+}
+
+REGISTER_SEGMENT(ambisonic_encoder, __make_ambisonic_encoder, 1, {
+      {.description = "order", .type = MIXED_UINT32}})
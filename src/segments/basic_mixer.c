@@ -8,6 +8,7 @@ struct basic_mixer_data{
   mixed_channel_t channels;
   float volume;
   float target_volume;
+  enum mixed_volume_mode volume_mode;
 };
 
 int basic_mixer_free(struct mixed_segment *segment){
@@ -79,6 +80,7 @@ VECTORIZE int basic_mixer_mix(struct mixed_segment *segment){
   float initial_volume = data->volume;
   float target_volume = data->target_volume;
   uint32_t count = data->count;
+  mix_add_kernel mix_add = kernels()->mix_add;
   bool changed = 0;
 
   for(mixed_channel_t c=0; c<channels; ++c){
@@ -102,23 +104,32 @@ VECTORIZE int basic_mixer_mix(struct mixed_segment *segment){
         if(!buffer) continue;
       
         mixed_buffer_request_read(&in, &samples, buffer);
-        float volume = initial_volume;
-        float previous = in[0];
-        out[0] += previous * volume;
-        for(uint32_t j=1; j<samples; ++j){
-          float sample = in[j];
-          if(previous * sample < 0.0f){
-            volume = target_volume;
-          }
-          out[j] += sample * volume;
-          previous = sample;
-        }
-        // KLUDGE: This is not entirely correct, ideally we would
-        //         have to keep this check per input buffer. We make the
-        //         optimistic assumption here that if one buffer can make
-        //         the jump, we have enough samples that they all did.
-        if(volume != initial_volume){
+        if(initial_volume == target_volume){
+          mix_add(out, in, samples, target_volume);
+        }else if(data->volume_mode == MIXED_VOLUME_RAMP){
+          float step = (target_volume - initial_volume) / samples;
+          for(uint32_t j=0; j<samples; ++j)
+            out[j] += in[j] * (initial_volume + step*(j+1));
           changed = 1;
+        }else{
+          float volume = initial_volume;
+          float previous = in[0];
+          out[0] += previous * volume;
+          for(uint32_t j=1; j<samples; ++j){
+            float sample = in[j];
+            if(previous * sample < 0.0f){
+              volume = target_volume;
+            }
+            out[j] += sample * volume;
+            previous = sample;
+          }
+          // KLUDGE: This is not entirely correct, ideally we would
+          //         have to keep this check per input buffer. We make the
+          //         optimistic assumption here that if one buffer can make
+          //         the jump, we have enough samples that they all did.
+          if(volume != initial_volume){
+            changed = 1;
+          }
         }
         mixed_buffer_finish_read(samples, buffer);
       }
@@ -137,6 +148,14 @@ int basic_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
   case MIXED_VOLUME:
     data->target_volume = *((float *)value);
     return 1;
+  case MIXED_VOLUME_MODE:
+    if(*(enum mixed_volume_mode *)value != MIXED_VOLUME_ZERO_CROSSING
+       && *(enum mixed_volume_mode *)value != MIXED_VOLUME_RAMP){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->volume_mode = *(enum mixed_volume_mode *)value;
+    return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -150,6 +169,9 @@ int basic_mixer_get(uint32_t field, void *value, struct mixed_segment *segment){
   case MIXED_VOLUME:
     *((float *)value) = data->target_volume;
     return 1;
+  case MIXED_VOLUME_MODE:
+    *(enum mixed_volume_mode *)value = data->volume_mode;
+    return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -172,6 +194,10 @@ int basic_mixer_info(struct mixed_segment_info *info, struct mixed_segment *segm
   set_info_field(field++, MIXED_VOLUME,
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The volume scaling factor for the output.");
+
+  set_info_field(field++, MIXED_VOLUME_MODE,
+                 MIXED_VOLUME_MODE_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "How a change of the volume is applied.");
   clear_info_field(field++);
   return 1;
 }
@@ -3,11 +3,32 @@
 #ifdef __ARM_NEON
 #include <arm_neon.h>
 #endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CONVOLUTION_X86
+#endif
 
 struct convolution_segment_data{
   struct mixed_buffer *in;
   struct mixed_buffer *out;
   struct fft_window_data fft_window_data;
+  struct convolver_data *convolver_data;
+  // Hot-swapping the FIR hands a new convolver over to the mixing thread,
+  // which fades over to it and retires the old one once the fade is over.
+  struct convolver_data *next_convolver_data;
+  struct convolver_data *fading_convolver_data;
+  struct direct_convolver_data direct_data;
+  float fade_buffer[256];
+  // The dry input, which is lost when running in place.
+  float dry_buffer[256];
+  float fade_time;
+  uint32_t fade_position;
+  enum mixed_convolution_mode mode;
+  // Whether the mode is still picked by the FIR size.
+  bool automatic_mode;
+  uint32_t direct_crossover;
+  uint32_t partition_size;
+  bool background;
   uint32_t samplerate;
   float mix;
   uint32_t block_count;
@@ -15,14 +36,34 @@ struct convolution_segment_data{
   uint32_t block_idx;
   float *fir;
   float *buf;
+  float *raw_fir;
+  uint32_t raw_fir_size;
 };
 
+static void destroy_convolver(struct convolver_data *convolver_data){
+  if(convolver_data){
+    free_convolver_data(convolver_data);
+    mixed_free(convolver_data);
+  }
+}
+
+// Must not be called while the segment is being mixed.
+static void drop_swapped_convolvers(struct convolution_segment_data *data){
+  destroy_convolver(atomic_swap(data->next_convolver_data, (struct convolver_data *)0));
+  destroy_convolver(data->fading_convolver_data);
+  data->fading_convolver_data = 0;
+}
+
 int convolution_segment_free(struct mixed_segment *segment){
   struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
   if(data){
     FREE(data->fir);
     FREE(data->buf);
+    FREE(data->raw_fir);
     free_fft_window_data(&data->fft_window_data);
+    drop_swapped_convolvers(data);
+    destroy_convolver(data->convolver_data);
+    free_direct_convolver_data(&data->direct_data);
     mixed_free(data);
   }
   segment->data = 0;
@@ -35,8 +76,21 @@ int convolution_segment_start(struct mixed_segment *segment){
     mixed_err(MIXED_BUFFER_MISSING);
     return 0;
   }
-  data->block_idx = 0;
-  memset(data->buf, 0, sizeof(float)*data->block_count*data->block_size);
+  if(data->mode == MIXED_CONVOLUTION_PARTITIONED){
+    // Apply a pending FIR right away, there is nothing to fade from.
+    struct convolver_data *next = atomic_swap(data->next_convolver_data, (struct convolver_data *)0);
+    if(next){
+      destroy_convolver(data->convolver_data);
+      data->convolver_data = next;
+    }
+    drop_swapped_convolvers(data);
+    convolver_reset(data->convolver_data);
+  }else if(data->mode == MIXED_CONVOLUTION_DIRECT){
+    direct_convolver_reset(&data->direct_data);
+  }else{
+    data->block_idx = 0;
+    memset(data->buf, 0, sizeof(float)*data->block_count*data->block_size);
+  }
   return 1;
 }
 
@@ -74,73 +128,131 @@ int convolution_segment_set_out(uint32_t field, uint32_t location, void *buffer,
   }
 }
 
-VECTORIZE static void complex_multiply_add(float *restrict dst, float *restrict l, float *restrict r, uint32_t size){
-  for(uint32_t k = 0; k < size; k+= 2){
-    float reA = l[k+0];
-    float imA = l[k+1];
-    float reB = r[k+0];
-    float imB = r[k+1];
+// The spectra are stored with split real and imaginary halves, so that
+// the multiply-accumulate over the delay line runs on contiguous lanes.
+static void split_multiply_add_generic(float *restrict dst_re, float *restrict dst_im, const float *restrict l_re, const float *restrict l_im, const float *restrict r_re, const float *restrict r_im, uint32_t size){
+  for(uint32_t k=0; k<size; ++k){
+    dst_re[k] += l_re[k] * r_re[k] - l_im[k] * r_im[k];
+    dst_im[k] += l_re[k] * r_im[k] + l_im[k] * r_re[k];
+  }
+}
 
-    float re = reA * reB - imA * imB;
-    float im = reA * imB + imA * reB;
+#ifdef CONVOLUTION_X86
+__attribute__((target("sse2")))
+static void split_multiply_add_sse2(float *restrict dst_re, float *restrict dst_im, const float *restrict l_re, const float *restrict l_im, const float *restrict r_re, const float *restrict r_im, uint32_t size){
+  uint32_t k = 0;
+  for(; k+4 <= size; k+=4){
+    __m128 reA = _mm_load_ps(l_re+k);
+    __m128 imA = _mm_load_ps(l_im+k);
+    __m128 reB = _mm_load_ps(r_re+k);
+    __m128 imB = _mm_load_ps(r_im+k);
+    __m128 re = _mm_sub_ps(_mm_mul_ps(reA, reB), _mm_mul_ps(imA, imB));
+    __m128 im = _mm_add_ps(_mm_mul_ps(reA, imB), _mm_mul_ps(imA, reB));
+    _mm_store_ps(dst_re+k, _mm_add_ps(_mm_load_ps(dst_re+k), re));
+    _mm_store_ps(dst_im+k, _mm_add_ps(_mm_load_ps(dst_im+k), im));
+  }
+  split_multiply_add_generic(dst_re+k, dst_im+k, l_re+k, l_im+k, r_re+k, r_im+k, size-k);
+}
 
-    dst[k+0] += re;
-    dst[k+1] += im;
+__attribute__((target("avx2,fma")))
+static void split_multiply_add_avx2(float *restrict dst_re, float *restrict dst_im, const float *restrict l_re, const float *restrict l_im, const float *restrict r_re, const float *restrict r_im, uint32_t size){
+  uint32_t k = 0;
+  for(; k+8 <= size; k+=8){
+    __m256 reA = _mm256_load_ps(l_re+k);
+    __m256 imA = _mm256_load_ps(l_im+k);
+    __m256 reB = _mm256_load_ps(r_re+k);
+    __m256 imB = _mm256_load_ps(r_im+k);
+    __m256 re = _mm256_fmadd_ps(reA, reB, _mm256_load_ps(dst_re+k));
+    __m256 im = _mm256_fmadd_ps(reA, imB, _mm256_load_ps(dst_im+k));
+    _mm256_store_ps(dst_re+k, _mm256_fnmadd_ps(imA, imB, re));
+    _mm256_store_ps(dst_im+k, _mm256_fmadd_ps(imA, reB, im));
   }
+  split_multiply_add_generic(dst_re+k, dst_im+k, l_re+k, l_im+k, r_re+k, r_im+k, size-k);
 }
+#endif
 
 #ifdef __ARM_NEON
-static void complex_multiply_add_neon(float *restrict dst, float *restrict l, float *restrict r, uint32_t size){
-  for(; size >= 8; size -= 8) {
-    float32x4x2_t A = vld2q_f32(l);
-    float32x4_t reA = A.val[0];
-    float32x4_t imA = A.val[1];
-    float32x4x2_t B = vld2q_f32(r);
-    float32x4_t reB = B.val[0];
-    float32x4_t imB = B.val[1];
-
-    float32x4_t re = vsubq_f32(vmulq_f32(reA, reB), vmulq_f32(imA, imB));
-    float32x4_t im = vaddq_f32(vmulq_f32(reA, imB), vmulq_f32(imA, reB));
+static void split_multiply_add_neon(float *restrict dst_re, float *restrict dst_im, const float *restrict l_re, const float *restrict l_im, const float *restrict r_re, const float *restrict r_im, uint32_t size){
+  uint32_t k = 0;
+  for(; k+4 <= size; k+=4){
+    float32x4_t reA = vld1q_f32(l_re+k);
+    float32x4_t imA = vld1q_f32(l_im+k);
+    float32x4_t reB = vld1q_f32(r_re+k);
+    float32x4_t imB = vld1q_f32(r_im+k);
+    float32x4_t re = vmlaq_f32(vld1q_f32(dst_re+k), reA, reB);
+    float32x4_t im = vmlaq_f32(vld1q_f32(dst_im+k), reA, imB);
+    vst1q_f32(dst_re+k, vmlsq_f32(re, imA, imB));
+    vst1q_f32(dst_im+k, vmlaq_f32(im, imA, reB));
+  }
+  split_multiply_add_generic(dst_re+k, dst_im+k, l_re+k, l_im+k, r_re+k, r_im+k, size-k);
+}
+#endif
 
-    float32x4x2_t dst2 = vld2q_f32(dst);
+void convolution_kernels(uint32_t features, struct kernel_table *table){
+  table->split_multiply_add = split_multiply_add_generic;
+#if defined(CONVOLUTION_X86)
+  if((features & CPU_TIER_AVX2) == CPU_TIER_AVX2)
+    table->split_multiply_add = split_multiply_add_avx2;
+  else if(features & MIXED_CPU_SSE2)
+    table->split_multiply_add = split_multiply_add_sse2;
+#elif defined(__ARM_NEON)
+  if(features & MIXED_CPU_NEON)
+    table->split_multiply_add = split_multiply_add_neon;
+#endif
+  IGNORE(features);
+}
 
-    float32x4_t dst_re = vaddq_f32(dst2.val[0], re);
-    float32x4_t dst_im = vaddq_f32(dst2.val[1], im);
+// The real spectra keep the purely real DC and nyquist bins packed in the
+// first pair, which needs to be multiplied component-wise instead.
+static inline void spectrum_multiply_add(split_multiply_add_kernel split_multiply_add, float *restrict dst, const float *restrict l, const float *restrict r, uint32_t size){
+  uint32_t half = size/2;
+  float dc = dst[0] + l[0] * r[0];
+  float nyquist = dst[half] + l[half] * r[half];
+  split_multiply_add(dst, dst+half, l, l+half, r, r+half, half);
+  dst[0] = dc;
+  dst[half] = nyquist;
+}
 
-    vst2q_f32(dst, (float32x4x2_t){{dst_re, dst_im}});
+static void split_spectrum(float *restrict dst, const float *restrict spectrum, uint32_t size){
+  uint32_t half = size/2;
+  for(uint32_t k=0; k<half; ++k){
+    dst[k] = spectrum[2*k+0];
+    dst[half+k] = spectrum[2*k+1];
+  }
+}
 
-    dst += 8;
-    l += 8;
-    r += 8;
+static void join_spectrum(float *restrict dst, const float *restrict spectrum, uint32_t size){
+  uint32_t half = size/2;
+  for(uint32_t k=0; k<half; ++k){
+    dst[2*k+0] = spectrum[k];
+    dst[2*k+1] = spectrum[half+k];
   }
-  complex_multiply_add(dst, l, r, size);
 }
-#endif
 
-VECTORIZE void fft_convolve(struct fft_window_data *data, void *user){
+void fft_convolve(struct fft_window_data *data, void *user){
   struct convolution_segment_data *user_data = (struct convolution_segment_data *)user;
   uint32_t framesize = data->framesize;
   uint32_t block_size = user_data->block_size;
   uint32_t block_idx = user_data->block_idx;
   uint32_t block_count = user_data->block_count;
   float *fft_workspace = data->fft_workspace;
+  // The scratch space is free between the forward and inverse transforms.
+  float *accumulator = data->fft_scratch;
   float *fir = user_data->fir;
   float *buf = user_data->buf;
 
   // Preserve the current block
-  memcpy(buf + (block_idx * framesize), fft_workspace, sizeof(float)*framesize);
+  split_spectrum(buf + (block_idx * framesize), fft_workspace, framesize);
   user_data->block_idx = (block_idx+1) % block_count;
   
   // Actually perform the FIR multiplication of each block in the delay line.
-  memset(fft_workspace, 0, sizeof(float)*framesize);
+  split_multiply_add_kernel split_multiply_add = kernels()->split_multiply_add;
+  memset(accumulator, 0, sizeof(float)*framesize);
   for(uint32_t i = 0; i < block_count; ++i){
     uint32_t buf_idx = (block_idx+block_count-i) % block_count;
-#ifdef __ARM_NEON
-    complex_multiply_add_neon(fft_workspace, buf + (buf_idx * framesize), fir + (i * block_size), framesize);
-#else
-    complex_multiply_add(fft_workspace, buf + (buf_idx * framesize), fir + (i * block_size), framesize);
-#endif
+    spectrum_multiply_add(split_multiply_add, accumulator, buf + (buf_idx * framesize), fir + (i * block_size), framesize);
   }
+  join_spectrum(fft_workspace, accumulator, framesize);
 }
 
 int convolution_segment_mix(struct mixed_segment *segment){
@@ -151,9 +263,108 @@ int convolution_segment_mix(struct mixed_segment *segment){
   float mix = data->mix;
   mixed_buffer_request_read(&in, &samples, data->in);
   mixed_buffer_request_write(&out, &samples, data->out);
-  fft_window(in, out, samples, &data->fft_window_data, fft_convolve, data);
-  for(uint32_t i=0; i<samples; ++i){
-    out[i] = LERP(in[i], out[i], mix);
+  if(mix < 1.0f){
+    for(uint32_t i=0; i<samples; ){
+      uint32_t chunk = MIN(samples-i, sizeof(data->dry_buffer)/sizeof(float));
+      memcpy(data->dry_buffer, in+i, chunk*sizeof(float));
+      fft_window(in+i, out+i, chunk, &data->fft_window_data, fft_convolve, data);
+      for(uint32_t k=0; k<chunk; ++k)
+        out[i+k] = LERP(data->dry_buffer[k], out[i+k], mix);
+      i += chunk;
+    }
+  }else{
+    fft_window(in, out, samples, &data->fft_window_data, fft_convolve, data);
+  }
+  mixed_buffer_finish_read(samples, data->in);
+  mixed_buffer_finish_write(samples, data->out);
+  return 1;
+}
+
+static void convolution_segment_fade(float *in, float *out, uint32_t samples, struct convolution_segment_data *data){
+  struct convolver_data *fading = data->fading_convolver_data;
+  // The new convolver starts with silence, so hold off on the fade until
+  // its first partition has produced output.
+  uint32_t delay = data->convolver_data->head;
+  uint32_t length = MAX(1, data->fade_time * data->samplerate);
+  uint32_t position = data->fade_position;
+  float *old = data->fade_buffer;
+
+  for(uint32_t i=0; i<samples; ){
+    uint32_t chunk = MIN(samples-i, sizeof(data->fade_buffer)/sizeof(float));
+    float *chunk_out = out+i;
+    // Process the old output first, since the new one may overwrite the input.
+    convolver(in+i, &old, chunk, fading);
+    convolver(in+i, &chunk_out, chunk, data->convolver_data);
+    for(uint32_t k=0; k<chunk; ++k, ++position){
+      float x = (position < delay)? 0.0f : MIN(1.0f, (float)(position-delay)/length);
+      chunk_out[k] = LERP(old[k], chunk_out[k], x);
+    }
+    i += chunk;
+  }
+  data->fade_position = position;
+  if(delay+length <= position){
+    retire_convolver_data(fading);
+    data->fading_convolver_data = 0;
+  }
+}
+
+static void convolve_partitioned(float *in, float *out, uint32_t samples, struct convolution_segment_data *data){
+  if(data->fading_convolver_data){
+    convolution_segment_fade(in, out, samples, data);
+  }else{
+    convolver(in, &out, samples, data->convolver_data);
+  }
+}
+
+int convolution_segment_mix_partitioned(struct mixed_segment *segment){
+  struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
+
+  float *in, *out;
+  uint32_t samples = UINT32_MAX;
+  float mix = data->mix;
+  mixed_buffer_request_read(&in, &samples, data->in);
+  mixed_buffer_request_write(&out, &samples, data->out);
+  if(data->fading_convolver_data == 0 && atomic_read(data->next_convolver_data)){
+    data->fading_convolver_data = data->convolver_data;
+    data->convolver_data = atomic_swap(data->next_convolver_data, (struct convolver_data *)0);
+    data->fade_position = 0;
+  }
+  if(mix < 1.0f){
+    for(uint32_t i=0; i<samples; ){
+      uint32_t chunk = MIN(samples-i, sizeof(data->dry_buffer)/sizeof(float));
+      memcpy(data->dry_buffer, in+i, chunk*sizeof(float));
+      convolve_partitioned(in+i, out+i, chunk, data);
+      for(uint32_t k=0; k<chunk; ++k)
+        out[i+k] = LERP(data->dry_buffer[k], out[i+k], mix);
+      i += chunk;
+    }
+  }else{
+    convolve_partitioned(in, out, samples, data);
+  }
+  mixed_buffer_finish_read(samples, data->in);
+  mixed_buffer_finish_write(samples, data->out);
+  return 1;
+}
+
+int convolution_segment_mix_direct(struct mixed_segment *segment){
+  struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
+
+  float *in, *out;
+  uint32_t samples = UINT32_MAX;
+  float mix = data->mix;
+  mixed_buffer_request_read(&in, &samples, data->in);
+  mixed_buffer_request_write(&out, &samples, data->out);
+  if(mix < 1.0f){
+    // Mixing needs the dry input, which is lost when running in place.
+    for(uint32_t i=0; i<samples; ){
+      uint32_t chunk = MIN(samples-i, sizeof(data->fade_buffer)/sizeof(float));
+      direct_convolver(in+i, data->fade_buffer, chunk, &data->direct_data);
+      for(uint32_t k=0; k<chunk; ++k)
+        out[i+k] = LERP(in[i+k], data->fade_buffer[k], mix);
+      i += chunk;
+    }
+  }else{
+    direct_convolver(in, out, samples, &data->direct_data);
   }
   mixed_buffer_finish_read(samples, data->in);
   mixed_buffer_finish_write(samples, data->out);
@@ -189,6 +400,34 @@ int convolution_segment_info(struct mixed_segment_info *info, struct mixed_segme
                  MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The samplerate at which the segment operates.");
 
+  set_info_field(field++, MIXED_FFT_WINDOW,
+                 MIXED_FFT_WINDOW_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The window function applied to the FFT frames.");
+
+  set_info_field(field++, MIXED_CONVOLUTION_MODE,
+                 MIXED_CONVOLUTION_MODE_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The method used to perform the convolution.");
+
+  set_info_field(field++, MIXED_PARTITION_SIZE,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The size of the first FIR partition in partitioned mode.");
+
+  set_info_field(field++, MIXED_FADE_TIME,
+                 MIXED_DURATION_T, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of seconds it takes to crossfade to a new FIR in partitioned mode.");
+
+  set_info_field(field++, MIXED_BACKGROUND_PROCESSING,
+                 MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Whether to process the FIR tail on a background thread.");
+
+  set_info_field(field++, MIXED_BACKGROUND_OVERRUNS,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "How often the background thread missed its deadline.");
+
+  set_info_field(field++, MIXED_DIRECT_CROSSOVER,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The FIR size up to which the direct mode is picked automatically.");
+
   set_info_field(field++, MIXED_MIX,
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "How much of the output to mix with the input.");
@@ -205,6 +444,15 @@ int convolution_segment_get(uint32_t field, void *value, struct mixed_segment *s
   struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
   switch(field){
   case MIXED_SAMPLERATE: *((uint32_t *)value) = data->samplerate; break;
+  case MIXED_FFT_WINDOW: *((enum mixed_fft_window *)value) = data->fft_window_data.window_type; break;
+  case MIXED_CONVOLUTION_MODE: *((enum mixed_convolution_mode *)value) = data->mode; break;
+  case MIXED_PARTITION_SIZE: *((uint32_t *)value) = data->partition_size; break;
+  case MIXED_DIRECT_CROSSOVER: *((uint32_t *)value) = data->direct_crossover; break;
+  case MIXED_FADE_TIME: *((float *)value) = data->fade_time; break;
+  case MIXED_BACKGROUND_PROCESSING: *((bool *)value) = data->background; break;
+  case MIXED_BACKGROUND_OVERRUNS:
+    *((uint32_t *)value) = (data->convolver_data)? atomic_read(data->convolver_data->overruns) : 0;
+    break;
   case MIXED_MIX: *((float *)value) = data->mix; break;
   case MIXED_BYPASS: *((bool *)value) = (segment->mix == convolution_segment_mix_bypass); break;
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
@@ -212,7 +460,7 @@ int convolution_segment_get(uint32_t field, void *value, struct mixed_segment *s
   return 1;
 }
 
-int update_fir(float *fir, uint32_t fir_size, struct convolution_segment_data *data){
+static int update_fir_windowed(float *fir, uint32_t fir_size, struct convolution_segment_data *data){
   uint32_t block_size = data->block_size;
   float *fir_fft = 0, *fir_buf = 0;
 
@@ -221,12 +469,12 @@ int update_fir(float *fir, uint32_t fir_size, struct convolution_segment_data *d
   }
   uint32_t block_count = 1 + ((fir_size - 1) / block_size);
   
-  fir_fft = mixed_calloc(block_count*block_size*2, sizeof(float));
+  fir_fft = aligned_calloc(64, block_count*block_size, sizeof(float));
   if(!fir_fft){
     mixed_err(MIXED_OUT_OF_MEMORY);
     goto cleanup;
   }
-  fir_buf = mixed_calloc(block_count*block_size*2, sizeof(float));
+  fir_buf = aligned_calloc(64, block_count*block_size, sizeof(float));
   if(!fir_buf){
     mixed_err(MIXED_OUT_OF_MEMORY);
     goto cleanup;
@@ -244,15 +492,17 @@ int update_fir(float *fir, uint32_t fir_size, struct convolution_segment_data *d
       memset(fir_o+fir_size, 0, sizeof(float)*(block_size-fir_size));
     }
 
-    if(!mixed_fwd_fft(block_size, fir_o, fir_o))
+    if(!mixed_fwd_fft(block_size, fir_o, fir_buf))
       goto cleanup;
+    split_spectrum(fir_o, fir_buf, block_size);
     fir_i += block_size;
     fir_o += block_size;
     fir_size -= block_size;
   }
 
-  if(data->fir) free(data->fir);
-  if(data->buf) free(data->buf);
+  if(data->fir) mixed_free(data->fir);
+  if(data->buf) mixed_free(data->buf);
+  memset(fir_buf, 0, sizeof(float)*block_count*block_size);
   
   data->block_count = block_count;
   data->fir = fir_fft;
@@ -260,11 +510,100 @@ int update_fir(float *fir, uint32_t fir_size, struct convolution_segment_data *d
   return 1;
 
  cleanup:
-  if(fir_fft) free(fir_fft);
-  if(fir_buf) free(fir_buf);
+  if(fir_fft) mixed_free(fir_fft);
+  if(fir_buf) mixed_free(fir_buf);
   return 0;
 }
 
+static int update_fir_partitioned(float *fir, uint32_t fir_size, struct convolution_segment_data *data){
+  // The convolver may be referenced by its worker thread, so it cannot be moved.
+  struct convolver_data *convolver_data = mixed_calloc(1, sizeof(struct convolver_data));
+  if(!convolver_data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  if(!make_convolver_data(fir, fir_size, 1, data->partition_size, data->background, convolver_data)){
+    mixed_free(convolver_data);
+    return 0;
+  }
+  drop_swapped_convolvers(data);
+  destroy_convolver(data->convolver_data);
+  data->convolver_data = convolver_data;
+  return 1;
+}
+
+// Prepare the new FIR on the calling thread and hand it to the mixing
+// thread, which will fade over to it on its next mix.
+static int swap_fir_partitioned(float *fir, uint32_t fir_size, struct convolution_segment_data *data){
+  struct convolver_data *convolver_data = mixed_calloc(1, sizeof(struct convolver_data));
+  if(!convolver_data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  if(!make_convolver_data(fir, fir_size, 1, data->partition_size, data->background, convolver_data)){
+    mixed_free(convolver_data);
+    return 0;
+  }
+  // If the previous FIR was not picked up yet, it is simply replaced.
+  destroy_convolver(atomic_swap(data->next_convolver_data, convolver_data));
+  return 1;
+}
+
+static int update_fir_direct(float *fir, uint32_t fir_size, struct convolution_segment_data *data){
+  struct direct_convolver_data direct_data;
+  if(!make_direct_convolver_data(fir, fir_size, &direct_data))
+    return 0;
+  free_direct_convolver_data(&data->direct_data);
+  data->direct_data = direct_data;
+  return 1;
+}
+
+static int rebuild_fir(struct convolution_segment_data *data){
+  if(data->mode == MIXED_CONVOLUTION_PARTITIONED)
+    return update_fir_partitioned(data->raw_fir, data->raw_fir_size, data);
+  if(data->mode == MIXED_CONVOLUTION_DIRECT)
+    return update_fir_direct(data->raw_fir, data->raw_fir_size, data);
+  return update_fir_windowed(data->raw_fir, data->raw_fir_size, data);
+}
+
+// Short FIRs are cheaper to convolve directly, and without any latency.
+static enum mixed_convolution_mode automatic_mode(float *fir, uint32_t fir_size, struct convolution_segment_data *data){
+  while(0 < fir_size && fabs(fir[fir_size-1]) < 0.000001f){
+    --fir_size;
+  }
+  return (fir_size <= data->direct_crossover)? MIXED_CONVOLUTION_DIRECT : MIXED_CONVOLUTION_WINDOWED;
+}
+
+int update_fir(float *fir, uint32_t fir_size, struct convolution_segment_data *data){
+  // Keep the raw FIR around so that we can switch modes later.
+  float *raw_fir = mixed_calloc(MAX(1, fir_size), sizeof(float));
+  if(!raw_fir){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  memcpy(raw_fir, fir, fir_size*sizeof(float));
+  float *old_fir = data->raw_fir;
+  uint32_t old_size = data->raw_fir_size;
+  enum mixed_convolution_mode old_mode = data->mode;
+  data->raw_fir = raw_fir;
+  data->raw_fir_size = fir_size;
+  // A new FIR may fall on the other side of the crossover.
+  if(data->automatic_mode)
+    data->mode = automatic_mode(raw_fir, fir_size, data);
+  int result = (data->mode == MIXED_CONVOLUTION_PARTITIONED && old_mode == data->mode && data->convolver_data)
+    ? swap_fir_partitioned(raw_fir, fir_size, data)
+    : rebuild_fir(data);
+  if(!result){
+    data->raw_fir = old_fir;
+    data->raw_fir_size = old_size;
+    data->mode = old_mode;
+    mixed_free(raw_fir);
+    return 0;
+  }
+  if(old_fir) mixed_free(old_fir);
+  return 1;
+}
+
 int convolution_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
   struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
   switch(field){
@@ -279,11 +618,79 @@ int convolution_segment_set(uint32_t field, void *value, struct mixed_segment *s
       return 0;
     }
     break;
+  case MIXED_FFT_WINDOW:
+    return fft_window_set_type(*(enum mixed_fft_window *)value, &data->fft_window_data);
   case MIXED_FIR: {
     float *fir;
     uint32_t size = 0xFFFFFFFF;
+    enum mixed_convolution_mode old_mode = data->mode;
     mixed_buffer_request_read(&fir, &size, (struct mixed_buffer *)value);
-    return update_fir(fir, size, data);
+    if(!update_fir(fir, size, data))
+      return 0;
+    if(data->mode != old_mode && segment->mix != convolution_segment_mix_bypass){
+      bool bypass = 0;
+      return convolution_segment_set(MIXED_BYPASS, &bypass, segment);
+    }
+    break;}
+  case MIXED_CONVOLUTION_MODE: {
+    enum mixed_convolution_mode mode = *(enum mixed_convolution_mode *)value;
+    enum mixed_convolution_mode old_mode = data->mode;
+    if(mode < MIXED_CONVOLUTION_WINDOWED || MIXED_CONVOLUTION_DIRECT < mode){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->mode = mode;
+    if(!rebuild_fir(data)){
+      data->mode = old_mode;
+      return 0;
+    }
+    data->automatic_mode = 0;
+    if(segment->mix != convolution_segment_mix_bypass){
+      bool bypass = 0;
+      return convolution_segment_set(MIXED_BYPASS, &bypass, segment);
+    }
+    break;}
+  case MIXED_DIRECT_CROSSOVER: {
+    uint32_t old_crossover = data->direct_crossover;
+    data->direct_crossover = *(uint32_t *)value;
+    if(data->automatic_mode){
+      enum mixed_convolution_mode mode = automatic_mode(data->raw_fir, data->raw_fir_size, data);
+      if(mode != data->mode){
+        if(!convolution_segment_set(MIXED_CONVOLUTION_MODE, &mode, segment)){
+          data->direct_crossover = old_crossover;
+          return 0;
+        }
+        data->automatic_mode = 1;
+      }
+    }
+    break;}
+  case MIXED_PARTITION_SIZE: {
+    uint32_t size = *(uint32_t *)value;
+    uint32_t old_size = data->partition_size;
+    if(size < 16 || 8192 < size || (size & (size-1)) != 0){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->partition_size = size;
+    if(data->mode == MIXED_CONVOLUTION_PARTITIONED && !rebuild_fir(data)){
+      data->partition_size = old_size;
+      return 0;
+    }
+    break;}
+  case MIXED_FADE_TIME:
+    if(*(float *)value < 0.0){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->fade_time = *(float *)value;
+    break;
+  case MIXED_BACKGROUND_PROCESSING: {
+    bool old_background = data->background;
+    data->background = *(bool *)value;
+    if(data->mode == MIXED_CONVOLUTION_PARTITIONED && !rebuild_fir(data)){
+      data->background = old_background;
+      return 0;
+    }
     break;}
   case MIXED_MIX:
     if(*(float *)value < 0 || 1 < *(float *)value){
@@ -302,6 +709,10 @@ int convolution_segment_set(uint32_t field, void *value, struct mixed_segment *s
   case MIXED_BYPASS:
     if(*(bool *)value){
       segment->mix = convolution_segment_mix_bypass;
+    }else if(data->mode == MIXED_CONVOLUTION_PARTITIONED){
+      segment->mix = convolution_segment_mix_partitioned;
+    }else if(data->mode == MIXED_CONVOLUTION_DIRECT){
+      segment->mix = convolution_segment_mix_direct;
     }else{
       segment->mix = convolution_segment_mix;
     }
@@ -345,13 +756,19 @@ MIXED_EXPORT int mixed_make_segment_convolution(uint32_t block_size, float *fir,
   data->samplerate = samplerate;
   data->mix = 1.0;
   data->block_size = block_size;
+  data->partition_size = 128;
+  data->fade_time = 0.05;
+
+  data->direct_crossover = DIRECT_CONVOLVER_CROSSOVER;
+  data->automatic_mode = 1;
+  data->mode = automatic_mode(fir, fir_size, data);
 
   if(!update_fir(fir, fir_size, data))
     goto cleanup;
   
   segment->free = convolution_segment_free;
   segment->start = convolution_segment_start;
-  segment->mix = convolution_segment_mix;
+  segment->mix = (data->mode == MIXED_CONVOLUTION_DIRECT)? convolution_segment_mix_direct : convolution_segment_mix;
   segment->set_in = convolution_segment_set_in;
   segment->set_out = convolution_segment_set_out;
   segment->info = convolution_segment_info;
@@ -362,8 +779,10 @@ MIXED_EXPORT int mixed_make_segment_convolution(uint32_t block_size, float *fir,
 
  cleanup:
   free_fft_window_data(&data->fft_window_data);
-  if(data->fir) free(data->fir);
-  if(data->buf) free(data->buf);
+  if(data->fir) mixed_free(data->fir);
+  if(data->buf) mixed_free(data->buf);
+  if(data->raw_fir) mixed_free(data->raw_fir);
+  free_direct_convolver_data(&data->direct_data);
   mixed_free(data);
   return 0;
 }
@@ -75,11 +75,16 @@ VECTORIZE void fft_equalize(struct fft_window_data *data, void *user){
   float *fft_workspace = data->fft_workspace;
   float *bands = user_data->bands;
 
+  // The nyquist bin is packed into the DC pair, pull it out and adjust
+  // it by the last band directly.
+  float nyquist = fft_workspace[1] * bands[7];
+  fft_workspace[1] = 0.0f;
+
   // Change to mag/phase
   for(uint32_t i = 0; i < framesize; i+= 2){
     float re = fft_workspace[i+0];
     float im = fft_workspace[i+1];
-    fft_workspace[i+0] = sqrtf(re * re + im * im) * 2;
+    fft_workspace[i+0] = sqrtf(re * re + im * im);
     fft_workspace[i+1] = atan2f(im, re);
   }
 
@@ -104,6 +109,7 @@ VECTORIZE void fft_equalize(struct fft_window_data *data, void *user){
 	fft_workspace[i+0] = cosf(pha) * mag;
 	fft_workspace[i+1] = sinf(pha) * mag;
   }
+  fft_workspace[1] = nyquist;
 }
 
 int equalizer_segment_mix(struct mixed_segment *segment){
@@ -152,6 +158,10 @@ int equalizer_segment_info(struct mixed_segment_info *info, struct mixed_segment
                  MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The samplerate at which the segment operates.");
 
+  set_info_field(field++, MIXED_FFT_WINDOW,
+                 MIXED_FFT_WINDOW_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The window function applied to the FFT frames.");
+
   set_info_field(field++, MIXED_MIX,
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "How much of the output to mix with the input.");
@@ -168,6 +178,7 @@ int equalizer_segment_get(uint32_t field, void *value, struct mixed_segment *seg
   struct equalizer_segment_data *data = (struct equalizer_segment_data *)segment->data;
   switch(field){
   case MIXED_SAMPLERATE: *((uint32_t *)value) = data->samplerate; break;
+  case MIXED_FFT_WINDOW: *((enum mixed_fft_window *)value) = data->fft_window_data.window_type; break;
   case MIXED_MIX: *((float *)value) = data->mix; break;
   case MIXED_BYPASS: *((bool *)value) = (segment->mix == equalizer_segment_mix_bypass); break;
   case MIXED_EQUALIZER_BAND: memcpy(value, data->bands, sizeof(float)*8); break;
@@ -190,6 +201,8 @@ int equalizer_segment_set(uint32_t field, void *value, struct mixed_segment *seg
       return 0;
     }
     break;
+  case MIXED_FFT_WINDOW:
+    return fft_window_set_type(*(enum mixed_fft_window *)value, &data->fft_window_data);
   case MIXED_EQUALIZER_BAND:
     memcpy(data->bands, value, sizeof(float)*8);
     break;
@@ -9,14 +9,19 @@ struct fft_segment_data{
   long overlap;
   float *fifo;
   float *fft_workspace;
+  float *fft_scratch;
   float *phase;
   float *accumulator;
+  const float *window;
 };
 
 int fft_realloc(struct fft_segment_data *data){
   uint32_t framesize = data->framesize;
   float *mem = data->fifo;
-  uint32_t size = framesize+framesize*2+framesize/2+1+framesize*2;
+  uint32_t size = framesize+framesize+framesize+framesize/2+1+framesize*2;
+  const float *window = fft_window_table(MIXED_HANN_WINDOW, framesize);
+  if(!window || !mixed_prepare_fft(framesize))
+    return 0;
   if(mem) mem = mixed_realloc(mem, size*sizeof(float));
   else mem = mixed_calloc(size, sizeof(float));
   if(!mem){
@@ -24,9 +29,11 @@ int fft_realloc(struct fft_segment_data *data){
     return 0;
   }
   data->fifo = mem; mem += framesize;
-  data->fft_workspace = mem; mem += framesize*2;
+  data->fft_workspace = mem; mem += framesize;
+  data->fft_scratch = mem; mem += framesize;
   data->phase = mem; mem += framesize/2+1;
   data->accumulator = mem; mem += framesize*2;
+  data->window = window;
   return 1;
 }
 
@@ -56,12 +63,13 @@ VECTORIZE int fft_segment_fwd(struct mixed_segment *segment){
   float *restrict in_fifo = data->fifo;
   float *restrict fft_workspace = data->fft_workspace;
   float *restrict last_phase = data->phase;
+  const float *restrict window = data->window;
 
   float *restrict in, *restrict out;
   uint32_t in_samples = UINT32_MAX;
   mixed_buffer_request_read(&in, &in_samples, data->in);
 
-  double magnitude, phase, tmp, window, real, imag;
+  double magnitude, phase, tmp, real, imag;
   long i, k, qpd;
   long framesize2 = framesize/2;
   long step = framesize/oversampling;
@@ -80,17 +88,15 @@ VECTORIZE int fft_segment_fwd(struct mixed_segment *segment){
       
       data->overlap = fifo_latency;
 
-      for(k=0; k<framesize; k++){
-        window = -.5*cos(2.*M_PI*(double)k/(double)framesize)+.5;
-        fft_workspace[2*k] = in_fifo[k] * window;
-        fft_workspace[2*k+1] = 0.;
-      }
+      for(k=0; k<framesize; k++)
+        fft_workspace[k] = in_fifo[k] * window[k];
 
-      mixed_fwd_fft(framesize, fft_workspace, fft_workspace);
+      fft_fwd(framesize, fft_workspace, fft_workspace, data->fft_scratch);
 
-      for(k=0; k<=framesize2; k++){
+      for(k=0; k<framesize2; k++){
         real = fft_workspace[2*k];
-        imag = fft_workspace[2*k+1];
+        // The first pair packs the nyquist bin in place of the DC's imaginary part
+        imag = (k == 0)? 0. : fft_workspace[2*k+1];
         magnitude = 2.*sqrt(real*real + imag*imag);
         phase = atan2(imag,real);
         
@@ -127,12 +133,13 @@ VECTORIZE int fft_segment_inv(struct mixed_segment *segment){
   float *restrict fft_workspace = data->fft_workspace;
   float *restrict phase_sum = data->phase;
   float *restrict output_accumulator = data->accumulator;
+  const float *restrict window = data->window;
 
   float *restrict in, *restrict out;
   uint32_t in_samples = framesize;
   uint32_t out_samples = UINT32_MAX;
 
-  double magnitude, phase, tmp, window;
+  double magnitude, phase, tmp;
   long i, k;
   long framesize2 = framesize/2;
   long step = framesize/oversampling;
@@ -152,7 +159,7 @@ VECTORIZE int fft_segment_inv(struct mixed_segment *segment){
       if(!mixed_buffer_request_read(&in, &in_samples, data->in))
         break;
       mixed_buffer_finish_read(in_samples, data->in);
-      for(k=0; k<=framesize2; k++){
+      for(k=0; k<framesize2; k++){
         tmp = in[k*2];
         magnitude = in[k*2+1];
 
@@ -163,18 +170,17 @@ VECTORIZE int fft_segment_inv(struct mixed_segment *segment){
         phase_sum[k] += tmp;
         phase = phase_sum[k];
 
-        fft_workspace[2*k] = magnitude*cos(phase);
-        fft_workspace[2*k+1] = magnitude*sin(phase);
-      } 
-
-      for(k=framesize+2; k<2*framesize; k++) fft_workspace[k] = 0.;
+        // The real inverse transform mirrors the spectrum, so only half
+        // of the magnitude is needed per bin.
+        fft_workspace[2*k] = 0.5*magnitude*cos(phase);
+        fft_workspace[2*k+1] = 0.5*magnitude*sin(phase);
+      }
+      fft_workspace[1] = 0.;
 
-      mixed_inv_fft(framesize, fft_workspace, fft_workspace);
+      fft_inv(framesize, fft_workspace, fft_workspace, data->fft_scratch);
 
-      for(k=0; k<framesize; k++){
-        window = -.5*cos(2.*M_PI*(double)k/(double)framesize)+.5;
-        output_accumulator[k] += 2.*window*fft_workspace[2*k]/(framesize2*oversampling);
-      }
+      for(k=0; k<framesize; k++)
+        output_accumulator[k] += 2.*window[k]*fft_workspace[k]/(framesize2*oversampling);
       for(k=0; k<step; k++) out_fifo[k] = output_accumulator[k];
 
       memmove(output_accumulator, output_accumulator+step, framesize*sizeof(float));
@@ -284,7 +290,7 @@ int fft_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
     break;
   case MIXED_FRAMESIZE:
     { uint32_t framesize = *(uint32_t *)value;
-    if(framesize < 1<<3 || 1<<18 < framesize || (framesize & (framesize - 1)) != 0){
+    if(framesize < 1<<5 || 1<<18 < framesize || (framesize & (framesize - 1)) != 0){
       mixed_err(MIXED_INVALID_VALUE);
       return 0;
     }
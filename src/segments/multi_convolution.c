@@ -0,0 +1,305 @@
+#include "../internal.h"
+
+struct multi_convolution_segment_data{
+  struct mixed_buffer *in;
+  struct mixed_buffer **out;
+  float **out_areas;
+  struct convolver_data *convolver_data;
+  uint32_t outputs;
+  uint32_t partition_size;
+  bool background;
+  float mix;
+  // The dry input, which is lost when an output is the input buffer.
+  float dry_buffer[256];
+  float *fir;
+  uint32_t fir_size;
+};
+
+int multi_convolution_segment_free(struct mixed_segment *segment){
+  struct multi_convolution_segment_data *data = (struct multi_convolution_segment_data *)segment->data;
+  if(data){
+    if(data->convolver_data){
+      free_convolver_data(data->convolver_data);
+      mixed_free(data->convolver_data);
+    }
+    FREE(data->out);
+    FREE(data->out_areas);
+    FREE(data->fir);
+    mixed_free(data);
+  }
+  segment->data = 0;
+  return 1;
+}
+
+int multi_convolution_segment_start(struct mixed_segment *segment){
+  struct multi_convolution_segment_data *data = (struct multi_convolution_segment_data *)segment->data;
+  if(data->in == 0){
+    mixed_err(MIXED_BUFFER_MISSING);
+    return 0;
+  }
+  for(uint32_t o=0; o<data->outputs; ++o){
+    if(data->out[o] == 0){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  convolver_reset(data->convolver_data);
+  return 1;
+}
+
+int multi_convolution_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct multi_convolution_segment_data *data = (struct multi_convolution_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(location == 0){
+      data->in = (struct mixed_buffer *)buffer;
+      return 1;
+    }
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int multi_convolution_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct multi_convolution_segment_data *data = (struct multi_convolution_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->outputs <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->out[location] = (struct mixed_buffer *)buffer;
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int multi_convolution_segment_mix(struct mixed_segment *segment){
+  struct multi_convolution_segment_data *data = (struct multi_convolution_segment_data *)segment->data;
+  uint32_t outputs = data->outputs;
+  float **out = data->out_areas;
+
+  float *in;
+  uint32_t samples = UINT32_MAX;
+  float mix = data->mix;
+  mixed_buffer_request_read(&in, &samples, data->in);
+  for(uint32_t o=0; o<outputs; ++o)
+    mixed_buffer_request_write(&out[o], &samples, data->out[o]);
+  if(mix < 1.0f){
+    float *chunk_out[outputs];
+    for(uint32_t i=0; i<samples; ){
+      uint32_t chunk = MIN(samples-i, sizeof(data->dry_buffer)/sizeof(float));
+      memcpy(data->dry_buffer, in+i, chunk*sizeof(float));
+      for(uint32_t o=0; o<outputs; ++o)
+        chunk_out[o] = out[o]+i;
+      convolver(in+i, chunk_out, chunk, data->convolver_data);
+      for(uint32_t o=0; o<outputs; ++o){
+        for(uint32_t k=0; k<chunk; ++k)
+          chunk_out[o][k] = LERP(data->dry_buffer[k], chunk_out[o][k], mix);
+      }
+      i += chunk;
+    }
+  }else{
+    convolver(in, out, samples, data->convolver_data);
+  }
+  mixed_buffer_finish_read(samples, data->in);
+  for(uint32_t o=0; o<outputs; ++o)
+    mixed_buffer_finish_write(samples, data->out[o]);
+  return 1;
+}
+
+int multi_convolution_segment_mix_bypass(struct mixed_segment *segment){
+  struct multi_convolution_segment_data *data = (struct multi_convolution_segment_data *)segment->data;
+  uint32_t outputs = data->outputs;
+  float **out = data->out_areas;
+
+  float *in;
+  uint32_t samples = UINT32_MAX;
+  mixed_buffer_request_read(&in, &samples, data->in);
+  for(uint32_t o=0; o<outputs; ++o)
+    mixed_buffer_request_write(&out[o], &samples, data->out[o]);
+  for(uint32_t o=0; o<outputs; ++o){
+    memcpy(out[o], in, samples*sizeof(float));
+    mixed_buffer_finish_write(samples, data->out[o]);
+  }
+  mixed_buffer_finish_read(samples, data->in);
+  return 1;
+}
+
+int multi_convolution_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  struct multi_convolution_segment_data *data = (struct multi_convolution_segment_data *)segment->data;
+
+  info->name = "multi_convolution";
+  info->description = "Convolve the audio signal with several finite input responses at once.";
+  info->min_inputs = 1;
+  info->max_inputs = 1;
+  info->outputs = data->outputs;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_PARTITION_SIZE,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The size of the first FIR partition.");
+
+  set_info_field(field++, MIXED_BACKGROUND_PROCESSING,
+                 MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Whether to process the FIR tails on a background thread.");
+
+  set_info_field(field++, MIXED_MIX,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "How much of the output to mix with the input.");
+
+  set_info_field(field++, MIXED_BYPASS,
+                 MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Bypass the segment's processing.");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+int multi_convolution_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct multi_convolution_segment_data *data = (struct multi_convolution_segment_data *)segment->data;
+  switch(field){
+  case MIXED_PARTITION_SIZE: *((uint32_t *)value) = data->partition_size; break;
+  case MIXED_BACKGROUND_PROCESSING: *((bool *)value) = data->background; break;
+  case MIXED_MIX: *((float *)value) = data->mix; break;
+  case MIXED_BYPASS: *((bool *)value) = (segment->mix == multi_convolution_segment_mix_bypass); break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+static int rebuild_convolver(struct multi_convolution_segment_data *data){
+  // The convolver may be referenced by its worker thread, so it cannot be moved.
+  struct convolver_data *convolver_data = mixed_calloc(1, sizeof(struct convolver_data));
+  if(!convolver_data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  if(!make_convolver_data(data->fir, data->fir_size, data->outputs, data->partition_size, data->background, convolver_data)){
+    mixed_free(convolver_data);
+    return 0;
+  }
+  if(data->convolver_data){
+    free_convolver_data(data->convolver_data);
+    mixed_free(data->convolver_data);
+  }
+  data->convolver_data = convolver_data;
+  return 1;
+}
+
+int multi_convolution_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct multi_convolution_segment_data *data = (struct multi_convolution_segment_data *)segment->data;
+  switch(field){
+  case MIXED_PARTITION_SIZE: {
+    uint32_t old_size = data->partition_size;
+    data->partition_size = *(uint32_t *)value;
+    if(!rebuild_convolver(data)){
+      data->partition_size = old_size;
+      return 0;
+    }
+    break;}
+  case MIXED_BACKGROUND_PROCESSING: {
+    bool old_background = data->background;
+    data->background = *(bool *)value;
+    if(!rebuild_convolver(data)){
+      data->background = old_background;
+      return 0;
+    }
+    break;}
+  case MIXED_MIX:
+    if(*(float *)value < 0 || 1 < *(float *)value){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->mix = *(float *)value;
+    if(data->mix == 0){
+      bool bypass = 1;
+      return multi_convolution_segment_set(MIXED_BYPASS, &bypass, segment);
+    }else{
+      bool bypass = 0;
+      return multi_convolution_segment_set(MIXED_BYPASS, &bypass, segment);
+    }
+    break;
+  case MIXED_BYPASS:
+    if(*(bool *)value){
+      segment->mix = multi_convolution_segment_mix_bypass;
+    }else{
+      segment->mix = multi_convolution_segment_mix;
+    }
+    break;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_multi_convolution(uint32_t partition_size, float *firs, uint32_t fir_size, uint32_t outputs, struct mixed_segment *segment){
+  if(outputs == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
+  struct multi_convolution_segment_data *data = mixed_calloc(1, sizeof(struct multi_convolution_segment_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  data->out = mixed_calloc(outputs, sizeof(struct mixed_buffer *));
+  data->out_areas = mixed_calloc(outputs, sizeof(float *));
+  // Keep the raw FIRs around so that we can rebuild the partitions later.
+  data->fir = mixed_calloc(MAX(1, outputs*fir_size), sizeof(float));
+  if(!data->out || !data->out_areas || !data->fir){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    goto cleanup;
+  }
+  memcpy(data->fir, firs, outputs*fir_size*sizeof(float));
+
+  data->outputs = outputs;
+  data->fir_size = fir_size;
+  data->partition_size = partition_size;
+  data->mix = 1.0;
+
+  if(!rebuild_convolver(data))
+    goto cleanup;
+
+  segment->free = multi_convolution_segment_free;
+  segment->start = multi_convolution_segment_start;
+  segment->mix = multi_convolution_segment_mix;
+  segment->set_in = multi_convolution_segment_set_in;
+  segment->set_out = multi_convolution_segment_set_out;
+  segment->info = multi_convolution_segment_info;
+  segment->get = multi_convolution_segment_get;
+  segment->set = multi_convolution_segment_set;
+  segment->data = data;
+  return 1;
+
+ cleanup:
+  FREE(data->out);
+  FREE(data->out_areas);
+  FREE(data->fir);
+  mixed_free(data);
+  return 0;
+}
+
+int __make_multi_convolution(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_multi_convolution(ARG(uint32_t, 0), ARG(float *, 1), ARG(uint32_t, 2), ARG(uint32_t, 3), segment);
+}
+
+REGISTER_SEGMENT(multi_convolution, __make_multi_convolution, 4, {
+  {.description = "partition_size", .type = MIXED_UINT32},
+  {.description = "firs", .type = MIXED_POINTER},
+  {.description = "fir_size", .type = MIXED_UINT32},
+  {.description = "outputs", .type = MIXED_UINT32}})
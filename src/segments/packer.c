@@ -1,4 +1,5 @@
 #include "../internal.h"
+#include "../bip.h"
 #include "samplerate.h"
 
 struct pack_segment_data{
@@ -9,6 +10,9 @@ struct pack_segment_data{
   float volume;
   float target_volume;
   int quality;
+  bool views;
+  uint32_t view_read;
+  uint32_t view_scaled;
   float resample_in[512];
   float resample_out[512];
 };
@@ -82,6 +86,112 @@ int pack_segment_start(struct mixed_segment *segment){
   return 1;
 }
 
+// Planar floats at the same sample rate need no conversion, so the
+// buffers can become views of the planes like the outputs of the
+// distribute segment. That only works if they have no data array of
+// their own, which a view from an earlier start does not count as.
+static bool can_view_planes(struct pack_segment_data *data){
+  struct mixed_pack *pack = data->pack;
+  if(pack->layout != MIXED_PLANAR || pack->encoding != MIXED_FLOAT
+     || pack->samplerate != data->samplerate
+     || pack->size % (pack->channels * sizeof(float)) != 0)
+    return 0;
+  for(mixed_channel_t c=0; c<pack->channels; ++c){
+    if(data->buffers[c]->_data && !data->buffers[c]->is_virtual)
+      return 0;
+  }
+  return 1;
+}
+
+// Only expose the first region of the pack, so that the readers of the
+// views cannot wrap around on their own and the consumed frames can be
+// told from their read positions alone.
+static void sync_views(struct pack_segment_data *data){
+  struct mixed_pack *pack = data->pack;
+  uint32_t frame_bytes = pack->channels * sizeof(float);
+  // Let the pack wrap around to the second region once the first is done.
+  bip_wrap_read((struct bip *)pack);
+  uint32_t read = atomic_read(pack->read);
+  uint32_t end = bip_read_end((struct bip *)pack);
+  data->view_read = read / frame_bytes;
+  for(mixed_channel_t c=0; c<pack->channels; ++c){
+    atomic_write(data->buffers[c]->read, read / frame_bytes);
+    atomic_write(data->buffers[c]->write, end / frame_bytes);
+  }
+}
+
+int source_segment_start(struct mixed_segment *segment){
+  struct pack_segment_data *data = (struct pack_segment_data *)segment->data;
+  if(!pack_segment_start(segment))
+    return 0;
+
+  data->views = can_view_planes(data);
+  if(data->views){
+    struct mixed_pack *pack = data->pack;
+    uint32_t plane = pack->size / pack->channels;
+    for(mixed_channel_t c=0; c<pack->channels; ++c){
+      struct mixed_buffer *buffer = data->buffers[c];
+      buffer->_data = (float *)(pack->_data + c*plane);
+      buffer->size = plane / sizeof(float);
+      buffer->is_virtual = 1;
+    }
+    sync_views(data);
+    data->view_scaled = 0;
+  }
+  return 1;
+}
+
+// The views hand out the samples of the pack itself, so the volume is
+// applied in place as new samples come in.
+static void scale_in_place(float *samples, uint32_t count, float volume, float target_volume, enum mixed_volume_mode mode){
+  if(count == 0) return;
+  if(volume == target_volume){
+    for(uint32_t i=0; i<count; ++i)
+      samples[i] = mixed_from_float(samples[i]) * volume;
+  }else if(mode == MIXED_VOLUME_RAMP){
+    float step = (target_volume - volume) / count;
+    for(uint32_t i=0; i<count; ++i)
+      samples[i] = mixed_from_float(samples[i]) * (volume + step*(i+1));
+  }else{
+    float previous = mixed_from_float(samples[0]);
+    samples[0] = previous * volume;
+    for(uint32_t i=1; i<count; ++i){
+      float sample = mixed_from_float(samples[i]);
+      if(previous * sample < 0.0f)
+        volume = target_volume;
+      samples[i] = sample * volume;
+      previous = sample;
+    }
+  }
+}
+
+static int view_segment_mix(struct pack_segment_data *data){
+  struct mixed_pack *pack = data->pack;
+  mixed_channel_t channels = pack->channels;
+  // The slowest reader decides how much of the pack is consumed.
+  uint32_t read = UINT32_MAX;
+  for(mixed_channel_t c=0; c<channels; ++c)
+    read = MIN(read, atomic_read(data->buffers[c]->read));
+  // The views may have been cleared in the meantime.
+  uint32_t consumed = (data->view_read <= read)? read - data->view_read : 0;
+  mixed_pack_finish_read(consumed * channels * sizeof(float), pack);
+  uint32_t scaled = (consumed < data->view_scaled)? data->view_scaled - consumed : 0;
+  sync_views(data);
+
+  uint32_t available = mixed_buffer_available_read(data->buffers[0]);
+  if(data->volume != 1.0f || data->target_volume != 1.0f){
+    for(mixed_channel_t c=0; c<channels; ++c){
+      float *plane = data->buffers[c]->_data + data->view_read;
+      scale_in_place(plane + scaled, available - scaled, data->volume, data->target_volume, pack->volume_mode);
+    }
+    // KLUDGE: this is not necessarily correct...
+    if(scaled < available)
+      data->volume = data->target_volume;
+  }
+  data->view_scaled = available;
+  return 1;
+}
+
 // FIXME: by using separate states per channel we could alias the
 //        SRC_DATA arrays with the input buffer arrays and avoid
 //        extra allocation and copying on at least one side.
@@ -90,7 +200,9 @@ int source_segment_mix(struct mixed_segment *segment){
   struct pack_segment_data *data = (struct pack_segment_data *)segment->data;
   struct mixed_pack *pack = data->pack;
 
-  if(pack->samplerate == data->samplerate){
+  if(data->views){
+    return view_segment_mix(data);
+  }else if(pack->samplerate == data->samplerate){
     mixed_buffer_from_pack(data->pack, data->buffers, &data->volume, data->target_volume);
   }else{
     void *restrict pack_data;
@@ -98,7 +210,6 @@ int source_segment_mix(struct mixed_segment *segment){
     mixed_channel_t channels = pack->channels;
     uint32_t frames, buffer_frames = 512 / channels;
     uint32_t frames_to_bytes = channels * mixed_samplesize(pack->encoding);
-    mixed_transfer_function_from decoder = mixed_translator_from(pack->encoding);
     SRC_DATA src_data = {0};
     src_data.src_ratio = ((double)data->samplerate)/((double)pack->samplerate);
     src_data.data_in = target;
@@ -114,7 +225,23 @@ int source_segment_mix(struct mixed_segment *segment){
       mixed_pack_request_read(&pack_data, &bytes, pack);
       frames = MIN(frames, bytes / frames_to_bytes);
       if(pack_data){
-        data->volume = decoder(pack_data, (float*)src_data.data_in, 1, frames*channels, data->volume, data->target_volume);
+        // The ramp runs over the interleaved samples, which only differs
+        // from a ramp per frame by a fraction of a step per channel.
+        mixed_transfer_function_from decoder = transfer_function_from(pack, data->volume, data->target_volume);
+        if(pack->layout & MIXED_PLANAR){
+          // Decode the planes next to each other first, the output is free
+          // until the resampler runs.
+          uint32_t plane = pack->size / channels;
+          float volume = data->volume;
+          for(mixed_channel_t c=0; c<channels; ++c)
+            volume = decoder((char *)pack_data + c*plane, data->resample_out + c*frames, 1, frames, data->volume, data->target_volume);
+          data->volume = volume;
+          for(mixed_channel_t c=0; c<channels; ++c)
+            for(uint32_t i=0; i<frames; ++i)
+              data->resample_in[c+i*channels] = data->resample_out[c*frames+i];
+        }else{
+          data->volume = decoder(pack_data, (float*)src_data.data_in, 1, frames*channels, data->volume, data->target_volume);
+        }
         // Step 3: resample
         src_data.input_frames = frames;
         int e = src_process(data->resample_state, &src_data);
@@ -154,7 +281,6 @@ int drain_segment_mix(struct mixed_segment *segment){
     mixed_channel_t channels = pack->channels;
     uint32_t frames, buffer_frames = 512 / channels;
     uint32_t frames_to_bytes = channels * mixed_samplesize(pack->encoding);
-    mixed_transfer_function_to encoder = mixed_translator_to(pack->encoding);
     SRC_DATA src_data = {0};
     src_data.src_ratio = ((double)pack->samplerate)/((double)data->samplerate);
     src_data.data_in = target;
@@ -188,7 +314,21 @@ int drain_segment_mix(struct mixed_segment *segment){
         // Pack
         frames = src_data.input_frames_used;
         uint32_t out_frames = src_data.output_frames_gen;
-        data->volume = encoder(src_data.data_out, pack_data, 1, out_frames*channels, data->volume, data->target_volume);
+        mixed_transfer_function_to encoder = transfer_function_to(pack, data->volume, data->target_volume);
+        if(pack->layout & MIXED_PLANAR){
+          // Split the frames up into planes in the input, which the
+          // resampler is done with.
+          uint32_t plane = pack->size / channels;
+          float volume = data->volume;
+          for(mixed_channel_t c=0; c<channels; ++c)
+            for(uint32_t i=0; i<out_frames; ++i)
+              data->resample_in[c*out_frames+i] = src_data.data_out[c+i*channels];
+          for(mixed_channel_t c=0; c<channels; ++c)
+            volume = encoder(data->resample_in + c*out_frames, (char *)pack_data + c*plane, 1, out_frames, data->volume, data->target_volume);
+          data->volume = volume;
+        }else{
+          data->volume = encoder(src_data.data_out, pack_data, 1, out_frames*channels, data->volume, data->target_volume);
+        }
         // Update consumed buffers
         mixed_pack_finish_write(out_frames * frames_to_bytes, pack);
         for(mixed_channel_t c=0; c<channels; ++c){
@@ -230,6 +370,14 @@ int source_segment_set(uint32_t field, void *value, struct mixed_segment *segmen
   case MIXED_VOLUME:
     data->target_volume = *((float *)value);
     return 1;
+  case MIXED_VOLUME_MODE:
+    if(*(enum mixed_volume_mode *)value != MIXED_VOLUME_ZERO_CROSSING
+       && *(enum mixed_volume_mode *)value != MIXED_VOLUME_RAMP){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->pack->volume_mode = *(enum mixed_volume_mode *)value;
+    return 1;
   case MIXED_BYPASS:
     if(*(bool *)value){
       for(mixed_channel_t i=0; i<data->pack->channels; ++i){
@@ -270,6 +418,9 @@ int packer_segment_get(uint32_t field, void *value, struct mixed_segment *segmen
   case MIXED_VOLUME:
     *((float *)value) = data->target_volume;
     return 1;
+  case MIXED_VOLUME_MODE:
+    *(enum mixed_volume_mode *)value = data->pack->volume_mode;
+    return 1;
   case MIXED_BYPASS:
     *(bool *)value = (segment->mix == mix_noop);
     return 1;
@@ -295,6 +446,10 @@ int source_segment_info(struct mixed_segment_info *info, struct mixed_segment *s
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The volume scaling factor.");
 
+  set_info_field(field++, MIXED_VOLUME_MODE,
+                 MIXED_VOLUME_MODE_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "How a change of the volume is applied.");
+
   set_info_field(field++, MIXED_RESAMPLE_TYPE,
                  MIXED_RESAMPLE_TYPE_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The type of resampling algorithm used.");
@@ -320,7 +475,7 @@ int drain_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
 int make_pack_internal(struct mixed_pack *pack, uint32_t samplerate, int quality, struct mixed_segment *segment){
   struct pack_segment_data *data = 0;
 
-  if(pack->encoding < MIXED_INT8 || MIXED_DOUBLE < pack->encoding){
+  if(!valid_encoding(pack->encoding)){
     mixed_err(MIXED_UNKNOWN_ENCODING);
     goto cleanup;
   }
@@ -355,7 +510,10 @@ MIXED_EXPORT int mixed_make_segment_unpacker(struct mixed_pack *pack, uint32_t s
   segment->info = source_segment_info;
   segment->set = source_segment_set;
   segment->set_out = pack_segment_set_buffer;
-  return make_pack_internal(pack, samplerate, MIXED_SINC_FASTEST, segment);
+  if(!make_pack_internal(pack, samplerate, MIXED_SINC_FASTEST, segment))
+    return 0;
+  segment->start = source_segment_start;
+  return 1;
 }
 
 int __make_unpacker(void *args, struct mixed_segment *segment){
@@ -112,6 +112,10 @@ int pitch_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
                  MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The samplerate at which the segment operates.");
 
+  set_info_field(field++, MIXED_FFT_WINDOW,
+                 MIXED_FFT_WINDOW_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The window function applied to the FFT frames.");
+
   set_info_field(field++, MIXED_MIX,
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "How much of the output to mix with the input.");
@@ -129,6 +133,7 @@ int pitch_segment_get(uint32_t field, void *value, struct mixed_segment *segment
   switch(field){
   case MIXED_PITCH_SHIFT: *((float *)value) = data->pitch; break;
   case MIXED_SAMPLERATE: *((uint32_t *)value) = data->samplerate; break;
+  case MIXED_FFT_WINDOW: *((enum mixed_fft_window *)value) = data->fft_window_data.window_type; break;
   case MIXED_MIX: *((float *)value) = data->mix; break;
   case MIXED_BYPASS: *((bool *)value) = (segment->mix == pitch_segment_mix_bypass); break;
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
@@ -150,6 +155,8 @@ int pitch_segment_set(uint32_t field, void *value, struct mixed_segment *segment
       return 0;
     }
     break;
+  case MIXED_FFT_WINDOW:
+    return fft_window_set_type(*(enum mixed_fft_window *)value, &data->fft_window_data);
   case MIXED_PITCH_SHIFT:
     if(*(float *)value <= 0.0){
       mixed_err(MIXED_INVALID_VALUE);
@@ -7,6 +7,12 @@ struct plane_source{
   float min_distance;
   float max_distance;
   float rolloff;
+  struct doppler_data doppler;
+  // The volumes used in the last block, to ramp from
+  float last_lvolume;
+  float last_rvolume;
+  float air_state;
+  bool started;
 };
 
 struct plane_mixer_data{
@@ -15,22 +21,29 @@ struct plane_mixer_data{
   uint32_t size;
   struct mixed_buffer *left;
   struct mixed_buffer *right;
-  struct fft_window_data fft_window_data;
   float location[2];
   float velocity[2];
   float soundspeed;
   float doppler_factor;
+  bool propagation_delay;
   float min_distance;
   float max_distance;
   float rolloff;
   float volume;
+  uint32_t samplerate;
+  struct air_absorption_data air;
   float (*attenuation)(float min, float max, float dist, float roll);
 };
 
 int plane_mixer_free(struct mixed_segment *segment){
   struct plane_mixer_data *data = (struct plane_mixer_data *)segment->data;
   if(data){
-    free_fft_window_data(&data->fft_window_data);
+    for(uint32_t s=0; s<data->count; ++s){
+      struct plane_source *source = data->sources[s];
+      if(!source) continue;
+      free_doppler_data(&source->doppler);
+      mixed_free(source);
+    }
     mixed_free(data->sources);
     mixed_free(data);
   }
@@ -96,14 +109,52 @@ VECTORIZE static inline float calculate_pitch_shift(struct plane_mixer_data *lis
   float SS = listener->soundspeed;
   float DF = listener->doppler_factor;
   float Mag = mag(SL);
-  float vls = dot(SL, LV) * Mag;
-  float vss = dot(SL, SV) * Mag;
+  if(Mag <= 0.0) return 1.0;
+  float vls = dot(SL, LV) / Mag;
+  float vss = dot(SL, SV) / Mag;
   float SS_DF = SS/DF;
   vss = min(vss, SS_DF);
   vls = min(vls, SS_DF);
   return (SS - DF*vls) / (SS - DF*vss);
 }
 
+// Run the pending sources through the air absorption bank and mix them.
+VECTORIZE static void mix_plane_sources(uint32_t n, struct plane_source **sources, float *ins[], uint32_t samples, float *restrict left, float *restrict right, struct plane_mixer_data *data){
+  if(0.0f < data->air.cutoff){
+    float coefficients[AIR_BANK_LANES] = {0};
+    float *states[AIR_BANK_LANES];
+    for(uint32_t k=0; k<n; ++k){
+      struct plane_source *source = sources[k];
+      float distance = dist(source->location, data->location);
+      coefficients[k] = air_absorption_coefficient(source->min_distance, source->max_distance, distance, &data->air);
+      states[k] = &source->air_state;
+    }
+    air_absorption_bank(n, ins, samples, coefficients, states);
+  }
+  for(uint32_t k=0; k<n; ++k){
+    struct plane_source *source = sources[k];
+    float *restrict in = ins[k];
+    float lvolume, rvolume;
+    calculate_volumes(&lvolume, &rvolume, source, data);
+    if(!source->started){
+      source->last_lvolume = lvolume;
+      source->last_rvolume = rvolume;
+      source->started = 1;
+    }
+    // Interpolate from the last block's volumes to avoid steps.
+    float lstart = source->last_lvolume, lstep = (lvolume - lstart) / samples;
+    float rstart = source->last_rvolume, rstep = (rvolume - rstart) / samples;
+    for(uint32_t i=0; i<samples; ++i){
+      float sample = in[i];
+      left[i] += sample * (lstart + lstep*(i+1));
+      right[i] += sample * (rstart + rstep*(i+1));
+    }
+    source->last_lvolume = lvolume;
+    source->last_rvolume = rvolume;
+    mixed_buffer_finish_read(samples, source->buffer);
+  }
+}
+
 VECTORIZE int plane_mixer_mix(struct mixed_segment *segment){
   struct plane_mixer_data *data = (struct plane_mixer_data *)segment->data;
   float *restrict left, *restrict right, *restrict in;
@@ -122,25 +173,30 @@ VECTORIZE int plane_mixer_mix(struct mixed_segment *segment){
   }
 
   if(0 < samples){
+    struct plane_source *pending[AIR_BANK_LANES];
+    float *ins[AIR_BANK_LANES];
+    uint32_t n = 0;
     memset(left, 0, samples*sizeof(float));
     memset(right, 0, samples*sizeof(float));
     for(uint32_t s=0; s<count; ++s){
       struct plane_source *source = data->sources[s];
       if(!source) continue;
       
-      float lvolume, rvolume;
       mixed_buffer_request_read(&in, &samples, source->buffer);
-      calculate_volumes(&lvolume, &rvolume, source, data);
-      float pitch = clamp(0.5, calculate_pitch_shift(data, source), 2.0);
-      if(pitch != 1.0)
-        fft_window(in, in, samples, &data->fft_window_data, fft_pitch_shift, &pitch);
-      for(uint32_t i=0; i<samples; ++i){
-        float sample = in[i];
-        left[i] += sample * lvolume;
-        right[i] += sample * rvolume;
+      if(0.0 < data->doppler_factor){
+        float pitch = clamp(0.5, calculate_pitch_shift(data, source), 2.0);
+        source->doppler.target = doppler_delay(dist(source->location, data->location), data->soundspeed, data->doppler_factor, data->samplerate);
+        doppler(in, in, samples, pitch, &source->doppler);
+      }
+      pending[n] = source;
+      ins[n] = in;
+      if(++n == AIR_BANK_LANES){
+        mix_plane_sources(n, pending, ins, samples, left, right, data);
+        n = 0;
       }
-      mixed_buffer_finish_read(samples, source->buffer);
     }
+    if(0 < n)
+      mix_plane_sources(n, pending, ins, samples, left, right, data);
   }
   mixed_buffer_finish_write(samples, data->left);
   mixed_buffer_finish_write(samples, data->right);
@@ -179,6 +235,24 @@ int plane_mixer_get_out(uint32_t field, uint32_t location, void *buffer, struct
   }
 }
 
+static inline float plane_doppler_max_delay(struct plane_mixer_data *data){
+  return doppler_delay(data->max_distance, data->soundspeed, data->doppler_factor, data->samplerate);
+}
+
+// Size the delay lines of all sources for the propagation delay at the
+// max distance, or to their short fixed size without it. They are only
+// allocated while doppler is enabled.
+static int ensure_doppler_lines(struct plane_mixer_data *data){
+  if(data->doppler_factor <= 0.0) return 1;
+  float max_delay = plane_doppler_max_delay(data);
+  for(uint32_t s=0; s<data->count; ++s){
+    struct plane_source *source = data->sources[s];
+    if(source && !make_doppler_data(data->samplerate, data->propagation_delay, max_delay, &source->doppler))
+      return 0;
+  }
+  return 1;
+}
+
 int plane_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
   struct plane_mixer_data *data = (struct plane_mixer_data *)segment->data;
 
@@ -194,6 +268,11 @@ int plane_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct m
           mixed_err(MIXED_OUT_OF_MEMORY);
           return 0;
         }
+        if(0.0 < data->doppler_factor
+           && !make_doppler_data(data->samplerate, data->propagation_delay, plane_doppler_max_delay(data), &source->doppler)){
+          mixed_free(source);
+          return 0;
+        }
         source->min_distance = data->min_distance;
         source->max_distance = data->max_distance;
         source->rolloff = data->rolloff;
@@ -210,8 +289,11 @@ int plane_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct m
         mixed_err(MIXED_INVALID_LOCATION);
         return 0;
       }
+      if(data->sources[location]){
+        free_doppler_data(&data->sources[location]->doppler);
+        mixed_free(data->sources[location]);
+      }
       data->sources[location] = 0;
-      mixed_free(data->sources[location]);
     }
     return 1;
   case MIXED_SPACE_MIN_DISTANCE:
@@ -319,6 +401,9 @@ int plane_mixer_get(uint32_t field, void *value, struct mixed_segment *segment){
   case MIXED_SPACE_DOPPLER_FACTOR:
     *(float *)value = data->doppler_factor;
     break;
+  case MIXED_SPACE_PROPAGATION_DELAY:
+    *(bool *)value = data->propagation_delay;
+    break;
   case MIXED_SPACE_MIN_DISTANCE:
     *(float *)value = data->min_distance;
     break;
@@ -328,6 +413,9 @@ int plane_mixer_get(uint32_t field, void *value, struct mixed_segment *segment){
   case MIXED_SPACE_ROLLOFF:
     *(float *)value = data->rolloff;
     break;
+  case MIXED_SPACE_AIR_ABSORPTION:
+    *(float *)value = data->air.cutoff;
+    break;
   case MIXED_SPACE_ATTENUATION:
     if(data->attenuation == attenuation_none){
       *(int *)value = MIXED_NO_ATTENUATION;
@@ -348,6 +436,39 @@ int plane_mixer_get(uint32_t field, void *value, struct mixed_segment *segment){
   return 1;
 }
 
+static int update_sources(struct mixed_source_update *update, struct plane_mixer_data *data){
+  uint32_t start = update->start;
+  if(update->priority){
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  if(data->count < start || data->count - start < update->count){
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+  for(uint32_t i=0; i<update->count; ++i){
+    if(!data->sources[start+i]){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+  }
+  for(uint32_t i=0; i<update->count; ++i){
+    struct plane_source *source = data->sources[start+i];
+    if(update->location){
+      source->location[0] = update->location[i*2+0];
+      source->location[1] = update->location[i*2+1];
+    }
+    if(update->velocity){
+      source->velocity[0] = update->velocity[i*2+0];
+      source->velocity[1] = update->velocity[i*2+1];
+    }
+    if(update->min_distance) source->min_distance = update->min_distance[i];
+    if(update->max_distance) source->max_distance = update->max_distance[i];
+    if(update->rolloff) source->rolloff = update->rolloff[i];
+  }
+  return 1;
+}
+
 int plane_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
   struct plane_mixer_data *data = (struct plane_mixer_data *)segment->data;
   float *parts = (float *)value;
@@ -363,18 +484,49 @@ int plane_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
     data->velocity[0] = parts[0];
     data->velocity[1] = parts[1];
     break;
-  case MIXED_SPACE_SOUNDSPEED:
+  case MIXED_SPACE_SOUNDSPEED:{
+    float old_soundspeed = data->soundspeed;
     data->soundspeed = *(float *)value;
-    break;
-  case MIXED_SPACE_DOPPLER_FACTOR:
+    if(!ensure_doppler_lines(data)){
+      data->soundspeed = old_soundspeed;
+      return 0;
+    }
+    break;}
+  case MIXED_SPACE_DOPPLER_FACTOR:{
+    float old_factor = data->doppler_factor;
     data->doppler_factor = *(float *)value;
-    break;
+    if(!ensure_doppler_lines(data)){
+      data->doppler_factor = old_factor;
+      return 0;
+    }
+    if(old_factor <= 0.0 && 0.0 < data->doppler_factor){
+      // The delay lines went stale while doppler was off, start them anew.
+      for(uint32_t s=0; s<data->count; ++s){
+        struct plane_source *source = data->sources[s];
+        if(source) doppler_reset(&source->doppler);
+      }
+    }
+    break;}
+  case MIXED_SPACE_PROPAGATION_DELAY:{
+    bool old_propagation = data->propagation_delay;
+    data->propagation_delay = *(bool *)value;
+    if(!ensure_doppler_lines(data)){
+      data->propagation_delay = old_propagation;
+      ensure_doppler_lines(data);
+      return 0;
+    }
+    break;}
   case MIXED_SPACE_MIN_DISTANCE:
     data->min_distance = *(float *)value;
     break;
-  case MIXED_SPACE_MAX_DISTANCE:
+  case MIXED_SPACE_MAX_DISTANCE:{
+    float old_distance = data->max_distance;
     data->max_distance = *(float *)value;
-    break;
+    if(!ensure_doppler_lines(data)){
+      data->max_distance = old_distance;
+      return 0;
+    }
+    break;}
   case MIXED_SPACE_ROLLOFF:
     data->rolloff = *(float *)value;
     break;
@@ -397,6 +549,21 @@ int plane_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
       break;
     }
     break;
+  case MIXED_SPACE_AIR_ABSORPTION:{
+    float cutoff = *(float *)value;
+    if(cutoff < 0.0f || data->samplerate/2.0f <= cutoff){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    if(data->air.cutoff <= 0.0f){
+      for(uint32_t s=0; s<data->count; ++s){
+        if(data->sources[s]) data->sources[s]->air_state = 0.0f;
+      }
+    }
+    air_absorption_table(cutoff, data->samplerate, &data->air);
+    break;}
+  case MIXED_SOURCE_UPDATE:
+    return update_sources((struct mixed_source_update *)value, data);
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -439,6 +606,10 @@ int plane_mixer_info(struct mixed_segment_info *info, struct mixed_segment *segm
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The doppler factor. You can use this to exaggerate or dampen the effect.");
 
+  set_info_field(field++, MIXED_SPACE_PROPAGATION_DELAY,
+                 MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Whether doppler delays sources by the full time their sound takes to reach the listener.");
+
   set_info_field(field++, MIXED_SPACE_MIN_DISTANCE,
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "Any distance lower than this will make the sound appear at its maximal volume.");
@@ -455,6 +626,14 @@ int plane_mixer_info(struct mixed_segment_info *info, struct mixed_segment *segm
                  MIXED_FUNCTION, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The function that calculates the attenuation curve that defines the volume of a source by its distance.");
 
+  set_info_field(field++, MIXED_SPACE_AIR_ABSORPTION,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The low-pass cutoff frequency for sources at the max distance, or 0 for no air absorption.");
+
+  set_info_field(field++, MIXED_SOURCE_UPDATE,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_SET,
+                 "Update the properties of a range of sources at once.");
+
   clear_info_field(field++);
   return 1;
 }
@@ -466,12 +645,6 @@ MIXED_EXPORT int mixed_make_segment_plane_mixer(uint32_t samplerate, struct mixe
     return 0;
   }
 
-  // These factors might need tweaking for efficiency/quality.
-  if(!make_fft_window_data(2048, 4, samplerate, &data->fft_window_data)){
-    mixed_free(data);
-    return 0;
-  }
-
   data->soundspeed = 34330.0;    // Means units are in [cm].
   data->doppler_factor = 0.0;
   data->min_distance = 10.0;      // That's 10 centimetres.
@@ -479,6 +652,7 @@ MIXED_EXPORT int mixed_make_segment_plane_mixer(uint32_t samplerate, struct mixe
   data->rolloff = 1.0;
   data->attenuation = attenuation_linear;
   data->volume = 1.0;
+  data->samplerate = samplerate;
   
   segment->free = plane_mixer_free;
   segment->info = plane_mixer_info;
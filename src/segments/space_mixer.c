@@ -1,30 +1,82 @@
 #include "../internal.h"
 #include<float.h>
 
-struct space_source{
-  struct mixed_buffer *buffer;
-  float location[3];
-  float velocity[3];
-  float min_distance;
-  float max_distance;
-  float rolloff;
+// Sources are kept as a structure of arrays, indexed by their input
+// location, so that the gains of many sources can be computed in batches
+// across contiguous memory. A slot without a buffer is empty.
+struct space_sources{
+  struct mixed_buffer **buffer;
+  float *location[3];
+  float *velocity[3];
+  float *min_distance;
+  float *max_distance;
+  float *rolloff;
   // cache
-  float volumes[MIXED_MAX_SPEAKER_COUNT];
-  mixed_channel_t speakers[MIXED_MAX_SPEAKER_COUNT];
-  mixed_channel_t speaker_count;
-  float pitch;
-  bool dirty;
-  bool spatial;
+  float *volume[3];
+  // Speakers, or measured HRTF directions in binaural mode
+  uint16_t *speaker[3];
+  mixed_channel_t *speaker_count;
+  // The gains used in the last block, to ramp from
+  float *last_volume[3];
+  uint16_t *last_speaker[3];
+  mixed_channel_t *last_speaker_count;
+  bool *ramp;
+  // Voice management
+  float *priority;
+  float *loudness;
+  uint32_t *order;
+  bool *voice;
+  bool *active;
+  // Sources that were not mixed yet, which start at their volume
+  bool *fresh;
+  float *pitch;
+  struct doppler_data *doppler;
+  // Air absorption filter
+  float *air_coefficient;
+  float *air_state;
+  bool *dirty;
+  bool *spatial;
+  uint32_t count;
+  uint32_t size;
+};
+
+// Below this many sources per thread, splitting up is not worth it.
+#define SPACE_MIN_SOURCES_PER_THREAD 16
+
+// A share of the sources. Every worker but the first mixes into its own
+// output blocks, which are summed up after all workers are done.
+struct space_worker{
+  struct space_mixer_data *data;
+  float **outs;
+  float *out[MIXED_MAX_SPEAKER_COUNT];
+  float *accumulator;
+  uint32_t start;
+  uint32_t end;
+  uint32_t samples;
+  uint32_t active_voices;
+  uint32_t virtual_voices;
+#ifdef MIXED_THREADS
+  pthread_t thread;
+  struct semaphore signal;
+  bool running;
+#endif
 };
 
 struct space_mixer_data{
-  struct space_source **sources;
-  uint32_t count;
-  uint32_t size;
+  struct space_sources sources;
+  struct space_worker *workers;
+  uint32_t thread_count;
+  uint32_t accumulator_size;
+#ifdef MIXED_THREADS
+  struct semaphore done;
+  bool threaded;
+  bool quit;
+#endif
   struct mixed_buffer **out;
   struct vbap_data vbap;
+  struct hrtf_data hrtf;
+  struct air_absorption_data air;
   struct mixed_channel_configuration channels;
-  struct fft_window_data fft_window_data;
   float location[3];
   float velocity[3];
   float direction[3];
@@ -32,26 +84,228 @@ struct space_mixer_data{
   float look_at[9];
   float soundspeed;
   float doppler_factor;
+  bool propagation_delay;
   float min_distance;
   float max_distance;
   float rolloff;
   float volume;
+  uint32_t samplerate;
+  uint32_t max_voices;
+  float audibility_threshold;
+  uint32_t active_voices;
+  uint32_t virtual_voices;
   bool surround;
   float (*attenuation)(float min, float max, float dist, float roll);
 };
 
+// HRTFs are only used while we output stereo.
+static inline bool is_binaural(struct space_mixer_data *data){
+  return 0 < data->hrtf.count && data->channels.count == 2;
+}
+
+static void free_space_sources(struct space_sources *sources){
+  for(uint32_t s=0; s<sources->count; ++s){
+    if(sources->buffer[s])
+      free_doppler_data(&sources->doppler[s]);
+  }
+  FREE(sources->buffer);
+  for(int i=0; i<3; ++i){
+    FREE(sources->location[i]);
+    FREE(sources->velocity[i]);
+    FREE(sources->volume[i]);
+    FREE(sources->speaker[i]);
+    FREE(sources->last_volume[i]);
+    FREE(sources->last_speaker[i]);
+  }
+  FREE(sources->min_distance);
+  FREE(sources->max_distance);
+  FREE(sources->rolloff);
+  FREE(sources->speaker_count);
+  FREE(sources->last_speaker_count);
+  FREE(sources->ramp);
+  FREE(sources->priority);
+  FREE(sources->loudness);
+  FREE(sources->order);
+  FREE(sources->voice);
+  FREE(sources->active);
+  FREE(sources->fresh);
+  FREE(sources->pitch);
+  FREE(sources->doppler);
+  FREE(sources->air_coefficient);
+  FREE(sources->air_state);
+  FREE(sources->dirty);
+  FREE(sources->spatial);
+  sources->count = 0;
+  sources->size = 0;
+}
+
+// Every array is grown separately, so a failure leaves the
+// previous arrays, which are still large enough, in place.
+#define GROW_SOURCE_ARRAY(FIELD){                               \
+    void *array = crealloc(FIELD, sources->size, size, sizeof(*FIELD)); \
+    if(!array) goto failure;                                    \
+    FIELD = array;                                              \
+  }
+
+static int ensure_space_sources(uint32_t count, struct space_sources *sources){
+  if(count <= sources->size) return 1;
+  uint32_t size = MAX(16, sources->size);
+  while(size < count) size *= 2;
+  GROW_SOURCE_ARRAY(sources->buffer);
+  for(int i=0; i<3; ++i){
+    GROW_SOURCE_ARRAY(sources->location[i]);
+    GROW_SOURCE_ARRAY(sources->velocity[i]);
+    GROW_SOURCE_ARRAY(sources->volume[i]);
+    GROW_SOURCE_ARRAY(sources->speaker[i]);
+    GROW_SOURCE_ARRAY(sources->last_volume[i]);
+    GROW_SOURCE_ARRAY(sources->last_speaker[i]);
+  }
+  GROW_SOURCE_ARRAY(sources->min_distance);
+  GROW_SOURCE_ARRAY(sources->max_distance);
+  GROW_SOURCE_ARRAY(sources->rolloff);
+  GROW_SOURCE_ARRAY(sources->speaker_count);
+  GROW_SOURCE_ARRAY(sources->last_speaker_count);
+  GROW_SOURCE_ARRAY(sources->ramp);
+  GROW_SOURCE_ARRAY(sources->priority);
+  GROW_SOURCE_ARRAY(sources->loudness);
+  GROW_SOURCE_ARRAY(sources->order);
+  GROW_SOURCE_ARRAY(sources->voice);
+  GROW_SOURCE_ARRAY(sources->active);
+  GROW_SOURCE_ARRAY(sources->fresh);
+  GROW_SOURCE_ARRAY(sources->pitch);
+  GROW_SOURCE_ARRAY(sources->doppler);
+  GROW_SOURCE_ARRAY(sources->air_coefficient);
+  GROW_SOURCE_ARRAY(sources->air_state);
+  GROW_SOURCE_ARRAY(sources->dirty);
+  GROW_SOURCE_ARRAY(sources->spatial);
+  sources->size = size;
+  return 1;
+ failure:
+  mixed_err(MIXED_OUT_OF_MEMORY);
+  return 0;
+}
+
+static void free_space_workers(struct space_mixer_data *data){
+  if(!data->workers) return;
+#ifdef MIXED_THREADS
+  atomic_write(data->quit, 1);
+  for(uint32_t t=1; t<data->thread_count; ++t){
+    struct space_worker *worker = &data->workers[t];
+    if(worker->running){
+      semaphore_post(&worker->signal);
+      pthread_join(worker->thread, 0);
+      semaphore_destroy(&worker->signal);
+      worker->running = 0;
+    }
+  }
+  if(data->threaded){
+    semaphore_destroy(&data->done);
+    data->threaded = 0;
+  }
+#endif
+  for(uint32_t t=0; t<data->thread_count; ++t){
+    FREE(data->workers[t].accumulator);
+  }
+  FREE(data->workers);
+  data->thread_count = 0;
+  data->accumulator_size = 0;
+}
+
+#ifdef MIXED_THREADS
+static void *space_worker_thread(void *arg);
+#endif
+
+// Replace the worker pool. The first worker is always the mixing thread.
+static int make_space_workers(uint32_t count, struct space_mixer_data *data){
+  free_space_workers(data);
+  data->workers = mixed_calloc(count, sizeof(struct space_worker));
+  if(!data->workers){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->thread_count = count;
+  for(uint32_t t=0; t<count; ++t){
+    data->workers[t].data = data;
+  }
+#ifdef MIXED_THREADS
+  // A single worker is just the mixing thread, which needs no sync.
+  if(count <= 1) return 1;
+  data->quit = 0;
+  if(!semaphore_init(&data->done)){
+    mixed_err(MIXED_INTERNAL_ERROR);
+    goto cleanup;
+  }
+  data->threaded = 1;
+  for(uint32_t t=1; t<count; ++t){
+    struct space_worker *worker = &data->workers[t];
+    if(!semaphore_init(&worker->signal)){
+      mixed_err(MIXED_INTERNAL_ERROR);
+      goto cleanup;
+    }
+    if(pthread_create(&worker->thread, 0, space_worker_thread, worker) != 0){
+      semaphore_destroy(&worker->signal);
+      mixed_err(MIXED_INTERNAL_ERROR);
+      goto cleanup;
+    }
+    worker->running = 1;
+  }
+#endif
+  return 1;
+
+#ifdef MIXED_THREADS
+ cleanup:
+  free_space_workers(data);
+  return 0;
+#endif
+}
+
 int space_mixer_free(struct mixed_segment *segment){
   struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
   if(data){
-    free_fft_window_data(&data->fft_window_data);
+    free_space_workers(data);
+    free_space_sources(&data->sources);
+    free_hrtf_data(&data->hrtf);
     FREE(data->out);
-    FREE(data->sources);
     mixed_free(data);
   }
   segment->data = 0;
   return 1;
 }
 
+// Size the workers' output blocks to hold a full output buffer per channel.
+static int ensure_space_accumulators(struct space_mixer_data *data){
+  if(data->thread_count <= 1) return 1;
+  uint32_t samples = UINT32_MAX;
+  for(int c=0; c<data->channels.count; ++c){
+    if(!data->out[c]) return 1;
+    samples = MIN(samples, data->out[c]->size);
+  }
+  uint32_t size = data->channels.count * samples;
+  if(size <= data->accumulator_size) return 1;
+  for(uint32_t t=1; t<data->thread_count; ++t){
+    float *accumulator = aligned_calloc(64, size, sizeof(float));
+    if(!accumulator){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    FREE(data->workers[t].accumulator);
+    data->workers[t].accumulator = accumulator;
+  }
+  data->accumulator_size = size;
+  return 1;
+}
+
+// Size the HRTF direction inputs to hold a full output buffer.
+static int ensure_hrtf_capacity(struct space_mixer_data *data){
+  if(data->hrtf.count == 0) return 1;
+  uint32_t samples = 0;
+  for(int c=0; c<data->channels.count; ++c){
+    if(!data->out[c]) return 1;
+    samples = MAX(samples, data->out[c]->size);
+  }
+  return hrtf_ensure_capacity(samples, &data->hrtf);
+}
+
 int space_mixer_start(struct mixed_segment *segment){
   struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
   for(int i=0; i<data->channels.count; ++i){
@@ -60,7 +314,8 @@ int space_mixer_start(struct mixed_segment *segment){
       return 0;
     }
   }
-  return 1;
+  return ensure_space_accumulators(data)
+    && ensure_hrtf_capacity(data);
 }
 
 float attenuation_none(float min, float max, float dist, float roll){
@@ -82,139 +337,500 @@ float attenuation_exponential(float min, float max, float dist, float roll){
   return 1.0/pow(dist / min, roll);
 }
 
-static inline float calculate_phase(float L[3]){
-  float t2[3], D[3] = {0.0, 0.0, 1.0};
-  return vec_dot(D, vec_normalize(t2, L));
-}
-
-VECTORIZE static void calculate_volumes(struct space_source *source, struct space_mixer_data *data){
-  float volumes[MIXED_MAX_SPEAKER_COUNT];
-  mixed_channel_t speakers[MIXED_MAX_SPEAKER_COUNT];
-  mixed_channel_t speaker_count;
-  float forward[3] = {0.0, 0.0, 1.0};
-  float min = source->min_distance;
-  float max = source->max_distance;
-  float roll = source->rolloff;
-  // Relative location to our listener
-  float location[3] = {source->location[0]-data->location[0],
-                       source->location[1]-data->location[1],
-                       source->location[2]-data->location[2]};
-  float distance = MIN(vec_length(location), max);
-  float volume = 1.0;
-  if(min < distance && min < max){
-    volume *= data->attenuation(min, max, distance, roll);
-  }
-  if(source->spatial){
+VECTORIZE static void attenuate(uint32_t n, const float *restrict min, const float *restrict max, const float *restrict distance, const float *restrict roll, float *restrict volume, float (*attenuation)(float min, float max, float dist, float roll)){
+  // The standard curves are inlined so that they vectorise.
+  if(attenuation == attenuation_none){
+    for(uint32_t i=0; i<n; ++i)
+      volume[i] = 1.0;
+  }else if(attenuation == attenuation_inverse){
+    for(uint32_t i=0; i<n; ++i){
+      float v = min[i] / (min[i] + roll[i] * (distance[i]-min[i]));
+      volume[i] = (min[i] < distance[i] && min[i] < max[i])? v : 1.0f;
+    }
+  }else if(attenuation == attenuation_linear){
+    for(uint32_t i=0; i<n; ++i){
+      float v = 1.0f - roll[i] * (distance[i] - min[i]) / (max[i] - min[i]);
+      volume[i] = (min[i] < distance[i] && min[i] < max[i])? v : 1.0f;
+    }
+  }else if(attenuation == attenuation_exponential){
+    for(uint32_t i=0; i<n; ++i){
+      float v = 1.0f / powf(distance[i] / min[i], roll[i]);
+      volume[i] = (min[i] < distance[i] && min[i] < max[i])? v : 1.0f;
+    }
+  }else{
+    for(uint32_t i=0; i<n; ++i){
+      volume[i] = (min[i] < distance[i] && min[i] < max[i])
+        ? attenuation(min[i], max[i], distance[i], roll[i])
+        : 1.0f;
+    }
+  }
+}
+
+// See OpenAL1.1 specification §3.5.2
+// The source locations are given relative to the listener.
+VECTORIZE static void calculate_pitch_shift(uint32_t n, const float *restrict x, const float *restrict y, const float *restrict z, const float *restrict vx, const float *restrict vy, const float *restrict vz, float *restrict pitch, struct space_mixer_data *listener){
+  if(listener->doppler_factor <= 0.0){
+    for(uint32_t i=0; i<n; ++i)
+      pitch[i] = 1.0;
+    return;
+  }
+  float *LV = listener->velocity;
+  float SS = listener->soundspeed;
+  float DF = listener->doppler_factor;
+  float SS_DF = SS/DF;
+  for(uint32_t i=0; i<n; ++i){
+    float Mag = sqrtf(x[i]*x[i] + y[i]*y[i] + z[i]*z[i]);
+    float inv = (0 < Mag)? -1.0f/Mag : 0.0f;
+    float vls = (x[i]*LV[0] + y[i]*LV[1] + z[i]*LV[2]) * inv;
+    float vss = (x[i]*vx[i] + y[i]*vy[i] + z[i]*vz[i]) * inv;
+    vss = MIN(vss, SS_DF);
+    vls = MIN(vls, SS_DF);
+    float p = (SS - DF*vls) / (SS - DF*vss);
+    pitch[i] = CLAMP(0.5f, p, 2.0f);
+  }
+}
+
+// Recompute the gains and pitch of a batch of sources. The
+// per-source parameters are gathered into contiguous scratch
+// arrays first, so that every step runs across the whole batch.
+VECTORIZE static void calculate_batch(uint32_t n, const uint32_t *restrict batch, struct space_mixer_data *data){
+  struct space_sources *sources = &data->sources;
+  // Only the first n entries are used, but the compiler cannot see that.
+  float x[VBAP_BATCH_SIZE] = {0}, y[VBAP_BATCH_SIZE] = {0}, z[VBAP_BATCH_SIZE] = {0};
+  float vx[VBAP_BATCH_SIZE] = {0}, vy[VBAP_BATCH_SIZE] = {0}, vz[VBAP_BATCH_SIZE] = {0};
+  float min[VBAP_BATCH_SIZE] = {0}, max[VBAP_BATCH_SIZE] = {0}, roll[VBAP_BATCH_SIZE] = {0};
+  float distance[VBAP_BATCH_SIZE] = {0}, volume[VBAP_BATCH_SIZE] = {0}, pitch[VBAP_BATCH_SIZE] = {0};
+  float delay[VBAP_BATCH_SIZE] = {0};
+  float g0[VBAP_BATCH_SIZE], g1[VBAP_BATCH_SIZE], g2[VBAP_BATCH_SIZE];
+  float *gains[3] = {g0, g1, g2};
+  uint32_t t0[VBAP_BATCH_SIZE], t1[VBAP_BATCH_SIZE], t2[VBAP_BATCH_SIZE];
+  uint32_t *targets[3] = {t0, t1, t2};
+  float *m = data->look_at;
+  bool binaural = is_binaural(data);
+  mixed_channel_t count;
+
+  for(uint32_t i=0; i<n; ++i){
+    uint32_t s = batch[i];
+    // Relative location to our listener
+    x[i] = sources->location[0][s] - data->location[0];
+    y[i] = sources->location[1][s] - data->location[1];
+    z[i] = sources->location[2][s] - data->location[2];
+    vx[i] = sources->velocity[0][s];
+    vy[i] = sources->velocity[1][s];
+    vz[i] = sources->velocity[2][s];
+    min[i] = sources->min_distance[s];
+    max[i] = sources->max_distance[s];
+    roll[i] = sources->rolloff[s];
+  }
+  calculate_pitch_shift(n, x, y, z, vx, vy, vz, pitch, data);
+  for(uint32_t i=0; i<n; ++i){
+    float d = sqrtf(x[i]*x[i] + y[i]*y[i] + z[i]*z[i]);
+    distance[i] = MIN(d, max[i]);
+    delay[i] = doppler_delay(d, data->soundspeed, data->doppler_factor, data->samplerate);
+  }
+  if(0.0 < data->doppler_factor){
+    for(uint32_t i=0; i<n; ++i)
+      sources->doppler[batch[i]].target = delay[i];
+  }
+  attenuate(n, min, max, distance, roll, volume, data->attenuation);
+  for(uint32_t i=0; i<n; ++i){
     // Bring the location into our reference frame
-    vec_mul(location, data->look_at, location);
+    float rx = x[i]*m[0] + y[i]*m[1] + z[i]*m[2];
+    float ry = x[i]*m[3] + y[i]*m[4] + z[i]*m[5];
+    float rz = x[i]*m[6] + y[i]*m[7] + z[i]*m[8];
     // If we are below min distance, bend towards forward
-    if(distance < min){
-      vec_lerp(location, location, forward, MIN(1.0, (1-distance/min)*2));
-    }
+    float t = (distance[i] < min[i])? MIN(1.0f, (1-distance[i]/min[i])*2) : 0.0f;
+    rx = rx*(1-t);
+    ry = ry*(1-t);
+    rz = rz*(1-t) + t;
+    // Non-spatial sources are placed right on top of the listener.
+    bool spatial = sources->spatial[batch[i]];
+    x[i] = spatial? rx : 0.0f;
+    y[i] = spatial? ry : 0.0f;
+    z[i] = spatial? rz : 0.0f;
+  }
+  if(binaural){
+    // Pan between the closest measured HRTF directions
+    hrtf_compute_gains_batch(n, x, y, z, gains, targets, &data->hrtf);
+    count = MIN(3, data->hrtf.count);
+  }else{
     // Compute the actual gain factors using VBAP
-    mixed_compute_gains(location, volumes, speakers, &speaker_count, &data->vbap);
-    for(mixed_channel_t c=0; c<speaker_count; ++c){
-      volumes[c] = MIN(1.0, volume*volumes[c]);
+    mixed_compute_gains_batch(n, x, y, z, gains, t0, &data->vbap);
+    count = data->vbap.dims;
+    for(uint32_t i=0; i<n; ++i){
+      struct vbap_set *set = &data->vbap.sets[t0[i]];
+      t0[i] = set->speakers[0];
+      t1[i] = set->speakers[1];
+      t2[i] = set->speakers[2];
     }
+  }
+
+  for(uint32_t i=0; i<n; ++i){
+    uint32_t s = batch[i];
     // If we are not on a surround setup, we can simulate the sound appearing
     // from behind by inverting the right channels, causing a phase shift.
     // Only do this when the sound is far enough away though as otherwise it
     // can lead to frequent fluctuations, which sound very... bad.
-    if(!data->surround && min < distance && calculate_phase(location) < 0){
-      for(mixed_channel_t c=0; c<speaker_count; ++c){
-        switch(data->channels.positions[speakers[c]]){
+    // The HRTFs already place the sound behind us properly.
+    bool invert = !data->surround && !binaural && sources->spatial[s] && min[i] < distance[i] && z[i] < 0;
+    float loudness = 0.0;
+    for(mixed_channel_t c=0; c<count; ++c){
+      float gain = MIN(1.0, volume[i]*gains[c][i]);
+      loudness = MAX(loudness, gain);
+      if(invert){
+        switch(data->channels.positions[targets[c][i]]){
         case MIXED_RIGHT_FRONT_BOTTOM:
         case MIXED_RIGHT_FRONT_TOP:
         case MIXED_RIGHT_FRONT_WIDE:
         case MIXED_RIGHT_FRONT_HIGH:
         case MIXED_RIGHT_CENTER_BOTTOM:
         case MIXED_RIGHT_FRONT_CENTER_BOTTOM:
-          volumes[c] *= -1.0;
+          gain *= -1.0;
         }
       }
+      // Cache
+      sources->volume[c][s] = gain;
+      sources->speaker[c][s] = targets[c][i];
+    }
+    sources->speaker_count[s] = count;
+    sources->loudness[s] = loudness;
+    sources->pitch[s] = pitch[i];
+    if(0.0f < data->air.cutoff)
+      sources->air_coefficient[s] = air_absorption_coefficient(min[i], max[i], distance[i], &data->air);
+    sources->dirty[s] = 0;
+    // A new source starts at its gains, any other ramps towards them.
+    if(sources->last_speaker_count[s] == 0){
+      for(mixed_channel_t c=0; c<count; ++c){
+        sources->last_volume[c][s] = sources->volume[c][s];
+        sources->last_speaker[c][s] = sources->speaker[c][s];
+      }
+      sources->last_speaker_count[s] = count;
+    }else{
+      sources->ramp[s] = 1;
+    }
+  }
+}
+
+// Interpolate from the gains of the last block to the current ones across
+// this block. Speakers that are no longer used ramp down to zero, and new
+// ones ramp up from zero.
+VECTORIZE static void mix_source_ramped(uint32_t s, float *restrict in, float *restrict outs[], uint32_t samples, float global_volume, struct space_sources *sources){
+  uint16_t speakers[6];
+  float from[6], to[6];
+  uint32_t count = 0;
+
+  for(mixed_channel_t c=0; c<sources->speaker_count[s]; ++c){
+    speakers[count] = sources->speaker[c][s];
+    to[count] = sources->volume[c][s];
+    from[count] = 0.0;
+    for(mixed_channel_t l=0; l<sources->last_speaker_count[s]; ++l){
+      if(sources->last_speaker[l][s] == speakers[count])
+        from[count] = sources->last_volume[l][s];
+    }
+    ++count;
+  }
+  for(mixed_channel_t l=0; l<sources->last_speaker_count[s]; ++l){
+    bool used = 0;
+    for(mixed_channel_t c=0; c<sources->speaker_count[s]; ++c){
+      if(sources->speaker[c][s] == sources->last_speaker[l][s])
+        used = 1;
+    }
+    if(!used){
+      speakers[count] = sources->last_speaker[l][s];
+      from[count] = sources->last_volume[l][s];
+      to[count] = 0.0;
+      ++count;
+    }
+  }
+
+  for(uint32_t c=0; c<count; ++c){
+    float *restrict out = outs[speakers[c]];
+    float start = global_volume*from[c];
+    float step = global_volume*(to[c] - from[c]) / samples;
+    for(uint32_t i=0; i<samples; ++i){
+      out[i] += (start + step*(i+1)) * in[i];
+    }
+  }
+
+  for(mixed_channel_t c=0; c<sources->speaker_count[s]; ++c){
+    sources->last_volume[c][s] = sources->volume[c][s];
+    sources->last_speaker[c][s] = sources->speaker[c][s];
+  }
+  sources->last_speaker_count[s] = sources->speaker_count[s];
+  sources->ramp[s] = 0;
+}
+
+static void calculate_volumes(struct space_mixer_data *data){
+  struct space_sources *sources = &data->sources;
+  uint32_t batch[VBAP_BATCH_SIZE];
+  uint32_t n = 0;
+  for(uint32_t s=0; s<sources->count; ++s){
+    if(!sources->buffer[s] || !sources->dirty[s]) continue;
+    batch[n++] = s;
+    if(n == VBAP_BATCH_SIZE){
+      calculate_batch(n, batch, data);
+      n = 0;
+    }
+  }
+  if(0 < n) calculate_batch(n, batch, data);
+}
+
+// Fade a source that was just virtualised out across this block.
+VECTORIZE static void mix_source_fade_out(uint32_t s, float *restrict in, float *restrict outs[], uint32_t samples, float global_volume, struct space_sources *sources){
+  for(mixed_channel_t c=0; c<sources->last_speaker_count[s]; ++c){
+    float *restrict out = outs[sources->last_speaker[c][s]];
+    float start = global_volume*sources->last_volume[c][s];
+    float step = -start / samples;
+    for(uint32_t i=0; i<samples; ++i){
+      out[i] += (start + step*(i+1)) * in[i];
+    }
+  }
+}
+
+// Partially sort the candidates so that the COUNT highest scores come first.
+static void select_loudest(uint32_t *order, uint32_t n, uint32_t count, struct space_sources *sources){
+  uint32_t lo = 0, hi = n;
+  while(lo+1 < hi){
+    // Partition around the middle element, descending by score.
+    uint32_t mid = lo + (hi-lo)/2;
+    float pivot = sources->loudness[order[mid]] * sources->priority[order[mid]];
+    uint32_t t = order[mid]; order[mid] = order[hi-1]; order[hi-1] = t;
+    uint32_t store = lo;
+    for(uint32_t i=lo; i<hi-1; ++i){
+      if(pivot < sources->loudness[order[i]] * sources->priority[order[i]]){
+        t = order[i]; order[i] = order[store]; order[store] = t;
+        ++store;
+      }
+    }
+    t = order[store]; order[store] = order[hi-1]; order[hi-1] = t;
+    if(store == count) return;
+    if(store < count) lo = store+1;
+    else hi = store;
+  }
+}
+
+// Decide which sources are mixed this block: audible ones, and of
+// those at most max_voices by their loudness times priority.
+static void select_voices(struct space_mixer_data *data){
+  struct space_sources *sources = &data->sources;
+  uint32_t *order = sources->order;
+  uint32_t n = 0;
+  for(uint32_t s=0; s<sources->count; ++s){
+    bool audible = sources->buffer[s]
+      && data->audibility_threshold <= sources->loudness[s]
+      && 0.0 < sources->priority[s];
+    sources->voice[s] = audible;
+    if(audible) order[n++] = s;
+  }
+  if(data->max_voices < n){
+    select_loudest(order, n, data->max_voices, sources);
+    for(uint32_t i=data->max_voices; i<n; ++i)
+      sources->voice[order[i]] = 0;
+  }
+}
+
+// Prepare the HRTF directions that any source mixes into in this block.
+static void use_hrtf_directions(uint32_t samples, struct space_mixer_data *data){
+  struct space_sources *sources = &data->sources;
+  for(uint32_t s=0; s<sources->count; ++s){
+    if(!sources->buffer[s]) continue;
+    if(sources->voice[s]){
+      for(mixed_channel_t c=0; c<sources->speaker_count[s]; ++c){
+        hrtf_use(sources->speaker[c][s], samples, &data->hrtf);
+      }
+    }
+    if(sources->voice[s] || sources->active[s]){
+      for(mixed_channel_t c=0; c<sources->last_speaker_count[s]; ++c){
+        hrtf_use(sources->last_speaker[c][s], samples, &data->hrtf);
+      }
     }
+  }
+}
+
+// Mix a voice whose input has been prepared, or fade it out if it
+// was just virtualised.
+VECTORIZE static void mix_space_voice(uint32_t s, float *restrict in, float *restrict outs[], uint32_t samples, float global_volume, struct space_sources *sources){
+  if(!sources->voice[s]){
+    mix_source_fade_out(s, in, outs, samples, global_volume, sources);
+    sources->active[s] = 0;
+  }else if(sources->ramp[s]){
+    mix_source_ramped(s, in, outs, samples, global_volume, sources);
   }else{
-    location[0] = 0.0;
-    location[1] = 0.0;
-    location[2] = 0.0;
-    mixed_compute_gains(location, volumes, speakers, &speaker_count, &data->vbap);
-    for(mixed_channel_t c=0; c<speaker_count; ++c){
-      volumes[c] = MIN(1.0, volume*volumes[c]);
+    for(mixed_channel_t c=0; c<sources->speaker_count[s]; ++c){
+      float *restrict out = outs[sources->speaker[c][s]];
+      float volume = global_volume*sources->volume[c][s];
+      for(uint32_t i=0; i<samples; ++i){
+        out[i] += volume * in[i];
+      }
     }
   }
-  // Cache
-  memcpy(source->volumes, volumes, sizeof(float)*speaker_count);
-  memcpy(source->speakers, speakers, sizeof(float)*speaker_count);
-  source->speaker_count = speaker_count;
 }
 
-VECTORIZE static void calculate_pitch_shift(struct space_source *source, struct space_mixer_data *listener){
-  if(listener->doppler_factor <= 0.0){
-    source->pitch = 1.0;
-    return;
+// Run the pending voices through the air absorption bank and mix them.
+static void mix_space_voices(uint32_t n, const uint32_t *voices, float *ins[], uint32_t samples, struct space_worker *worker){
+  struct space_mixer_data *data = worker->data;
+  struct space_sources *sources = &data->sources;
+  if(0.0f < data->air.cutoff){
+    float coefficients[AIR_BANK_LANES] = {0};
+    float *states[AIR_BANK_LANES];
+    for(uint32_t k=0; k<n; ++k){
+      coefficients[k] = sources->air_coefficient[voices[k]];
+      states[k] = &sources->air_state[voices[k]];
+    }
+    air_absorption_bank(n, ins, samples, coefficients, states);
   }
-  // See OpenAL1.1 specification §3.5.2
-  float SL[3] = {listener->location[0] - source->location[0],
-                 listener->location[1] - source->location[1],
-                 listener->location[2] - source->location[2]};
-  float *SV = source->velocity;
-  float *LV = listener->velocity;
-  float SS = listener->soundspeed;
-  float DF = listener->doppler_factor;
-  float Mag = vec_length(SL);
-  float vls = vec_dot(SL, LV) * Mag;
-  float vss = vec_dot(SL, SV) * Mag;
-  float SS_DF = SS/DF;
-  vss = MIN(vss, SS_DF);
-  vls = MIN(vls, SS_DF);
-  float pitch = CLAMP(0.5, (SS - DF*vls) / (SS - DF*vss), 2.0);
-  source->pitch = pitch;
+  for(uint32_t k=0; k<n; ++k){
+    mix_space_voice(voices[k], ins[k], worker->outs, samples, data->volume, sources);
+    mixed_buffer_finish_read(samples, sources->buffer[voices[k]]);
+  }
+}
+
+// Mix the worker's share of the sources into its outputs. The voices
+// are gathered into groups that are filtered together before mixing.
+static void mix_space_worker(struct space_worker *worker){
+  struct space_mixer_data *data = worker->data;
+  struct space_sources *sources = &data->sources;
+  float *ins[AIR_BANK_LANES];
+  uint32_t voices[AIR_BANK_LANES];
+  uint32_t n = 0;
+  uint32_t samples = worker->samples;
+
+  worker->active_voices = 0;
+  worker->virtual_voices = 0;
+  for(uint32_t s=worker->start; s<worker->end; ++s){
+    if(!sources->buffer[s]) continue;
+
+    float *in;
+    mixed_buffer_request_read(&in, &samples, sources->buffer[s]);
+    bool fresh = sources->fresh[s];
+    sources->fresh[s] = 0;
+    if(!sources->voice[s]){
+      worker->virtual_voices++;
+      // Virtual voices only consume their input, after fading out.
+      if(!sources->active[s]){
+        if(0.0 < data->doppler_factor)
+          doppler_skip(in, samples, &sources->doppler[s]);
+        mixed_buffer_finish_read(samples, sources->buffer[s]);
+        continue;
+      }
+    }else{
+      if(!sources->active[s] && !fresh){
+        // Fade voices that come back from being virtual in.
+        for(mixed_channel_t c=0; c<sources->speaker_count[s]; ++c){
+          sources->last_volume[c][s] = 0.0;
+          sources->last_speaker[c][s] = sources->speaker[c][s];
+        }
+        sources->last_speaker_count[s] = sources->speaker_count[s];
+        sources->ramp[s] = 1;
+      }
+      sources->active[s] = 1;
+      worker->active_voices++;
+    }
+    if(0.0 < data->doppler_factor)
+      doppler(in, in, samples, sources->pitch[s], &sources->doppler[s]);
+    voices[n] = s;
+    ins[n] = in;
+    if(++n == AIR_BANK_LANES){
+      mix_space_voices(n, voices, ins, samples, worker);
+      n = 0;
+    }
+  }
+  if(0 < n)
+    mix_space_voices(n, voices, ins, samples, worker);
+}
+
+#ifdef MIXED_THREADS
+static void *space_worker_thread(void *arg){
+  struct space_worker *worker = (struct space_worker *)arg;
+  struct space_mixer_data *data = worker->data;
+  for(;;){
+    semaphore_wait(&worker->signal);
+    if(atomic_read(data->quit)) break;
+    for(mixed_channel_t c=0; c<data->channels.count; ++c){
+      memset(worker->out[c], 0, worker->samples*sizeof(float));
+    }
+    mix_space_worker(worker);
+    semaphore_post(&data->done);
+  }
+  return 0;
 }
+#endif
 
 VECTORIZE int space_mixer_mix(struct mixed_segment *segment){
   struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
+  struct space_sources *sources = &data->sources;
+  struct space_worker *workers = data->workers;
   uint32_t samples = UINT32_MAX;
   uint32_t channels = data->channels.count;
   float *restrict outs[channels], *restrict in;
-  float global_volume = data->volume;
   
   // Compute sample counts
   for(mixed_channel_t c=0; c<channels; ++c){
     mixed_buffer_request_write(&outs[c], &samples, data->out[c]);
   }
-  for(uint32_t s=0; s<data->count; ++s){
-    struct space_source *source = data->sources[s];
-    if(!source) continue;
+  for(uint32_t s=0; s<sources->count; ++s){
+    if(!sources->buffer[s]) continue;
 
-    mixed_buffer_request_read(&in, &samples, source->buffer);
+    mixed_buffer_request_read(&in, &samples, sources->buffer[s]);
     if(samples == 0) break;
   }
+  bool binaural = is_binaural(data);
+  if(binaural) samples = MIN(samples, data->hrtf.capacity);
 
   if(0 < samples){
     for(mixed_channel_t c=0; c<channels; ++c){
       memset(outs[c], 0, samples*sizeof(float));
     }
-    for(uint32_t s=0; s<data->count; ++s){
-      struct space_source *source = data->sources[s];
-      if(!source) continue;
-      
-      if(source->dirty){
-        calculate_volumes(source, data);
-        calculate_pitch_shift(source, data);
-        source->dirty = 0;
-      }
+    calculate_volumes(data);
+    select_voices(data);
 
-      mixed_buffer_request_read(&in, &samples, source->buffer);
-      if(source->pitch != 1.0)
-        fft_window(in, in, samples, &data->fft_window_data, fft_pitch_shift, &source->pitch);
-      for(mixed_channel_t c=0; c<source->speaker_count; ++c){
-        float *restrict out = outs[source->speakers[c]];
-        float volume = global_volume*source->volumes[c];
+    // Split the sources up if the workers can hold the whole block.
+    uint32_t threads = MIN(data->thread_count, sources->count / SPACE_MIN_SOURCES_PER_THREAD);
+    if(data->accumulator_size < channels*samples || binaural) threads = 1;
+    threads = MAX(1, threads);
+    uint32_t share = (sources->count + threads - 1) / threads;
+    for(uint32_t t=0; t<threads; ++t){
+      struct space_worker *worker = &workers[t];
+      worker->start = MIN(t*share, sources->count);
+      worker->end = MIN(worker->start+share, sources->count);
+      worker->samples = samples;
+      for(mixed_channel_t c=0; c<channels; ++c){
+        worker->out[c] = (t == 0)? outs[c] : worker->accumulator + c*samples;
+      }
+      worker->outs = worker->out;
+    }
+    // In binaural mode we mix into the inputs of the HRTF directions.
+    if(binaural){
+      use_hrtf_directions(samples, data);
+      workers[0].outs = data->hrtf.input;
+    }
+#ifdef MIXED_THREADS
+    for(uint32_t t=1; t<threads; ++t){
+      semaphore_post(&workers[t].signal);
+    }
+#endif
+    mix_space_worker(&workers[0]);
+    data->active_voices = workers[0].active_voices;
+    data->virtual_voices = workers[0].virtual_voices;
+#ifdef MIXED_THREADS
+    for(uint32_t t=1; t<threads; ++t){
+      semaphore_wait(&data->done);
+    }
+#endif
+    // Sum the other workers' outputs into ours.
+    for(uint32_t t=1; t<threads; ++t){
+      for(mixed_channel_t c=0; c<channels; ++c){
+        float *restrict out = outs[c];
+        float *restrict part = workers[t].out[c];
         for(uint32_t i=0; i<samples; ++i){
-          out[i] += volume * in[i];
+          out[i] += part[i];
         }
       }
-      mixed_buffer_finish_read(samples, source->buffer);
+      data->active_voices += workers[t].active_voices;
+      data->virtual_voices += workers[t].virtual_voices;
+    }
+    if(binaural){
+      hrtf_render(outs[0], outs[1], samples, &data->hrtf);
     }
   }
   for(mixed_channel_t c=0; c<channels; ++c){
@@ -233,7 +849,7 @@ int space_mixer_set_out(uint32_t field, uint32_t location, void *buffer, struct
       return 0;
     }
     data->out[location] = (struct mixed_buffer *)buffer;
-    return 1;
+    return ensure_hrtf_capacity(data);
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -257,43 +873,71 @@ int space_mixer_get_out(uint32_t field, uint32_t location, void *buffer, struct
   }
 }
 
+static inline float space_doppler_max_delay(struct space_mixer_data *data){
+  return doppler_delay(data->max_distance, data->soundspeed, data->doppler_factor, data->samplerate);
+}
+
+// Size the delay lines of all sources for the propagation delay at the
+// max distance, or to their short fixed size without it. They are only
+// allocated while doppler is enabled.
+static int ensure_doppler_lines(struct space_mixer_data *data){
+  if(data->doppler_factor <= 0.0) return 1;
+  float max_delay = space_doppler_max_delay(data);
+  for(uint32_t s=0; s<data->sources.count; ++s){
+    if(!data->sources.buffer[s]) continue;
+    if(!make_doppler_data(data->samplerate, data->propagation_delay, max_delay, &data->sources.doppler[s]))
+      return 0;
+  }
+  return 1;
+}
+
 int space_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
   struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
+  struct space_sources *sources = &data->sources;
 
   switch(field){
   case MIXED_BUFFER:
     if(buffer){ // Add or set an element
-      struct space_source *source = 0;
-      if(location < data->count)
-        source = data->sources[location];
-      if(!source){
-        source = mixed_calloc(1, sizeof(struct space_source));
-        if(!source){
-          mixed_err(MIXED_OUT_OF_MEMORY);
+      if(location >= sources->count || !sources->buffer[location]){
+        if(!ensure_space_sources(location+1, sources)){
+          return 0;
+        }
+        if(0.0 < data->doppler_factor
+           && !make_doppler_data(data->samplerate, data->propagation_delay, space_doppler_max_delay(data), &sources->doppler[location])){
           return 0;
         }
-        source->min_distance = data->min_distance;
-        source->max_distance = data->max_distance;
-        source->rolloff = data->rolloff;
-        source->velocity[0] = data->velocity[0];
-        source->velocity[1] = data->velocity[1];
-        source->velocity[2] = data->velocity[2];
-        source->location[0] = data->location[0];
-        source->location[1] = data->location[1];
-        source->location[2] = data->location[2];
-        source->dirty = 1;
-        source->spatial = 1;
+        sources->min_distance[location] = data->min_distance;
+        sources->max_distance[location] = data->max_distance;
+        sources->rolloff[location] = data->rolloff;
+        for(int i=0; i<3; ++i){
+          sources->velocity[i][location] = data->velocity[i];
+          sources->location[i][location] = data->location[i];
+        }
+        sources->pitch[location] = 1.0;
+        sources->air_coefficient[location] = 1.0;
+        sources->air_state[location] = 0.0;
+        sources->speaker_count[location] = 0;
+        sources->last_speaker_count[location] = 0;
+        sources->ramp[location] = 0;
+        sources->priority[location] = 1.0;
+        sources->loudness[location] = 0.0;
+        sources->active[location] = 0;
+        sources->fresh[location] = 1;
+        sources->dirty[location] = 1;
+        sources->spatial[location] = 1;
+        if(sources->count <= location)
+          sources->count = location+1;
       }
-      source->buffer = (struct mixed_buffer *)buffer;
-      if(location < data->count) data->sources[location] = source;
-      else return vector_add_pos(location, source, (struct vector *)data);
+      sources->buffer[location] = (struct mixed_buffer *)buffer;
     }else{ // Remove an element
-      if(data->count <= location){
+      if(sources->count <= location){
         mixed_err(MIXED_INVALID_LOCATION);
         return 0;
       }
-      mixed_free(data->sources[location]);
-      data->sources[location] = 0;
+      if(sources->buffer[location]){
+        free_doppler_data(&sources->doppler[location]);
+        sources->buffer[location] = 0;
+      }
     }
     return 1;
   case MIXED_SPACE_MIN_DISTANCE:
@@ -302,37 +946,40 @@ int space_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct m
   case MIXED_SPACE_LOCATION:
   case MIXED_SPACE_VELOCITY:
   case MIXED_SPACE_SPATIAL:
-    if(data->count <= location){
+  case MIXED_SPACE_PRIORITY:
+    if(sources->count <= location || !sources->buffer[location]){
       mixed_err(MIXED_INVALID_LOCATION);
       return 0;
     }
-    struct space_source *source = data->sources[location];
     float *value = (float *)buffer;
     switch(field){
+    case MIXED_SPACE_PRIORITY:
+      sources->priority[location] = *(float *)buffer;
+      return 1;
     case MIXED_SPACE_MIN_DISTANCE:
-      source->min_distance = *(float *)buffer;
+      sources->min_distance[location] = *(float *)buffer;
       break;
     case MIXED_SPACE_MAX_DISTANCE:
-      source->max_distance = *(float *)buffer;
+      sources->max_distance[location] = *(float *)buffer;
       break;
     case MIXED_SPACE_ROLLOFF:
-      source->rolloff = *(float *)buffer;
+      sources->rolloff[location] = *(float *)buffer;
       break;
     case MIXED_SPACE_LOCATION:
-      source->location[0] = value[0];
-      source->location[1] = value[1];
-      source->location[2] = value[2];
+      sources->location[0][location] = value[0];
+      sources->location[1][location] = value[1];
+      sources->location[2][location] = value[2];
       break;
     case MIXED_SPACE_VELOCITY:
-      source->velocity[0] = value[0];
-      source->velocity[1] = value[1];
-      source->velocity[2] = value[2];
+      sources->velocity[0][location] = value[0];
+      sources->velocity[1][location] = value[1];
+      sources->velocity[2][location] = value[2];
       break;
     case MIXED_SPACE_SPATIAL:
-      source->spatial = *(bool *)buffer;
+      sources->spatial[location] = *(bool *)buffer;
       break;
     }
-    source->dirty = 1;
+    sources->dirty[location] = 1;
     return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
@@ -342,49 +989,47 @@ int space_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct m
 
 int space_mixer_get_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
   struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
+  struct space_sources *sources = &data->sources;
   
-  if(data->count <= location){
-    mixed_err(MIXED_INVALID_LOCATION);
-    return 0;
-  }
-  
-  struct space_source *source = data->sources[location];
-  if(source == 0){
+  if(sources->count <= location || !sources->buffer[location]){
     mixed_err(MIXED_INVALID_LOCATION);
     return 0;
   }
 
   switch(field){
   case MIXED_BUFFER:
-    *(struct mixed_buffer **)buffer = source->buffer;
+    *(struct mixed_buffer **)buffer = sources->buffer[location];
     return 1;
   case MIXED_SPACE_MIN_DISTANCE:
-    *(float *)buffer = source->min_distance;
+    *(float *)buffer = sources->min_distance[location];
     return 1;
   case MIXED_SPACE_MAX_DISTANCE:
-    *(float *)buffer = source->max_distance;
+    *(float *)buffer = sources->max_distance[location];
     return 1;
   case MIXED_SPACE_ROLLOFF:
-    *(float *)buffer = source->rolloff;
+    *(float *)buffer = sources->rolloff[location];
     return 1;
   case MIXED_SPACE_LOCATION:
   case MIXED_SPACE_VELOCITY:{
     float *value = (float *)buffer;
     switch(field){
     case MIXED_SPACE_LOCATION:
-      value[0] = source->location[0];
-      value[1] = source->location[1];
-      value[2] = source->location[2];
+      value[0] = sources->location[0][location];
+      value[1] = sources->location[1][location];
+      value[2] = sources->location[2][location];
       break;
     case MIXED_SPACE_VELOCITY:
-      value[0] = source->velocity[0];
-      value[1] = source->velocity[1];
-      value[2] = source->velocity[2];
+      value[0] = sources->velocity[0][location];
+      value[1] = sources->velocity[1][location];
+      value[2] = sources->velocity[2][location];
       break;
     }}
     return 1;
   case MIXED_SPACE_SPATIAL:
-    *(bool *)buffer = source->spatial;
+    *(bool *)buffer = sources->spatial[location];
+    return 1;
+  case MIXED_SPACE_PRIORITY:
+    *(float *)buffer = sources->priority[location];
     return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
@@ -425,6 +1070,9 @@ int space_mixer_get(uint32_t field, void *value, struct mixed_segment *segment){
   case MIXED_SPACE_DOPPLER_FACTOR:
     *(float *)value = data->doppler_factor;
     break;
+  case MIXED_SPACE_PROPAGATION_DELAY:
+    *(bool *)value = data->propagation_delay;
+    break;
   case MIXED_SPACE_MIN_DISTANCE:
     *(float *)value = data->min_distance;
     break;
@@ -453,6 +1101,24 @@ int space_mixer_get(uint32_t field, void *value, struct mixed_segment *segment){
   case MIXED_CHANNEL_CONFIGURATION:
     *(struct mixed_channel_configuration *)value = data->channels;
     break;
+  case MIXED_SPACE_MAX_VOICES:
+    *(uint32_t *)value = data->max_voices;
+    break;
+  case MIXED_SPACE_AUDIBILITY_THRESHOLD:
+    *(float *)value = data->audibility_threshold;
+    break;
+  case MIXED_SPACE_ACTIVE_VOICES:
+    *(uint32_t *)value = data->active_voices;
+    break;
+  case MIXED_SPACE_VIRTUAL_VOICES:
+    *(uint32_t *)value = data->virtual_voices;
+    break;
+  case MIXED_SPACE_AIR_ABSORPTION:
+    *(float *)value = data->air.cutoff;
+    break;
+  case MIXED_THREAD_COUNT:
+    *(uint32_t *)value = data->thread_count;
+    break;
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -483,13 +1149,62 @@ void recompute_look_at(struct space_mixer_data *data){
 }
 
 void mark_sources_dirty(struct space_mixer_data *data){
-  for(uint32_t s=0; s<data->count; ++s){
-      struct space_source *source = data->sources[s];
-      if(!source) continue;
-      source->dirty = 1;
+  for(uint32_t s=0; s<data->sources.count; ++s){
+    data->sources.dirty[s] = 1;
+  }
+}
+
+// The old speakers are meaningless in a new layout, so don't ramp from them.
+static void reset_source_ramps(struct space_mixer_data *data){
+  for(uint32_t s=0; s<data->sources.count; ++s){
+    data->sources.last_speaker_count[s] = 0;
+    data->sources.ramp[s] = 0;
+  }
+}
+
+// Copy the interleaved vectors of the update into the source arrays.
+VECTORIZE static void deinterleave_vectors(uint32_t n, const float *restrict vectors, float *restrict x, float *restrict y, float *restrict z){
+  for(uint32_t i=0; i<n; ++i){
+    x[i] = vectors[i*3+0];
+    y[i] = vectors[i*3+1];
+    z[i] = vectors[i*3+2];
   }
 }
 
+static int update_sources(struct mixed_source_update *update, struct space_mixer_data *data){
+  struct space_sources *sources = &data->sources;
+  uint32_t start = update->start;
+  uint32_t n = update->count;
+  if(sources->count < start || sources->count - start < n){
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+  for(uint32_t s=start; s<start+n; ++s){
+    if(!sources->buffer[s]){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+  }
+  if(update->location)
+    deinterleave_vectors(n, update->location, sources->location[0]+start, sources->location[1]+start, sources->location[2]+start);
+  if(update->velocity)
+    deinterleave_vectors(n, update->velocity, sources->velocity[0]+start, sources->velocity[1]+start, sources->velocity[2]+start);
+  if(update->min_distance)
+    memcpy(sources->min_distance+start, update->min_distance, n*sizeof(float));
+  if(update->max_distance)
+    memcpy(sources->max_distance+start, update->max_distance, n*sizeof(float));
+  if(update->rolloff)
+    memcpy(sources->rolloff+start, update->rolloff, n*sizeof(float));
+  if(update->priority)
+    memcpy(sources->priority+start, update->priority, n*sizeof(float));
+  // The priority only matters when picking voices, so it alone does not
+  // require the gains to be recalculated.
+  if(update->location || update->velocity || update->min_distance
+     || update->max_distance || update->rolloff)
+    memset(sources->dirty+start, 1, n*sizeof(bool));
+  return 1;
+}
+
 int space_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
   struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
   float *parts = (float *)value;
@@ -539,22 +1254,52 @@ int space_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
       mark_sources_dirty(data);
     }
     break;
-  case MIXED_SPACE_SOUNDSPEED:
+  case MIXED_SPACE_SOUNDSPEED:{
+    float old_soundspeed = data->soundspeed;
     data->soundspeed = *(float *)value;
+    if(!ensure_doppler_lines(data)){
+      data->soundspeed = old_soundspeed;
+      return 0;
+    }
     mark_sources_dirty(data);
-    break;
-  case MIXED_SPACE_DOPPLER_FACTOR:
+    break;}
+  case MIXED_SPACE_DOPPLER_FACTOR:{
+    float old_factor = data->doppler_factor;
     data->doppler_factor = *(float *)value;
+    if(!ensure_doppler_lines(data)){
+      data->doppler_factor = old_factor;
+      return 0;
+    }
+    if(old_factor <= 0.0 && 0.0 < data->doppler_factor){
+      // The delay lines went stale while doppler was off, start them anew.
+      for(uint32_t s=0; s<data->sources.count; ++s){
+        if(data->sources.buffer[s]) doppler_reset(&data->sources.doppler[s]);
+      }
+    }
     mark_sources_dirty(data);
-    break;
+    break;}
+  case MIXED_SPACE_PROPAGATION_DELAY:{
+    bool old_propagation = data->propagation_delay;
+    data->propagation_delay = *(bool *)value;
+    if(!ensure_doppler_lines(data)){
+      data->propagation_delay = old_propagation;
+      ensure_doppler_lines(data);
+      return 0;
+    }
+    break;}
   case MIXED_SPACE_MIN_DISTANCE:
     data->min_distance = *(float *)value;
     mark_sources_dirty(data);
     break;
-  case MIXED_SPACE_MAX_DISTANCE:
+  case MIXED_SPACE_MAX_DISTANCE:{
+    float old_distance = data->max_distance;
     data->max_distance = *(float *)value;
+    if(!ensure_doppler_lines(data)){
+      data->max_distance = old_distance;
+      return 0;
+    }
     mark_sources_dirty(data);
-    break;
+    break;}
   case MIXED_SPACE_ROLLOFF:
     data->rolloff = *(float *)value;
     mark_sources_dirty(data);
@@ -588,6 +1333,7 @@ int space_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
       return 0;
     }
     data->surround = mixed_configuration_is_surround(&data->channels);
+    reset_source_ramps(data);
     mark_sources_dirty(data);
     break;
   case MIXED_CHANNEL_CONFIGURATION:
@@ -599,8 +1345,67 @@ int space_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
       return 0;
     }
     data->surround = mixed_configuration_is_surround(&data->channels);
+    reset_source_ramps(data);
     mark_sources_dirty(data);
     break;
+  case MIXED_SPACE_MAX_VOICES:
+    data->max_voices = *(uint32_t *)value;
+    break;
+  case MIXED_SPACE_AUDIBILITY_THRESHOLD:
+    data->audibility_threshold = *(float *)value;
+    break;
+  case MIXED_SPACE_HRTF:{
+    struct hrtf_data hrtf = {0};
+    if(value && !load_hrtf_data((const char *)value, data->samplerate, &hrtf))
+      return 0;
+    if(value && !hrtf_make_convolvers(&hrtf)){
+      free_hrtf_data(&hrtf);
+      return 0;
+    }
+    free_hrtf_data(&data->hrtf);
+    data->hrtf = hrtf;
+    if(!ensure_hrtf_capacity(data)){
+      free_hrtf_data(&data->hrtf);
+      return 0;
+    }
+    // The speaker indices change meaning between the modes.
+    reset_source_ramps(data);
+    mark_sources_dirty(data);
+    break;}
+  case MIXED_THREAD_COUNT:{
+    uint32_t count = *(uint32_t *)value;
+    if(count < 1){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+#ifndef MIXED_THREADS
+    if(1 < count){
+      mixed_err(MIXED_NOT_IMPLEMENTED);
+      return 0;
+    }
+#endif
+    if(count == data->thread_count) break;
+    if(!make_space_workers(count, data)){
+      make_space_workers(1, data);
+      return 0;
+    }
+    return ensure_space_accumulators(data);
+  }
+  case MIXED_SPACE_AIR_ABSORPTION:{
+    float cutoff = *(float *)value;
+    if(cutoff < 0.0f || data->samplerate/2.0f <= cutoff){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    if(data->air.cutoff <= 0.0f){
+      for(uint32_t s=0; s<data->sources.count; ++s)
+        data->sources.air_state[s] = 0.0f;
+    }
+    air_absorption_table(cutoff, data->samplerate, &data->air);
+    mark_sources_dirty(data);
+    break;}
+  case MIXED_SOURCE_UPDATE:
+    return update_sources((struct mixed_source_update *)value, data);
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -651,6 +1456,10 @@ int space_mixer_info(struct mixed_segment_info *info, struct mixed_segment *segm
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The doppler factor. You can use this to exaggerate or dampen the effect.");
 
+  set_info_field(field++, MIXED_SPACE_PROPAGATION_DELAY,
+                 MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Whether doppler delays sources by the full time their sound takes to reach the listener.");
+
   set_info_field(field++, MIXED_SPACE_MIN_DISTANCE,
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_IN | MIXED_SET | MIXED_GET,
                  "Any distance lower than this will make the sound appear at its maximal volume.");
@@ -671,6 +1480,42 @@ int space_mixer_info(struct mixed_segment_info *info, struct mixed_segment *segm
                  MIXED_BOOL, 1, MIXED_IN | MIXED_SET | MIXED_GET,
                  "Whether the source should receive spatial location attenuation.");
 
+  set_info_field(field++, MIXED_SPACE_PRIORITY,
+                 MIXED_FLOAT, 1, MIXED_IN | MIXED_SET | MIXED_GET,
+                 "The priority of the source when picking which sources to mix.");
+
+  set_info_field(field++, MIXED_SPACE_MAX_VOICES,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The maximal number of sources that are mixed at once.");
+
+  set_info_field(field++, MIXED_SPACE_AUDIBILITY_THRESHOLD,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The loudness below which a source is not mixed.");
+
+  set_info_field(field++, MIXED_SPACE_ACTIVE_VOICES,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The number of sources mixed in the last block.");
+
+  set_info_field(field++, MIXED_SPACE_VIRTUAL_VOICES,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The number of sources not mixed in the last block.");
+
+  set_info_field(field++, MIXED_SPACE_HRTF,
+                 MIXED_STRING, 1, MIXED_SEGMENT | MIXED_SET,
+                 "The path to an HRTF table to render binaurally with on stereo outputs.");
+
+  set_info_field(field++, MIXED_SPACE_AIR_ABSORPTION,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The low-pass cutoff frequency for sources at the max distance, or 0 for no air absorption.");
+
+  set_info_field(field++, MIXED_SOURCE_UPDATE,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_SET,
+                 "Update the properties of a range of sources at once.");
+
+  set_info_field(field++, MIXED_THREAD_COUNT,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of threads the sources are mixed on.");
+
   set_info_field(field++, MIXED_OUT_COUNT,
                  MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The number of output channels. When set, the output buffers need to be set anew.");
@@ -690,11 +1535,6 @@ MIXED_EXPORT int mixed_make_segment_space_mixer(uint32_t samplerate, struct mixe
     return 0;
   }
 
-  // These factors might need tweaking for efficiency/quality.
-  if(!make_fft_window_data(2048, 4, samplerate, &data->fft_window_data)){
-    goto cleanup;
-  }
-
   data->out = mixed_calloc(2, sizeof(struct mixed_buffer *));
   if(!data->out){
     mixed_err(MIXED_OUT_OF_MEMORY);
@@ -714,9 +1554,15 @@ MIXED_EXPORT int mixed_make_segment_space_mixer(uint32_t samplerate, struct mixe
   data->min_distance = 10.0;      // That's 10 centimetres.
   data->max_distance = 100000.0;  // That's a kilometre.
   data->rolloff = 0.5;
+  data->max_voices = UINT32_MAX;
+  data->audibility_threshold = 0.0001; // -80dB
   data->attenuation = attenuation_exponential;
   data->volume = 1.0;
+  data->samplerate = samplerate;
   recompute_look_at(data);
+  if(!make_space_workers(1, data)){
+    goto cleanup;
+  }
   
   segment->free = space_mixer_free;
   segment->info = space_mixer_info;
@@ -732,7 +1578,8 @@ MIXED_EXPORT int mixed_make_segment_space_mixer(uint32_t samplerate, struct mixe
   return 1;
 
  cleanup:
-  free_fft_window_data(&data->fft_window_data);
+  free_space_workers(data);
+  FREE(data->out);
   mixed_free(data);
   return 0;
 }
@@ -97,12 +97,109 @@ MIXED_EXPORT int mixed_configuration_is_surround(struct mixed_channel_configurat
 //// This is an implementation of "Vector Based Amplitude Panning" algorithms
 //// as described by Ville Pulkki in "Spatial Sound Generation and Perception by Amplitude Panning Techniques"
 
+// Evaluate a set for the direction and make it the best if it beats the current best.
+static inline void consider_set(int set, const float direction[3], float *best_gain, char *best_negs, int *best_set, float gains[3], struct vbap_data *data){
+  char dims = data->dims;
+  float gain[3] = {0.0, 0.0, 0.0};
+  float cur_gain = INFINITY;
+  char cur_negs = dims;
+
+  for(int j=0; j<dims; ++j){
+    gain[j] = direction[0] * data->sets[set].inv_mat[0+j*3] +
+              direction[1] * data->sets[set].inv_mat[1+j*3] +
+              direction[2] * data->sets[set].inv_mat[2+j*3];
+    if(gain[j] < cur_gain)
+      cur_gain = gain[j];
+    if(-0.01 <= gain[j])
+      cur_negs--;
+  }
+  if(*best_gain < cur_gain && cur_negs <= *best_negs){
+    *best_gain = cur_gain;
+    *best_negs = cur_negs;
+    *best_set = set;
+    memcpy(gains, gain, sizeof(float)*3);
+  }
+}
+
+// Map a unit direction onto the octahedron unfolded into [-1,+1]², with Y up.
+static inline void octahedral_encode(const float d[3], float *u, float *v){
+  float l = fabsf(d[0]) + fabsf(d[1]) + fabsf(d[2]);
+  float x = d[0] / l;
+  float z = d[2] / l;
+  if(d[1] < 0.0){
+    float ox = x;
+    x = (1.0f - fabsf(z)) * copysignf(1.0f, ox);
+    z = (1.0f - fabsf(ox)) * copysignf(1.0f, z);
+  }
+  *u = x;
+  *v = z;
+}
+
+static inline void octahedral_decode(float u, float v, float d[3]){
+  d[0] = u;
+  d[1] = 1.0f - fabsf(u) - fabsf(v);
+  d[2] = v;
+  if(d[1] < 0.0){
+    d[0] = (1.0f - fabsf(v)) * copysignf(1.0f, u);
+    d[2] = (1.0f - fabsf(u)) * copysignf(1.0f, v);
+  }
+  vec_normalized(d);
+}
+
+// Find the set with the highest correspondence to the direction.
+// With a grid only the sets at the corners of the surrounding grid cell
+// are considered first. Should none of them contain the direction, which
+// happens when a set is too small to cover any grid vertex, we fall back
+// to searching all sets.
+static int find_set(const float direction[3], float gains[3], struct vbap_data *data){
+  float best_gain = -INFINITY;
+  char best_negs = data->dims;
+  int best_set = 0;
+  // Planar sets ignore the Y component, so look up the projected direction.
+  float lookup[3] = {direction[0], (data->dims == 2)? 0.0f : direction[1], direction[2]};
+
+  gains[0] = gains[1] = gains[2] = 0.0;
+  if(data->has_grid && (lookup[0] != 0.0 || lookup[1] != 0.0 || lookup[2] != 0.0)){
+    float u, v;
+    octahedral_encode(lookup, &u, &v);
+    int i = CLAMP(0, (int)((u*0.5f + 0.5f) * VBAP_GRID_SIZE), VBAP_GRID_SIZE-1);
+    int j = CLAMP(0, (int)((v*0.5f + 0.5f) * VBAP_GRID_SIZE), VBAP_GRID_SIZE-1);
+    int corners[4] = {data->grid[i][j], data->grid[i+1][j], data->grid[i][j+1], data->grid[i+1][j+1]};
+    // Visit in ascending order so that ties resolve like the full search.
+    for(int a=1; a<4; ++a){
+      for(int b=a; 0<b && corners[b] < corners[b-1]; --b){
+        int t = corners[b]; corners[b] = corners[b-1]; corners[b-1] = t;
+      }
+    }
+    for(int c=0; c<4; ++c){
+      if(c == 0 || corners[c] != corners[c-1])
+        consider_set(corners[c], direction, &best_gain, &best_negs, &best_set, gains, data);
+    }
+    if(best_negs == 0) return best_set;
+    best_gain = -INFINITY;
+    best_negs = data->dims;
+  }
+  for(int i=0; i<data->set_count; ++i)
+    consider_set(i, direction, &best_gain, &best_negs, &best_set, gains, data);
+  return best_set;
+}
+
+static void make_vbap_grid(struct vbap_data *data){
+  data->has_grid = 0;
+  if(data->set_count < VBAP_GRID_MIN_SETS) return;
+  for(int i=0; i<=VBAP_GRID_SIZE; ++i){
+    for(int j=0; j<=VBAP_GRID_SIZE; ++j){
+      float direction[3], gains[3];
+      octahedral_decode(i*2.0f/VBAP_GRID_SIZE - 1.0f, j*2.0f/VBAP_GRID_SIZE - 1.0f, direction);
+      data->grid[i][j] = find_set(direction, gains, data);
+    }
+  }
+  data->has_grid = 1;
+}
+
 /// The compute_gains function is used at runtime, regardless of data dimensionality.
 VECTORIZE int mixed_compute_gains(const float position[3], float gains[], mixed_channel_t speakers[], mixed_channel_t *count, struct vbap_data *data){
   char dims = data->dims;
-  float best_gain = -INFINITY;
-  char best_negs = dims;
-  mixed_channel_t best_set = 0;
   
   // If the direction is a zero vector, recast as 0,-1,0 on 3d, and 0,0,1 on 2d.
   // which should give a best approximation for being "on" the position.
@@ -114,28 +211,7 @@ VECTORIZE int mixed_compute_gains(const float position[3], float gains[], mixed_
     if(dims == 3) direction[1] = -1.0;
     else          direction[2] = +1.0;
   }
-  // Find set with the highest correspondence to our direction
-  for(int i=0; i<data->set_count; ++i){
-    float gain[3] = {0.0, 0.0, 0.0};
-    float cur_gain = INFINITY;
-    char cur_negs = dims;
-    
-    for(int j=0; j<dims; ++j){
-      gain[j] = direction[0] * data->sets[i].inv_mat[0+j*3] +
-                direction[1] * data->sets[i].inv_mat[1+j*3] +
-                direction[2] * data->sets[i].inv_mat[2+j*3];
-      if(gain[j] < cur_gain)
-        cur_gain = gain[j];
-      if(-0.01 <= gain[j])
-        cur_negs--;
-    }
-    if(best_gain < cur_gain && cur_negs <= best_negs){
-      best_gain = cur_gain;
-      best_negs = cur_negs;
-      best_set = i;
-      memcpy(gains, gain, sizeof(float)*3);
-    }
-  }
+  int best_set = find_set(direction, gains, data);
   memcpy(speakers, data->sets[best_set].speakers, sizeof(mixed_channel_t)*3);
   // Handle if the best set still does not contain our point.
   char okey = 1;
@@ -150,6 +226,76 @@ VECTORIZE int mixed_compute_gains(const float position[3], float gains[], mixed_
   return okey;
 }
 
+/// The batched variant of compute_gains, for many positions at once.
+/// The positions are passed as separate coordinate arrays and are normalised
+/// in place. For each position the gains and the index of the chosen speaker
+/// set are written out. The search is done per set across all positions, so
+/// that the inner loops run over contiguous arrays and can be vectorised.
+VECTORIZE void mixed_compute_gains_batch(uint32_t count, float *restrict x, float *restrict y, float *restrict z, float *restrict gains[3], uint32_t *restrict sets, struct vbap_data *data){
+  char dims = data->dims;
+  float *restrict g0 = gains[0], *restrict g1 = gains[1], *restrict g2 = gains[2];
+  float best_gain[VBAP_BATCH_SIZE];
+  float best_negs[VBAP_BATCH_SIZE];
+
+  for(uint32_t offset=0; offset<count; offset+=VBAP_BATCH_SIZE){
+    uint32_t n = MIN(VBAP_BATCH_SIZE, count-offset);
+    float *restrict px = x+offset, *restrict py = y+offset, *restrict pz = z+offset;
+    float *restrict pg0 = g0+offset, *restrict pg1 = g1+offset, *restrict pg2 = g2+offset;
+    uint32_t *restrict pset = sets+offset;
+
+    // See mixed_compute_gains for the zero vector treatment.
+    for(uint32_t i=0; i<n; ++i){
+      float length = sqrtf(px[i]*px[i] + py[i]*py[i] + pz[i]*pz[i]);
+      float inv = (0 < length)? 1.0f/length : 0.0f;
+      px[i] *= inv;
+      py[i] *= inv;
+      pz[i] = (0 < length)? pz[i]*inv : ((dims == 3)? 0.0f : 1.0f);
+      py[i] = (0 < length || dims != 3)? py[i] : -1.0f;
+      best_gain[i] = -INFINITY;
+      best_negs[i] = dims;
+      pset[i] = 0;
+      pg0[i] = 0.0f;
+      pg1[i] = 0.0f;
+      pg2[i] = 0.0f;
+    }
+    if(data->has_grid){
+      for(uint32_t i=0; i<n; ++i){
+        float direction[3] = {px[i], py[i], pz[i]}, gain[3];
+        pset[i] = find_set(direction, gain, data);
+        pg0[i] = gain[0];
+        pg1[i] = gain[1];
+        pg2[i] = gain[2];
+      }
+    }else for(int s=0; s<data->set_count; ++s){
+      const float *m = data->sets[s].inv_mat;
+      for(uint32_t i=0; i<n; ++i){
+        float a = px[i]*m[0] + py[i]*m[1] + pz[i]*m[2];
+        float b = px[i]*m[3] + py[i]*m[4] + pz[i]*m[5];
+        float c = (dims == 3)? px[i]*m[6] + py[i]*m[7] + pz[i]*m[8] : INFINITY;
+        float cur_gain = MIN(MIN(a, b), c);
+        float cur_negs = (a < -0.01f) + (b < -0.01f) + (c < -0.01f);
+        bool better = best_gain[i] < cur_gain && cur_negs <= best_negs[i];
+        best_gain[i] = better? cur_gain : best_gain[i];
+        best_negs[i] = better? cur_negs : best_negs[i];
+        pset[i] = better? (uint32_t)s : pset[i];
+        pg0[i] = better? a : pg0[i];
+        pg1[i] = better? b : pg1[i];
+        pg2[i] = better? ((dims == 3)? c : 0.0f) : pg2[i];
+      }
+    }
+    for(uint32_t i=0; i<n; ++i){
+      float a = (pg0[i] < -0.01f)? 0.0001f : pg0[i];
+      float b = (pg1[i] < -0.01f)? 0.0001f : pg1[i];
+      float c = (pg2[i] < -0.01f)? 0.0001f : pg2[i];
+      float length = sqrtf(a*a + b*b + c*c);
+      float inv = (0 < length)? 1.0f/length : 0.0f;
+      pg0[i] = a*inv;
+      pg1[i] = b*inv;
+      pg2[i] = c*inv;
+    }
+  }
+}
+
 /// Helper functions for 3D speaker set triangulation
 float set_side_length(mixed_channel_t set, struct vbap_data *data){
   float cross[3];
@@ -263,15 +409,13 @@ int make_vbap_3d(struct vbap_data *data){
   float distances[MAX_VBAP_SETS];
   int distances_i[MAX_VBAP_SETS];
   int distances_j[MAX_VBAP_SETS];
-  for(int i=0; i<set_count; ++i){
-    distances[i] = INFINITY;
-  }
+  int pair_count = 0;
   for(int i=0; i<speaker_count; ++i){
     for(int j=i+1; j<speaker_count; ++j){
       if(connected[i][j]){
         float dist = fabs(vec_angle(data->speakers[i], data->speakers[j]));
-        int k=0; while(distances[k] < dist) ++k;
-        for(int l=set_count-1; k < l; --l){
+        int k=0; while(k < pair_count && distances[k] < dist) ++k;
+        for(int l=pair_count++; k < l; --l){
           distances[l] = distances[l-1];
           distances_i[l] = distances_i[l-1];
           distances_j[l] = distances_j[l-1];
@@ -284,7 +428,7 @@ int make_vbap_3d(struct vbap_data *data){
   }
 
   // Disconnect connections which cross over ones that are shorter.
-  for(int i=0; i<set_count; ++i){
+  for(int i=0; i<pair_count; ++i){
     int first = distances_i[i];
     int second = distances_j[i];
     if(connected[first][second]){
@@ -311,8 +455,9 @@ int make_vbap_3d(struct vbap_data *data){
       // Shift sets downwards
       for(int t=s; t<set_count-1; ++t){
         data->sets[t] = data->sets[t+1];
-        --set_count;
       }
+      --set_count;
+      --s;
     }
   }
 
@@ -373,9 +518,16 @@ int make_vbap_2d(struct vbap_data *data){
     }
   }
   
-  // Sort the speakers by angle
+  // Sort the speakers by angle, leaving out ones without a direction (LFE)
   int sorted[MIXED_MAX_SPEAKER_COUNT];
+  int count = 0;
   for(int i=0; i<speaker_count; ++i){
+    if(data->speakers[i][0] == 0.0 && data->speakers[i][2] == 0.0)
+      azimuth[i] += 4096.0;
+    else
+      ++count;
+  }
+  for(int i=0; i<count; ++i){
     float smallest_angle = 1024.0;
     int smallest = 0;
     for(int j=0; j<speaker_count; ++j){
@@ -389,13 +541,17 @@ int make_vbap_2d(struct vbap_data *data){
     azimuth[smallest] += 2048.0;
   }
   // Undo the bias.
-  for(int i=0; i<speaker_count; ++i){
-    azimuth[i] -= 2048.0;
+  for(int i=0; i<count; ++i){
+    azimuth[sorted[i]] -= 2048.0;
+  }
+  if(count < 2){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
   }
 
   // Construct pairs based on adjacent speakers
-  for(int i=0; i<speaker_count-1; ++i){
-    if(azimuth[i+1] - azimuth[i] <= (170)){
+  for(int i=0; i<count-1; ++i){
+    if(azimuth[sorted[i+1]] - azimuth[sorted[i]] <= (170)){
       data->sets[set_count].speakers[0] = sorted[i];
       data->sets[set_count].speakers[1] = sorted[i+1];
       data->sets[set_count].speakers[2] = -1;
@@ -404,8 +560,8 @@ int make_vbap_2d(struct vbap_data *data){
       }
     }
   }
-  if(360 - azimuth[sorted[speaker_count-1]] + azimuth[sorted[0]] <= 170){
-      data->sets[set_count].speakers[0] = sorted[speaker_count-1];
+  if(360 - azimuth[sorted[count-1]] + azimuth[sorted[0]] <= 170){
+      data->sets[set_count].speakers[0] = sorted[count-1];
       data->sets[set_count].speakers[1] = sorted[0];
       data->sets[set_count].speakers[2] = -1;
       if(compute_set_matrix_2d(set_count, azimuth, data)){
@@ -430,6 +586,7 @@ int make_vbap(float speakers[][3], mixed_channel_t speaker_count, int dim, struc
 
   data->dims = dim;
   data->speaker_count = speaker_count;
+  data->has_grid = 0;
   switch(dim){
   case 2:
     memcpy(data->speakers, speakers, speaker_count*3*sizeof(float));
@@ -438,16 +595,20 @@ int make_vbap(float speakers[][3], mixed_channel_t speaker_count, int dim, struc
       data->speakers[i][1] = 0.0;
       vec_normalized(data->speakers[i]);
     }
-    return make_vbap_2d(data);
+    if(!make_vbap_2d(data)) return 0;
+    break;
   case 3:
     for(mixed_channel_t i=0; i<speaker_count; ++i){
       vec_normalize(data->speakers[i], speakers[i]);
     }
-    return make_vbap_3d(data);
+    if(!make_vbap_3d(data)) return 0;
+    break;
   default:
     mixed_err(MIXED_INVALID_VALUE);
     return 0;
   }
+  make_vbap_grid(data);
+  return 1;
 }
 
 int make_vbap_from_configuration(struct mixed_channel_configuration const* configuration, struct vbap_data *data){
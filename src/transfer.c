@@ -1,7 +1,8 @@
 #include "internal.h"
 
 //// Single sample transfer functions
-// We assume little endian for all formats.
+// These are for little endian samples, the big endian variants below
+// swap the bytes around the little endian ones.
 #define DEF_MIXED_TRANSFER_SAMPLE_FROM(name, datatype)                  \
   __attribute__((always_inline))                                        \
   static inline void mixed_transfer_sample_from_##name(void *in, uint32_t is, float *out, uint32_t os, float volume) { \
@@ -16,6 +17,8 @@ DEF_MIXED_TRANSFER_SAMPLE_FROM(int32, int32_t)
 DEF_MIXED_TRANSFER_SAMPLE_FROM(uint32, uint32_t)
 DEF_MIXED_TRANSFER_SAMPLE_FROM(float, float)
 DEF_MIXED_TRANSFER_SAMPLE_FROM(double, double)
+DEF_MIXED_TRANSFER_SAMPLE_FROM(float16, uint16_t)
+DEF_MIXED_TRANSFER_SAMPLE_FROM(bfloat16, uint16_t)
 
 __attribute__((always_inline))
 extern inline void mixed_transfer_sample_from_int24(void *in, uint32_t is, float *out, uint32_t os, float volume) {
@@ -64,6 +67,72 @@ extern inline void mixed_transfer_sample_to_uint24(float *in, uint32_t is, void
   ((uint8_t *)out)[3*os+0] = (sample >>  0) & 0xFF;
 }
 
+// The half precision encodings are scaled before conversion to keep
+// the precision of the float, like the 24 bit encodings.
+__attribute__((always_inline))
+static inline void mixed_transfer_sample_to_float16(float *in, uint32_t is, void *out, uint32_t os, float volume){
+  ((uint16_t *)out)[os] = mixed_to_float16(in[is] * volume);
+}
+
+__attribute__((always_inline))
+static inline void mixed_transfer_sample_to_bfloat16(float *in, uint32_t is, void *out, uint32_t os, float volume){
+  ((uint16_t *)out)[os] = mixed_to_bfloat16(in[is] * volume);
+}
+
+#define DEF_MIXED_TRANSFER_SAMPLE_SWAPPED(name, datatype, bits)         \
+  __attribute__((always_inline))                                        \
+  static inline void mixed_transfer_sample_from_##name##_be(void *in, uint32_t is, float *out, uint32_t os, float volume){ \
+    union { uint##bits##_t raw; datatype value; } sample;               \
+    sample.raw = __builtin_bswap##bits(((uint##bits##_t *)in)[is]);     \
+    mixed_transfer_sample_from_##name(&sample.value, 0, out, os, volume); \
+  }                                                                     \
+  __attribute__((always_inline))                                        \
+  static inline void mixed_transfer_sample_to_##name##_be(float *in, uint32_t is, void *out, uint32_t os, float volume){ \
+    union { uint##bits##_t raw; datatype value; } sample;               \
+    mixed_transfer_sample_to_##name(in, is, &sample.value, 0, volume);  \
+    ((uint##bits##_t *)out)[os] = __builtin_bswap##bits(sample.raw);    \
+  }
+
+DEF_MIXED_TRANSFER_SAMPLE_SWAPPED(int16, int16_t, 16)
+DEF_MIXED_TRANSFER_SAMPLE_SWAPPED(uint16, uint16_t, 16)
+DEF_MIXED_TRANSFER_SAMPLE_SWAPPED(int32, int32_t, 32)
+DEF_MIXED_TRANSFER_SAMPLE_SWAPPED(uint32, uint32_t, 32)
+DEF_MIXED_TRANSFER_SAMPLE_SWAPPED(float, float, 32)
+DEF_MIXED_TRANSFER_SAMPLE_SWAPPED(double, double, 64)
+DEF_MIXED_TRANSFER_SAMPLE_SWAPPED(float16, uint16_t, 16)
+DEF_MIXED_TRANSFER_SAMPLE_SWAPPED(bfloat16, uint16_t, 16)
+
+__attribute__((always_inline))
+static inline void mixed_transfer_sample_from_int24_be(void *in, uint32_t is, float *out, uint32_t os, float volume) {
+  int32_t sample = (((int8_t *)in)[3*is] << 16) + \
+                  (((uint8_t *)in)[3*is+1] << 8 ) + \
+                  (((uint8_t *)in)[3*is+2]);
+  out[os] = mixed_from_int24(sample) * volume;
+}
+
+__attribute__((always_inline))
+static inline void mixed_transfer_sample_from_uint24_be(void *in, uint32_t is, float *out, uint32_t os, float volume) {
+  uint8_t *data = (uint8_t *)in;
+  uint24_t sample = (data[3*is] << 16) + (data[3*is+1] << 8) + (data[3*is+2]);
+  out[os] = mixed_from_uint24(sample) * volume;
+}
+
+__attribute__((always_inline))
+static inline void mixed_transfer_sample_to_int24_be(float *in, uint32_t is, void *out, uint32_t os, float volume){
+  int24_t sample = mixed_to_int24(in[is] * volume);
+  ((uint8_t *)out)[3*os+0] = (sample >> 16) & 0xFF;
+  ((uint8_t *)out)[3*os+1] = (sample >>  8) & 0xFF;
+  ((uint8_t *)out)[3*os+2] = (sample >>  0) & 0xFF;
+}
+
+__attribute__((always_inline))
+static inline void mixed_transfer_sample_to_uint24_be(float *in, uint32_t is, void *out, uint32_t os, float volume){
+  uint24_t sample = mixed_to_uint24(in[is] * volume);
+  ((uint8_t *)out)[3*os+0] = (sample >> 16) & 0xFF;
+  ((uint8_t *)out)[3*os+1] = (sample >>  8) & 0xFF;
+  ((uint8_t *)out)[3*os+2] = (sample >>  0) & 0xFF;
+}
+
 //// Array transfer functions
 #define DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(datatype)             \
   VECTORIZE float mixed_transfer_array_from_alternating_##datatype(void *restrict in, float *restrict out, uint8_t stride, uint32_t samples, float volume, float target_volume) { \
@@ -92,6 +161,73 @@ extern inline void mixed_transfer_sample_to_uint24(float *in, uint32_t is, void
     return volume;                                                      \
   }
 
+// Without a change of volume there is nothing to check per sample.
+#define DEF_MIXED_TRANSFER_ARRAY_FROM_CONSTANT(datatype)                \
+  VECTORIZE static float mixed_transfer_array_from_constant_##datatype(void *restrict in, float *restrict out, uint8_t stride, uint32_t samples, float volume, float target_volume) { \
+    IGNORE(target_volume);                                              \
+    for(uint32_t sample=0; sample<samples; ++sample){                   \
+      mixed_transfer_sample_from_##datatype(in, sample*stride, out, sample, volume); \
+    }                                                                   \
+    return volume;                                                      \
+  }
+
+#define DEF_MIXED_TRANSFER_ARRAY_TO_CONSTANT(datatype)                  \
+  VECTORIZE static float mixed_transfer_array_to_constant_##datatype(float *restrict in, void *restrict out, uint8_t stride, uint32_t samples, float volume, float target_volume){ \
+    IGNORE(target_volume);                                              \
+    for(uint32_t sample=0; sample<samples; ++sample){                   \
+      mixed_transfer_sample_to_##datatype(in, sample, out, sample*stride, volume); \
+    }                                                                   \
+    return volume;                                                      \
+  }
+
+// Ramp linearly so that the last sample reaches the target volume.
+#define DEF_MIXED_TRANSFER_ARRAY_FROM_RAMP(datatype)                    \
+  VECTORIZE static float mixed_transfer_array_from_ramp_##datatype(void *restrict in, float *restrict out, uint8_t stride, uint32_t samples, float volume, float target_volume) { \
+    if(samples == 0) return volume;                                     \
+    float step = (target_volume - volume) / samples;                    \
+    for(uint32_t sample=0; sample<samples; ++sample){                   \
+      mixed_transfer_sample_from_##datatype(in, sample*stride, out, sample, volume + step*(sample+1)); \
+    }                                                                   \
+    return target_volume;                                               \
+  }
+
+#define DEF_MIXED_TRANSFER_ARRAY_TO_RAMP(datatype)                      \
+  VECTORIZE static float mixed_transfer_array_to_ramp_##datatype(float *restrict in, void *restrict out, uint8_t stride, uint32_t samples, float volume, float target_volume){ \
+    if(samples == 0) return volume;                                     \
+    float step = (target_volume - volume) / samples;                    \
+    for(uint32_t sample=0; sample<samples; ++sample){                   \
+      mixed_transfer_sample_to_##datatype(in, sample, out, sample*stride, volume + step*(sample+1)); \
+    }                                                                   \
+    return target_volume;                                               \
+  }
+
+#define DEF_MIXED_TRANSFER_ARRAY(kind)          \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(int8)         \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(uint8)        \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(int16)        \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(uint16)       \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(int24)        \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(uint24)       \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(int32)        \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(uint32)       \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(float)        \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(double)       \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(float16)      \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(bfloat16)
+
+// Single bytes have no order, so int8 and uint8 have no variants.
+#define DEF_MIXED_TRANSFER_ARRAY_BE(kind)       \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(int16_be)     \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(uint16_be)    \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(int24_be)     \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(uint24_be)    \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(int32_be)     \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(uint32_be)    \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(float_be)     \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(double_be)    \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(float16_be)   \
+  DEF_MIXED_TRANSFER_ARRAY_##kind(bfloat16_be)
+
 DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(int8)
 DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(uint8)
 DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(int16)
@@ -102,6 +238,8 @@ DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(int32)
 DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(uint32)
 DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(float)
 DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(double)
+DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(float16)
+DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(bfloat16)
 DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(int8)
 DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(uint8)
 DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(int16)
@@ -112,6 +250,48 @@ DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(int32)
 DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(uint32)
 DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(float)
 DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(double)
+DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(float16)
+DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(bfloat16)
+DEF_MIXED_TRANSFER_ARRAY(FROM_CONSTANT)
+DEF_MIXED_TRANSFER_ARRAY(TO_CONSTANT)
+DEF_MIXED_TRANSFER_ARRAY(FROM_RAMP)
+DEF_MIXED_TRANSFER_ARRAY(TO_RAMP)
+DEF_MIXED_TRANSFER_ARRAY_BE(FROM_ALTERNATING)
+DEF_MIXED_TRANSFER_ARRAY_BE(TO_ALTERNATING)
+DEF_MIXED_TRANSFER_ARRAY_BE(FROM_CONSTANT)
+DEF_MIXED_TRANSFER_ARRAY_BE(TO_CONSTANT)
+DEF_MIXED_TRANSFER_ARRAY_BE(FROM_RAMP)
+DEF_MIXED_TRANSFER_ARRAY_BE(TO_RAMP)
+
+#define MIXED_TRANSFER_ARRAY_TABLE(prefix)      \
+  { prefix##_int8,                              \
+    prefix##_uint8,                             \
+    prefix##_int16,                             \
+    prefix##_uint16,                            \
+    prefix##_int24,                             \
+    prefix##_uint24,                            \
+    prefix##_int32,                             \
+    prefix##_uint32,                            \
+    prefix##_float,                             \
+    prefix##_double,                            \
+    prefix##_float16,                           \
+    prefix##_bfloat16,                          \
+  }
+
+#define MIXED_TRANSFER_ARRAY_TABLE_BE(prefix)   \
+  { prefix##_int8,                              \
+    prefix##_uint8,                             \
+    prefix##_int16_be,                          \
+    prefix##_uint16_be,                         \
+    prefix##_int24_be,                          \
+    prefix##_uint24_be,                         \
+    prefix##_int32_be,                          \
+    prefix##_uint32_be,                         \
+    prefix##_float_be,                          \
+    prefix##_double_be,                         \
+    prefix##_float16_be,                        \
+    prefix##_bfloat16_be,                       \
+  }
 
 //// Buffer transfer functions
 static mixed_transfer_function_from transfer_array_functions_from[20] =
@@ -125,10 +305,43 @@ static mixed_transfer_function_from transfer_array_functions_from[20] =
     mixed_transfer_array_from_alternating_uint32,
     mixed_transfer_array_from_alternating_float,
     mixed_transfer_array_from_alternating_double,
+    mixed_transfer_array_from_alternating_float16,
+    mixed_transfer_array_from_alternating_bfloat16,
   };
 
+static mixed_transfer_function_from transfer_array_functions_from_constant[20] =
+  MIXED_TRANSFER_ARRAY_TABLE(mixed_transfer_array_from_constant);
+
+static mixed_transfer_function_from transfer_array_functions_from_ramp[20] =
+  MIXED_TRANSFER_ARRAY_TABLE(mixed_transfer_array_from_ramp);
+
+static mixed_transfer_function_from transfer_array_functions_from_be[20] =
+  MIXED_TRANSFER_ARRAY_TABLE_BE(mixed_transfer_array_from_alternating);
+
+static mixed_transfer_function_from transfer_array_functions_from_constant_be[20] =
+  MIXED_TRANSFER_ARRAY_TABLE_BE(mixed_transfer_array_from_constant);
+
+static mixed_transfer_function_from transfer_array_functions_from_ramp_be[20] =
+  MIXED_TRANSFER_ARRAY_TABLE_BE(mixed_transfer_array_from_ramp);
+
 MIXED_EXPORT mixed_transfer_function_from mixed_translator_from(enum mixed_encoding encoding){
-  return transfer_array_functions_from[encoding-1];
+  return transfer_array_functions_from[encoding_index(encoding)];
+}
+
+mixed_transfer_function_from transfer_function_from(struct mixed_pack *pack, float volume, float target_volume){
+  uint32_t index = encoding_index(pack->encoding);
+  if(pack->layout & MIXED_BIG_ENDIAN){
+    if(volume == target_volume)
+      return transfer_array_functions_from_constant_be[index];
+    if(pack->volume_mode == MIXED_VOLUME_RAMP)
+      return transfer_array_functions_from_ramp_be[index];
+    return transfer_array_functions_from_be[index];
+  }
+  if(volume == target_volume)
+    return transfer_array_functions_from_constant[index];
+  if(pack->volume_mode == MIXED_VOLUME_RAMP)
+    return transfer_array_functions_from_ramp[index];
+  return transfer_array_functions_from[index];
 }
 
 VECTORIZE MIXED_EXPORT int mixed_buffer_from_pack(struct mixed_pack *in, struct mixed_buffer **outs, float *volume, float target_volume){
@@ -144,14 +357,27 @@ VECTORIZE MIXED_EXPORT int mixed_buffer_from_pack(struct mixed_pack *in, struct
     mixed_buffer_request_write(&outd[i], &frames, outs[i]);
 
   if(0 < frames){
-    mixed_transfer_function_from fun = transfer_array_functions_from[in->encoding-1];
-    uint8_t size = mixed_samplesize(in->encoding);
     float vol = *volume;
+    mixed_transfer_function_from fun = transfer_function_from(in, vol, target_volume);
     // KLUDGE: this is not necessarily correct...
     *volume = target_volume;
-    for(int8_t c=0; c<channels; ++c){
-      fun(ind, outd[c], channels, frames, vol, target_volume);
-      ind += size;
+    if(in->layout & MIXED_PLANAR){
+      uint32_t plane = in->size / channels;
+      if(vol != target_volume || (in->layout & MIXED_BIG_ENDIAN)
+         || !transfer_planes_from(in->encoding, channels, plane, ind, outd, frames, vol)){
+        for(int8_t c=0; c<channels; ++c)
+          fun(ind + c*plane, outd[c], 1, frames, vol, target_volume);
+      }
+    }else{
+      // With a steady volume all channels can be converted in one pass.
+      if(vol != target_volume || (in->layout & MIXED_BIG_ENDIAN)
+         || !transfer_frames_from(in->encoding, channels, ind, outd, frames, vol)){
+        uint8_t size = mixed_samplesize(in->encoding);
+        for(int8_t c=0; c<channels; ++c){
+          fun(ind, outd[c], channels, frames, vol, target_volume);
+          ind += size;
+        }
+      }
     }
   }
 
@@ -173,10 +399,43 @@ static mixed_transfer_function_to transfer_array_functions_to[20] =
     mixed_transfer_array_to_alternating_uint32,
     mixed_transfer_array_to_alternating_float,
     mixed_transfer_array_to_alternating_double,
+    mixed_transfer_array_to_alternating_float16,
+    mixed_transfer_array_to_alternating_bfloat16,
   };
 
+static mixed_transfer_function_to transfer_array_functions_to_constant[20] =
+  MIXED_TRANSFER_ARRAY_TABLE(mixed_transfer_array_to_constant);
+
+static mixed_transfer_function_to transfer_array_functions_to_ramp[20] =
+  MIXED_TRANSFER_ARRAY_TABLE(mixed_transfer_array_to_ramp);
+
+static mixed_transfer_function_to transfer_array_functions_to_be[20] =
+  MIXED_TRANSFER_ARRAY_TABLE_BE(mixed_transfer_array_to_alternating);
+
+static mixed_transfer_function_to transfer_array_functions_to_constant_be[20] =
+  MIXED_TRANSFER_ARRAY_TABLE_BE(mixed_transfer_array_to_constant);
+
+static mixed_transfer_function_to transfer_array_functions_to_ramp_be[20] =
+  MIXED_TRANSFER_ARRAY_TABLE_BE(mixed_transfer_array_to_ramp);
+
 MIXED_EXPORT mixed_transfer_function_to mixed_translator_to(enum mixed_encoding encoding){
-  return transfer_array_functions_to[encoding-1];
+  return transfer_array_functions_to[encoding_index(encoding)];
+}
+
+mixed_transfer_function_to transfer_function_to(struct mixed_pack *pack, float volume, float target_volume){
+  uint32_t index = encoding_index(pack->encoding);
+  if(pack->layout & MIXED_BIG_ENDIAN){
+    if(volume == target_volume)
+      return transfer_array_functions_to_constant_be[index];
+    if(pack->volume_mode == MIXED_VOLUME_RAMP)
+      return transfer_array_functions_to_ramp_be[index];
+    return transfer_array_functions_to_be[index];
+  }
+  if(volume == target_volume)
+    return transfer_array_functions_to_constant[index];
+  if(pack->volume_mode == MIXED_VOLUME_RAMP)
+    return transfer_array_functions_to_ramp[index];
+  return transfer_array_functions_to[index];
 }
 
 VECTORIZE MIXED_EXPORT int mixed_buffer_to_pack(struct mixed_buffer **ins, struct mixed_pack *out, float *volume, float target_volume){
@@ -192,14 +451,27 @@ VECTORIZE MIXED_EXPORT int mixed_buffer_to_pack(struct mixed_buffer **ins, struc
     mixed_buffer_request_read(&ind[i], &frames, ins[i]);
 
   if(0 < frames){
-    mixed_transfer_function_to fun = transfer_array_functions_to[out->encoding-1];
-    uint8_t size = mixed_samplesize(out->encoding);
     float vol = *volume;
+    mixed_transfer_function_to fun = transfer_function_to(out, vol, target_volume);
     // KLUDGE: this is not necessarily correct...
     *volume = target_volume;
-    for(int8_t c=0; c<channels; ++c){
-      fun(ind[c], outd, channels, frames, vol, target_volume);
-      outd += size;
+    if(out->layout & MIXED_PLANAR){
+      uint32_t plane = out->size / channels;
+      if(vol != target_volume || (out->layout & MIXED_BIG_ENDIAN)
+         || !transfer_planes_to(out->encoding, channels, plane, ind, outd, frames, vol)){
+        for(int8_t c=0; c<channels; ++c)
+          fun(ind[c], outd + c*plane, 1, frames, vol, target_volume);
+      }
+    }else{
+      // With a steady volume all channels can be converted in one pass.
+      if(vol != target_volume || (out->layout & MIXED_BIG_ENDIAN)
+         || !transfer_frames_to(out->encoding, channels, ind, outd, frames, vol)){
+        uint8_t size = mixed_samplesize(out->encoding);
+        for(int8_t c=0; c<channels; ++c){
+          fun(ind[c], outd, channels, frames, vol, target_volume);
+          outd += size;
+        }
+      }
     }
   }
 
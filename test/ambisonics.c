@@ -0,0 +1,238 @@
+#define __TEST_SUITE ambisonics
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "tester.h"
+
+#define BLOCK_SIZE 256
+#define BUS_CHANNELS 16
+
+// Encode a constant signal from the location into a bus of the given order.
+static int encode(uint32_t order, float location[3], struct mixed_buffer *bus){
+  struct mixed_segment segment = {0};
+  struct mixed_buffer in = {0};
+  uint32_t attenuation = MIXED_NO_ATTENUATION;
+  uint32_t channels = (order+1)*(order+1);
+  int ok = 0;
+  if(!mixed_make_segment_ambisonic_encoder(order, &segment)
+     || !mixed_make_buffer(BLOCK_SIZE, &in)
+     || !mixed_segment_set(MIXED_SPACE_ATTENUATION, &attenuation, &segment)
+     || !mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment)
+     || !mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, location, &segment))
+    goto cleanup;
+  for(uint32_t c=0; c<channels; ++c){
+    if(!mixed_segment_set_out(MIXED_BUFFER, c, &bus[c], &segment))
+      goto cleanup;
+  }
+  float *data;
+  uint32_t samples = BLOCK_SIZE;
+  mixed_buffer_request_write(&data, &samples, &in);
+  for(uint32_t i=0; i<samples; ++i) data[i] = 1.0;
+  mixed_buffer_finish_write(samples, &in);
+  ok = mixed_segment_start(&segment) && mixed_segment_mix(&segment);
+ cleanup:
+  mixed_free_segment(&segment);
+  mixed_free_buffer(&in);
+  return ok;
+}
+
+// Encode the location at third order and decode it for the listener.
+static int render(float location[3], float direction[3], uint32_t speakers, float *level){
+  struct mixed_segment segment = {0};
+  struct mixed_buffer bus[BUS_CHANNELS] = {0}, out[MIXED_MAX_SPEAKER_COUNT] = {0};
+  int ok = 0;
+  for(uint32_t c=0; c<BUS_CHANNELS; ++c){
+    if(!mixed_make_buffer(BLOCK_SIZE, &bus[c])) goto cleanup;
+  }
+  if(!encode(3, location, bus)
+     || !mixed_make_segment_ambisonic_decoder(3, &segment)
+     || !mixed_segment_set(MIXED_OUT_COUNT, &speakers, &segment)
+     || !mixed_segment_set(MIXED_SPACE_DIRECTION, direction, &segment))
+    goto cleanup;
+  for(uint32_t c=0; c<BUS_CHANNELS; ++c){
+    if(!mixed_segment_set_in(MIXED_BUFFER, c, &bus[c], &segment))
+      goto cleanup;
+  }
+  for(uint32_t c=0; c<speakers; ++c){
+    if(!mixed_make_buffer(BLOCK_SIZE, &out[c])
+       || !mixed_segment_set_out(MIXED_BUFFER, c, &out[c], &segment))
+      goto cleanup;
+  }
+  if(!mixed_segment_start(&segment) || !mixed_segment_mix(&segment))
+    goto cleanup;
+  for(uint32_t c=0; c<speakers; ++c){
+    float *data;
+    uint32_t samples = UINT32_MAX;
+    mixed_buffer_request_read(&data, &samples, &out[c]);
+    if(samples != BLOCK_SIZE) goto cleanup;
+    level[c] = data[samples-1];
+  }
+  ok = 1;
+ cleanup:
+  mixed_free_segment(&segment);
+  for(uint32_t c=0; c<BUS_CHANNELS; ++c)
+    mixed_free_buffer(&bus[c]);
+  for(uint32_t c=0; c<MIXED_MAX_SPEAKER_COUNT; ++c)
+    mixed_free_buffer(&out[c]);
+  return ok;
+}
+
+static float bus_level(struct mixed_buffer *bus){
+  float *data;
+  uint32_t samples = UINT32_MAX;
+  mixed_buffer_request_read(&data, &samples, bus);
+  return data[0];
+}
+
+define_test(encode_first_order, {
+    struct mixed_buffer bus[4] = {0};
+    float front[3] = {0.0, 0.0, 1000.0};
+    float left[3] = {-1000.0, 0.0, 0.0};
+    float above[3] = {0.0, 1000.0, 0.0};
+    for(int c=0; c<4; ++c){
+      pass(mixed_make_buffer(BLOCK_SIZE, &bus[c]));
+    }
+    // The channels are W, Y (left), Z (up), X (front) in ACN order.
+    pass(encode(1, front, bus));
+    is_a(bus_level(&bus[0])*1000, 1000, 1);
+    is_a(bus_level(&bus[1])*1000, 0, 1);
+    is_a(bus_level(&bus[2])*1000, 0, 1);
+    is_a(bus_level(&bus[3])*1000, 1000, 1);
+    for(int c=0; c<4; ++c) mixed_buffer_clear(&bus[c]);
+    pass(encode(1, left, bus));
+    is_a(bus_level(&bus[1])*1000, 1000, 1);
+    is_a(bus_level(&bus[3])*1000, 0, 1);
+    for(int c=0; c<4; ++c) mixed_buffer_clear(&bus[c]);
+    pass(encode(1, above, bus));
+    is_a(bus_level(&bus[2])*1000, 1000, 1);
+  cleanup:
+    for(int c=0; c<4; ++c)
+      mixed_free_buffer(&bus[c]);
+  })
+
+define_test(invalid_order, {
+    struct mixed_segment segment = {0};
+    fail(mixed_make_segment_ambisonic_encoder(0, &segment));
+    fail(mixed_make_segment_ambisonic_encoder(4, &segment));
+    fail(mixed_make_segment_ambisonic_decoder(4, &segment));
+  cleanup:;
+  })
+
+define_test(speaker_directions, {
+    struct mixed_channel_configuration const *configuration = mixed_default_channel_configuration(8);
+    float forward[3] = {0.0, 0.0, 1.0};
+    float level[MIXED_MAX_SPEAKER_COUNT];
+    for(uint32_t c=0; c<configuration->count; ++c){
+      float position[3];
+      pass(mixed_default_speaker_position(position, configuration->positions[c]));
+      if(position[0] == 0.0 && position[1] == 0.0 && position[2] == 0.0) continue;
+      for(int i=0; i<3; ++i) position[i] *= 1000.0;
+      // A source in the direction of a speaker should be loudest on it.
+      pass(render(position, forward, configuration->count, level));
+      for(uint32_t o=0; o<configuration->count; ++o){
+        if(o != c && level[c] <= level[o])
+          fail_test("Channel %u is louder than channel %u", o, c);
+      }
+    }
+  cleanup:;
+  })
+
+define_test(rotation, {
+    float front[3] = {0.0, 0.0, 1000.0};
+    float forward[3] = {0.0, 0.0, 1.0};
+    float turned[3] = {-1.0, 0.0, 0.0};
+    float level[2];
+    pass(render(front, forward, 2, level));
+    is_a(level[0]*1000, level[1]*1000, 1);
+    // Turning to the left puts the source on the right.
+    pass(render(front, turned, 2, level));
+    if(level[1] <= level[0]*2)
+      fail_test("The source did not move to the right: %f %f", level[0], level[1]);
+  cleanup:;
+  })
+
+// A table of single taps in the four horizontal directions, where the
+// far ear only gets half the level.
+#define HRTF_FILE "ambisonics-test-hrtf.raw"
+#define HRTF_LENGTH 16
+static int write_hrtf(){
+  FILE *file = fopen(HRTF_FILE, "wb");
+  if(!file) return 0;
+  uint32_t header[5] = {0x5452484D, 1, 48000, 4, HRTF_LENGTH};
+  fwrite(header, sizeof(uint32_t), 5, file);
+  for(int d=0; d<4; ++d){
+    float angles[2] = {d*90.0f, 0.0f};
+    float ir[2][HRTF_LENGTH] = {{0}};
+    switch(d){
+    case 0: case 2: ir[0][0] = 1.0; ir[1][0] = 1.0; break;
+    case 1: ir[0][0] = 1.0; ir[1][0] = 0.5; break;
+    case 3: ir[0][0] = 0.5; ir[1][0] = 1.0; break;
+    }
+    fwrite(angles, sizeof(float), 2, file);
+    fwrite(ir, sizeof(float), 2*HRTF_LENGTH, file);
+  }
+  fclose(file);
+  return 1;
+}
+
+define_test(binaural, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer bus[BUS_CHANNELS] = {0}, out[2] = {0};
+    float left[3] = {-1000.0, 0.0, 0.0};
+    float back[3] = {0.0, 0.0, -1.0};
+    uint32_t samplerate = 44100;
+    pass(write_hrtf());
+    for(uint32_t c=0; c<BUS_CHANNELS; ++c)
+      pass(mixed_make_buffer(BLOCK_SIZE, &bus[c]));
+    pass(encode(3, left, bus));
+    pass(mixed_make_segment_ambisonic_decoder(3, &segment));
+    fail(mixed_segment_set(MIXED_SPACE_HRTF, "ambisonics-test-missing.raw", &segment));
+    // The responses are not resampled.
+    pass(mixed_segment_set(MIXED_SAMPLERATE, &samplerate, &segment));
+    fail(mixed_segment_set(MIXED_SPACE_HRTF, HRTF_FILE, &segment));
+    samplerate = 48000;
+    pass(mixed_segment_set(MIXED_SAMPLERATE, &samplerate, &segment));
+    pass(mixed_segment_set(MIXED_SPACE_HRTF, HRTF_FILE, &segment));
+    for(uint32_t c=0; c<BUS_CHANNELS; ++c)
+      pass(mixed_segment_set_in(MIXED_BUFFER, c, &bus[c], &segment));
+    for(uint32_t c=0; c<2; ++c){
+      pass(mixed_make_buffer(BLOCK_SIZE, &out[c]));
+      pass(mixed_segment_set_out(MIXED_BUFFER, c, &out[c], &segment));
+    }
+    pass(mixed_segment_start(&segment));
+    pass(mixed_segment_mix(&segment));
+    float *l, *r;
+    uint32_t samples = UINT32_MAX;
+    mixed_buffer_request_read(&l, &samples, &out[0]);
+    mixed_buffer_request_read(&r, &samples, &out[1]);
+    is(samples, BLOCK_SIZE);
+    // A source on the left is louder on the left ear, past the latency.
+    if(l[samples-1] < 0.01 || l[samples-1] <= r[samples-1]*1.2)
+      fail_test("The source is not on the left: %f %f", l[samples-1], r[samples-1]);
+    mixed_buffer_finish_read(samples, &out[0]);
+    mixed_buffer_finish_read(samples, &out[1]);
+    // Turning around puts the source on the right, once the turn has
+    // been interpolated across a block.
+    pass(mixed_segment_set(MIXED_SPACE_DIRECTION, back, &segment));
+    for(int i=0; i<2; ++i){
+      pass(encode(3, left, bus));
+      pass(mixed_segment_mix(&segment));
+      samples = UINT32_MAX;
+      mixed_buffer_request_read(&l, &samples, &out[0]);
+      mixed_buffer_request_read(&r, &samples, &out[1]);
+      is(samples, BLOCK_SIZE);
+      if(i == 0){
+        mixed_buffer_finish_read(samples, &out[0]);
+        mixed_buffer_finish_read(samples, &out[1]);
+      }
+    }
+    if(r[samples-1] < 0.01 || r[samples-1] <= l[samples-1]*1.2)
+      fail_test("The source is not on the right: %f %f", l[samples-1], r[samples-1]);
+  cleanup:
+    mixed_free_segment(&segment);
+    for(uint32_t c=0; c<BUS_CHANNELS; ++c)
+      mixed_free_buffer(&bus[c]);
+    mixed_free_buffer(&out[0]);
+    mixed_free_buffer(&out[1]);
+    remove(HRTF_FILE);
+  })
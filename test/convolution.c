@@ -0,0 +1,491 @@
+#define __TEST_SUITE convolution
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tester.h"
+
+#define FIR_SIZE 20000
+#define SIGNAL_SIZE 12000
+
+static float noise(uint32_t *state){
+  *state = *state * 1664525 + 1013904223;
+  return ((*state >> 8) / (float)(1 << 24)) * 2.0f - 1.0f;
+}
+
+static void make_fir(float *fir, uint32_t size, uint32_t seed){
+  uint32_t state = seed;
+  double sum = 0.0;
+  for(uint32_t i=0; i<size; ++i){
+    fir[i] = noise(&state) * expf(-(float)i/(size/4));
+    sum += fir[i]*fir[i];
+  }
+  for(uint32_t i=0; i<size; ++i)
+    fir[i] /= sqrt(sum);
+}
+
+static void make_signal(float *signal, uint32_t size){
+  uint32_t state = 7;
+  for(uint32_t i=0; i<size; ++i)
+    signal[i] = noise(&state);
+}
+
+static float direct_convolve(float *fir, uint32_t fir_size, float *signal, uint32_t t){
+  double sum = 0.0;
+  for(uint32_t k=0; k<fir_size && k<=t; ++k)
+    sum += fir[k] * signal[t-k];
+  return sum;
+}
+
+// Push the signal through the segment in odd block sizes.
+static int run_segment(struct mixed_segment *segment, float *signal, float *result, uint32_t size){
+  struct mixed_buffer in = {0}, out = {0};
+  uint32_t t = 0, o = 0;
+  int ok = 0;
+  if(!mixed_make_buffer(700, &in) || !mixed_make_buffer(700, &out)
+     || !mixed_segment_set_in(MIXED_BUFFER, 0, &in, segment)
+     || !mixed_segment_set_out(MIXED_BUFFER, 0, &out, segment)
+     || !mixed_segment_start(segment))
+    goto cleanup;
+  for(int i=0; o<size; ++i){
+    float *data;
+    uint32_t samples = 50 + (i*97)%600;
+    mixed_buffer_request_write(&data, &samples, &in);
+    for(uint32_t j=0; j<samples; ++j, ++t)
+      data[j] = (t < size)? signal[t] : 0.0f;
+    mixed_buffer_finish_write(samples, &in);
+    if(!mixed_segment_mix(segment)) goto cleanup;
+    samples = UINT32_MAX;
+    mixed_buffer_request_read(&data, &samples, &out);
+    for(uint32_t j=0; j<samples && o<size; ++j, ++o)
+      result[o] = data[j];
+    mixed_buffer_finish_read(samples, &out);
+  }
+  ok = mixed_segment_end(segment);
+ cleanup:
+  mixed_free_buffer(&in);
+  mixed_free_buffer(&out);
+  return ok;
+}
+
+// Compare against the direct convolution, which should be delayed by the
+// first partition. Returns the first sample that differs, -1 if none do,
+// or -2 if the segment failed.
+static long check_partitioned(bool background){
+  struct mixed_segment segment = {0};
+  enum mixed_convolution_mode mode = MIXED_CONVOLUTION_PARTITIONED;
+  uint32_t partition_size = 128;
+  float *fir = calloc(FIR_SIZE, sizeof(float));
+  float *signal = calloc(SIGNAL_SIZE, sizeof(float));
+  float *result = calloc(SIGNAL_SIZE, sizeof(float));
+  long bad = -2;
+  make_fir(fir, FIR_SIZE, 1);
+  make_signal(signal, SIGNAL_SIZE);
+  if(!mixed_make_segment_convolution(2048, fir, FIR_SIZE, 48000, &segment)
+     || !mixed_segment_set(MIXED_BACKGROUND_PROCESSING, &background, &segment)
+     || !mixed_segment_set(MIXED_CONVOLUTION_MODE, &mode, &segment)
+     || !mixed_segment_set(MIXED_PARTITION_SIZE, &partition_size, &segment)
+     || !run_segment(&segment, signal, result, SIGNAL_SIZE))
+    goto cleanup;
+  bad = -1;
+  for(uint32_t t=0; t<partition_size && bad < 0; ++t)
+    if(0.001 < fabs(result[t])) bad = t;
+  for(uint32_t t=partition_size; t<SIGNAL_SIZE && bad < 0; t+=7)
+    if(0.001 < fabs(result[t] - direct_convolve(fir, FIR_SIZE, signal, t-partition_size))) bad = t;
+ cleanup:
+  mixed_free_segment(&segment);
+  free(fir);
+  free(signal);
+  free(result);
+  return bad;
+}
+
+define_test(partitioned, {
+    is(check_partitioned(0), -1);
+  cleanup:;
+  })
+
+define_test(partitioned_background, {
+    is(check_partitioned(1), -1);
+  cleanup:;
+  })
+
+define_test(background_overruns, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    enum mixed_convolution_mode mode = MIXED_CONVOLUTION_PARTITIONED;
+    uint32_t fir_size = 1<<21, size = 4*48000, partition_size = 128, overruns = 1;
+    bool background = 1;
+    float *fir = calloc(fir_size, sizeof(float));
+    float *signal = calloc(size, sizeof(float));
+    float *data;
+    // A faint but very long tail, whose large partitions take the worker
+    // far longer than the mixing thread needs to push a few seconds through.
+    make_fir(fir, fir_size, 9);
+    for(uint32_t i=1; i<fir_size; ++i)
+      fir[i] *= 0.0001f;
+    fir[0] = 1.0f;
+    fir[fir_size-1] = 0.001f;
+    make_signal(signal, size);
+    pass(mixed_make_buffer(size, &in));
+    pass(mixed_make_buffer(size, &out));
+    pass(mixed_make_segment_convolution(2048, fir, fir_size, 48000, &segment));
+    pass(mixed_segment_get(MIXED_BACKGROUND_OVERRUNS, &overruns, &segment));
+    is(overruns, 0);
+    fail(mixed_segment_set(MIXED_BACKGROUND_OVERRUNS, &overruns, &segment));
+    pass(mixed_segment_set(MIXED_BACKGROUND_PROCESSING, &background, &segment));
+    pass(mixed_segment_set(MIXED_PARTITION_SIZE, &partition_size, &segment));
+    pass(mixed_segment_set(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &segment));
+    pass(mixed_segment_start(&segment));
+    pass(mixed_buffer_request_write(&data, &size, &in));
+    memcpy(data, signal, size*sizeof(float));
+    pass(mixed_buffer_finish_write(size, &in));
+    pass(mixed_segment_mix(&segment));
+    pass(mixed_segment_get(MIXED_BACKGROUND_OVERRUNS, &overruns, &segment));
+    if(overruns == 0) fail_test("The worker was never late");
+    // The head is unaffected by the late tail.
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &size, &out));
+    is(size, 4*48000);
+    for(uint32_t t=partition_size; t<size; t+=7)
+      is_a(data[t]*100, signal[t-partition_size]*100, 5);
+    pass(mixed_buffer_finish_read(size, &out));
+    pass(mixed_segment_end(&segment));
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+    free(fir);
+    free(signal);
+  })
+
+define_test(partition_size, {
+    struct mixed_segment segment = {0};
+    float fir[64] = {1};
+    uint32_t size = 100;
+    enum mixed_convolution_mode mode = MIXED_CONVOLUTION_PARTITIONED;
+    pass(mixed_make_segment_convolution(2048, fir, 64, 48000, &segment));
+    fail(mixed_segment_set(MIXED_PARTITION_SIZE, &size, &segment));
+    size = 8;
+    fail(mixed_segment_set(MIXED_PARTITION_SIZE, &size, &segment));
+    size = 256;
+    pass(mixed_segment_set(MIXED_PARTITION_SIZE, &size, &segment));
+    pass(mixed_segment_set(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    size = 0;
+    pass(mixed_segment_get(MIXED_PARTITION_SIZE, &size, &segment));
+    is(size, 256);
+    mode = 0;
+    pass(mixed_segment_get(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    is(mode, MIXED_CONVOLUTION_PARTITIONED);
+  cleanup:
+    mixed_free_segment(&segment);
+  })
+
+define_test(multi_output, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0}, out[2] = {0};
+    uint32_t t = 0, o = 0, fir_size = 5000, size = 6000;
+    float *firs = calloc(2*fir_size, sizeof(float));
+    float *signal = calloc(size, sizeof(float));
+    make_fir(firs, fir_size, 1);
+    make_fir(firs+fir_size, fir_size, 2);
+    make_signal(signal, size);
+    pass(mixed_make_buffer(500, &in));
+    pass(mixed_make_buffer(500, &out[0]));
+    pass(mixed_make_buffer(500, &out[1]));
+    pass(mixed_make_segment_multi_convolution(64, firs, fir_size, 2, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out[0], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 1, &out[1], &segment));
+    fail(mixed_segment_set_out(MIXED_BUFFER, 2, &out[1], &segment));
+    pass(mixed_segment_start(&segment));
+    for(int i=0; o<size; ++i){
+      float *data[2];
+      uint32_t samples = 30 + (i*53)%450;
+      pass(mixed_buffer_request_write(&data[0], &samples, &in));
+      for(uint32_t j=0; j<samples; ++j, ++t)
+        data[0][j] = (t < size)? signal[t] : 0.0f;
+      pass(mixed_buffer_finish_write(samples, &in));
+      pass(mixed_segment_mix(&segment));
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_read(&data[0], &samples, &out[0]));
+      pass(mixed_buffer_request_read(&data[1], &samples, &out[1]));
+      // Each output is convolved with its own FIR, delayed by the first partition.
+      for(uint32_t j=0; j<samples && o<size; ++j, ++o){
+        if(64 <= o && o%5 == 0){
+          is_a(data[0][j]*1000, direct_convolve(firs, fir_size, signal, o-64)*1000, 1);
+          is_a(data[1][j]*1000, direct_convolve(firs+fir_size, fir_size, signal, o-64)*1000, 1);
+        }
+      }
+      pass(mixed_buffer_finish_read(samples, &out[0]));
+      pass(mixed_buffer_finish_read(samples, &out[1]));
+    }
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out[0]);
+    mixed_free_buffer(&out[1]);
+    free(firs);
+    free(signal);
+  })
+
+define_test(windowed, {
+    struct mixed_segment segment = {0};
+    float fir[8] = {0, 0, 0, 0, 0, 0.5f};
+    uint32_t size = 20000;
+    float *signal = calloc(size, sizeof(float));
+    float *result = calloc(size, sizeof(float));
+    for(uint32_t t=0; t<size; ++t)
+      signal[t] = sinf(t*0.05f) + 0.5f*sinf(t*0.31f);
+    enum mixed_convolution_mode mode = MIXED_CONVOLUTION_WINDOWED;
+    pass(mixed_make_segment_convolution(512, fir, 8, 48000, &segment));
+    pass(mixed_segment_set(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    pass(run_segment(&segment, signal, result, size));
+    // A delayed impulse only shifts the signal, on top of the frame latency.
+    for(uint32_t t=2048; t<size; ++t)
+      is_a(result[t]*100, signal[t-512-5]*50, 1);
+  cleanup:
+    mixed_free_segment(&segment);
+    free(signal);
+    free(result);
+  })
+
+define_test(hot_swap, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0}, out = {0}, fir_buffer = {0};
+    enum mixed_convolution_mode mode = MIXED_CONVOLUTION_PARTITIONED;
+    float fir[1] = {1}, fade = 0.01, last = 0.0;
+    uint32_t o = 0;
+    pass(mixed_make_buffer(500, &in));
+    pass(mixed_make_buffer(500, &out));
+    pass(mixed_make_buffer(4, &fir_buffer));
+    pass(mixed_make_segment_convolution(2048, fir, 1, 48000, &segment));
+    pass(mixed_segment_set(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    pass(mixed_segment_set(MIXED_FADE_TIME, &fade, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &segment));
+    pass(mixed_segment_start(&segment));
+    for(int i=0; i<40; ++i){
+      float *data;
+      uint32_t samples = 100 + (i*61)%300;
+      if(i == 10){
+        // Swap to a quieter FIR mid-stream
+        uint32_t size = 1;
+        pass(mixed_buffer_request_write(&data, &size, &fir_buffer));
+        data[0] = 0.5;
+        pass(mixed_buffer_finish_write(1, &fir_buffer));
+        pass(mixed_segment_set(MIXED_FIR, &fir_buffer, &segment));
+      }
+      pass(mixed_buffer_request_write(&data, &samples, &in));
+      for(uint32_t j=0; j<samples; ++j)
+        data[j] = 1.0;
+      pass(mixed_buffer_finish_write(samples, &in));
+      pass(mixed_segment_mix(&segment));
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_read(&data, &samples, &out));
+      for(uint32_t j=0; j<samples; ++j, ++o){
+        // Past the start, the output must move smoothly from 1 to 0.5.
+        if(128 < o){
+          is_a(fabs(data[j]-last)*1000, 0, 2);
+          is_a(data[j]*1000, 750, 250);
+        }
+        last = data[j];
+      }
+      pass(mixed_buffer_finish_read(samples, &out));
+    }
+    is_a(last*1000, 500, 1);
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+    mixed_free_buffer(&fir_buffer);
+  })
+
+define_test(hot_swap_background, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0}, out = {0}, fir_buffer = {0};
+    enum mixed_convolution_mode mode = MIXED_CONVOLUTION_PARTITIONED;
+    uint32_t fir_size = 2048, partition_size = 128;
+    bool background = 1;
+    float fade = 0.01, last = 0.0;
+    float *fir = calloc(fir_size, sizeof(float));
+    // Long enough for the tail stages to run on the worker.
+    fir[0] = 1.0;
+    fir[fir_size-1] = 0.001;
+    pass(mixed_make_buffer(512, &in));
+    pass(mixed_make_buffer(512, &out));
+    pass(mixed_make_buffer(2*fir_size, &fir_buffer));
+    pass(mixed_make_segment_convolution(2048, fir, fir_size, 48000, &segment));
+    pass(mixed_segment_set(MIXED_BACKGROUND_PROCESSING, &background, &segment));
+    pass(mixed_segment_set(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    pass(mixed_segment_set(MIXED_PARTITION_SIZE, &partition_size, &segment));
+    pass(mixed_segment_set(MIXED_FADE_TIME, &fade, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &segment));
+    pass(mixed_segment_start(&segment));
+    for(int i=0; i<60; ++i){
+      float *data;
+      uint32_t samples = 512;
+      if(i == 20 || i == 40){
+        // Swap to half and back, retiring each old convolver after its fade.
+        float gain = (i == 20)? 0.5 : 1.0;
+        samples = fir_size;
+        pass(mixed_buffer_request_write(&data, &samples, &fir_buffer));
+        for(uint32_t j=0; j<fir_size; ++j)
+          data[j] = fir[j] * gain;
+        pass(mixed_buffer_finish_write(fir_size, &fir_buffer));
+        pass(mixed_segment_set(MIXED_FIR, &fir_buffer, &segment));
+        samples = UINT32_MAX;
+        pass(mixed_buffer_request_read(&data, &samples, &fir_buffer));
+        pass(mixed_buffer_finish_read(samples, &fir_buffer));
+        samples = 512;
+      }
+      pass(mixed_buffer_request_write(&data, &samples, &in));
+      for(uint32_t j=0; j<samples; ++j)
+        data[j] = 1.0;
+      pass(mixed_buffer_finish_write(samples, &in));
+      pass(mixed_segment_mix(&segment));
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_read(&data, &samples, &out));
+      if(0 < samples) last = data[samples-1];
+      if(i == 39) is_a(last*10000, 5005, 2);
+      pass(mixed_buffer_finish_read(samples, &out));
+    }
+    is_a(last*10000, 10010, 2);
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+    mixed_free_buffer(&fir_buffer);
+    free(fir);
+  })
+
+define_test(direct, {
+    struct mixed_segment segment = {0};
+    enum mixed_convolution_mode mode = 0;
+    float impulse[1] = {1};
+    float fir[40];
+    uint32_t size = 3000;
+    float *signal = calloc(size, sizeof(float));
+    float *result = calloc(size, sizeof(float));
+    make_fir(fir, 40, 3);
+    make_signal(signal, size);
+    // A single tap is always cheapest to convolve directly.
+    pass(mixed_make_segment_convolution(2048, impulse, 1, 48000, &segment));
+    pass(mixed_segment_get(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    is(mode, MIXED_CONVOLUTION_DIRECT);
+    mixed_free_segment(&segment);
+    mode = MIXED_CONVOLUTION_DIRECT;
+    pass(mixed_make_segment_convolution(2048, fir, 40, 48000, &segment));
+    pass(mixed_segment_set(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    pass(run_segment(&segment, signal, result, size));
+    // The output is exact and not delayed at all.
+    for(uint32_t t=0; t<size; ++t)
+      is_a(result[t]*10000, direct_convolve(fir, 40, signal, t)*10000, 1);
+  cleanup:
+    mixed_free_segment(&segment);
+    free(signal);
+    free(result);
+  })
+
+define_test(direct_crossover, {
+    struct mixed_segment segment = {0};
+    enum mixed_convolution_mode mode = 0;
+    float fir[200];
+    uint32_t crossover = 0;
+    make_fir(fir, 200, 5);
+    pass(mixed_make_segment_convolution(2048, fir, 200, 48000, &segment));
+    pass(mixed_segment_get(MIXED_DIRECT_CROSSOVER, &crossover, &segment));
+    is(crossover, 128);
+    pass(mixed_segment_get(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    is(mode, MIXED_CONVOLUTION_WINDOWED);
+    crossover = 256;
+    pass(mixed_segment_set(MIXED_DIRECT_CROSSOVER, &crossover, &segment));
+    pass(mixed_segment_get(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    is(mode, MIXED_CONVOLUTION_DIRECT);
+    // An explicitly set mode is kept.
+    mode = MIXED_CONVOLUTION_PARTITIONED;
+    pass(mixed_segment_set(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    crossover = 16;
+    pass(mixed_segment_set(MIXED_DIRECT_CROSSOVER, &crossover, &segment));
+    pass(mixed_segment_get(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    is(mode, MIXED_CONVOLUTION_PARTITIONED);
+  cleanup:
+    mixed_free_segment(&segment);
+  })
+
+define_test(automatic_fir_swap, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer fir_buffer = {0};
+    enum mixed_convolution_mode mode = 0;
+    float fir[40];
+    float *data;
+    uint32_t size = 4800;
+    make_fir(fir, 40, 3);
+    pass(mixed_make_buffer(size, &fir_buffer));
+    pass(mixed_make_segment_convolution(2048, fir, 40, 48000, &segment));
+    pass(mixed_segment_get(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    is(mode, MIXED_CONVOLUTION_DIRECT);
+    // A long FIR is past the crossover and leaves the direct mode.
+    pass(mixed_buffer_request_write(&data, &size, &fir_buffer));
+    make_fir(data, size, 4);
+    pass(mixed_buffer_finish_write(size, &fir_buffer));
+    pass(mixed_segment_set(MIXED_FIR, &fir_buffer, &segment));
+    pass(mixed_segment_get(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    is(mode, MIXED_CONVOLUTION_WINDOWED);
+    // And a short one returns to it.
+    pass(mixed_buffer_finish_read(size, &fir_buffer));
+    size = 40;
+    pass(mixed_buffer_request_write(&data, &size, &fir_buffer));
+    memcpy(data, fir, 40*sizeof(float));
+    pass(mixed_buffer_finish_write(40, &fir_buffer));
+    pass(mixed_segment_set(MIXED_FIR, &fir_buffer, &segment));
+    pass(mixed_segment_get(MIXED_CONVOLUTION_MODE, &mode, &segment));
+    is(mode, MIXED_CONVOLUTION_DIRECT);
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&fir_buffer);
+  })
+
+define_test(in_place_mix, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    enum mixed_convolution_mode modes[] = {MIXED_CONVOLUTION_PARTITIONED, MIXED_CONVOLUTION_WINDOWED, MIXED_CONVOLUTION_DIRECT};
+    float fir[1] = {0.5}, mix = 0.5;
+    pass(mixed_make_buffer(1000, &in));
+    // The output shares its storage with the input, as in a chain.
+    out._data = in._data;
+    out.size = in.size;
+    out.is_virtual = 1;
+    for(uint32_t m=0; m<3; ++m){
+      float last = 0.0;
+      pass(mixed_make_segment_convolution(512, fir, 1, 48000, &segment));
+      pass(mixed_segment_set(MIXED_CONVOLUTION_MODE, &modes[m], &segment));
+      pass(mixed_segment_set(MIXED_MIX, &mix, &segment));
+      pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+      pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &segment));
+      pass(mixed_segment_start(&segment));
+      for(int i=0; i<20; ++i){
+        float *data;
+        uint32_t samples = 500;
+        pass(mixed_buffer_request_write(&data, &samples, &in));
+        for(uint32_t j=0; j<samples; ++j)
+          data[j] = 1.0;
+        pass(mixed_buffer_finish_write(samples, &in));
+        pass(mixed_segment_mix(&segment));
+        samples = UINT32_MAX;
+        pass(mixed_buffer_request_read(&data, &samples, &out));
+        last = data[samples-1];
+        pass(mixed_buffer_finish_read(samples, &out));
+      }
+      // Half of the dry signal and half of the halved wet signal.
+      is_a(last*1000, 750, 5);
+      pass(mixed_segment_end(&segment));
+      mixed_free_segment(&segment);
+    }
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+  })
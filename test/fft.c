@@ -0,0 +1,161 @@
+#define __TEST_SUITE fft
+#include <math.h>
+#include <pthread.h>
+#include "tester.h"
+
+define_test(roundtrip, {
+    struct mixed_buffer buffer = {0};
+    float original[512];
+    pass(mixed_make_buffer(512, &buffer));
+    float *data = buffer._data;
+    for(uint32_t i=0; i<512; ++i)
+      original[i] = data[i] = sinf(i*0.1f) + 0.5f*cosf(i*0.37f);
+    pass(mixed_fwd_fft(512, data, data));
+    pass(mixed_inv_fft(512, data, data));
+    for(uint32_t i=0; i<512; ++i)
+      is_a(data[i]/512*1000, original[i]*1000, 1);
+  cleanup:
+    mixed_free_buffer(&buffer);
+  })
+
+define_test(real_packing, {
+    struct mixed_buffer buffer = {0};
+    pass(mixed_make_buffer(256, &buffer));
+    float *data = buffer._data;
+    // DC offset, a cosine at bin 8, and a nyquist alternation
+    for(uint32_t i=0; i<256; ++i)
+      data[i] = 0.25f + cosf(2*M_PI*8*i/256) + ((i%2)? -0.5f : 0.5f);
+    pass(mixed_fwd_fft(256, data, data));
+    is_a(data[0], 0.25*256, 1);
+    is_a(data[1], 0.5*256, 1);
+    is_a(data[2*8], 0.5*256, 1);
+    is_a(data[2*8+1], 0, 1);
+    is_a(data[2*9], 0, 1);
+    fail(mixed_fwd_fft(16, data, data));
+  cleanup:
+    mixed_free_buffer(&buffer);
+  })
+
+define_test(prepare, {
+    pass(mixed_prepare_fft(1024));
+    pass(mixed_prepare_fft(1024));
+    fail(mixed_prepare_fft(100));
+    fail(mixed_prepare_fft(1<<20));
+  cleanup:;
+  })
+
+static void *fft_thread(void *arg){
+  float *data = (float *)arg;
+  for(int i=0; i<100; ++i){
+    if(!mixed_fwd_fft(8192, data, data) || !mixed_inv_fft(8192, data, data))
+      return (void *)1;
+    for(uint32_t k=0; k<8192; ++k)
+      data[k] /= 8192;
+  }
+  return 0;
+}
+
+define_test(concurrent, {
+    struct mixed_buffer buffers[4] = {0};
+    pthread_t threads[4];
+    void *result;
+    for(int t=0; t<4; ++t){
+      pass(mixed_make_buffer(8192, &buffers[t]));
+      for(uint32_t i=0; i<8192; ++i)
+        buffers[t]._data[i] = sinf(i*0.01f*(t+1));
+    }
+    for(int t=0; t<4; ++t)
+      is(pthread_create(&threads[t], 0, fft_thread, buffers[t]._data), 0);
+    for(int t=0; t<4; ++t){
+      is(pthread_join(threads[t], &result), 0);
+      is_p(result, 0);
+    }
+    for(int t=0; t<4; ++t)
+      for(uint32_t i=0; i<8192; ++i)
+        is_a(buffers[t]._data[i]*1000, sinf(i*0.01f*(t+1))*1000, 1);
+  cleanup:
+    for(int t=0; t<4; ++t)
+      mixed_free_buffer(&buffers[t]);
+  })
+
+static float window_rms(enum mixed_fft_window window){
+  struct mixed_buffer in = {0}, out = {0};
+  struct mixed_segment eq = {0};
+  float bands[8] = {1, 1, 1, 1, 1, 1, 1, 1};
+  double sum = 0.0;
+  uint32_t count = 0, t = 0;
+  if(!mixed_make_buffer(512, &in) || !mixed_make_buffer(512, &out)
+     || !mixed_make_segment_equalizer(bands, 48000, &eq)
+     || !mixed_segment_set(MIXED_FFT_WINDOW, &window, &eq)
+     || !mixed_segment_set_in(MIXED_BUFFER, 0, &in, &eq)
+     || !mixed_segment_set_out(MIXED_BUFFER, 0, &out, &eq)
+     || !mixed_segment_start(&eq))
+    goto cleanup;
+  for(int i=0; i<64; ++i){
+    float *data;
+    uint32_t samples = UINT32_MAX;
+    mixed_buffer_request_write(&data, &samples, &in);
+    for(uint32_t j=0; j<samples; ++j, ++t)
+      data[j] = sinf(t*2*M_PI*440/48000);
+    mixed_buffer_finish_write(samples, &in);
+    mixed_segment_mix(&eq);
+    samples = UINT32_MAX;
+    mixed_buffer_request_read(&data, &samples, &out);
+    // Skip the startup latency
+    if(16 <= i){
+      for(uint32_t j=0; j<samples; ++j)
+        sum += data[j]*data[j];
+      count += samples;
+    }
+    mixed_buffer_finish_read(samples, &out);
+  }
+ cleanup:
+  mixed_free_segment(&eq);
+  mixed_free_buffer(&in);
+  mixed_free_buffer(&out);
+  return (count == 0)? 0.0 : sqrt(sum/count);
+}
+
+define_test(window_gain, {
+    // A flat equalizer should leave the signal level (1/sqrt(2)) intact.
+    is_a(window_rms(MIXED_HANN_WINDOW)*100, 71, 2);
+    is_a(window_rms(MIXED_HAMMING_WINDOW)*100, 71, 2);
+    is_a(window_rms(MIXED_BLACKMAN_HARRIS_WINDOW)*100, 71, 2);
+    is_a(window_rms(MIXED_SQRT_HANN_WINDOW)*100, 71, 2);
+  cleanup:;
+  })
+
+define_test(window_latency, {
+    struct mixed_buffer in = {0}, out = {0};
+    struct mixed_segment eq = {0};
+    float bands[8] = {1, 1, 1, 1, 1, 1, 1, 1};
+    uint32_t t = 0, o = 0;
+    pass(mixed_make_buffer(300, &in));
+    pass(mixed_make_buffer(300, &out));
+    pass(mixed_make_segment_equalizer(bands, 48000, &eq));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &eq));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &eq));
+    pass(mixed_segment_start(&eq));
+    // Odd block sizes to cross hop boundaries mid-block
+    for(int i=0; i<64; ++i){
+      float *data;
+      uint32_t samples = 100 + (i*37)%200;
+      pass(mixed_buffer_request_write(&data, &samples, &in));
+      for(uint32_t j=0; j<samples; ++j, ++t)
+        data[j] = sinf(t*0.05f);
+      pass(mixed_buffer_finish_write(samples, &in));
+      pass(mixed_segment_mix(&eq));
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_read(&data, &samples, &out));
+      // The output is delayed by a full default frame of 2048 samples
+      for(uint32_t j=0; j<samples; ++j, ++o){
+        if(4096 <= o)
+          is_a(data[j]*100, sinf((o-2048)*0.05f)*100, 1);
+      }
+      pass(mixed_buffer_finish_read(samples, &out));
+    }
+  cleanup:
+    mixed_free_segment(&eq);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
@@ -186,5 +186,156 @@ define_test(dual_channel_resample_in_out, {
     mixed_free_pack(&pack_i);
     mixed_free_pack(&pack_o);
   })
+
+define_test(planar_resample_in_out, {
+    struct mixed_pack pack_i = {0};
+    struct mixed_pack pack_o = {0};
+    struct mixed_buffer l = {0}, r = {0};
+    struct mixed_segment unpacker = {0};
+    struct mixed_segment packer = {0};
+    // Allocate stuff
+    pack_i.layout = MIXED_PLANAR | MIXED_BIG_ENDIAN;
+    pack_o.layout = MIXED_PLANAR;
+    pass(make_pack(MIXED_INT16, 2, &pack_i));
+    pass(make_pack(MIXED_FLOAT, 2, &pack_o));
+    pass(mixed_make_buffer(500, &l));
+    pass(mixed_make_buffer(500, &r));
+    pass(mixed_make_segment_unpacker(&pack_i, 44100, &unpacker));
+    pass(mixed_make_segment_packer(&pack_o, 44100, &packer));
+    // Set quality so we get predictable results
+    enum mixed_resample_type quality = MIXED_SINC_BEST_QUALITY;
+    pass(mixed_segment_set(MIXED_RESAMPLE_TYPE, &quality, &unpacker));
+    pass(mixed_segment_set(MIXED_RESAMPLE_TYPE, &quality, &packer));
+    // Connect the buffers
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &l, &unpacker));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_LEFT, &l, &packer));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &r, &unpacker));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_RIGHT, &r, &packer));
+    // Fill data, a slow ramp on the left and a constant on the right.
+    unsigned char *data_i = pack_i._data;
+    float *data_o = (float *)pack_o._data;
+    for(uint32_t i=0; i<500; ++i){
+      int16_t left = i*20, right = 3200;
+      data_i[2*i] = (left >> 8) & 0xFF;
+      data_i[2*i+1] = left & 0xFF;
+      data_i[1000+2*i] = (right >> 8) & 0xFF;
+      data_i[1000+2*i+1] = right & 0xFF;
+    }
+    mixed_pack_clear(&pack_o);
+    // Run
+    pass(mixed_segment_start(&unpacker));
+    pass(mixed_segment_start(&packer));
+    pass(mixed_segment_mix(&unpacker));
+    pass(mixed_segment_mix(&packer));
+    // Check for expected
+    uint32_t frames = mixed_pack_available_read(&pack_o)/(2*sizeof(float));
+    is(0 < frames, 1);
+    for(uint32_t i=10; i<frames; ++i){
+      is(fabs(data_o[i]-(i*20)/32767.0) < 0.005, 1);
+      is(fabs(data_o[500+i]-3200/32767.0) < 0.005, 1);
+    }
+
+  cleanup:
+    mixed_free_segment(&packer);
+    mixed_free_segment(&unpacker);
+    mixed_free_buffer(&l);
+    mixed_free_buffer(&r);
+    mixed_free_pack(&pack_i);
+    mixed_free_pack(&pack_o);
+  })
+
+define_test(planar_views, {
+    struct mixed_pack pack = {0};
+    struct mixed_buffer l = {0}, r = {0};
+    struct mixed_segment unpacker = {0};
+    float *plane, *area;
+    uint32_t size;
+    // Allocate stuff
+    pack.layout = MIXED_PLANAR;
+    pass(make_pack(MIXED_FLOAT, 2, &pack));
+    pass(mixed_make_segment_unpacker(&pack, pack.samplerate, &unpacker));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &l, &unpacker));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &r, &unpacker));
+    plane = (float *)pack._data;
+    for(uint32_t i=0; i<1000; ++i)
+      plane[i] = (i < 500)? 0.25f : 1.5f;
+    // The buffers read from the planes directly.
+    pass(mixed_segment_start(&unpacker));
+    is(l._data == plane, 1);
+    is(r._data == plane+500, 1);
+    pass(mixed_segment_mix(&unpacker));
+    is(mixed_buffer_available_read(&l), 500);
+    is(mixed_buffer_available_read(&r), 500);
+    // Samples are not touched at unity volume.
+    is_f(r._data[0], 1.5f);
+    // Only what both readers are done with is consumed.
+    size = 100;
+    pass(mixed_buffer_request_read(&area, &size, &l));
+    pass(mixed_buffer_finish_read(100, &l));
+    pass(mixed_segment_mix(&unpacker));
+    is(mixed_pack_available_read(&pack), 500*2*sizeof(float));
+    is(mixed_buffer_available_read(&l), 500);
+    size = 100;
+    pass(mixed_buffer_request_read(&area, &size, &l));
+    pass(mixed_buffer_finish_read(100, &l));
+    size = 100;
+    pass(mixed_buffer_request_read(&area, &size, &r));
+    pass(mixed_buffer_finish_read(100, &r));
+    pass(mixed_segment_mix(&unpacker));
+    is(mixed_pack_available_read(&pack), 400*2*sizeof(float));
+    is(mixed_buffer_available_read(&r), 400);
+    // A volume change is applied in place to new samples.
+    float volume = 0.5f;
+    enum mixed_volume_mode mode = MIXED_VOLUME_RAMP;
+    pass(mixed_segment_set(MIXED_VOLUME, &volume, &unpacker));
+    pass(mixed_segment_set(MIXED_VOLUME_MODE, &mode, &unpacker));
+    size = UINT32_MAX;
+    pass(mixed_pack_request_write((void **)&area, &size, &pack));
+    is(size, 100*2*sizeof(float));
+    is(area == plane, 1);
+    for(uint32_t i=0; i<100; ++i){
+      area[i] = 0.5f;
+      area[500+i] = -0.5f;
+    }
+    pass(mixed_pack_finish_write(size, &pack));
+    size = 400;
+    pass(mixed_buffer_request_read(&area, &size, &l));
+    pass(mixed_buffer_finish_read(400, &l));
+    size = 400;
+    pass(mixed_buffer_request_read(&area, &size, &r));
+    pass(mixed_buffer_finish_read(400, &r));
+    pass(mixed_segment_mix(&unpacker));
+    is(mixed_buffer_available_read(&l), 100);
+    is(l._data == plane, 1);
+    for(uint32_t i=0; i<100; ++i){
+      float expected = 0.5f * (1.0f - 0.5f * (i+1) / 100);
+      is_a(l._data[i]*1000000, expected*1000000, 1);
+      is_a(r._data[i]*1000000, -expected*1000000, 1);
+    }
+
+  cleanup:
+    mixed_free_segment(&unpacker);
+    mixed_free_buffer(&l);
+    mixed_free_buffer(&r);
+    mixed_free_pack(&pack);
+  })
   
 #undef __TEST_SUITE
+
+define_test(encoding_values, {
+    struct mixed_pack pack = {0};
+    struct mixed_segment segment = {0};
+    // The 16 bit floats lie outside of the contiguous range.
+    pass(make_pack(MIXED_DOUBLE+1, 1, &pack));
+    fail(mixed_make_segment_unpacker(&pack, pack.samplerate, &segment));
+    mixed_free_pack(&pack);
+    pass(make_pack(MIXED_BFLOAT16, 1, &pack));
+    pass(mixed_make_segment_unpacker(&pack, pack.samplerate, &segment));
+    mixed_free_segment(&segment);
+    mixed_free_pack(&pack);
+    pass(make_pack(MIXED_FLOAT16, 1, &pack));
+    pass(mixed_make_segment_packer(&pack, pack.samplerate, &segment));
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_pack(&pack);
+  })
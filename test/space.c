@@ -0,0 +1,649 @@
+#define __TEST_SUITE space
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tester.h"
+
+#define SAMPLERATE 48000
+#define SIGNAL_SIZE 16384
+#define BLOCK_SIZE 512
+
+static void make_sine(float *signal, uint32_t size, float frequency){
+  for(uint32_t i=0; i<size; ++i)
+    signal[i] = sinf(2.0f*M_PI*frequency*i/SAMPLERATE);
+}
+
+// Mix the source in the first input and sum up all output channels.
+static int run_space_mixer(struct mixed_segment *segment, struct mixed_buffer *in, float *signal, float *result, uint32_t size){
+  struct mixed_buffer left = {0}, right = {0};
+  int ok = 0;
+  if(!mixed_make_buffer(BLOCK_SIZE, &left)
+     || !mixed_make_buffer(BLOCK_SIZE, &right)
+     || !mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &left, segment)
+     || !mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &right, segment)
+     || !mixed_segment_start(segment))
+    goto cleanup;
+  for(uint32_t t=0; t<size; t+=BLOCK_SIZE){
+    float *data, *l, *r;
+    uint32_t samples = BLOCK_SIZE;
+    mixed_buffer_request_write(&data, &samples, in);
+    memcpy(data, signal+t, samples*sizeof(float));
+    mixed_buffer_finish_write(samples, in);
+    if(!mixed_segment_mix(segment)) goto cleanup;
+    samples = UINT32_MAX;
+    mixed_buffer_request_read(&l, &samples, &left);
+    mixed_buffer_request_read(&r, &samples, &right);
+    for(uint32_t i=0; i<samples; ++i)
+      result[t+i] = l[i] + r[i];
+    mixed_buffer_finish_read(samples, &left);
+    mixed_buffer_finish_read(samples, &right);
+  }
+  ok = mixed_segment_end(segment);
+ cleanup:
+  mixed_free_buffer(&left);
+  mixed_free_buffer(&right);
+  return ok;
+}
+
+// Estimate the frequency from the rising zero crossings within the range.
+static float measure_frequency(float *signal, uint32_t start, uint32_t end){
+  float first = -1.0, last = -1.0;
+  uint32_t crossings = 0;
+  for(uint32_t i=start; i+1<end; ++i){
+    if(signal[i] <= 0.0 && 0.0 < signal[i+1]){
+      float t = i + signal[i] / (signal[i] - signal[i+1]);
+      if(first < 0.0) first = t;
+      else ++crossings;
+      last = t;
+    }
+  }
+  if(crossings == 0) return 0.0;
+  return crossings * SAMPLERATE / (last - first);
+}
+
+define_test(stationary, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0};
+    float location[3] = {0.0, 0.0, 1000.0};
+    float *signal = calloc(SIGNAL_SIZE, sizeof(float));
+    float *result = calloc(SIGNAL_SIZE, sizeof(float));
+    make_sine(signal, SIGNAL_SIZE, 1000.0);
+    pass(mixed_make_segment_space_mixer(SAMPLERATE, &segment));
+    pass(mixed_make_buffer(BLOCK_SIZE, &in));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, location, &segment));
+    // Without doppler the source must come out undelayed and unchanged.
+    pass(run_space_mixer(&segment, &in, signal, result, SIGNAL_SIZE));
+    float gain = result[12] / signal[12];
+    for(uint32_t i=0; i<SIGNAL_SIZE; ++i){
+      if(0.0001 < fabs(result[i] - gain*signal[i]))
+        fail_test("Sample %u was %f but should have been %f", i, result[i], gain*signal[i]);
+    }
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    free(signal);
+    free(result);
+  })
+
+define_test(doppler, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0};
+    float doppler_factor = 1.0;
+    float location[3] = {0.0, 0.0, 2500.0};
+    float velocity[3] = {0.0, 0.0, -3433.0};
+    float *signal = calloc(SIGNAL_SIZE, sizeof(float));
+    float *result = calloc(SIGNAL_SIZE, sizeof(float));
+    make_sine(signal, SIGNAL_SIZE, 1000.0);
+    pass(mixed_make_segment_space_mixer(SAMPLERATE, &segment));
+    pass(mixed_make_buffer(BLOCK_SIZE, &in));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set(MIXED_SPACE_DOPPLER_FACTOR, &doppler_factor, &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, location, &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_VELOCITY, 0, velocity, &segment));
+    pass(run_space_mixer(&segment, &in, signal, result, SIGNAL_SIZE));
+    // Approaching at a tenth of the speed of sound raises the pitch by 34330/(34330-3433).
+    float frequency = measure_frequency(result, 4096, SIGNAL_SIZE);
+    if(20.0 < fabs(frequency - 1111.1))
+      fail_test("Frequency was %f but should have been 1111.1", frequency);
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    free(signal);
+    free(result);
+  })
+
+define_test(doppler_propagation, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0};
+    float doppler_factor = 1.0;
+    bool propagation = 1;
+    // A tenth of a second away from the listener.
+    float location[3] = {0.0, 0.0, 3433.0};
+    float *signal = calloc(SIGNAL_SIZE, sizeof(float));
+    float *result = calloc(SIGNAL_SIZE, sizeof(float));
+    make_sine(signal, SIGNAL_SIZE, 1000.0);
+    pass(mixed_make_segment_space_mixer(SAMPLERATE, &segment));
+    pass(mixed_make_buffer(BLOCK_SIZE, &in));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set(MIXED_SPACE_DOPPLER_FACTOR, &doppler_factor, &segment));
+    pass(mixed_segment_set(MIXED_SPACE_PROPAGATION_DELAY, &propagation, &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, location, &segment));
+    pass(run_space_mixer(&segment, &in, signal, result, SIGNAL_SIZE));
+    // The source is heard after its propagation delay, at its pitch.
+    uint32_t onset = 0;
+    while(onset < SIGNAL_SIZE && fabs(result[onset]) < 0.0001) ++onset;
+    is_a(onset, SAMPLERATE/10, 4);
+    float frequency = measure_frequency(result, SAMPLERATE/10+64, SIGNAL_SIZE);
+    if(2.0 < fabs(frequency - 1000.0))
+      fail_test("Frequency was %f but should have been 1000.0", frequency);
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    free(signal);
+    free(result);
+  })
+
+define_test(doppler_base_delay, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0};
+    float doppler_factor = 1.0;
+    bool propagation = 1;
+    // Much further away than the short line could hold.
+    float location[3] = {0.0, 0.0, 50000.0};
+    float *signal = calloc(SIGNAL_SIZE, sizeof(float));
+    float *result = calloc(SIGNAL_SIZE, sizeof(float));
+    make_sine(signal, SIGNAL_SIZE, 1000.0);
+    pass(mixed_make_segment_space_mixer(SAMPLERATE, &segment));
+    pass(mixed_segment_get(MIXED_SPACE_PROPAGATION_DELAY, &propagation, &segment));
+    is(propagation, 0);
+    pass(mixed_make_buffer(BLOCK_SIZE, &in));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set(MIXED_SPACE_DOPPLER_FACTOR, &doppler_factor, &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, location, &segment));
+    pass(run_space_mixer(&segment, &in, signal, result, SIGNAL_SIZE));
+    // Without the propagation delay only the base delay in the middle of the line remains.
+    uint32_t onset = 0;
+    while(onset < SIGNAL_SIZE && fabs(result[onset]) < 0.0001) ++onset;
+    is_a(onset, 4096, 4);
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    free(signal);
+    free(result);
+  })
+
+#define SOURCE_COUNT 150
+#define MAX_CHANNELS 8
+
+// Mix one block of constant signal from the given sources and return the output levels.
+static int mix_sources(uint32_t channels, uint32_t threads, float locations[][3], uint32_t *indices, uint32_t count, float *level){
+  struct mixed_segment segment = {0};
+  struct mixed_buffer in[SOURCE_COUNT] = {0}, out[MAX_CHANNELS] = {0};
+  int ok = 0;
+  if(!mixed_make_segment_space_mixer(SAMPLERATE, &segment)) return 0;
+  if(!mixed_segment_set(MIXED_OUT_COUNT, &channels, &segment)
+     || !mixed_segment_set(MIXED_THREAD_COUNT, &threads, &segment))
+    goto cleanup;
+  for(uint32_t c=0; c<channels; ++c){
+    if(!mixed_make_buffer(BLOCK_SIZE, &out[c])
+       || !mixed_segment_set_out(MIXED_BUFFER, c, &out[c], &segment))
+      goto cleanup;
+  }
+  for(uint32_t i=0; i<count; ++i){
+    uint32_t s = indices[i];
+    float *data;
+    uint32_t samples = BLOCK_SIZE;
+    if(!mixed_make_buffer(BLOCK_SIZE, &in[s])
+       || !mixed_segment_set_in(MIXED_BUFFER, s, &in[s], &segment)
+       || !mixed_segment_set_in(MIXED_SPACE_LOCATION, s, locations[s], &segment))
+      goto cleanup;
+    mixed_buffer_request_write(&data, &samples, &in[s]);
+    for(uint32_t j=0; j<samples; ++j) data[j] = 1.0;
+    mixed_buffer_finish_write(samples, &in[s]);
+  }
+  if(!mixed_segment_start(&segment) || !mixed_segment_mix(&segment))
+    goto cleanup;
+  for(uint32_t c=0; c<channels; ++c){
+    float *data;
+    uint32_t samples = UINT32_MAX;
+    mixed_buffer_request_read(&data, &samples, &out[c]);
+    if(samples != BLOCK_SIZE) goto cleanup;
+    level[c] = data[0];
+  }
+  ok = 1;
+ cleanup:
+  mixed_free_segment(&segment);
+  for(uint32_t s=0; s<SOURCE_COUNT; ++s)
+    mixed_free_buffer(&in[s]);
+  for(uint32_t c=0; c<MAX_CHANNELS; ++c)
+    mixed_free_buffer(&out[c]);
+  return ok;
+}
+
+define_test(many_sources, {
+    float locations[SOURCE_COUNT][3];
+    uint32_t indices[SOURCE_COUNT];
+    float level[2], expected[2] = {0.0, 0.0};
+    uint32_t count = 0;
+    for(uint32_t s=0; s<SOURCE_COUNT; ++s){
+      locations[s][0] = 500.0 * sinf(s*0.7f);
+      locations[s][1] = 50.0 * cosf(s*1.3f);
+      locations[s][2] = 800.0 * cosf(s*0.4f);
+      // Leave some holes in the input locations.
+      if(s % 7 != 3) indices[count++] = s;
+    }
+    // Mixing all sources at once must match the sum of mixing each on its own.
+    for(uint32_t i=0; i<count; ++i){
+      pass(mix_sources(2, 1, locations, &indices[i], 1, level));
+      expected[0] += level[0];
+      expected[1] += level[1];
+    }
+    pass(mix_sources(2, 1, locations, indices, count, level));
+    is_a(level[0]*1000, expected[0]*1000, 1);
+    is_a(level[1]*1000, expected[1]*1000, 1);
+  cleanup:;
+  })
+
+define_test(threads, {
+    float locations[SOURCE_COUNT][3];
+    uint32_t indices[SOURCE_COUNT];
+    float level[MAX_CHANNELS], expected[MAX_CHANNELS];
+    for(uint32_t s=0; s<SOURCE_COUNT; ++s){
+      locations[s][0] = 500.0 * sinf(s*0.9f);
+      locations[s][1] = 50.0 * cosf(s*1.1f);
+      locations[s][2] = 800.0 * cosf(s*0.3f);
+      indices[s] = s;
+    }
+    // Splitting the sources up between threads must not change the mix.
+    pass(mix_sources(6, 1, locations, indices, SOURCE_COUNT, expected));
+    pass(mix_sources(6, 4, locations, indices, SOURCE_COUNT, level));
+    for(uint32_t c=0; c<6; ++c){
+      is_a(level[c]*1000, expected[c]*1000, 1);
+    }
+  cleanup:;
+  })
+
+define_test(speaker_directions, {
+    // 7.1 has enough speaker pairs for the gains to come from the direction lookup grid.
+    struct mixed_channel_configuration const *configuration = mixed_default_channel_configuration(8);
+    float locations[SOURCE_COUNT][3];
+    float level[MAX_CHANNELS];
+    uint32_t index = 0;
+    for(uint32_t c=0; c<configuration->count; ++c){
+      float *position = locations[0];
+      pass(mixed_default_speaker_position(position, configuration->positions[c]));
+      if(position[0] == 0.0 && position[1] == 0.0 && position[2] == 0.0) continue;
+      for(int i=0; i<3; ++i) position[i] *= 1000.0;
+      // A source right in the direction of a speaker should only play on that speaker.
+      pass(mix_sources(configuration->count, 1, locations, &index, 1, level));
+      for(uint32_t o=0; o<configuration->count; ++o){
+        if(o != c) is_a(level[o]*1000, 0, 10);
+      }
+      if(fabs(level[c]) < 0.01)
+        fail_test("Channel %u was silent", c);
+    }
+  cleanup:;
+  })
+
+// Mix one block of constant signal and read the outputs.
+static int mix_block(struct mixed_segment *segment, struct mixed_buffer *in, struct mixed_buffer *out, float *left, float *right){
+  float *data, *l, *r;
+  uint32_t samples = BLOCK_SIZE;
+  mixed_buffer_request_write(&data, &samples, in);
+  for(uint32_t i=0; i<samples; ++i) data[i] = 1.0;
+  mixed_buffer_finish_write(samples, in);
+  if(!mixed_segment_mix(segment)) return 0;
+  samples = UINT32_MAX;
+  mixed_buffer_request_read(&l, &samples, &out[0]);
+  mixed_buffer_request_read(&r, &samples, &out[1]);
+  if(samples != BLOCK_SIZE) return 0;
+  memcpy(left, l, samples*sizeof(float));
+  if(right) memcpy(right, r, samples*sizeof(float));
+  mixed_buffer_finish_read(samples, &out[0]);
+  mixed_buffer_finish_read(samples, &out[1]);
+  return 1;
+}
+
+define_test(gain_ramp, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0}, out[2] = {0};
+    float left_location[3] = {-1000.0, 0.0, 1000.0};
+    float right_location[3] = {1000.0, 0.0, 1000.0};
+    float before[BLOCK_SIZE], ramp[BLOCK_SIZE], after[BLOCK_SIZE];
+    pass(mixed_make_segment_space_mixer(SAMPLERATE, &segment));
+    pass(mixed_make_buffer(BLOCK_SIZE, &in));
+    pass(mixed_make_buffer(BLOCK_SIZE, &out[0]));
+    pass(mixed_make_buffer(BLOCK_SIZE, &out[1]));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out[0], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &out[1], &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, left_location, &segment));
+    pass(mixed_segment_start(&segment));
+    pass(mix_block(&segment, &in, out, before, 0));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, right_location, &segment));
+    pass(mix_block(&segment, &in, out, ramp, 0));
+    pass(mix_block(&segment, &in, out, after, 0));
+    // A new source starts at its gain right away.
+    is_a(before[0]*10000, before[BLOCK_SIZE-1]*10000, 1);
+    // Moving it ramps the gain linearly across the next block.
+    float step = (after[0] - before[0]) / BLOCK_SIZE;
+    if(fabs(step) < 0.00001)
+      fail_test("The gain did not change");
+    for(uint32_t i=0; i<BLOCK_SIZE; ++i)
+      is_a(ramp[i]*10000, (before[0] + step*(i+1))*10000, 1);
+    is_a(after[0]*10000, after[BLOCK_SIZE-1]*10000, 1);
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out[0]);
+    mixed_free_buffer(&out[1]);
+  })
+
+define_test(voices, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in[10] = {0}, out[2] = {0};
+    float locations[SOURCE_COUNT][3];
+    uint32_t loudest[3] = {7, 8, 9};
+    uint32_t max_voices = 3, active, virtual;
+    float level[2], expected[2];
+    pass(mixed_make_segment_space_mixer(SAMPLERATE, &segment));
+    pass(mixed_segment_set(MIXED_SPACE_MAX_VOICES, &max_voices, &segment));
+    pass(mixed_make_buffer(BLOCK_SIZE, &out[0]));
+    pass(mixed_make_buffer(BLOCK_SIZE, &out[1]));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out[0], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &out[1], &segment));
+    // Later sources are closer, and thus louder.
+    for(uint32_t s=0; s<10; ++s){
+      locations[s][0] = (s%2)? 100.0 : -100.0;
+      locations[s][1] = 0.0;
+      locations[s][2] = 5000.0 - s*400.0;
+      pass(mixed_make_buffer(BLOCK_SIZE, &in[s]));
+      pass(mixed_segment_set_in(MIXED_BUFFER, s, &in[s], &segment));
+      pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, s, locations[s], &segment));
+    }
+    pass(mixed_segment_start(&segment));
+    pass(mix_sources(2, 1, locations, loudest, 3, expected));
+    // The culled voices were never heard, so both blocks mix only the loudest.
+    for(uint32_t block=0; block<2; ++block){
+      for(uint32_t s=0; s<10; ++s){
+        float *data;
+        uint32_t samples = BLOCK_SIZE;
+        mixed_buffer_request_write(&data, &samples, &in[s]);
+        for(uint32_t i=0; i<samples; ++i) data[i] = 1.0;
+        mixed_buffer_finish_write(samples, &in[s]);
+      }
+      pass(mixed_segment_mix(&segment));
+      for(uint32_t c=0; c<2; ++c){
+        float *data;
+        uint32_t samples = UINT32_MAX;
+        mixed_buffer_request_read(&data, &samples, &out[c]);
+        is(samples, BLOCK_SIZE);
+        level[c] = data[0];
+        mixed_buffer_finish_read(samples, &out[c]);
+      }
+      is_a(level[0]*1000, expected[0]*1000, 1);
+      is_a(level[1]*1000, expected[1]*1000, 1);
+      // Virtual voices must still have their input consumed.
+      for(uint32_t s=0; s<10; ++s)
+        is(mixed_buffer_available_read(&in[s]), 0);
+    }
+    pass(mixed_segment_get(MIXED_SPACE_ACTIVE_VOICES, &active, &segment));
+    pass(mixed_segment_get(MIXED_SPACE_VIRTUAL_VOICES, &virtual, &segment));
+    is(active, 3);
+    is(virtual, 7);
+  cleanup:
+    mixed_free_segment(&segment);
+    for(uint32_t s=0; s<10; ++s)
+      mixed_free_buffer(&in[s]);
+    mixed_free_buffer(&out[0]);
+    mixed_free_buffer(&out[1]);
+  })
+
+// Write an HRTF table with a single tap per ear in the four horizontal
+// directions. The far ear gets half the level, five samples late.
+#define HRTF_FILE "space-test-hrtf.raw"
+#define HRTF_LENGTH 16
+static int write_hrtf(uint32_t samplerate){
+  FILE *file = fopen(HRTF_FILE, "wb");
+  if(!file) return 0;
+  uint32_t header[5] = {0x5452484D, 1, samplerate, 4, HRTF_LENGTH};
+  fwrite(header, sizeof(uint32_t), 5, file);
+  for(int d=0; d<4; ++d){
+    float angles[2] = {d*90.0f, 0.0f};
+    float ir[2][HRTF_LENGTH] = {{0}};
+    switch(d){
+    case 0: case 2: ir[0][0] = 1.0; ir[1][0] = 1.0; break;
+    case 1: ir[0][0] = 1.0; ir[1][5] = 0.5; break;
+    case 3: ir[0][5] = 0.5; ir[1][0] = 1.0; break;
+    }
+    fwrite(angles, sizeof(float), 2, file);
+    fwrite(ir, sizeof(float), 2*HRTF_LENGTH, file);
+  }
+  fclose(file);
+  return 1;
+}
+
+define_test(binaural, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0}, out[2] = {0};
+    float left_location[3] = {-1000.0, 0.0, 0.0};
+    float left[BLOCK_SIZE], right[BLOCK_SIZE];
+    pass(write_hrtf(SAMPLERATE));
+    pass(mixed_make_segment_space_mixer(SAMPLERATE, &segment));
+    pass(mixed_make_buffer(BLOCK_SIZE, &in));
+    pass(mixed_make_buffer(BLOCK_SIZE, &out[0]));
+    pass(mixed_make_buffer(BLOCK_SIZE, &out[1]));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, left_location, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out[0], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &out[1], &segment));
+    fail(mixed_segment_set(MIXED_SPACE_HRTF, "space-test-missing.raw", &segment));
+    pass(mixed_segment_set(MIXED_SPACE_HRTF, HRTF_FILE, &segment));
+    pass(mixed_segment_start(&segment));
+    // Skip past the latency of the convolution.
+    pass(mix_block(&segment, &in, out, left, right));
+    pass(mix_block(&segment, &in, out, left, right));
+    // A source on the left plays on the left ear through the left HRIR.
+    if(left[BLOCK_SIZE-1] < 0.01)
+      fail_test("The left ear is silent");
+    is_a(right[BLOCK_SIZE-1]*1000, left[BLOCK_SIZE-1]*500, 1);
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out[0]);
+    mixed_free_buffer(&out[1]);
+    remove(HRTF_FILE);
+  })
+
+define_test(binaural_samplerate, {
+    struct mixed_segment segment = {0};
+    pass(write_hrtf(44100));
+    pass(mixed_make_segment_space_mixer(SAMPLERATE, &segment));
+    // The responses are not resampled.
+    fail(mixed_segment_set(MIXED_SPACE_HRTF, HRTF_FILE, &segment));
+  cleanup:
+    mixed_free_segment(&segment);
+    remove(HRTF_FILE);
+  })
+
+define_test(source_update, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in[4] = {0};
+    float locations[4*3], velocities[4*3], rolloff[4];
+    float value[3];
+    struct mixed_source_update update = {0};
+    pass(mixed_make_segment_space_mixer(SAMPLERATE, &segment));
+    for(uint32_t s=0; s<4; ++s){
+      pass(mixed_make_buffer(BLOCK_SIZE, &in[s]));
+      pass(mixed_segment_set_in(MIXED_BUFFER, s, &in[s], &segment));
+      for(int i=0; i<3; ++i){
+        locations[s*3+i] = s*10.0 + i;
+        velocities[s*3+i] = -(s*10.0 + i);
+      }
+      rolloff[s] = 0.1 * s;
+    }
+    // Update the last three sources, leaving the velocity untouched.
+    update.start = 1;
+    update.count = 3;
+    update.location = locations+3;
+    update.rolloff = rolloff+1;
+    pass(mixed_segment_set(MIXED_SOURCE_UPDATE, &update, &segment));
+    for(uint32_t s=1; s<4; ++s){
+      pass(mixed_segment_get_in(MIXED_SPACE_LOCATION, s, value, &segment));
+      is(value[0], s*10);
+      is(value[2], s*10+2);
+      pass(mixed_segment_get_in(MIXED_SPACE_ROLLOFF, s, value, &segment));
+      is_a(value[0]*1000, s*100, 1);
+      pass(mixed_segment_get_in(MIXED_SPACE_VELOCITY, s, value, &segment));
+      is(value[0], 0);
+    }
+    pass(mixed_segment_get_in(MIXED_SPACE_LOCATION, 0, value, &segment));
+    is(value[0], 0);
+    // Ranges past the sources or across empty slots change nothing.
+    update.location = 0;
+    update.velocity = velocities;
+    update.start = 2;
+    fail(mixed_segment_set(MIXED_SOURCE_UPDATE, &update, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 1, 0, &segment));
+    update.start = 0;
+    fail(mixed_segment_set(MIXED_SOURCE_UPDATE, &update, &segment));
+    pass(mixed_segment_get_in(MIXED_SPACE_VELOCITY, 0, value, &segment));
+    is(value[0], 0);
+  cleanup:
+    mixed_free_segment(&segment);
+    for(uint32_t s=0; s<4; ++s)
+      mixed_free_buffer(&in[s]);
+  })
+
+// Mix a sine from the location with air absorption and return the ratio
+// of the output to the input level.
+static float absorbed_level(float frequency, float distance){
+  struct mixed_segment segment = {0};
+  struct mixed_buffer in = {0};
+  uint32_t attenuation = MIXED_NO_ATTENUATION;
+  float min = 1.0, max = 1000.0, cutoff = 1000.0;
+  float location[3] = {0.0, 0.0, distance};
+  float *signal = calloc(SIGNAL_SIZE, sizeof(float));
+  float *result = calloc(SIGNAL_SIZE, sizeof(float));
+  float level = -1.0, in_energy = 0.0, out_energy = 0.0;
+  make_sine(signal, SIGNAL_SIZE, frequency);
+  if(!mixed_make_segment_space_mixer(SAMPLERATE, &segment)
+     || !mixed_make_buffer(BLOCK_SIZE, &in)
+     || !mixed_segment_set(MIXED_SPACE_ATTENUATION, &attenuation, &segment)
+     || !mixed_segment_set(MIXED_SPACE_MIN_DISTANCE, &min, &segment)
+     || !mixed_segment_set(MIXED_SPACE_MAX_DISTANCE, &max, &segment)
+     || !mixed_segment_set(MIXED_SPACE_AIR_ABSORPTION, &cutoff, &segment)
+     || !mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment)
+     || !mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, location, &segment)
+     || !run_space_mixer(&segment, &in, signal, result, SIGNAL_SIZE))
+    goto cleanup;
+  for(uint32_t i=SIGNAL_SIZE/2; i<SIGNAL_SIZE; ++i){
+    in_energy += signal[i]*signal[i];
+    out_energy += result[i]*result[i];
+  }
+  level = sqrtf(out_energy / in_energy);
+ cleanup:
+  mixed_free_segment(&segment);
+  mixed_free_buffer(&in);
+  free(signal);
+  free(result);
+  return level;
+}
+
+define_test(air_absorption, {
+    struct mixed_segment segment = {0};
+    float cutoff = SAMPLERATE;
+    // Far sources lose their highs, but keep their lows.
+    float far_high = absorbed_level(8000.0, 1000.0);
+    float far_low = absorbed_level(100.0, 1000.0);
+    float near_high = absorbed_level(8000.0, 1.0);
+    if(far_high < 0.0 || 0.2 < far_high)
+      fail_test("The far high tone was not absorbed: %f", far_high);
+    if(far_low < 0.95)
+      fail_test("The far low tone was absorbed: %f", far_low);
+    if(near_high < 0.95)
+      fail_test("The near high tone was absorbed: %f", near_high);
+    pass(mixed_make_segment_space_mixer(SAMPLERATE, &segment));
+    fail(mixed_segment_set(MIXED_SPACE_AIR_ABSORPTION, &cutoff, &segment));
+  cleanup:
+    mixed_free_segment(&segment);
+  })
+
+// Mix two blocks of a sine from the given sources with air absorption
+// and return the last output samples.
+static int mix_absorbed(float locations[][3], uint32_t *indices, uint32_t count, float *level){
+  struct mixed_segment segment = {0};
+  struct mixed_buffer in[SOURCE_COUNT] = {0}, out[2] = {0};
+  float cutoff = 500.0;
+  float signal[BLOCK_SIZE], left[BLOCK_SIZE], right[BLOCK_SIZE];
+  int ok = 0;
+  make_sine(signal, BLOCK_SIZE, 3000.0);
+  if(!mixed_make_segment_space_mixer(SAMPLERATE, &segment)
+     || !mixed_segment_set(MIXED_SPACE_AIR_ABSORPTION, &cutoff, &segment)
+     || !mixed_make_buffer(BLOCK_SIZE, &out[0])
+     || !mixed_make_buffer(BLOCK_SIZE, &out[1])
+     || !mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out[0], &segment)
+     || !mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &out[1], &segment))
+    goto cleanup;
+  for(uint32_t i=0; i<count; ++i){
+    uint32_t s = indices[i];
+    if(!mixed_make_buffer(BLOCK_SIZE, &in[s])
+       || !mixed_segment_set_in(MIXED_BUFFER, s, &in[s], &segment)
+       || !mixed_segment_set_in(MIXED_SPACE_LOCATION, s, locations[s], &segment))
+      goto cleanup;
+  }
+  if(!mixed_segment_start(&segment)) goto cleanup;
+  for(int block=0; block<2; ++block){
+    for(uint32_t i=0; i<count; ++i){
+      float *data;
+      uint32_t samples = BLOCK_SIZE;
+      mixed_buffer_request_write(&data, &samples, &in[indices[i]]);
+      memcpy(data, signal, samples*sizeof(float));
+      mixed_buffer_finish_write(samples, &in[indices[i]]);
+    }
+    if(!mixed_segment_mix(&segment)) goto cleanup;
+    for(int c=0; c<2; ++c){
+      float *data;
+      uint32_t samples = UINT32_MAX;
+      mixed_buffer_request_read(&data, &samples, &out[c]);
+      memcpy((c == 0)? left : right, data, samples*sizeof(float));
+      mixed_buffer_finish_read(samples, &out[c]);
+    }
+  }
+  level[0] = left[BLOCK_SIZE-1];
+  level[1] = right[BLOCK_SIZE-1];
+  ok = 1;
+ cleanup:
+  mixed_free_segment(&segment);
+  for(uint32_t s=0; s<SOURCE_COUNT; ++s)
+    mixed_free_buffer(&in[s]);
+  mixed_free_buffer(&out[0]);
+  mixed_free_buffer(&out[1]);
+  return ok;
+}
+
+define_test(air_absorption_bank, {
+    float locations[SOURCE_COUNT][3];
+    uint32_t indices[SOURCE_COUNT];
+    float level[2], expected[2] = {0.0, 0.0};
+    uint32_t count = 0;
+    for(uint32_t s=0; s<20; ++s){
+      locations[s][0] = 3000.0 * sinf(s*0.7f);
+      locations[s][1] = 0.0;
+      locations[s][2] = 20000.0 * cosf(s*0.4f);
+      if(s % 5 != 2) indices[count++] = s;
+    }
+    // Filtering the sources together must match filtering each on its own.
+    for(uint32_t i=0; i<count; ++i){
+      pass(mix_absorbed(locations, &indices[i], 1, level));
+      expected[0] += level[0];
+      expected[1] += level[1];
+    }
+    pass(mix_absorbed(locations, indices, count, level));
+    is_a(level[0]*1000, expected[0]*1000, 1);
+    is_a(level[1]*1000, expected[1]*1000, 1);
+  cleanup:;
+  })
@@ -118,4 +118,374 @@ define_test(bounds_check, {
   cleanup: {}
   })
 
+// Scalar reference for the encodings the interleave kernels cover.
+static float reference_from(enum mixed_encoding encoding, unsigned char *data, uint32_t i){
+  switch(encoding){
+  case MIXED_INT16: return mixed_from_int16(((int16_t *)data)[i]);
+  case MIXED_INT24: return mixed_from_int24(((int8_t)data[3*i+2] << 16) + (data[3*i+1] << 8) + data[3*i]);
+  case MIXED_INT32: return mixed_from_int32(((int32_t *)data)[i]);
+  case MIXED_FLOAT: return mixed_from_float(((float *)data)[i]);
+  default: return 0.0f;
+  }
+}
+
+static int32_t reference_to(enum mixed_encoding encoding, float sample, float volume){
+  switch(encoding){
+  case MIXED_INT16: return (int16_t)(mixed_to_int16(sample) * volume);
+  case MIXED_INT24: return mixed_to_int24(sample * volume);
+  case MIXED_INT32: {
+    // Saturate rather than wrap when INT32_MAX rounds up to 2^31.
+    float value = mixed_to_int32(sample) * volume;
+    return (INT32_MAX <= value)? INT32_MAX : (int32_t)value;
+  }
+  default: return 0;
+  }
+}
+
+static int32_t encoded(enum mixed_encoding encoding, unsigned char *data, uint32_t i){
+  switch(encoding){
+  case MIXED_INT16: return ((int16_t *)data)[i];
+  case MIXED_INT24: return ((int8_t)data[3*i+2] << 16) + (data[3*i+1] << 8) + data[3*i];
+  case MIXED_INT32: return ((int32_t *)data)[i];
+  default: return 0;
+  }
+}
+
+define_test(steady_volume_kernels, {
+    enum mixed_encoding encodings[] = {MIXED_INT16, MIXED_INT24, MIXED_INT32, MIXED_FLOAT};
+    int channel_counts[] = {1, 2, 3, 6, 8};
+    float volumes[] = {1.0f, 0.5f, 0.75f};
+    uint32_t frames = 1003;
+    struct mixed_pack pack = {0};
+    struct mixed_buffer buffers[8] = {0};
+    struct mixed_buffer *barray[8];
+    for(int c=0; c<8; ++c){
+      barray[c] = &buffers[c];
+      pass(mixed_make_buffer(frames, &buffers[c]));
+    }
+    for(int e=0; e<4; ++e){
+      for(int n=0; n<5; ++n){
+        for(int v=0; v<3; ++v){
+          int channels = channel_counts[n];
+          float volume = volumes[v];
+          uint32_t samples = frames*channels;
+          pack.encoding = encodings[e];
+          pack.channels = channels;
+          pack.samplerate = 1;
+          pass(mixed_make_pack(frames, &pack));
+          unsigned char *data;
+          uint32_t size = UINT32_MAX;
+          mixed_pack_request_write((void**)&data, &size, &pack);
+          for(uint32_t i=0; i<pack.size; ++i)
+            data[i] = rand()%256;
+          // Random floats are mostly huge or NaN, so keep some in range.
+          if(pack.encoding == MIXED_FLOAT)
+            for(uint32_t i=0; i<samples; i+=2)
+              ((float *)data)[i] = (rand()%2400 - 1200) / 1000.0f;
+          mixed_pack_finish_write(pack.size, &pack);
+          // Convert to buffers
+          pass(mixed_buffer_from_pack(&pack, barray, &volume, volume));
+          for(int c=0; c<channels; ++c)
+            is(mixed_buffer_available_read(&buffers[c]), frames);
+          uint32_t mismatches = 0;
+          for(uint32_t i=0; i<samples; ++i)
+            if(buffers[i%channels]._data[i/channels] != reference_from(pack.encoding, data, i) * volume)
+              ++mismatches;
+          is(mismatches, 0);
+          // Convert from buffers, with a few samples out of range.
+          for(int c=0; c<channels; ++c)
+            buffers[c]._data[c] = (c%2)? 1.5f : -1.5f;
+          float expected[8*1003];
+          for(uint32_t i=0; i<samples; ++i)
+            expected[i] = buffers[i%channels]._data[i/channels];
+          pass(mixed_buffer_to_pack(barray, &pack, &volume, volume));
+          is(mixed_pack_available_read(&pack), pack.size);
+          for(uint32_t i=0; i<samples; ++i){
+            if(pack.encoding == MIXED_FLOAT){
+              if(((float *)data)[i] != mixed_to_float(expected[i]) * volume)
+                ++mismatches;
+            }else if(encoded(pack.encoding, data, i) != reference_to(pack.encoding, expected[i], volume)){
+              ++mismatches;
+            }
+          }
+          is(mismatches, 0);
+          for(int c=0; c<8; ++c)
+            mixed_buffer_clear(&buffers[c]);
+          mixed_free_pack(&pack);
+        }
+      }
+    }
+
+  cleanup:
+    for(int c=0; c<8; ++c)
+      mixed_free_buffer(&buffers[c]);
+    mixed_free_pack(&pack);
+  })
+
+define_test(volume_ramp, {
+    struct mixed_pack pack = {0};
+    struct mixed_buffer buffers[2] = {0};
+    struct mixed_buffer *barray[2] = {&buffers[0], &buffers[1]};
+    float volume = 1.0f;
+    uint32_t frames = 100;
+    float *data;
+    uint32_t size = UINT32_MAX;
+    pack.encoding = MIXED_FLOAT;
+    pack.channels = 2;
+    pack.samplerate = 1;
+    pass(mixed_make_pack(frames, &pack));
+    pass(mixed_make_buffer(frames, &buffers[0]));
+    pass(mixed_make_buffer(frames, &buffers[1]));
+    // A signal that never crosses zero never switches the volume.
+    mixed_pack_request_write((void**)&data, &size, &pack);
+    for(uint32_t i=0; i<2*frames; ++i)
+      data[i] = 0.5f;
+    mixed_pack_finish_write(2*frames*sizeof(float), &pack);
+    pass(mixed_buffer_from_pack(&pack, barray, &volume, 0.5f));
+    is_f(buffers[0]._data[frames-1], 0.5f);
+    is_f(buffers[1]._data[frames-1], 0.5f);
+    mixed_buffer_clear(&buffers[0]);
+    mixed_buffer_clear(&buffers[1]);
+    // Whereas the ramp reaches the target by the end of the block.
+    pack.volume_mode = MIXED_VOLUME_RAMP;
+    volume = 1.0f;
+    mixed_pack_request_write((void**)&data, &size, &pack);
+    for(uint32_t i=0; i<2*frames; ++i)
+      data[i] = 0.5f;
+    mixed_pack_finish_write(2*frames*sizeof(float), &pack);
+    pass(mixed_buffer_from_pack(&pack, barray, &volume, 0.5f));
+    is_f(volume, 0.5f);
+    for(uint32_t i=0; i<frames; ++i){
+      float expected = 0.5f * (1.0f - 0.5f * (i+1) / frames);
+      is_a(buffers[0]._data[i]*1000000, expected*1000000, 1);
+      is_a(buffers[1]._data[i]*1000000, expected*1000000, 1);
+    }
+    // And ramps back when packing.
+    pass(mixed_buffer_to_pack(barray, &pack, &volume, 1.0f));
+    is_f(volume, 1.0f);
+    for(uint32_t i=0; i<2*frames; ++i){
+      float ramp = 0.5f + 0.5f * (i/2+1) / frames;
+      is_a(data[i]*1000000, buffers[i%2]._data[i/2]*ramp*1000000, 1);
+    }
+
+  cleanup:
+    mixed_free_buffer(&buffers[0]);
+    mixed_free_buffer(&buffers[1]);
+    mixed_free_pack(&pack);
+  })
+
+define_test(cpu_tiers, {
+    uint32_t features = mixed_cpu_features();
+    uint32_t tiers[] = {0, MIXED_CPU_SSE2, MIXED_CPU_NEON, UINT32_MAX};
+    uint32_t frames = 1003;
+    struct mixed_pack pack = {0};
+    struct mixed_buffer buffers[2] = {0};
+    struct mixed_buffer *barray[2] = {&buffers[0], &buffers[1]};
+    float reference[2*1003];
+    float volume = 1.0f;
+    int16_t *data;
+    uint32_t size = UINT32_MAX;
+    pack.encoding = MIXED_INT16;
+    pack.channels = 2;
+    pack.samplerate = 1;
+    pass(mixed_make_pack(frames, &pack));
+    pass(mixed_make_buffer(frames, &buffers[0]));
+    pass(mixed_make_buffer(frames, &buffers[1]));
+    mixed_pack_request_write((void**)&data, &size, &pack);
+    for(uint32_t i=0; i<2*frames; ++i)
+      data[i] = rand()%65536 - 32768;
+    // Every tier has to produce the same result.
+    for(int t=0; t<4; ++t){
+      pass(mixed_force_cpu_features(tiers[t]));
+      is(mixed_cpu_features(), features & tiers[t]);
+      mixed_pack_finish_write(2*frames*sizeof(int16_t), &pack);
+      pass(mixed_buffer_from_pack(&pack, barray, &volume, 1.0f));
+      uint32_t mismatches = 0;
+      for(uint32_t i=0; i<2*frames; ++i){
+        float sample = buffers[i%2]._data[i/2];
+        if(t == 0) reference[i] = sample;
+        else if(sample != reference[i]) ++mismatches;
+      }
+      is(mismatches, 0);
+      mixed_buffer_clear(&buffers[0]);
+      mixed_buffer_clear(&buffers[1]);
+      mixed_pack_clear(&pack);
+    }
+
+  cleanup:
+    mixed_force_cpu_features(UINT32_MAX);
+    mixed_free_buffer(&buffers[0]);
+    mixed_free_buffer(&buffers[1]);
+    mixed_free_pack(&pack);
+  })
+
+define_test(half_precision, {
+    enum mixed_encoding encodings[] = {MIXED_FLOAT16, MIXED_BFLOAT16};
+    uint32_t tiers[] = {0, UINT32_MAX};
+    int channel_counts[] = {1, 2, 6};
+    float volumes[] = {1.0f, 0.5f};
+    uint32_t frames = 1003;
+    struct mixed_pack pack = {0};
+    struct mixed_buffer buffers[6] = {0};
+    struct mixed_buffer *barray[6];
+    float expected[6*1003];
+    for(int c=0; c<6; ++c){
+      barray[c] = &buffers[c];
+      pass(mixed_make_buffer(frames, &buffers[c]));
+    }
+    // Both formats represent these exactly.
+    is(mixed_to_float16(0.5f), 0x3800);
+    is(mixed_to_float16(-0.25f), 0xB400);
+    is(mixed_to_bfloat16(0.5f), 0x3F00);
+    is(mixed_to_bfloat16(-0.25f), 0xBE80);
+    is_f(mixed_from_float16(0x3800), 0.5f);
+    is_f(mixed_from_bfloat16(0xBE80), -0.25f);
+    // Out of range and NaN clamp like floats do.
+    is_f(mixed_from_float16(0x7C00), 1.0f);
+    is_f(mixed_from_float16(0x7E00), -1.0f);
+    is(mixed_to_bfloat16(2.0f), 0x3F80);
+    for(int t=0; t<2; ++t){
+      pass(mixed_force_cpu_features(tiers[t]));
+      for(int e=0; e<2; ++e){
+        for(int n=0; n<3; ++n){
+          for(int v=0; v<2; ++v){
+            int channels = channel_counts[n];
+            float volume = volumes[v];
+            uint32_t samples = frames*channels;
+            pack.encoding = encodings[e];
+            pack.channels = channels;
+            pack.samplerate = 1;
+            pass(mixed_make_pack(frames, &pack));
+            is(pack.size, samples*2);
+            uint16_t *data;
+            uint32_t size = UINT32_MAX;
+            mixed_pack_request_write((void**)&data, &size, &pack);
+            for(uint32_t i=0; i<samples; ++i)
+              data[i] = rand()%65536;
+            mixed_pack_finish_write(pack.size, &pack);
+            pass(mixed_buffer_from_pack(&pack, barray, &volume, volume));
+            uint32_t mismatches = 0;
+            for(uint32_t i=0; i<samples; ++i){
+              float sample = (pack.encoding == MIXED_FLOAT16)? mixed_from_float16(data[i]) : mixed_from_bfloat16(data[i]);
+              if(buffers[i%channels]._data[i/channels] != sample * volume)
+                ++mismatches;
+            }
+            is(mismatches, 0);
+            for(int c=0; c<channels; ++c)
+              buffers[c]._data[c] = (c%2)? 1.5f : -1.5f;
+            for(uint32_t i=0; i<samples; ++i)
+              expected[i] = buffers[i%channels]._data[i/channels];
+            pass(mixed_buffer_to_pack(barray, &pack, &volume, volume));
+            is(mixed_pack_available_read(&pack), pack.size);
+            for(uint32_t i=0; i<samples; ++i){
+              uint16_t sample = (pack.encoding == MIXED_FLOAT16)? mixed_to_float16(expected[i] * volume) : mixed_to_bfloat16(expected[i] * volume);
+              if(data[i] != sample)
+                ++mismatches;
+            }
+            is(mismatches, 0);
+            for(int c=0; c<6; ++c)
+              mixed_buffer_clear(&buffers[c]);
+            mixed_free_pack(&pack);
+          }
+        }
+      }
+    }
+
+  cleanup:
+    mixed_force_cpu_features(UINT32_MAX);
+    for(int c=0; c<6; ++c)
+      mixed_free_buffer(&buffers[c]);
+    mixed_free_pack(&pack);
+  })
+
+static void fill_buffers(struct mixed_buffer *buffers, float *values, int channels, uint32_t frames){
+  for(int c=0; c<channels; ++c){
+    float *area;
+    uint32_t size = frames;
+    mixed_buffer_clear(&buffers[c]);
+    mixed_buffer_request_write(&area, &size, &buffers[c]);
+    for(uint32_t i=0; i<frames; ++i)
+      area[i] = values[c*frames+i];
+    mixed_buffer_finish_write(frames, &buffers[c]);
+  }
+}
+
+define_test(layouts, {
+    enum mixed_encoding encodings[] = {MIXED_INT16, MIXED_INT24, MIXED_FLOAT, MIXED_DOUBLE};
+    enum mixed_layout layouts[] = {MIXED_PLANAR, MIXED_BIG_ENDIAN, MIXED_PLANAR | MIXED_BIG_ENDIAN};
+    float targets[] = {1.0f, 0.5f};
+    int channels = 3;
+    uint32_t frames = 257;
+    struct mixed_pack reference = {0};
+    struct mixed_pack pack = {0};
+    struct mixed_buffer buffers[3] = {0};
+    struct mixed_buffer *barray[3] = {&buffers[0], &buffers[1], &buffers[2]};
+    float values[3*257];
+    float expected[3*257];
+    for(int c=0; c<channels; ++c)
+      pass(mixed_make_buffer(frames, &buffers[c]));
+    for(uint32_t i=0; i<channels*frames; ++i)
+      values[i] = (rand()%2000 - 1000) / 1000.0f;
+    for(int e=0; e<4; ++e){
+      for(int l=0; l<3; ++l){
+        for(int t=0; t<2; ++t){
+          float volume;
+          uint8_t size = mixed_samplesize(encodings[e]);
+          uint32_t plane = frames*size;
+          reference.encoding = pack.encoding = encodings[e];
+          reference.channels = pack.channels = channels;
+          reference.samplerate = pack.samplerate = 1;
+          pack.layout = layouts[l];
+          pass(mixed_make_pack(frames, &reference));
+          pass(mixed_make_pack(frames, &pack));
+          // Packing has to rearrange the same bytes.
+          fill_buffers(buffers, values, channels, frames);
+          volume = 1.0f;
+          pass(mixed_buffer_to_pack(barray, &reference, &volume, targets[t]));
+          fill_buffers(buffers, values, channels, frames);
+          volume = 1.0f;
+          pass(mixed_buffer_to_pack(barray, &pack, &volume, targets[t]));
+          is(mixed_pack_available_read(&pack), pack.size);
+          uint32_t mismatches = 0;
+          for(uint32_t f=0; f<frames; ++f){
+            for(int c=0; c<channels; ++c){
+              unsigned char *from = reference._data + (f*channels+c)*size;
+              unsigned char *to = pack._data + ((pack.layout & MIXED_PLANAR)? c*plane+f*size : (f*channels+c)*size);
+              for(uint8_t b=0; b<size; ++b){
+                if(to[(pack.layout & MIXED_BIG_ENDIAN)? size-1-b : b] != from[b])
+                  ++mismatches;
+              }
+            }
+          }
+          is(mismatches, 0);
+          // And unpacking has to give the same samples back.
+          for(int c=0; c<channels; ++c)
+            mixed_buffer_clear(&buffers[c]);
+          volume = 1.0f;
+          pass(mixed_buffer_from_pack(&reference, barray, &volume, targets[t]));
+          for(uint32_t i=0; i<channels*frames; ++i)
+            expected[i] = buffers[i/frames]._data[i%frames];
+          for(int c=0; c<channels; ++c)
+            mixed_buffer_clear(&buffers[c]);
+          volume = 1.0f;
+          pass(mixed_buffer_from_pack(&pack, barray, &volume, targets[t]));
+          is(mixed_pack_available_read(&pack), 0);
+          for(uint32_t i=0; i<channels*frames; ++i){
+            if(buffers[i/frames]._data[i%frames] != expected[i])
+              ++mismatches;
+          }
+          is(mismatches, 0);
+          mixed_free_pack(&reference);
+          mixed_free_pack(&pack);
+        }
+      }
+    }
+
+  cleanup:
+    for(int c=0; c<3; ++c)
+      mixed_free_buffer(&buffers[c]);
+    mixed_free_pack(&reference);
+    mixed_free_pack(&pack);
+  })
+
 #undef __TEST_SUITE